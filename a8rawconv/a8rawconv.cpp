@@ -20,7 +20,13 @@
 #include "compensation.h"
 #include "encode.h"
 #include "interleave.h"
+#include "jsonreport.h"
+#include "os.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trackcache.h"
 #include "version.h"
+#include "zip.h"
 
 int analyze_raw(const RawDisk& raw_disk, int selected_track);
 
@@ -32,6 +38,15 @@ int g_inputPathSideBase;
 int g_inputPathCountPos;
 int g_inputPathCountWidth;
 
+// Path template for KryoFlux track streams. This is the input path, unless
+// the streams are being read from a zip archive, in which case it is the
+// name of the first stream entry in the archive.
+std::string g_inputStreamPath;
+
+// Archive holding the KryoFlux track streams, kept open from the search for
+// the stream entries until they are read.
+std::unique_ptr<ZipArchive> g_inputArchive;
+
 std::string g_outputPath;
 bool g_showLayout;
 bool g_encoding_fm = true;
@@ -51,12 +66,17 @@ int g_trackStep = 2;
 int g_sides = 1;
 int g_revs = 5;
 bool g_kryoflux_48tpi = false;
-bool g_high_density = false;
 bool g_erase_odd_tracks = false;
 bool g_splice_mode = false;
 InterleaveMode g_interleave = kInterleaveMode_Auto;
 AnalysisMode g_analyze = kAnalysisMode_None;
 PostCompensationMode g_postcomp = kPostComp_Auto;
+uint32_t g_maxLiveParsers = 0;
+uint32_t g_maxParserSpawns = 0;
+uint32_t g_maxTrackDecodeTime = 0;
+std::string g_trackCachePath;
+TrackCache g_trackCache;
+std::string g_reportPath;
 
 enum InputFormat : uint8_t {
 	kInputFormat_Auto,
@@ -75,7 +95,8 @@ enum InputFormat : uint8_t {
 	kInputFormat_AppleII_NIB,
 	kInputFormat_PC_VFD,
 	kInputFormat_Amiga_ADF,
-	kInputFormat_DiskScript
+	kInputFormat_DiskScript,
+	kInputFormat_A8F
 } g_inputFormat = kInputFormat_Auto;
 
 enum OutputFormat : uint8_t {
@@ -95,38 +116,1428 @@ enum OutputFormat : uint8_t {
 	kOutputFormat_Mac_DSK,
 	kOutputFormat_Amiga_ADF,
 	kOutputFormat_PC_VFD,
+	kOutputFormat_A8F,
 } g_outputFormat = kOutputFormat_Auto;
 
-///////////////////////////////////////////////////////////////////////////
+struct OutputTarget {
+	std::string mPath;
+	OutputFormat mFormat;
+};
+
+// Images to write, in command line order. The positional output path comes
+// first, followed by any given with -o.
+std::vector<OutputTarget> g_outputs;
+
+bool is_raw_output_format(OutputFormat format) {
+	switch(format) {
+		case kOutputFormat_SCP_Auto:
+		case kOutputFormat_SCP_ForceSS40:
+		case kOutputFormat_SCP_ForceDS40:
+		case kOutputFormat_SCP_ForceSS80:
+		case kOutputFormat_SCP_ForceDS80:
+		case kOutputFormat_SCPDirect:
+		case kOutputFormat_A8F:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+// Per-track limits on decoding effort, set by -maxparsers, -maxspawns and
+// -maxtime. Some copy protection schemes lay down thousands of bogus address
+// marks on a track, each of which starts a sector parser; without limits those
+// tracks can take orders of magnitude longer to decode than a normal track.
+// When a limit is hit the decoders keep whatever they have found so far and
+// the track is flagged as a best-effort result.
+//
+// The spawn limit is for the whole track. Budgets for parts of a track's
+// decode, such as its revolution windows, share the track's spawn count. The
+// live parser limit applies to each list of parsers fed by one bit stream.
+class DecodeBudget {
+public:
+	DecodeBudget();
+
+	// Create a budget for part of the decode of a track, sharing the parent's
+	// deadline and spawn count. It may be used on another thread.
+	explicit DecodeBudget(DecodeBudget& parent);
+
+	// Start a new parser in the given list, or return null if the spawn limit
+	// has been reached. If the live parser limit has been reached, the oldest
+	// parser is dropped to make room, since it is the one that has been
+	// waiting longest for a data mark that probably isn't coming.
+	template<typename T>
+	T *AddParser(std::vector<T>& parsers);
+
+	// Count a sector candidate that is decoded without a parser against the
+	// spawn limit. Returns false if the limit has been reached.
+	bool AddSpawn();
+
+	// Called once per bit cell; returns false once the time limit has run out.
+	// The clock is only polled every 64K cells.
+	bool Tick() {
+		if (++mTickCount & 0xFFFF)
+			return true;
+
+		return CheckTime();
+	}
+
+	// Count a run of bit cells at once.
+	bool Tick(uint32_t cells) {
+		const uint32_t prevCount = mTickCount;
+
+		mTickCount += cells;
+		if (!((prevCount ^ mTickCount) >> 16))
+			return true;
+
+		return CheckTime();
+	}
+
+	bool IsOutOfTime() const { return (mLimitsHit & kDecodeLimit_WallTime) != 0; }
+	uint8_t GetLimitsHit() const { return mLimitsHit; }
+	void MergeLimitsHit(uint8_t limits) { mLimitsHit |= limits; }
+
+	// Counters for -stats, which the decoders and parsers bump directly. They
+	// are kept for each decoder pass, and go to the pass last selected with
+	// SetPass(); parsers keep counting to the pass they were started in. The
+	// bit cells and parser spawns are already tallied by Tick() and AddSpawn(),
+	// and are only added in by SetPass() and GetCounterTotals().
+	StatsPass GetPass() const { return mPass; }
+	void SetPass(StatsPass pass);
+	DecoderCounters& GetCounters() { return mCounters.mPasses[mPass]; }
+	DecoderPassCounters GetCounterTotals() const;
+	void MergeCounters(const DecoderPassCounters& counters) { mCounters += counters; }
+
+private:
+	bool CheckTime();
+
+	uint64_t mDeadline = 0;
+	uint32_t mSpawnCount = 0;
+	std::atomic<uint32_t> mTrackSpawnCount { 0 };
+	std::atomic<uint32_t> *mpTrackSpawnCount = &mTrackSpawnCount;
+	uint32_t mTickCount = 0;
+	uint8_t mLimitsHit = 0;
+	StatsPass mPass = kStatsPass_FM;
+	uint32_t mPassTickStart = 0;
+	uint32_t mPassSpawnStart = 0;
+	DecoderPassCounters mCounters;
+};
+
+DecodeBudget::DecodeBudget() {
+	if (g_maxTrackDecodeTime)
+		mDeadline = get_monotonic_time_us() + (uint64_t)g_maxTrackDecodeTime * 1000;
+}
+
+DecodeBudget::DecodeBudget(DecodeBudget& parent)
+	: mDeadline(parent.mDeadline)
+	, mpTrackSpawnCount(parent.mpTrackSpawnCount)
+	, mPass(parent.mPass)
+{
+}
+
+template<typename T>
+T *DecodeBudget::AddParser(std::vector<T>& parsers) {
+	if (!AddSpawn())
+		return nullptr;
+
+	if (g_maxLiveParsers && parsers.size() >= g_maxLiveParsers) {
+		mLimitsHit |= kDecodeLimit_LiveParsers;
+		parsers.erase(parsers.begin());
+	}
+
+	parsers.emplace_back(&GetCounters());
+	return &parsers.back();
+}
+
+bool DecodeBudget::AddSpawn() {
+	uint32_t trackSpawns = mpTrackSpawnCount->load(std::memory_order_relaxed);
+
+	do {
+		if (g_maxParserSpawns && trackSpawns >= g_maxParserSpawns) {
+			mLimitsHit |= kDecodeLimit_ParserSpawns;
+			return false;
+		}
+	} while(!mpTrackSpawnCount->compare_exchange_weak(trackSpawns, trackSpawns + 1, std::memory_order_relaxed));
+
+	++mSpawnCount;
+	return true;
+}
+
+void DecodeBudget::SetPass(StatsPass pass) {
+	DecoderCounters& counters = mCounters.mPasses[mPass];
+	counters.mBitsClocked += mTickCount - mPassTickStart;
+	counters.mParsersSpawned += mSpawnCount - mPassSpawnStart;
+
+	mPassTickStart = mTickCount;
+	mPassSpawnStart = mSpawnCount;
+	mPass = pass;
+}
+
+DecoderPassCounters DecodeBudget::GetCounterTotals() const {
+	DecoderPassCounters counters = mCounters;
+	counters.mPasses[mPass].mBitsClocked += mTickCount - mPassTickStart;
+	counters.mPasses[mPass].mParsersSpawned += mSpawnCount - mPassSpawnStart;
+	return counters;
+}
+
+bool DecodeBudget::CheckTime() {
+	if (mLimitsHit & kDecodeLimit_WallTime)
+		return false;
+
+	if (mDeadline && get_monotonic_time_us() >= mDeadline) {
+		mLimitsHit |= kDecodeLimit_WallTime;
+		return false;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void init_amiga_track(TrackDecoderMFMAmiga& amigaTrack, const RawTrack& rawTrack, const std::vector<uint32_t>& transitions, TrackInfo& dstTrack, double scks_per_cell) {
+	const size_t expectedCells = transitions.size() < 2 ? 0 : (size_t)((transitions.back() - transitions.front()) / scks_per_cell * 1.05);
+
+	amigaTrack.Init(rawTrack.mPhysTrack, rawTrack.mSide, &rawTrack.mIndexTimes, &dstTrack, expectedCells);
+}
+
+void decode_amiga_track(TrackDecoderMFMAmiga& amigaTrack, DecodeBudget& budget) {
+	std::vector<uint32_t> syncCells;
+	amigaTrack.FindSyncMarks(syncCells);
+
+	for(uint32_t syncCell : syncCells) {
+		if (!budget.AddSpawn())
+			break;
+
+		amigaTrack.DecodeSector(syncCell, budget.GetCounters());
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+// Bins the phase error of each transition that a PLL clocks in, by table
+// lookup so that the PLL loops don't take a divide per transition. Errors
+// beyond a whole cell are clamped, since the GCR PLLs don't bound the early
+// side.
+class PhaseErrorBinner {
+public:
+	explicit PhaseErrorBinner(int cell_len);
+
+	void Add(DecoderCounters& counters, int trans_delta) const {
+		const int clamped = std::max<int>(-mRange, std::min<int>(mRange, trans_delta));
+
+		++counters.mPhaseErrors[mBins[clamped + mRange]];
+	}
+
+private:
+	int mRange;
+	std::vector<uint8_t> mBins;
+};
+
+PhaseErrorBinner::PhaseErrorBinner(int cell_len)
+	: mRange(std::max<int>(cell_len, 1))
+	, mBins(mRange * 2 + 1)
+{
+	const int bins = DecoderCounters::kPhaseErrorBins;
+
+	for(int i = -mRange; i <= mRange; ++i) {
+		const int bin = (int)floor((double)i * bins / mRange) + bins / 2;
+
+		mBins[i + mRange] = (uint8_t)std::max<int>(0, std::min<int>(bins - 1, bin));
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+// Alternate PLL configurations for the FM and MFM decoders, enabled by -pll.
+// Marginal disks often only read with a tighter or looser PLL than the stock
+// one. Rather than retrying the whole conversion with different settings, the
+// alternates are run over the same flux stream after the stock PLL, each
+// feeding its own sector parsers, and sift_sectors() keeps whichever reads
+// pass CRC.
+//
+// The alternates are clocked together as lanes in a single pass over the
+// flux. Each transition interval is added to every lane, and the lanes then
+// step through their bit cells in lockstep until all of them have reached the
+// transition. The lane state is kept in structure-of-arrays form so that a
+// step is a handful of SSE2 operations for all eight lanes, which keeps -pll 8
+// at about the cost of -pll 4 and of the stock pass. A lane's parsers are
+// only woken for the cells that they need to see -- sync marks, and the last
+// cell of each byte while reading a sector -- and the cells in between are
+// passed over in bulk, as in run_exact_parsers().
+
+static constexpr int kMaxPLLs = 8;
+
+struct PLLConfig {
+	uint8_t mWindow;		// half-width of the capture window, in 1/12ths of a cell
+	uint8_t mPhaseGain;		// phase correction in 1/16ths of the phase error, or 0 for the stock steps
+};
+
+// Alternates to the stock PLL, in the order that -pll enables them. The stock
+// FM PLL has a window of 4/12 and the stock MFM PLL 6/12.
+static const PLLConfig kAltPLLsFM[kMaxPLLs - 1] = {
+	{ 4, 4 },
+	{ 3, 0 },
+	{ 5, 0 },
+	{ 3, 4 },
+	{ 5, 4 },
+	{ 4, 8 },
+	{ 5, 8 },
+};
+
+static const PLLConfig kAltPLLsMFM[kMaxPLLs - 1] = {
+	{ 6, 4 },
+	{ 5, 0 },
+	{ 4, 0 },
+	{ 5, 4 },
+	{ 4, 4 },
+	{ 6, 8 },
+	{ 5, 8 },
+};
+
+int g_pllCount = 1;
+
+// A set of alternate PLLs, each the same PLL as in process_track_fm() and
+// process_track_mfm() but with its own window and phase correction.
+class PLLLanes {
+public:
+	enum : int { kMaxLanes = 8 };
+
+	// A lane is woken for each cell that matches wake_cells, as well as for
+	// the cell that the wake function asks for.
+	PLLLanes(int cell_len, int lane_count, const PLLConfig *configs, uint16_t wake_cells);
+
+	int GetLaneCount() const { return mLaneCount; }
+
+	// Set the first cell to wake a lane for, other than by wake_cells.
+	void SetWakeCell(int lane, uint32_t cell) { mWakeCell[lane] = cell; }
+
+	// Clock all lanes over a track, calling wakeFn(lane, cell, time, shifter)
+	// for each cell that wakes a lane. Cells are numbered from 1 in each lane,
+	// and wakeFn returns the next cell to wake the lane for. The lanes don't
+	// record phase errors; the stock PLL already does for the same flux.
+	template<typename T_WakeFn>
+	void Run(const std::vector<uint32_t>& transitions, DecodeBudget& budget, T_WakeFn&& wakeFn);
+
+private:
+	template<typename T_WakeFn>
+	uint32_t ClockScalar(uint32_t delta, uint32_t time_basis, T_WakeFn& wakeFn);
+
+#if A8RC_FLUX_SSE2
+	template<typename T_WakeFn>
+	void RunSSE2(const uint32_t *samp, const uint32_t *samp_end, DecodeBudget& budget, T_WakeFn& wakeFn);
+#endif
+
+	int mCellLen;
+	int mLaneCount;
+	int mPhaseLimit;
+	uint16_t mWakeCells;
+	bool mbUseSSE2 = false;
+
+	int mCellRange[kMaxLanes] {};
+	int mPhaseGain[kMaxLanes] {};
+	int mTimeLeft[kMaxLanes] {};
+	int mCellTimer[kMaxLanes] {};
+	uint16_t mShifter[kMaxLanes] {};
+	uint32_t mCellCount[kMaxLanes] {};
+	uint32_t mWakeCell[kMaxLanes] {};
+	uint32_t mIgnored[kMaxLanes] {};
+};
+
+PLLLanes::PLLLanes(int cell_len, int lane_count, const PLLConfig *configs, uint16_t wake_cells)
+	: mCellLen(cell_len)
+	, mLaneCount(std::max<int>(0, std::min<int>(lane_count, kMaxLanes)))
+	, mPhaseLimit(std::max<int>(3, cell_len / 16))
+	, mWakeCells(wake_cells)
+{
+	int max_product = 0;
+
+	for(int lane = 0; lane < mLaneCount; ++lane) {
+		mCellRange[lane] = cell_len * configs[lane].mWindow / 12;
+		mPhaseGain[lane] = configs[lane].mPhaseGain;
+
+		max_product = std::max<int>(max_product, mCellRange[lane] * std::max<int>(1, mPhaseGain[lane]));
+	}
+
+#if A8RC_FLUX_SSE2
+	// The SSE2 path runs all lanes in 16-bit elements, which is enough for
+	// everything but long gaps between transitions. It needs the cell timer
+	// and the phase correction product to fit.
+	mbUseSSE2 = max_product < 32768 && cell_len + mPhaseLimit < 32768;
+#endif
+}
+
+template<typename T_WakeFn>
+void PLLLanes::Run(const std::vector<uint32_t>& transitions, DecodeBudget& budget, T_WakeFn&& wakeFn) {
+	if (transitions.size() < 2 || !mLaneCount)
+		return;
+
+	const uint32_t *samp = transitions.data();
+	const uint32_t *const samp_end = samp + transitions.size() - 1;
+
+#if A8RC_FLUX_SSE2
+	if (mbUseSSE2) {
+		RunSSE2(samp, samp_end, budget, wakeFn);
+	} else
+#endif
+	{
+		while(samp != samp_end) {
+			const uint32_t delta = samp[1] - samp[0];
+
+			++samp;
+			if (!budget.Tick(ClockScalar(delta, *samp, wakeFn)))
+				break;
+		}
+	}
+
+	DecoderCounters& counters = budget.GetCounters();
+
+	for(int lane = 0; lane < mLaneCount; ++lane)
+		counters.mTransitionsIgnored += mIgnored[lane];
+}
+
+// Clock all lanes up to the next transition. The lanes are stepped together so
+// that they wake in the same order as with the SSE2 path. Returns the number of
+// cells clocked.
+template<typename T_WakeFn>
+uint32_t PLLLanes::ClockScalar(uint32_t delta, uint32_t time_basis, T_WakeFn& wakeFn) {
+	const int cell_len = mCellLen;
+	uint32_t cells = 0;
+
+	for(int lane = 0; lane < mLaneCount; ++lane)
+		mTimeLeft[lane] += delta;
+
+	for(;;) {
+		bool live = false;
+
+		for(int lane = 0; lane < mLaneCount; ++lane) {
+			int time_left = mTimeLeft[lane];
+
+			if (time_left <= 0)
+				continue;
+
+			live = true;
+
+			// if the shift register is empty, restart shift timing at next transition
+			uint16_t shifter = mShifter[lane];
+			if (!shifter) {
+				mTimeLeft[lane] = 0;
+				mCellTimer[lane] = cell_len;
+				mShifter[lane] = 1;
+				continue;
+			}
+
+			// compare time to next transition against cell length
+			int cell_timer = mCellTimer[lane];
+			const int trans_delta = time_left - cell_timer;
+
+			if (trans_delta < -mCellRange[lane]) {
+				// ignore the transition
+				mCellTimer[lane] = cell_timer - time_left;
+				++mIgnored[lane];
+				continue;
+			}
+
+			shifter += shifter;
+
+			if (trans_delta <= mCellRange[lane]) {
+				// we have a transition in range -- clock in a 1 bit
+				++shifter;
+				cell_timer = cell_len;
+				time_left = 0;
+
+				// adjust clocking by phase error
+				if (const int phase_gain = mPhaseGain[lane]) {
+					cell_timer += std::max<int>(-mPhaseLimit, std::min<int>(mPhaseLimit, trans_delta * phase_gain / 16));
+				} else {
+					if (trans_delta < -5)
+						cell_timer -= 3;
+					else if (trans_delta < -3)
+						cell_timer -= 2;
+					else if (trans_delta < 1)
+						--cell_timer;
+					else if (trans_delta > 1)
+						++cell_timer;
+				}
+			} else {
+				// we don't have a transition in range -- clock in a 0 bit
+				time_left -= cell_timer;
+				cell_timer = cell_len;
+			}
+
+			mTimeLeft[lane] = time_left;
+			mCellTimer[lane] = cell_timer;
+			mShifter[lane] = shifter;
+			++cells;
+
+			const uint32_t cell = ++mCellCount[lane];
+			if (shifter == mWakeCells || cell == mWakeCell[lane])
+				mWakeCell[lane] = wakeFn(lane, cell, time_basis - time_left, shifter);
+		}
+
+		if (!live)
+			break;
+	}
+
+	return cells;
+}
+
+#if A8RC_FLUX_SSE2
+template<typename T_WakeFn>
+void PLLLanes::RunSSE2(const uint32_t *samp, const uint32_t *samp_end, DecodeBudget& budget, T_WakeFn& wakeFn) {
+	// All eight lanes are held in one register, as 16-bit elements. A lane
+	// always ends up exactly on the transition, with no time left, so the
+	// time left fits as long as the gap to the next transition does; the rare
+	// longer gaps are clocked by ClockScalar(). Cells are counted from the
+	// last fold, which is done every 256 transitions.
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i minus3 = _mm_set1_epi16(-3);
+	const __m128i minus5 = _mm_set1_epi16(-5);
+	const __m128i fifteen = _mm_set1_epi16(15);
+	const __m128i cell_len = _mm_set1_epi16((int16_t)mCellLen);
+	const __m128i phase_limit = _mm_set1_epi16((int16_t)mPhaseLimit);
+	const __m128i neg_phase_limit = _mm_set1_epi16((int16_t)-mPhaseLimit);
+	const __m128i wake_cells = _mm_set1_epi16((int16_t)mWakeCells);
+
+	alignas(16) int16_t lane_active[kMaxLanes] {};
+	alignas(16) int16_t lane_range[kMaxLanes] {};
+	alignas(16) int16_t lane_gain[kMaxLanes] {};
+	alignas(16) int16_t lane_time_left[kMaxLanes];
+	alignas(16) int16_t lane_cell_timer[kMaxLanes];
+	alignas(16) int16_t lane_shifter[kMaxLanes];
+	alignas(16) int16_t lane_cells[kMaxLanes];
+	alignas(16) int16_t lane_wake[kMaxLanes];
+	alignas(16) int16_t lane_ignored[kMaxLanes];
+	uint32_t wake_base[kMaxLanes] {};
+
+	for(int lane = 0; lane < mLaneCount; ++lane) {
+		lane_active[lane] = -1;
+		lane_range[lane] = (int16_t)mCellRange[lane];
+		lane_gain[lane] = (int16_t)mPhaseGain[lane];
+	}
+
+	const __m128i active = _mm_load_si128((const __m128i *)lane_active);
+	const __m128i cell_range = _mm_load_si128((const __m128i *)lane_range);
+	const __m128i neg_cell_range = _mm_sub_epi16(zero, cell_range);
+	const __m128i phase_gain = _mm_load_si128((const __m128i *)lane_gain);
+	const __m128i stock_steps = _mm_cmpeq_epi16(phase_gain, zero);
+
+	__m128i time_left, cell_timer, shifter, cells, wake_cell, ignored;
+
+	// Write the lane state back to the lane arrays, with the cell counts
+	// folded in, or load it from them. The wake cells are kept relative to
+	// the last fold, and any beyond 16 bits are left for a later one.
+	const auto store = [&] {
+		_mm_store_si128((__m128i *)lane_time_left, time_left);
+		_mm_store_si128((__m128i *)lane_cell_timer, cell_timer);
+		_mm_store_si128((__m128i *)lane_shifter, shifter);
+		_mm_store_si128((__m128i *)lane_cells, cells);
+		_mm_store_si128((__m128i *)lane_ignored, ignored);
+
+		for(int lane = 0; lane < mLaneCount; ++lane) {
+			mTimeLeft[lane] = lane_time_left[lane];
+			mCellTimer[lane] = lane_cell_timer[lane];
+			mShifter[lane] = (uint16_t)lane_shifter[lane];
+			mCellCount[lane] += (uint16_t)lane_cells[lane];
+			mIgnored[lane] += (uint16_t)lane_ignored[lane];
+		}
+	};
+
+	const auto load = [&] {
+		for(int lane = 0; lane < mLaneCount; ++lane) {
+			lane_time_left[lane] = (int16_t)mTimeLeft[lane];
+			lane_cell_timer[lane] = (int16_t)mCellTimer[lane];
+			lane_shifter[lane] = (int16_t)mShifter[lane];
+			lane_wake[lane] = (int16_t)std::min<uint32_t>(mWakeCell[lane] - mCellCount[lane], 0x7FFF);
+			wake_base[lane] = mCellCount[lane];
+		}
+
+		time_left = _mm_load_si128((const __m128i *)lane_time_left);
+		cell_timer = _mm_load_si128((const __m128i *)lane_cell_timer);
+		shifter = _mm_load_si128((const __m128i *)lane_shifter);
+		wake_cell = _mm_load_si128((const __m128i *)lane_wake);
+		cells = zero;
+		ignored = zero;
+	};
+
+	for(int lane = 0; lane < kMaxLanes; ++lane) {
+		lane_time_left[lane] = 0;
+		lane_cell_timer[lane] = 0;
+		lane_shifter[lane] = 0;
+		lane_wake[lane] = 0;
+	}
+
+	load();
+
+	uint32_t ticked_cells = 0;
+	int fold_countdown = 256;
+
+	while(samp != samp_end) {
+		const uint32_t delta = samp[1] - samp[0];
+		const uint32_t time_basis = *++samp;
+
+		if (delta > 0x7FFF) {
+			store();
+			ClockScalar(delta, time_basis, wakeFn);
+			load();
+			fold_countdown = 1;
+		} else {
+			time_left = _mm_add_epi16(time_left, _mm_and_si128(_mm_set1_epi16((int16_t)delta), active));
+
+			for(;;) {
+				const __m128i live = _mm_cmpgt_epi16(time_left, zero);
+
+				if (!_mm_movemask_epi8(live))
+					break;
+
+				// compare time to next transition against cell length, and
+				// sort the lanes into restarts, ignored transitions, 1 bits
+				// and 0 bits
+				const __m128i trans_delta = _mm_sub_epi16(time_left, cell_timer);
+				const __m128i empty = _mm_cmpeq_epi16(shifter, zero);
+				const __m128i early = _mm_cmpgt_epi16(neg_cell_range, trans_delta);
+				const __m128i late = _mm_cmpgt_epi16(trans_delta, cell_range);
+				const __m128i restart = _mm_and_si128(live, empty);
+				const __m128i clocked = _mm_andnot_si128(empty, live);
+				const __m128i ignore = _mm_and_si128(clocked, early);
+				const __m128i cell = _mm_andnot_si128(early, clocked);
+				const __m128i bit0 = _mm_and_si128(cell, late);
+				const __m128i bit1 = _mm_andnot_si128(late, cell);
+
+				// phase correction for a 1 bit: either the stock steps, or
+				// the gain with truncation toward zero and a limit
+				const __m128i steps = _mm_sub_epi16(
+					_mm_add_epi16(
+						_mm_add_epi16(_mm_cmpgt_epi16(minus5, trans_delta), _mm_cmpgt_epi16(minus3, trans_delta)),
+						_mm_cmpgt_epi16(one, trans_delta)),
+					_mm_cmpgt_epi16(trans_delta, one));
+
+				__m128i product = _mm_mullo_epi16(trans_delta, phase_gain);
+				product = _mm_add_epi16(product, _mm_and_si128(_mm_srai_epi16(product, 15), fifteen));
+
+				const __m128i gain_adjust = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(product, 4), neg_phase_limit), phase_limit);
+				const __m128i adjust = _mm_or_si128(_mm_and_si128(stock_steps, steps), _mm_andnot_si128(stock_steps, gain_adjust));
+
+				// shift in the new cell, or restart the register with a 1
+				const __m128i shifted = _mm_add_epi16(_mm_add_epi16(shifter, shifter), _mm_and_si128(bit1, one));
+				shifter = _mm_or_si128(_mm_or_si128(_mm_and_si128(cell, shifted), _mm_andnot_si128(cell, shifter)), _mm_and_si128(restart, one));
+
+				// A 1 bit or a restart consumes the transition, and a 0 bit
+				// takes a cell off the time left; all three reset the cell
+				// timer. An ignored transition takes its time off the cell
+				// timer instead.
+				const __m128i consumed = _mm_or_si128(bit1, restart);
+				const __m128i reset = _mm_or_si128(consumed, bit0);
+				const __m128i new_time_left = _mm_andnot_si128(consumed, _mm_sub_epi16(time_left, _mm_and_si128(bit0, cell_timer)));
+
+				__m128i new_cell_timer = _mm_sub_epi16(cell_timer, _mm_and_si128(ignore, time_left));
+				new_cell_timer = _mm_or_si128(_mm_andnot_si128(reset, new_cell_timer), _mm_and_si128(reset, cell_len));
+				cell_timer = _mm_add_epi16(new_cell_timer, _mm_and_si128(bit1, adjust));
+				time_left = new_time_left;
+
+				cells = _mm_sub_epi16(cells, cell);
+				ignored = _mm_sub_epi16(ignored, ignore);
+
+				const __m128i wake = _mm_and_si128(cell, _mm_or_si128(_mm_cmpeq_epi16(shifter, wake_cells), _mm_cmpeq_epi16(cells, wake_cell)));
+
+				if (const int wake_bits = _mm_movemask_epi8(_mm_packs_epi16(wake, zero))) {
+					_mm_store_si128((__m128i *)lane_time_left, time_left);
+					_mm_store_si128((__m128i *)lane_shifter, shifter);
+					_mm_store_si128((__m128i *)lane_cells, cells);
+
+					for(int lane = 0; lane < mLaneCount; ++lane) {
+						if (wake_bits & (1 << lane)) {
+							const uint32_t cell_number = wake_base[lane] + (uint16_t)lane_cells[lane];
+							const uint32_t next = wakeFn(lane, cell_number, time_basis - lane_time_left[lane], (uint16_t)lane_shifter[lane]);
+
+							mWakeCell[lane] = next;
+							lane_wake[lane] = (int16_t)std::min<uint32_t>(next - wake_base[lane], 0x7FFF);
+						}
+					}
+
+					wake_cell = _mm_load_si128((const __m128i *)lane_wake);
+				}
+			}
+		}
+
+		if (!--fold_countdown || samp == samp_end) {
+			fold_countdown = 256;
+
+			store();
+			load();
+
+			uint32_t total_cells = 0;
+			for(int lane = 0; lane < mLaneCount; ++lane)
+				total_cells += mCellCount[lane];
+
+			const bool in_time = budget.Tick(total_cells - ticked_cells);
+			ticked_cells = total_cells;
+
+			if (!in_time)
+				break;
+		}
+	}
+}
+#endif
+
+// Sector parsers for one PLL lane. The parsers are only passed the cells that
+// they need to see; the others are skipped when the lane is next woken up.
+template<typename T_Parser>
+class PLLLaneParsers {
+public:
+	std::vector<T_Parser>& GetParsers() { return mParsers; }
+
+	// Bring the parsers up to the given cell, parsing it if any of them needs it.
+	void Parse(uint32_t cell, uint32_t vsn_time, uint16_t shifter) {
+		const uint32_t skipped = cell - mLastCell - 1;
+
+		mLastCell = cell;
+
+		if (cell != mNextCell) {
+			for(T_Parser& parser : mParsers)
+				parser.SkipCells(skipped + 1);
+
+			return;
+		}
+
+		for(auto it = mParsers.begin(); it != mParsers.end();) {
+			if (skipped)
+				it->SkipCells(skipped);
+
+			if (it->Parse(vsn_time, shifter))
+				++it;
+			else
+				it = mParsers.erase(it);
+		}
+	}
+
+	// Return the next cell that the parsers need to see, or one that will never come.
+	uint32_t UpdateNextCell() {
+		uint32_t next = mLastCell + 0x80000000U;
+
+		for(const T_Parser& parser : mParsers)
+			next = std::min<uint32_t>(next, mLastCell + parser.GetCellsToNextByte());
+
+		mNextCell = next;
+		return next;
+	}
+
+private:
+	std::vector<T_Parser> mParsers;
+	uint32_t mLastCell = 0;
+	uint32_t mNextCell = 0;
+};
+
+void process_track_fm_alt_plls(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget, double scks_per_cell) {
+	const int cell_len = (int)(scks_per_cell + 0.5);
+	PLLLanes lanes(cell_len, g_pllCount - 1, kAltPLLsFM, kFMIDAMCells);
+	PLLLaneParsers<SectorParser> laneParsers[PLLLanes::kMaxLanes];
+
+	lanes.Run(rawTrack.mTransitions, budget,
+		[&](int lane, uint32_t cell, uint32_t vsn_time, uint16_t shifter) {
+			PLLLaneParsers<SectorParser>& parsers = laneParsers[lane];
+
+			parsers.Parse(cell, vsn_time, shifter);
+
+			if (shifter == kFMIDAMCells) {
+				if (SectorParser *parser = budget.AddParser(parsers.GetParsers()))
+					parser->Init(rawTrack.mPhysTrack / g_trackStep, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
+			}
+
+			return parsers.UpdateNextCell();
+		}
+	);
+}
+
+void process_track_mfm_alt_plls(const RawTrack& rawTrack, const std::vector<uint32_t>& transitions, TrackInfo& dstTrack, DecodeBudget& budget, double scks_per_cell, bool decode_amiga) {
+	const int cell_len = (int)(scks_per_cell + 0.5);
+	PLLLanes lanes(cell_len, g_pllCount - 1, kAltPLLsMFM, kMFMSyncCells);
+	const int lane_count = lanes.GetLaneCount();
+
+	if (decode_amiga) {
+		// The Amiga decoder takes every cell, so the lanes are woken for all of them.
+		std::vector<TrackDecoderMFMAmiga> amigaTracks(lane_count);
+
+		for(int lane = 0; lane < lane_count; ++lane) {
+			init_amiga_track(amigaTracks[lane], rawTrack, transitions, dstTrack, scks_per_cell);
+			lanes.SetWakeCell(lane, 1);
+		}
+
+		lanes.Run(transitions, budget,
+			[&](int lane, uint32_t cell, uint32_t vsn_time, uint16_t shifter) {
+				amigaTracks[lane].AddCell(vsn_time, shifter);
+				return cell + 1;
+			}
+		);
+
+		for(TrackDecoderMFMAmiga& amigaTrack : amigaTracks)
+			decode_amiga_track(amigaTrack, budget);
+
+		return;
+	}
+
+	// IDAM detection is the same as in process_track_mfm(), but as the lanes
+	// are only woken at sync marks, it goes by the cell that started the run
+	// of marks instead of counting every cell.
+	struct SyncRun {
+		uint32_t mStartCell = 0;
+		uint32_t mMarks = 0;
+	};
+
+	PLLLaneParsers<SectorParserMFM> laneParsers[PLLLanes::kMaxLanes];
+	SyncRun syncRuns[PLLLanes::kMaxLanes];
+
+	lanes.Run(transitions, budget,
+		[&](int lane, uint32_t cell, uint32_t vsn_time, uint16_t shifter) {
+			PLLLaneParsers<SectorParserMFM>& parsers = laneParsers[lane];
+
+			parsers.Parse(cell, vsn_time, shifter);
+
+			if (shifter == kMFMSyncCells) {
+				SyncRun& run = syncRuns[lane];
+				const uint32_t offset = cell - run.mStartCell;
+
+				if (run.mMarks == 1 && offset == 16) {
+					run.mMarks = 2;
+				} else if (run.mMarks == 2 && offset == 32) {
+					if (SectorParserMFM *parser = budget.AddParser(parsers.GetParsers()))
+						parser->Init(rawTrack.mPhysTrack / g_trackStep, rawTrack.mSide, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
+
+					run.mMarks = 0;
+				} else if (!run.mMarks || offset > run.mMarks * 16) {
+					run.mStartCell = cell;
+					run.mMarks = 1;
+				}
+			}
+
+			return parsers.UpdateNextCell();
+		}
+	);
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+// Exact decoding for synthesized flux.
+//
+// Flux that we generated ourselves -- from encode_disk(), a disk script, a
+// nibble image, or an SCP marked as normalized -- has transitions on exact
+// cell boundaries, so the adaptive PLL gains nothing over simply rounding
+// each flux interval to a whole number of cells. The interval is looked up in
+// a table built for the track's cell length and expanded into the same
+// stream of shift register values that the PLL would produce, including the
+// restart after the register runs dry.
+//
+// The FM and MFM sector parsers then only need to see the cells that finish
+// a byte, or every cell while they are hunting for a mark, and address marks
+// are found with a scan over the whole stream. This turns the per-cell work
+// into per-byte work for most of the track. Apple II GCR bytes sync on the
+// cells themselves, so that decoder still takes every cell, but skips the
+// PLL arithmetic.
+//
+// Flux that doesn't fit the grid -- an interval more than a quarter cell off,
+// as with weak sectors, or intervals that run long or short on average, as
+// when the cell length is wrong for the track -- is decoded with the PLL
+// instead. Within those limits the PLL locks on and reads the same cells, so
+// the decoded sectors, including any with deliberately bad CRCs, are the
+// same either way.
+
+bool g_synthesizedFlux = false;
+
+class ExactFluxQuantizer {
+public:
+	ExactFluxQuantizer(double scks_per_cell);
+
+	// Convert all transition intervals to cell counts. Returns false if the
+	// flux isn't on the cell grid.
+	bool Quantize(const std::vector<uint32_t>& transitions, std::vector<uint8_t>& cellCounts) const;
+
+private:
+	enum : int { kMaxCells = 32 };
+	enum : uint8_t { kOffGrid = 0 };
+
+	double mScksPerCell;
+	std::vector<uint8_t> mCellTable;
+};
+
+ExactFluxQuantizer::ExactFluxQuantizer(double scks_per_cell)
+	: mScksPerCell(scks_per_cell)
+{
+	// Intervals past the end of the table are only ever sync gaps that reset
+	// the shift register, and are computed directly.
+	mCellTable.resize((size_t)(scks_per_cell * kMaxCells), kOffGrid);
+
+	const double tolerance = scks_per_cell / 4;
+
+	for(int cells = 1; cells < kMaxCells; ++cells) {
+		const double center = scks_per_cell * cells;
+		const size_t lo = (size_t)std::max<double>(0, ceil(center - tolerance));
+		const size_t hi = std::min<size_t>(mCellTable.size() - 1, (size_t)floor(center + tolerance));
+
+		for(size_t i = lo; i <= hi; ++i)
+			mCellTable[i] = (uint8_t)cells;
+	}
+}
+
+bool ExactFluxQuantizer::Quantize(const std::vector<uint32_t>& transitions, std::vector<uint8_t>& cellCounts) const {
+	const size_t n = transitions.size();
+	const size_t tableSize = mCellTable.size();
+	const uint8_t *cellTable = mCellTable.data();
+	uint64_t totalTime = 0;
+	uint64_t totalCells = 0;
+
+	cellCounts.resize(n > 0 ? n - 1 : 0);
+
+	for(size_t i = 1; i < n; ++i) {
+		const uint32_t delta = transitions[i] - transitions[i - 1];
+		uint8_t cells;
+
+		if (delta < tableSize)
+			cells = cellTable[delta];
+		else {
+			const double exactCells = (double)delta / mScksPerCell;
+			const double roundedCells = floor(exactCells + 0.5);
+
+			if (fabs(exactCells - roundedCells) > 0.25)
+				return false;
+
+			// long gaps are left out of the average, as they are clamped
+			cells = (uint8_t)std::min<double>(roundedCells, 255);
+			cellCounts[i - 1] = cells;
+			continue;
+		}
+
+		if (cells == kOffGrid)
+			return false;
+
+		cellCounts[i - 1] = cells;
+		totalTime += delta;
+		totalCells += cells;
+	}
+
+	// Encoders may deliberately shift transitions early or late, as with
+	// write precompensation, but those shifts cancel out; a consistent drift
+	// means that the cells aren't the length we think they are.
+	if (totalCells && fabs((double)totalTime / (double)totalCells - mScksPerCell) > mScksPerCell / 64)
+		return false;
+
+	return true;
+}
+
+// The shift register values that a PLL loop produces for a track, one per
+// bit cell that it reports, with the time of each cell.
+template<typename T_Shifter>
+struct ExactCellStream {
+	std::vector<T_Shifter> mShifters;
+	std::vector<uint32_t> mTimes;
+};
+
+// Reciprocals of cell counts, for placing the 0 cells within an interval
+// without a divide per cell. floor(x * R(n) / 2^32) with R(n) = 2^32 / n
+// rounded up equals floor(x / n) for any x below 2^32 / n.
+class CellCountReciprocals {
+public:
+	CellCountReciprocals() {
+		mTable[0] = 0;
+
+		for(uint32_t n = 1; n < 256; ++n)
+			mTable[n] = (UINT64_C(1) << 32) / n + 1;
+	}
+
+	uint64_t operator[](int n) const { return mTable[n]; }
+
+private:
+	uint64_t mTable[256];
+};
+
+// Expand cell counts back into the per-cell shift register values that the
+// PLL loops produce. A cell that leaves the register empty is followed by a
+// restart at the next transition, which isn't reported.
+template<typename T_Shifter>
+void expand_exact_flux(const std::vector<uint32_t>& transitions, const std::vector<uint8_t>& cellCounts, ExactCellStream<T_Shifter>& stream) {
+	static const CellCountReciprocals kReciprocals;
+
+	const size_t n = cellCounts.size();
+	size_t totalCells = 0;
+
+	for(uint8_t cells : cellCounts)
+		totalCells += cells;
+
+	stream.mShifters.resize(totalCells);
+	stream.mTimes.resize(totalCells);
+
+	T_Shifter *dstShifter = stream.mShifters.data();
+	uint32_t *dstTime = stream.mTimes.data();
+	T_Shifter shifter = 0;
+
+	for(size_t i = 0; i < n; ++i) {
+		// if the shift register is empty, restart shift timing at next transition
+		if (!shifter) {
+			shifter = 1;
+			continue;
+		}
+
+		const uint32_t t0 = transitions[i];
+		const uint32_t t1 = transitions[i + 1];
+		const int cells = cellCounts[i];
+
+		// clock in 0 bits up to the transition
+		if (cells > 1) {
+			const uint64_t dt = t1 - t0;
+			const bool fast = dt * cells < (UINT64_C(1) << 24);
+			const uint64_t rcp = kReciprocals[cells];
+
+			for(int j = 1; j < cells && shifter; ++j) {
+				shifter = (T_Shifter)(shifter + shifter);
+
+				*dstShifter++ = shifter;
+				*dstTime++ = t0 + (uint32_t)(fast ? (dt * j * rcp) >> 32 : dt * j / cells);
+			}
+
+			if (!shifter)
+				continue;
+		}
+
+		// clock in a 1 bit for the transition
+		shifter = (T_Shifter)(shifter + shifter + 1);
+
+		*dstShifter++ = shifter;
+		*dstTime++ = t1;
+	}
+
+	stream.mShifters.resize(dstShifter - stream.mShifters.data());
+	stream.mTimes.resize(dstTime - stream.mTimes.data());
+}
+
+// Bin the timing error of each flux interval against its whole number of
+// cells, for the same -stats phase error distribution that the PLL reports.
+// This is a separate pass over the track, so it's skipped without -stats.
+void count_exact_phase_errors(const std::vector<uint32_t>& transitions, const std::vector<uint8_t>& cellCounts, double scks_per_cell, DecoderCounters& counters) {
+	if (!g_stats.IsEnabled())
+		return;
+
+	const PhaseErrorBinner phaseErrors((int)(scks_per_cell + 0.5));
+	const size_t n = cellCounts.size();
+
+	for(size_t i = 0; i < n; ++i) {
+		const double error = (double)(transitions[i + 1] - transitions[i]) - cellCounts[i] * scks_per_cell;
+
+		phaseErrors.Add(counters, (int)floor(error + 0.5));
+	}
+}
+
+// Run sector parsers over an exact cell stream, starting a new parser after
+// each of the given cells, as the PLL loops would. Runs of cells that no
+// parser needs to see are passed over in one go.
+template<typename T_Parser, typename T_InitFn>
+void run_exact_parsers(const ExactCellStream<uint16_t>& stream, const std::vector<uint32_t>& spawnCells, DecodeBudget& budget, T_InitFn&& initFn) {
+	const uint32_t n = (uint32_t)stream.mShifters.size();
+	std::vector<T_Parser> parsers;
+	auto itSpawn = spawnCells.begin();
+	uint32_t i = 0;
+
+	while(i < n) {
+		uint32_t next = itSpawn != spawnCells.end() ? *itSpawn : n;
+
+		for(const T_Parser& parser : parsers)
+			next = std::min<uint32_t>(next, i + parser.GetCellsToNextByte() - 1);
+
+		if (next > i) {
+			for(T_Parser& parser : parsers)
+				parser.SkipCells(next - i);
+
+			const bool inTime = budget.Tick(next - i);
+
+			i = next;
+			if (!inTime || i >= n)
+				break;
+		}
+
+		const uint32_t vsn_time = stream.mTimes[i];
+		const uint16_t shifter = stream.mShifters[i];
+
+		for(auto it = parsers.begin(); it != parsers.end();) {
+			if (it->Parse(vsn_time, shifter))
+				++it;
+			else
+				it = parsers.erase(it);
+		}
+
+		if (itSpawn != spawnCells.end() && *itSpawn == i) {
+			++itSpawn;
+
+			if (T_Parser *parser = budget.AddParser(parsers))
+				initFn(*parser, vsn_time);
+		}
+
+		if (!budget.Tick())
+			break;
+
+		++i;
+	}
+}
+
+bool process_track_fm_exact(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget, double scks_per_cell) {
+	std::vector<uint8_t> cellCounts;
+	if (!ExactFluxQuantizer(scks_per_cell).Quantize(rawTrack.mTransitions, cellCounts))
+		return false;
+
+	count_exact_phase_errors(rawTrack.mTransitions, cellCounts, scks_per_cell, budget.GetCounters());
+
+	ExactCellStream<uint16_t> stream;
+	expand_exact_flux(rawTrack.mTransitions, cellCounts, stream);
+
+	std::vector<uint32_t> idamCells;
+	const uint32_t n = (uint32_t)stream.mShifters.size();
+
+	for(uint32_t i = 0; i < n; ++i) {
+		if (stream.mShifters[i] == kFMIDAMCells)
+			idamCells.push_back(i);
+	}
+
+	run_exact_parsers<SectorParser>(stream, idamCells, budget,
+		[&](SectorParser& parser, uint32_t vsn_time) {
+			parser.Init(rawTrack.mPhysTrack / g_trackStep, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
+		}
+	);
+
+	return true;
+}
+
+bool process_track_mfm_exact(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget, double scks_per_cell, bool decode_amiga) {
+	std::vector<uint8_t> cellCounts;
+	if (!ExactFluxQuantizer(scks_per_cell).Quantize(rawTrack.mTransitions, cellCounts))
+		return false;
+
+	count_exact_phase_errors(rawTrack.mTransitions, cellCounts, scks_per_cell, budget.GetCounters());
+
+	ExactCellStream<uint16_t> stream;
+	expand_exact_flux(rawTrack.mTransitions, cellCounts, stream);
+
+	const uint32_t n = (uint32_t)stream.mShifters.size();
+
+	if (decode_amiga) {
+		TrackDecoderMFMAmiga amigaTrack;
+		init_amiga_track(amigaTrack, rawTrack, rawTrack.mTransitions, dstTrack, scks_per_cell);
+
+		for(uint32_t i = 0; i < n; ++i) {
+			amigaTrack.AddCell(stream.mTimes[i], stream.mShifters[i]);
+
+			if (!budget.Tick())
+				break;
+		}
+
+		decode_amiga_track(amigaTrack, budget);
+		return true;
+	}
+
+	// IDAM detection -- see process_track_mfm(). A parser is started on the
+	// third of three sync marks 16 cells apart. As with the state machine
+	// there, the search only resumes after the last mark checked.
+	std::vector<uint32_t> idamCells;
+
+	for(uint32_t i = 0; i < n;) {
+		if (stream.mShifters[i] != kMFMSyncCells) {
+			++i;
+			continue;
+		}
+
+		if (i + 16 < n && stream.mShifters[i + 16] == kMFMSyncCells) {
+			if (i + 32 < n && stream.mShifters[i + 32] == kMFMSyncCells)
+				idamCells.push_back(i + 32);
+
+			i += 33;
+		} else
+			i += 17;
+	}
+
+	run_exact_parsers<SectorParserMFM>(stream, idamCells, budget,
+		[&](SectorParserMFM& parser, uint32_t vsn_time) {
+			parser.Init(rawTrack.mPhysTrack / g_trackStep, rawTrack.mSide, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
+		}
+	);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+typedef void (*TrackDecoder)(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget);
+
+void process_track_fm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget);
+void process_track_mfm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget, bool decode_amiga, bool use_300rpm);
+void process_track_macgcr(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget);
+void process_track_a2gcr(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget);
+
+void process_track_atarimfm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
+	process_track_mfm(rawTrack, dstTrack, budget, false, false);
+}
+
+void process_track_pcmfm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
+	process_track_mfm(rawTrack, dstTrack, budget, false, true);
+}
+
+void process_track_amigamfm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
+	process_track_mfm(rawTrack, dstTrack, budget, true, true);
+}
+
+// A window of a raw track covering one revolution, plus lead-in and lead-out
+// margins. Sectors found in the window are kept only if they end within the
+// window's own revolution, so that sectors in the margins are not reported
+// twice; the lead-in is long enough to hold the longest sector plus time for
+// the PLL to lock, so that sectors straddling an index mark are still found
+// by the window that owns them.
+struct TrackWindow {
+	RawTrack mRawTrack;
+	uint32_t mOwnStart;
+	uint32_t mOwnEnd;
+};
+
+// Revolution count at which a track is worth splitting even if we are
+// decoding a whole disk.
+static constexpr int kMinWindowedRevs = 10;
+
+std::vector<TrackWindow> split_track_windows(const RawTrack& rawTrack) {
+	std::vector<TrackWindow> windows;
+
+	const int revs = (int)rawTrack.mIndexTimes.size() - 1;
+	if (revs < 2 || get_worker_thread_count() < 2)
+		return windows;
+
+	if (g_trackSelect < 0 && revs < kMinWindowedRevs)
+		return windows;
+
+	// Per-sector diagnostics must come out in stream order, and windows would
+	// also report sectors in their margins twice.
+	if (g_verbosity > 0 || g_dumpBadSectors)
+		return windows;
+
+	// A 1K sector in FM takes up almost a third of a revolution.
+	const uint32_t leadIn = (uint32_t)(rawTrack.mSamplesPerRev * 3 / 8);
+	const uint32_t leadOut = (uint32_t)(rawTrack.mSamplesPerRev / 64);
+	const auto& transitions = rawTrack.mTransitions;
+
+	windows.resize(revs);
+
+	for(int i=0; i<revs; ++i) {
+		TrackWindow& window = windows[i];
+		const uint32_t revStart = rawTrack.mIndexTimes[i];
+		const uint32_t revEnd = rawTrack.mIndexTimes[i + 1];
+
+		window.mOwnStart = i ? revStart : 0;
+		window.mOwnEnd = i < revs - 1 ? revEnd : UINT32_MAX;
+
+		auto itStart = i ? std::lower_bound(transitions.begin(), transitions.end(), revStart > leadIn ? revStart - leadIn : 0) : transitions.begin();
+		auto itEnd = i < revs - 1 ? std::upper_bound(itStart, transitions.end(), revEnd + leadOut) : transitions.end();
+
+		RawTrack& windowTrack = window.mRawTrack;
+		windowTrack.mPhysTrack = rawTrack.mPhysTrack;
+		windowTrack.mSide = rawTrack.mSide;
+		windowTrack.mSamplesPerRev = rawTrack.mSamplesPerRev;
+		windowTrack.mSpliceStart = rawTrack.mSpliceStart;
+		windowTrack.mSpliceEnd = rawTrack.mSpliceEnd;
+		windowTrack.mTransitions.assign(itStart, itEnd);
+
+		// Sectors are placed between the index marks either side of their
+		// address mark, so only the marks around the window are needed: the
+		// last one at or before its first transition, up to the first one
+		// after its last transition.
+		if (!windowTrack.mTransitions.empty()) {
+			const auto& indexTimes = rawTrack.mIndexTimes;
+			auto itIndexStart = std::upper_bound(indexTimes.begin(), indexTimes.end(), windowTrack.mTransitions.front());
+			if (itIndexStart != indexTimes.begin())
+				--itIndexStart;
+
+			auto itIndexEnd = std::upper_bound(itIndexStart, indexTimes.end(), windowTrack.mTransitions.back() + 1);
+			if (itIndexEnd != indexTimes.end())
+				++itIndexEnd;
+
+			windowTrack.mIndexTimes.assign(itIndexStart, itIndexEnd);
+		}
+	}
+
+	return windows;
+}
+
+void decode_track_windows(const std::vector<TrackWindow>& windows, TrackInfo& dstTrack, DecodeBudget& budget, TrackDecoder decoder, DecodeLog& log) {
+	const size_t n = windows.size();
+	std::vector<TrackInfo> windowTracks(n);
+	std::vector<uint8_t> windowLimitsHit(n, 0);
+	std::vector<DecoderPassCounters> windowCounters(n);
+	std::vector<DecodeLog> windowLogs(n);
+
+	parallel_for(n, [&](size_t i) {
+		DecodeLogScope logScope(windowLogs[i]);
+		DecodeBudget windowBudget(budget);
+
+		decoder(windows[i].mRawTrack, windowTracks[i], windowBudget);
+
+		windowLimitsHit[i] = windowBudget.GetLimitsHit();
+		windowCounters[i] = windowBudget.GetCounterTotals();
+	});
+
+	// merge in window order so that the sector list comes out in the same
+	// order as a serial decode
+	for(size_t i=0; i<n; ++i) {
+		const TrackWindow& window = windows[i];
+
+		for(const SectorInfo& sec : windowTracks[i].mSectors) {
+			if (sec.mRawEnd >= window.mOwnStart && sec.mRawEnd < window.mOwnEnd)
+				dstTrack.mSectors.push_back(sec);
+		}
+
+		budget.MergeLimitsHit(windowLimitsHit[i]);
+		budget.MergeCounters(windowCounters[i]);
+		log.Append(windowLogs[i]);
+	}
+}
+
+void report_decode_limits(const RawTrack& rawTrack, uint8_t limitsHit) {
+	std::string limits;
+	if (limitsHit & kDecodeLimit_LiveParsers)
+		limits += ", live parsers";
+	if (limitsHit & kDecodeLimit_ParserSpawns)
+		limits += ", parser spawns";
+	if (limitsHit & kDecodeLimit_WallTime)
+		limits += ", time";
+
+	A8RC_LOG(0, "WARNING: Track %d, side %d exceeded its decode budget (%s) -- sectors on this track are a best-effort result.\n"
+		, rawTrack.mPhysTrack / g_trackStep
+		, rawTrack.mSide
+		, limits.c_str() + 2
+	);
+}
 
-void process_track_fm(const RawTrack& rawTrack);
-void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300rpm);
-void process_track_macgcr(const RawTrack& rawTrack);
-void process_track_a2gcr(const RawTrack& rawTrack);
+// Hash of all options that can change the sectors decoded from a given
+// flux stream, for keying the track cache. Post-compensation and track
+// reversal are applied to the flux before it is hashed, but are included
+// anyway so that a change to either can never be missed.
+uint64_t compute_decode_settings_hash() {
+	BinaryWriter writer;
+
+	writer.PutBytes(A8RC_VERSION, sizeof A8RC_VERSION);
+	writer.PutU8(g_encoding_fm);
+	writer.PutU8(g_encoding_mfm);
+	writer.PutU8(g_encoding_pcmfm);
+	writer.PutU8(g_encoding_amigamfm);
+	writer.PutU8(g_encoding_macgcr);
+	writer.PutU8(g_encoding_a2gcr);
+	writer.PutU8(g_high_density);
+	writer.PutU8(g_postcomp);
+	writer.PutU8(g_reverseTracks);
+	writer.PutU8(g_invertBit7);
+	writer.PutU8(g_synthesizedFlux);
+	writer.PutBytes(&g_clockPeriodAdjust, sizeof g_clockPeriodAdjust);
+	writer.PutU32((uint32_t)g_pllCount);
+	writer.PutU32((uint32_t)g_trackStep);
+	writer.PutU32(g_maxLiveParsers);
+	writer.PutU32(g_maxParserSpawns);
+
+	return ComputeHash64(writer.GetData(), writer.GetSize());
+}
 
 void process_track(const RawTrack& rawTrack) {
+	TrackInfo& dstTrack = g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack];
+
+	StatsTimer trackTimer;
+	TrackStats trackStats;
+	trackStats.mTrack = rawTrack.mPhysTrack / g_trackStep;
+	trackStats.mPhysTrack = rawTrack.mPhysTrack;
+	trackStats.mSide = rawTrack.mSide;
+	trackStats.mTransitions = (uint32_t)rawTrack.mTransitions.size();
+
+	// The decoders' diagnostic output can't be replayed from the cache, so
+	// it's bypassed when any has been asked for.
+	const bool useCache = g_trackCache.IsEnabled() && g_verbosity == 0 && !g_dumpBadSectors;
+	const uint64_t cacheKey = useCache ? g_trackCache.ComputeKey(rawTrack) : 0;
+
+	if (useCache && g_trackCache.Load(cacheKey, dstTrack)) {
+		if (dstTrack.mDecodeLimitsHit)
+			report_decode_limits(rawTrack, dstTrack.mDecodeLimitsHit);
+
+		trackStats.mTimes = trackTimer.Lap();
+		trackStats.mDecodedSectors = (uint32_t)dstTrack.mSectors.size();
+		trackStats.mbCached = true;
+		g_stats.AddTrack(trackStats);
+		return;
+	}
+
+	DecodeBudget budget;
+
+	// Decoder messages are held until the track is done, so that they come
+	// out in order and noise on the track can be summarized.
+	DecodeLog log;
+	DecodeLogScope logScope(log);
+
+	// Long captures and single-track re-reads are split at the index marks
+	// and the revolutions decoded concurrently.
+	const std::vector<TrackWindow> windows = split_track_windows(rawTrack);
+
+	StatsTimer decoderTimer;
+
+	const auto decode = [&](StatsDecoder statsDecoder, TrackDecoder decoder) {
+		if (budget.IsOutOfTime())
+			return;
+
+		decoderTimer.Lap();
+		budget.SetPass((StatsPass)statsDecoder);
+
+		if (windows.empty())
+			decoder(rawTrack, dstTrack, budget);
+		else
+			decode_track_windows(windows, dstTrack, budget, decoder, log);
+
+		g_stats.AddDecoderTime(statsDecoder, decoderTimer.Lap(), trackStats.mTransitions);
+	};
+
 	if (g_encoding_fm)
-		process_track_fm(rawTrack);
+		decode(kStatsDecoder_FM, process_track_fm);
 	
 	if (g_encoding_mfm)
-		process_track_mfm(rawTrack, false, false);
+		decode(kStatsDecoder_AtariMFM, process_track_atarimfm);
 
 	if (g_encoding_pcmfm)
-		process_track_mfm(rawTrack, false, true);
+		decode(kStatsDecoder_PCMFM, process_track_pcmfm);
 
 	if (g_encoding_amigamfm)
-		process_track_mfm(rawTrack, true, true);
+		decode(kStatsDecoder_AmigaMFM, process_track_amigamfm);
 
 	if (g_encoding_macgcr)
-		process_track_macgcr(rawTrack);
+		decode(kStatsDecoder_MacGCR, process_track_macgcr);
+
+	// The Apple II decoder also captures the raw nibble stream for the track,
+	// so it always runs over the whole track.
+	if (g_encoding_a2gcr && !budget.IsOutOfTime()) {
+		decoderTimer.Lap();
+		budget.SetPass(kStatsPass_A2GCR);
+		process_track_a2gcr(rawTrack, dstTrack, budget);
+		g_stats.AddDecoderTime(kStatsDecoder_A2GCR, decoderTimer.Lap(), trackStats.mTransitions);
+	}
+
+	const uint8_t limitsHit = budget.GetLimitsHit();
+	if (limitsHit) {
+		dstTrack.mDecodeLimitsHit |= limitsHit;
+
+		report_decode_limits(rawTrack, limitsHit);
+	}
+
+	log.Flush();
 
-	if (g_encoding_a2gcr)
-		process_track_a2gcr(rawTrack);
+	// A track cut short by the time limit may decode further on another run,
+	// so don't keep it.
+	if (useCache && !(dstTrack.mDecodeLimitsHit & kDecodeLimit_WallTime))
+		g_trackCache.Store(cacheKey, dstTrack);
+
+	trackStats.mTimes = trackTimer.Lap();
+	trackStats.mDecodedSectors = (uint32_t)dstTrack.mSectors.size();
+	trackStats.mCounters = budget.GetCounterTotals();
+	g_stats.AddTrack(trackStats);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void process_track_fm(const RawTrack& rawTrack) {
+void process_track_fm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
 	if (rawTrack.mTransitions.size() < 2)
 		return;
 
@@ -137,6 +1548,10 @@ void process_track_fm(const RawTrack& rawTrack) {
 
 	//printf("%.2f samples per cell\n", scks_per_cell);
 
+	// bit-level tracing is for the PLL, so it forces the PLL path
+	if (g_synthesizedFlux && g_verbosity < 3 && process_track_fm_exact(rawTrack, dstTrack, budget, scks_per_cell))
+		return;
+
 	const uint32_t *samp = rawTrack.mTransitions.data();
 	size_t samps_left = rawTrack.mTransitions.size() - 1;
 	int time_basis = 0;
@@ -147,14 +1562,16 @@ void process_track_fm(const RawTrack& rawTrack) {
 	int cell_timer = 0;
 	int cell_fine_adjust = 0;
 
-	uint8_t shift_even = 0;
-	uint8_t shift_odd = 0;
+	uint16_t shifter = 0;
 
 	std::vector<SectorParser> sectorParsers;
 	uint8_t spew_data[16];
 	int spew_index = 0;
 	uint32_t spew_last_time = samp[0];
 
+	DecoderCounters& counters = budget.GetCounters();
+	const PhaseErrorBinner phaseErrors(cell_len);
+
 	for(;;) {
 		while (time_left <= 0) {
 			if (!samps_left)
@@ -162,8 +1579,7 @@ void process_track_fm(const RawTrack& rawTrack) {
 
 			int delta = samp[1] - samp[0];
 
-			if (g_verbosity >= 4)
-				printf(" %02X %02X | %3d | %d\n", shift_even, shift_odd, delta, samp[0]);
+			A8RC_LOG(4, " %02X %02X | %3d | %d\n", split_cells32(shifter) >> 16, split_cells32(shifter) & 0xFF, delta, samp[0]);
 
 			time_left += delta;
 			time_basis = samp[1];
@@ -174,35 +1590,33 @@ void process_track_fm(const RawTrack& rawTrack) {
 		//printf("next_trans = %d, cell_timer = %d, %d transitions left\n", time_left, cell_timer, samps_left);
 
 		// if the shift register is empty, restart shift timing at next transition
-		if (!(shift_even | shift_odd)) {
+		if (!shifter) {
 			time_left = 0;
 			cell_timer = cell_len;
-			shift_even = 0;
-			shift_odd = 1;
+			shifter = 1;
 		} else {
 			// compare time to next transition against cell length
 			int trans_delta = time_left - cell_timer;
 
 			if (trans_delta < -cell_range) {
-				if (g_verbosity >= 4)
-					printf(" %02X %02X | delta = %+3d | ignore\n", shift_even, shift_odd, trans_delta);
+				A8RC_LOG(4, " %02X %02X | delta = %+3d | ignore\n", split_cells32(shifter) >> 16, split_cells32(shifter) & 0xFF, trans_delta);
 				// ignore the transition
+				++counters.mTransitionsIgnored;
 				cell_timer -= time_left;
 				continue;
 			}
 
-			std::swap(shift_even, shift_odd);
-			shift_odd += shift_odd;
+			shifter += shifter;
 			
 			if (trans_delta <= cell_range) {
-				++shift_odd;
+				++shifter;
 
-				if (g_verbosity >= 4)
-					printf(" %02X %02X | delta = %+3d | 1\n", shift_even, shift_odd, trans_delta);
+				A8RC_LOG(4, " %02X %02X | delta = %+3d | 1\n", split_cells32(shifter) >> 16, split_cells32(shifter) & 0xFF, trans_delta);
 
 				// we have a transition in range -- clock in a 1 bit
 				cell_timer = cell_len;
 				time_left = 0;
+				phaseErrors.Add(counters, trans_delta);
 
 				// adjust clocking by phase error
 				if (trans_delta < -5)
@@ -218,8 +1632,7 @@ void process_track_fm(const RawTrack& rawTrack) {
 				else if (trans_delta > 5)
 					cell_timer += 3;
 			} else {
-				if (g_verbosity >= 4)
-					printf(" %02X %02X | delta = %+3d | 0\n", shift_even, shift_odd, trans_delta);
+				A8RC_LOG(4, " %02X %02X | delta = %+3d | 0\n", split_cells32(shifter) >> 16, split_cells32(shifter) & 0xFF, trans_delta);
 
 				// we don't have a transition in range -- clock in a 0 bit
 				time_left -= cell_timer;
@@ -227,10 +1640,10 @@ void process_track_fm(const RawTrack& rawTrack) {
 			}
 
 			if (g_verbosity >= 3) {
-				spew_data[spew_index] = shift_odd;
+				spew_data[spew_index] = (uint8_t)split_cells32(shifter);
 				if (++spew_index == 16) {
 					spew_index = 0;
-					printf("%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X | %.2f\n"
+					log_printf(3, "%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X | %.2f\n"
 						, spew_data[0]
 						, spew_data[1]
 						, spew_data[2]
@@ -256,57 +1669,45 @@ void process_track_fm(const RawTrack& rawTrack) {
 			
 			const uint32_t vsn_time = time_basis - time_left;
 			for(auto it = sectorParsers.begin(); it != sectorParsers.end();) {
-				if (it->Parse(vsn_time, shift_even, shift_odd))
+				if (it->Parse(vsn_time, shifter))
 					++it;
 				else
 					it = sectorParsers.erase(it);
 			}
 
-			if (shift_even == 0xC7 && shift_odd == 0xFE) {
-				sectorParsers.emplace_back();
-				sectorParsers.back().Init(rawTrack.mPhysTrack / g_trackStep, &rawTrack.mIndexTimes, (float)scks_per_cell, &g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack], vsn_time);
+			if (shifter == kFMIDAMCells) {
+				if (SectorParser *parser = budget.AddParser(sectorParsers))
+					parser->Init(rawTrack.mPhysTrack / g_trackStep, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
 			}
+
+			if (!budget.Tick())
+				goto done;
 		}
 	}
 
 done:
-	;
+	// the alternates are counted apart from the stock PLL
+	if (g_pllCount > 1 && !budget.IsOutOfTime()) {
+		const StatsPass stockPass = budget.GetPass();
+
+		budget.SetPass(kStatsPass_FMAltPLLs);
+		process_track_fm_alt_plls(rawTrack, dstTrack, budget, scks_per_cell);
+		budget.SetPass(stockPass);
+	}
 }
 
-void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300rpm) {
+void process_track_mfm(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget, bool decode_amiga, bool use_300rpm) {
 	if (rawTrack.mTransitions.size() < 2)
 		return;
 
 	const double cells_per_rev = 500000.0 / ((use_300rpm ? 300.0 : 288.0) / 60.0) * (g_high_density ? 2 : 1);
 	double scks_per_cell = rawTrack.mSamplesPerRev / cells_per_rev * g_clockPeriodAdjust;
 
-	auto transitions = rawTrack.mTransitions;
-
-	if(0){
-		size_t n = transitions.size();
-
-		if (n > 3) {
-			uint32_t t0 = transitions[0];
-			uint32_t t1 = transitions[1];
-
-//			int thresh = (int)(0.5 + 2.0 / cells_per_sample);
-			int thresh = (int)(0.5 + rawTrack.mSamplesPerRev / 90000.0 * (float)(400 - rawTrack.mPhysTrack) / 400.0f);
-
-			for(size_t i=2; i<n; ++i) {
-				uint32_t t2 = transitions[i];
-				int32_t t01 = (int32_t)(t1 - t0);
-				int32_t t12 = (int32_t)(t2 - t1);
-
-				int32_t delta1 = std::max<int>(0, thresh - t01) * 5 / 12;
-				int32_t delta2 = std::max<int>(0, thresh - t12) * 5 / 12;
-
-				transitions[i-1] = t1 - delta1 + delta2;
+	if (g_synthesizedFlux && g_verbosity < 3 && process_track_mfm_exact(rawTrack, dstTrack, budget, scks_per_cell, decode_amiga))
+		return;
 
-				t0 = t1;
-				t1 = t2;
-			}
-		}
-	}
+	// peak shift correction, if any, has already been applied by postcomp_disk()
+	const auto& transitions = rawTrack.mTransitions;
 
 	const uint32_t *samp = transitions.data();
 	size_t samps_left = transitions.size() - 1;
@@ -317,15 +1718,20 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 	int cell_range = cell_len / 2;
 	int cell_timer = 0;
 
-	uint8_t shift_even = 0;
-	uint8_t shift_odd = 0;
+	uint16_t shifter = 0;
 
 	std::vector<SectorParserMFM> sectorParsers;
-	std::vector<SectorParserMFMAmiga> amigaSectorParsers;
+	TrackDecoderMFMAmiga amigaTrack;
 	uint8_t spew_data[16];
 	int spew_index = 0;
 	uint32_t spew_last_time = samp[0];
 
+	if (decode_amiga)
+		init_amiga_track(amigaTrack, rawTrack, transitions, dstTrack, scks_per_cell);
+
+	DecoderCounters& counters = budget.GetCounters();
+	const PhaseErrorBinner phaseErrors(cell_len);
+
 	int state = 0;
 	for(;;) {
 		while (time_left <= 0) {
@@ -341,26 +1747,26 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 //		printf("next_trans = %d, cell_timer = %d, %d transitions left\n", time_left, cell_timer, samps_left);
 
 		// if the shift register is empty, restart shift timing at next transition
-		if (!(shift_even | shift_odd)) {
+		if (!shifter) {
 			time_left = 0;
 			cell_timer = cell_len;
-			shift_even = 0;
-			shift_odd = 1;
+			shifter = 1;
 		} else {
 			// compare time to next transition against cell length
 			int trans_delta = time_left - cell_timer;
 
 			if (trans_delta < -cell_range) {
 				// ignore the transition
+				++counters.mTransitionsIgnored;
 				cell_timer -= time_left;
 				continue;
 			}
 
-			std::swap(shift_even, shift_odd);
-			shift_odd += shift_odd;
+			shifter += shifter;
 			
 			if (trans_delta <= cell_range) {
 				cell_timer = cell_len;
+				phaseErrors.Add(counters, trans_delta);
 
 				// we have a transition in range -- clock in a 1 bit
 				if (trans_delta < -5)
@@ -376,7 +1782,7 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 				else if (trans_delta > 5)
 					cell_timer += 3;
 
-				shift_odd++;
+				++shifter;
 				time_left = 0;
 			} else {
 				// we don't have a transition in range -- clock in a 0 bit
@@ -385,10 +1791,10 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 			}
 
 			if (g_verbosity >= 3) {
-				spew_data[spew_index] = shift_odd;
+				spew_data[spew_index] = (uint8_t)split_cells32(shifter);
 				if (++spew_index == 16) {
 					spew_index = 0;
-					printf("%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X | %.2f\n"
+					log_printf(3, "%02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X | %.2f\n"
 						, spew_data[0]
 						, spew_data[1]
 						, spew_data[2]
@@ -414,20 +1820,21 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 
 			const uint32_t vsn_time = time_basis - time_left;
 
+			// Amiga tracks are decoded as a whole once the PLL is done.
 			if (decode_amiga) {
-				for(auto it = amigaSectorParsers.begin(); it != amigaSectorParsers.end();) {
-					if (it->Parse(vsn_time, shift_even, shift_odd))
-						++it;
-					else
-						it = amigaSectorParsers.erase(it);
-				}
-			} else {
-				for(auto it = sectorParsers.begin(); it != sectorParsers.end();) {
-					if (it->Parse(vsn_time, shift_even, shift_odd))
-						++it;
-					else
-						it = sectorParsers.erase(it);
-				}
+				amigaTrack.AddCell(vsn_time, shifter);
+
+				if (!budget.Tick())
+					goto done;
+
+				continue;
+			}
+
+			for(auto it = sectorParsers.begin(); it != sectorParsers.end();) {
+				if (it->Parse(vsn_time, shifter))
+					++it;
+				else
+					it = sectorParsers.erase(it);
 			}
 
 			// The IDAM is 0xA1 with a missing clock pulse:
@@ -436,72 +1843,44 @@ void process_track_mfm(const RawTrack& rawTrack, bool decode_amiga, bool use_300
 			// clock	1 1 1 1 1 1 1 1 0 0 0 0 1>0<1 0
 
 			if (state == 0) {
-				if (shift_even == 0x0A && shift_odd == 0xA1)
+				if (shifter == kMFMSyncCells)
 					++state;
 			} else if (state == 16) {
-				if (shift_even == 0x0A && shift_odd == 0xA1) {
+				if (shifter == kMFMSyncCells)
 					++state;
-
-					if (decode_amiga) {
-						amigaSectorParsers.emplace_back();
-						amigaSectorParsers.back().Init(rawTrack.mPhysTrack, rawTrack.mSide, &rawTrack.mIndexTimes, (float)scks_per_cell, &g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack], vsn_time);
-						state = 0;
-					}
-				} else
+				else
 					state = 0;
 			} else if (state == 32) {
-				if (shift_even == 0x0A && shift_odd == 0xA1) {
-					sectorParsers.emplace_back();
-					sectorParsers.back().Init(rawTrack.mPhysTrack / g_trackStep, rawTrack.mSide, &rawTrack.mIndexTimes, (float)scks_per_cell, &g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack], vsn_time);
+				if (shifter == kMFMSyncCells) {
+					if (SectorParserMFM *parser = budget.AddParser(sectorParsers))
+						parser->Init(rawTrack.mPhysTrack / g_trackStep, rawTrack.mSide, &rawTrack.mIndexTimes, (float)scks_per_cell, &dstTrack, vsn_time);
 				}
 
 				state = 0;
 			} else {
 				++state;
 			}
+
+			if (!budget.Tick())
+				goto done;
 		}
 	}
 
 done:
-	;
-}
-
-static const uint8_t kGCR6Decoder[256]={
-#define IL 255
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	if (decode_amiga)
+		decode_amiga_track(amigaTrack, budget);
 
-	// $90
-	IL,IL,IL,IL,IL,IL, 0, 1,IL,IL, 2, 3,IL, 4, 5, 6,
+	// the alternates are counted apart from the stock PLL
+	if (g_pllCount > 1 && !budget.IsOutOfTime()) {
+		const StatsPass stockPass = budget.GetPass();
 
-	// $A0
-	IL,IL,IL,IL,IL,IL, 7, 8,IL,IL, 8, 9,10,11,12,13,
-
-	// $B0
-	IL,IL,14,15,16,17,18,19,IL,20,21,22,23,24,25,26,
-
-	// $C0
-	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,27,IL,28,29,30,
-
-	// $D0
-	IL,IL,IL,31,IL,IL,32,33,IL,34,35,36,37,38,39,40,
-
-	// $E0
-	IL,IL,IL,IL,IL,41,42,43,IL,44,45,46,47,48,49,50,
-
-	// $F0
-	IL,IL,51,52,53,54,55,56,IL,57,58,59,60,61,62,63,
-#undef IL
-};
+		budget.SetPass(kStatsPass_MFMAltPLLs);
+		process_track_mfm_alt_plls(rawTrack, transitions, dstTrack, budget, scks_per_cell, decode_amiga);
+		budget.SetPass(stockPass);
+	}
+}
 
-void process_track_macgcr(const RawTrack& rawTrack) {
+void process_track_macgcr(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
 	double rpm = 590.0;
 
 	if (rawTrack.mPhysTrack < 16)
@@ -547,6 +1926,9 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 	uint32_t rot_start = 0;
 	uint32_t rot_end = 0;
 
+	DecoderCounters& counters = budget.GetCounters();
+	const PhaseErrorBinner phaseErrors(cell_len);
+
 	if (rawTrack.mTransitions.size() >= 2) {
 		for(;;) {
 			while (time_left <= 0) {
@@ -575,6 +1957,7 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 				if (trans_delta <= cell_range) {
 					cell_timer = cell_len;
 					time_left = 0;
+					phaseErrors.Add(counters, trans_delta);
 
 					// we have a transition in range -- clock in a 1 bit
 					if (trans_delta < -5)
@@ -597,6 +1980,9 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 					cell_timer = cell_len;
 				}
 
+				if (!budget.Tick())
+					goto done;
+
 				// advance bit machine state
 				if (bit_state == 0) {
 					if (shifter & 0x80) {
@@ -605,7 +1991,7 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 						if (g_verbosity >= 3) {
 							int t = time_basis - time_left;
 
-							printf("%02X (%.2f)\n", shifter, (float)(t - last_byte_time) / (scks_per_cell * 8));
+							log_printf(3, "%02X (%.2f)\n", shifter, (float)(t - last_byte_time) / (scks_per_cell * 8));
 							last_byte_time = t;
 						}
 
@@ -654,27 +2040,24 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 									int side = decbuf[2] & 0x20 ? 1 : 0;
 
 									if (track != rawTrack.mPhysTrack || side != rawTrack.mSide) {
-										printf("Ignoring sector header -- track %d, side %d, sector %d is on the wrong track.\n", track, side, sector);
+										A8RC_LOG(0, "Ignoring sector header -- track %d, side %d, sector %d is on the wrong track.\n", track, side, sector);
 										goto reject;
 									}
 
-									if (g_verbosity >= 2)
-										printf("Sector header %02X %02X %02X %02X %02X (checksum OK)\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3], decbuf[4]);
+									A8RC_LOG(2, "Sector header %02X %02X %02X %02X %02X (checksum OK)\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3], decbuf[4]);
 
 									// find the nearest index mark
 									int vsn_time = time_basis - time_left;
 									auto it_index = std::upper_bound(rawTrack.mIndexTimes.begin(), rawTrack.mIndexTimes.end(), (uint32_t)vsn_time + 1);
 
 									if (it_index == rawTrack.mIndexTimes.begin()) {
-										if (g_verbosity >= 2)
-											printf("Skipping track %d, sector %d before first index mark\n", rawTrack.mPhysTrack, decbuf[2]);
+										A8RC_LOG(2, "Skipping track %d, sector %d before first index mark\n", rawTrack.mPhysTrack, decbuf[2]);
 
 										goto reject;
 									}
 
 									if (it_index == rawTrack.mIndexTimes.end()) {
-										if (g_verbosity >= 2)
-											printf("Skipping track %d, sector %d after last index mark\n", rawTrack.mPhysTrack, decbuf[2]);
+										A8RC_LOG(2, "Skipping track %d, sector %d after last index mark\n", rawTrack.mPhysTrack, decbuf[2]);
 								
 										goto reject;
 									}
@@ -689,8 +2072,8 @@ void process_track_macgcr(const RawTrack& rawTrack) {
 									if (sector_position >= 1.0f)
 										sector_position -= 1.0f;
 								} else {
-									if (g_verbosity >= 2)
-										printf("Sector header %02X %02X %02X %02X %02X (checksum BAD)\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3], decbuf[4]);
+									A8RC_LOG(2, "Sector header %02X %02X %02X %02X %02X (checksum BAD)\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3], decbuf[4]);
+									++counters.mAddressCRCErrors;
 
 reject:
 									sector = -1;
@@ -707,84 +2090,30 @@ reject:
 									// check if sector is correct
 									int marked_sector = kGCR6Decoder[buf[0]];
 									if (marked_sector != sector) {
-										printf("Rejecting sector %d (expected sector %d)\n", marked_sector, sector);
+										A8RC_LOG(0, "Rejecting sector %d (expected sector %d)\n", marked_sector, sector);
 										break;
 									}
 
-									// decode first 522 of 524 data bytes
-									uint8_t checksumA = 0;
-									uint8_t checksumB = 0;
-									uint8_t checksumC = 0;
-									uint8_t carry = 0;
+									// decode all 524 bytes of the data field
 									uint32_t invalid = 0;
+									uint32_t computedChecksum = 0;
+									uint32_t recordedChecksum = 0;
 
-									for(int i=0; i<175; ++i) {
-										const uint8_t x0 = kGCR6Decoder[buf[i*4+0+1]];
-										const uint8_t x1 = kGCR6Decoder[buf[i*4+1+1]];
-										const uint8_t x2 = kGCR6Decoder[buf[i*4+2+1]];
-										const uint8_t x3 = kGCR6Decoder[buf[i*4+3+1]];
-
-										invalid += (x0 >> 7);
-										invalid += (x1 >> 7);
-										invalid += (x2 >> 7);
-										invalid += (x3 >> 7);
-
-										checksumC = (checksumC << 1) + (checksumC >> 7);
-
-										uint8_t y0 = x1 + ((x0 << 2) & 0xc0);
-										y0 ^= checksumC;
-
-										uint32_t tmpSumA = (uint32_t)checksumA + y0 + (checksumC & 1);
-										checksumA = (uint8_t)tmpSumA;
-										carry = (uint8_t)(tmpSumA >> 8);
-
-										uint8_t y1 = x2 + ((x0 << 4) & 0xc0);
-										y1 ^= checksumA;
+									gcr6_decode_mac_sector(decbuf, buf + 1, invalid, computedChecksum, recordedChecksum);
 
-										uint32_t tmpSumB = (uint32_t)checksumB + y1 + carry;
-										checksumB = (uint8_t)tmpSumB;
-										carry = (uint8_t)(tmpSumB >> 8);
+									if (invalid)
+										A8RC_LOG(2, "%u invalid GCR bytes encountered\n", invalid);
 
-										decbuf[i*3+0] = y0;
-										decbuf[i*3+1] = y1;
-
-										if (i<174) {		// @&*(@$
-											uint8_t y2 = x3 + ((x0 << 6) & 0xc0);
-											y2 ^= checksumB;
-
-											uint32_t tmpSumC = (uint32_t)checksumC + y2 + carry;
-											checksumC = (uint8_t)tmpSumC;
-											carry = (uint8_t)(tmpSumC >> 8);
-											decbuf[i*3+2] = y2;
-										}
-									}
-
-									const uint8_t z0 = kGCR6Decoder[buf[175*4+0]];
-									const uint8_t z1 = kGCR6Decoder[buf[175*4+1]];
-									const uint8_t z2 = kGCR6Decoder[buf[175*4+2]];
-									const uint8_t z3 = kGCR6Decoder[buf[175*4+3]];
-									invalid += (z0 >> 7);
-									invalid += (z1 >> 7);
-									invalid += (z2 >> 7);
-									invalid += (z3 >> 7);
-
-									uint8_t decCheckA = z1 + ((z0 << 2) & 0xc0);
-									uint8_t decCheckB = z2 + ((z0 << 4) & 0xc0);
-									uint8_t decCheckC = z3 + ((z0 << 6) & 0xc0);
-
-									if (invalid && g_verbosity >= 2)
-										printf("%u invalid GCR bytes encountered\n", invalid);
-
-									bool checksumOK = (checksumA == decCheckA && checksumB == decCheckB && checksumC == decCheckC);
+									bool checksumOK = (computedChecksum == recordedChecksum);
 
 									if (g_verbosity >= 2) {
-										printf("checksums: %02X %02X %02X vs. %02X %02X %02X (%s)\n"
-											, checksumA
-											, checksumB
-											, checksumC
-											, decCheckA
-											, decCheckB
-											, decCheckC
+										log_printf(2, "checksums: %02X %02X %02X vs. %02X %02X %02X (%s)\n"
+											, (computedChecksum >> 16) & 0xFF
+											, (computedChecksum >> 8) & 0xFF
+											, computedChecksum & 0xFF
+											, (recordedChecksum >> 16) & 0xFF
+											, (recordedChecksum >> 8) & 0xFF
+											, recordedChecksum & 0xFF
 											, checksumOK
 												? "good" : "BAD"
 											);
@@ -794,10 +2123,12 @@ reject:
 
 									if (checksumOK)
 										++good_sectors;
+									else
+										++counters.mDataCRCErrors;
 
 									int vsn_time = time_basis - time_left;
 
-									auto& tracksecs = g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack].mSectors;
+									auto& tracksecs = dstTrack.mSectors;
 									tracksecs.emplace_back();
 									SectorInfo& newsec = tracksecs.back();
 
@@ -812,19 +2143,18 @@ reject:
 									newsec.mAddressMark = 0;
 									newsec.mRecordedAddressCRC = 0;
 									newsec.mComputedAddressCRC = 0;
-									newsec.mRecordedCRC = ((uint32_t)checksumA << 16) + ((uint32_t)checksumB << 8) + (uint32_t)checksumC;
-									newsec.mComputedCRC = ((uint32_t)decCheckA << 16) + ((uint32_t)decCheckB << 8) + (uint32_t)decCheckC;
+									newsec.mRecordedCRC = computedChecksum;
+									newsec.mComputedCRC = recordedChecksum;
 									newsec.mSectorSize = 512;
 									newsec.mbMFM = false;
 									newsec.mWeakOffset = -1;
 
-									if (g_verbosity >= 1)
-										printf("Decoded Mac track %2d.%d, sector %2d [pos %.3f-%.3f]\n",
-											rawTrack.mPhysTrack,
-											rawTrack.mSide,
-											sector,
-											newsec.mPosition,
-											newsec.mEndingPosition);
+									A8RC_LOG(1, "Decoded Mac track %2d.%d, sector %2d [pos %.3f-%.3f]\n",
+										rawTrack.mPhysTrack,
+										rawTrack.mSide,
+										sector,
+										newsec.mPosition,
+										newsec.mEndingPosition);
 
 								} while(false);
 
@@ -846,25 +2176,270 @@ done:
 	;
 
 	if (g_verbosity > 0) {
-		printf("%d sector headers decoded\n", sector_headers);
-		printf("%d data sectors decoded\n", data_sectors);
-		printf("%d good sectors decoded\n", good_sectors);
+		log_printf(1, "%d sector headers decoded\n", sector_headers);
+		log_printf(1, "%d data sectors decoded\n", data_sectors);
+		log_printf(1, "%d good sectors decoded\n", good_sectors);
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////////
-void process_track_a2gcr(const RawTrack& rawTrack) {
+// Byte and sector decoder for Apple II GCR, fed a cell at a time by either
+// the PLL or the exact decoding path. Disk bytes are self-synchronizing: a
+// byte is taken as soon as the top bit of the register is set, and the next
+// seven cells are passed over while the following byte shifts in.
+class TrackDecoderA2GCR {
+public:
+	TrackDecoderA2GCR(const RawTrack& rawTrack, TrackInfo& dstTrack, DecoderCounters& counters);
+
+	// Add a cell with the byte register after it was shifted in.
+	void AddCell(uint32_t vsn_time, uint8_t shifter) {
+		if (mBitState) {
+			if (++mBitState == 8)
+				mBitState = 0;
+		} else if (shifter & 0x80) {
+			mBitState = 1;
+			AddByte(vsn_time, shifter);
+		}
+	}
+
+	// Resynchronize after the register has run dry and been restarted.
+	void Restart() { mBitState = 0; }
+
+	void LogSummary() const;
+
+private:
+	void AddByte(uint32_t vsn_time, uint8_t shifter);
+
+	const RawTrack& mRawTrack;
+	TrackInfo& mDstTrack;
+	DecoderCounters& mCounters;
+	const uint8_t mLogicalTrack;
+
+	int mBitState = 0;
+	int mByteState = 0;
+
+	int mSectorHeaders = 0;
+	int mDataSectors = 0;
+	int mGoodSectors = 0;
+
+	int mSectorIndex = -1;
+	float mSectorPosition = 0;
+	uint8_t mSectorVolume = 0;
+	uint32_t mRawStart = 0;
+	uint32_t mRotStart = 0;
+	uint32_t mRotEnd = 0;
+
+	uint8_t mBuf[704];
+};
+
+TrackDecoderA2GCR::TrackDecoderA2GCR(const RawTrack& rawTrack, TrackInfo& dstTrack, DecoderCounters& counters)
+	: mRawTrack(rawTrack)
+	, mDstTrack(dstTrack)
+	, mCounters(counters)
+	, mLogicalTrack((uint8_t)(rawTrack.mPhysTrack / g_trackStep))
+{
+}
+
+void TrackDecoderA2GCR::LogSummary() const {
+	if (g_verbosity > 0) {
+		log_printf(1, "%d sector headers decoded\n", mSectorHeaders);
+		log_printf(1, "%d data sectors decoded\n", mDataSectors);
+		log_printf(1, "%d good sectors decoded\n", mGoodSectors);
+	}
+}
+
+void TrackDecoderA2GCR::AddByte(uint32_t vsn_time, uint8_t shifter) {
+	uint8_t decbuf[4];
+
+	mDstTrack.mGCRData.push_back(shifter);
+
+	A8RC_LOG(2, "%4u  %02X\n", mByteState, shifter);
+
+	// okay, we have a byte... advance the byte state machine.
+	if (mByteState == 0) {			// waiting for FF
+		mRawStart = vsn_time;
+
+		if (shifter == 0xFF)
+			mByteState = 1;
+	} else if (mByteState == 1) {	// waiting for D5 in address/data mark
+		if (shifter == 0xD5)
+			mByteState = 2;
+		else if (shifter != 0xFF)
+			mByteState = 0;
+	} else if (mByteState == 2) {	// waiting for AA in address/data mark
+		if (shifter == 0xAA)
+			mByteState = 3;
+		else if (shifter == 0xFF)
+			mByteState = 1;
+		else
+			mByteState = 0;
+	} else if (mByteState == 3) {	// waiting for 96 for address mark or AD for data mark
+		if (shifter == 0x96)
+			mByteState = 10;
+		else if (shifter == 0xAD) {
+			if (mSectorIndex >= 0)
+				mByteState = 1000;
+			else
+				mByteState = 1;
+		} else if (shifter == 0xFF)
+			mByteState = 1;
+		else
+			mByteState = 0;
+	} else if (mByteState >= 10 && mByteState < 18) {
+		// found D5 AA 96 for address mark - read volume, track, sector, checksum
+		// in 4-4 encoding
+		mBuf[mByteState - 10] = shifter;
+
+		if (++mByteState == 18) {
+			uint8_t checksum = 0;
+
+			for(int i=0; i<4; ++i) {
+				decbuf[i] = (mBuf[i*2] & 0x55)*2 + (mBuf[i*2+1] & 0x55);
+				checksum ^= decbuf[i];
+			}
+
+			mByteState = 0;
+			if (!checksum) {
+				// toss it if it's the wrong track number
+				if (decbuf[1] != mLogicalTrack)
+					return;
+
+				A8RC_LOG(1, "Sector header %02X %02X %02X %02X\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3]);
+
+				// find the nearest index mark
+				const auto& indexTimes = mRawTrack.mIndexTimes;
+				auto it_index = std::upper_bound(indexTimes.begin(), indexTimes.end(), vsn_time + 1);
+
+				if (it_index == indexTimes.begin()) {
+					A8RC_LOG(2, "Skipping track %d, sector %d before first index mark\n", mLogicalTrack, decbuf[2]);
+
+					return;
+				}
+
+				if (it_index == indexTimes.end()) {
+					A8RC_LOG(2, "Skipping track %d, sector %d after last index mark\n", mLogicalTrack, decbuf[2]);
+				
+					return;
+				}
+
+				int vsn_offset = vsn_time - *--it_index;
+
+				mRotStart = it_index[0];
+				mRotEnd = it_index[1];
+
+				mSectorPosition = (float)vsn_offset / (float)(it_index[1] - it_index[0]);
+
+				if (mSectorPosition >= 1.0f)
+					mSectorPosition -= 1.0f;
+
+				mSectorVolume = decbuf[0];
+				mSectorIndex = decbuf[2];
+				++mSectorHeaders;
+			} else {
+				++mCounters.mAddressCRCErrors;
+			}
+		}
+	} else if (mByteState >= 1000 && mByteState < 1343) {
+		mBuf[mByteState - 1000] = shifter;
+
+		if (++mByteState == 1343) {
+			uint32_t invalid = 0;
+			uint8_t decdata[256];
+			const uint8_t chksum = gcr6_decode_a2_sector(decdata, mBuf, invalid, g_invertBit7);
+
+			if (invalid)
+				A8RC_LOG(0, "%u invalid GCR bytes encountered\n", invalid);
+
+			bool checksumOK = !chksum;
+
+			if (!checksumOK)
+				A8RC_LOG(1, "(%d) Checksum mismatch! %02X\n", mSectorIndex, chksum);
+
+			++mDataSectors;
+
+			if (checksumOK)
+				++mGoodSectors;
+			else
+				++mCounters.mDataCRCErrors;
+
+			auto& secs = mDstTrack.mSectors;
+			secs.emplace_back();
+			auto& sector = secs.back();
+
+			sector.mbMFM = false;
+			sector.mAddressMark = mSectorVolume;
+			sector.mComputedAddressCRC = 0;
+			sector.mRecordedAddressCRC = 0;
+			sector.mComputedCRC = 0;
+			sector.mRecordedCRC = chksum;
+			sector.mSectorSize = 256;
+			sector.mWeakOffset = -1;
+			sector.mIndex = mSectorIndex;
+			sector.mRawStart = mRawStart;
+			sector.mRawEnd = vsn_time;
+			sector.mPosition = mSectorPosition;
+			sector.mEndingPosition = (float)(vsn_time - mRotStart) / (float)(mRotEnd - mRotStart);
+			sector.mEndingPosition -= floorf(sector.mEndingPosition);
+
+			// Apple II sector data uses 6-and-2 encoding to encode 256 data bytes as 342 GCR
+			// bytes, plus an additional checksum byte; see gcr6_decode_a2_sector().
+			memcpy(sector.mData, decdata, 256);
+
+			mByteState = 1;
+			mSectorIndex = -1;
+		}
+	}
+}
+
+bool process_track_a2gcr_exact(const RawTrack& rawTrack, TrackDecoderA2GCR& decoder, DecodeBudget& budget, double scks_per_cell) {
+	std::vector<uint8_t> cellCounts;
+	if (!ExactFluxQuantizer(scks_per_cell).Quantize(rawTrack.mTransitions, cellCounts))
+		return false;
+
+	count_exact_phase_errors(rawTrack.mTransitions, cellCounts, scks_per_cell, budget.GetCounters());
+
+	ExactCellStream<uint8_t> stream;
+	expand_exact_flux(rawTrack.mTransitions, cellCounts, stream);
+
+	const size_t n = stream.mShifters.size();
+
+	for(size_t i = 0; i < n; ++i) {
+		if (!budget.Tick())
+			break;
+
+		const uint8_t shifter = stream.mShifters[i];
+
+		decoder.AddCell(stream.mTimes[i], shifter);
+
+		if (!shifter)
+			decoder.Restart();
+	}
+
+	return true;
+}
+
+void process_track_a2gcr(const RawTrack& rawTrack, TrackInfo& dstTrack, DecodeBudget& budget) {
 	double rpm = 300.0;
 
 	const double cells_per_rev = 250000.0 / (rpm / 60.0);
 	double scks_per_cell = rawTrack.mSamplesPerRev / cells_per_rev * g_clockPeriodAdjust;
 
-	const uint8_t logical_track = rawTrack.mPhysTrack / g_trackStep;
-	auto& decTrack = g_disk.mPhysTracks[rawTrack.mSide][rawTrack.mPhysTrack];
-	
 	if (rawTrack.mTransitions.size() < 2)
 		return;
 
+	// Size the raw GCR byte capture for the whole stream up front; there is
+	// roughly one disk byte per 8 cells.
+	const double stream_cells = (double)(rawTrack.mTransitions.back() - rawTrack.mTransitions.front()) / scks_per_cell;
+	dstTrack.mGCRData.reserve(dstTrack.mGCRData.size() + (size_t)(stream_cells / 8.0) + 16);
+
+	DecoderCounters& counters = budget.GetCounters();
+	TrackDecoderA2GCR decoder(rawTrack, dstTrack, counters);
+
+	if (g_synthesizedFlux && g_verbosity < 3 && process_track_a2gcr_exact(rawTrack, decoder, budget, scks_per_cell)) {
+		decoder.LogSummary();
+		return;
+	}
+
 	const uint32_t *samp = rawTrack.mTransitions.data();
 	size_t samps_left = rawTrack.mTransitions.size() - 1;
 	int time_left = 0;
@@ -876,22 +2451,7 @@ void process_track_a2gcr(const RawTrack& rawTrack) {
 
 	uint8_t shifter = 0;
 
-	int bit_state = 0;
-	int byte_state = 0;
-
-	int sector_headers = 0;
-	int data_sectors = 0;
-	int good_sectors = 0;
-
-	int sector_index = -1;
-	float sector_position = 0;
-	uint8_t sector_volume = 0;
-	uint32_t raw_start = 0;
-	uint32_t rot_start = 0;
-	uint32_t rot_end = 0;
-
-	uint8_t buf[704];
-	uint8_t decbuf[528];
+	const PhaseErrorBinner phaseErrors(cell_len);
 
 	for(;;) {
 		while (time_left <= 0) {
@@ -910,7 +2470,7 @@ void process_track_a2gcr(const RawTrack& rawTrack) {
 			time_left = 0;
 			cell_timer = cell_len;
 			shifter = 1;
-			bit_state = 0;
+			decoder.Restart();
 		} else {
 			// compare time to next transition against cell length
 			int trans_delta = time_left - cell_timer;
@@ -927,6 +2487,7 @@ void process_track_a2gcr(const RawTrack& rawTrack) {
 			if (trans_delta <= cell_range) {
 				cell_timer = cell_len - trans_delta/3;
 				time_left = 0;
+				phaseErrors.Add(counters, trans_delta);
 
 				shifter++;
 			} else {
@@ -935,199 +2496,23 @@ void process_track_a2gcr(const RawTrack& rawTrack) {
 				cell_timer = cell_len;
 			}
 
-			// advance bit machine state
-			if (bit_state == 0) {
-				if (shifter & 0x80) {
-					bit_state = 1;
-
-					decTrack.mGCRData.push_back(shifter);
-
-					if (g_verbosity >= 2)
-						printf("%4u  %02X\n", byte_state, shifter);
-
-					// okay, we have a byte... advance the byte state machine.
-					if (byte_state == 0) {			// waiting for FF
-						raw_start = time_basis - time_left;
-
-						if (shifter == 0xFF)
-							byte_state = 1;
-					} else if (byte_state == 1) {	// waiting for D5 in address/data mark
-						if (shifter == 0xD5)
-							byte_state = 2;
-						else if (shifter != 0xFF)
-							byte_state = 0;
-					} else if (byte_state == 2) {	// waiting for AA in address/data mark
-						if (shifter == 0xAA)
-							byte_state = 3;
-						else if (shifter == 0xFF)
-							byte_state = 1;
-						else
-							byte_state = 0;
-					} else if (byte_state == 3) {	// waiting for 96 for address mark or AD for data mark
-						if (shifter == 0x96)
-							byte_state = 10;
-						else if (shifter == 0xAD) {
-							if (sector_index >= 0)
-								byte_state = 1000;
-							else
-								byte_state = 1;
-						} else if (shifter == 0xFF)
-							byte_state = 1;
-						else
-							byte_state = 0;
-					} else if (byte_state >= 10 && byte_state < 18) {
-						// found D5 AA 96 for address mark - read volume, track, sector, checksum
-						// in 4-4 encoding
-						buf[byte_state - 10] = shifter;
-
-						if (++byte_state == 18) {
-							uint8_t checksum = 0;
-
-							for(int i=0; i<4; ++i) {
-								decbuf[i] = (buf[i*2] & 0x55)*2 + (buf[i*2+1] & 0x55);
-								checksum ^= decbuf[i];
-							}
-
-							byte_state = 0;
-							if (!checksum) {
-								// toss it if it's the wrong track number
-								if (decbuf[1] != logical_track)
-									continue;
-
-								if (g_verbosity >= 1)
-									printf("Sector header %02X %02X %02X %02X\n", decbuf[0], decbuf[1], decbuf[2], decbuf[3]);
-
-								// find the nearest index mark
-								int vsn_time = time_basis - time_left;
-								auto it_index = std::upper_bound(rawTrack.mIndexTimes.begin(), rawTrack.mIndexTimes.end(), (uint32_t)vsn_time + 1);
-
-								if (it_index == rawTrack.mIndexTimes.begin()) {
-									if (g_verbosity >= 2)
-										printf("Skipping track %d, sector %d before first index mark\n", logical_track, decbuf[2]);
-
-									continue;
-								}
-
-								if (it_index == rawTrack.mIndexTimes.end()) {
-									if (g_verbosity >= 2)
-										printf("Skipping track %d, sector %d after last index mark\n", logical_track, decbuf[2]);
-								
-									continue;
-								}
-
-								int vsn_offset = vsn_time - *--it_index;
-
-								rot_start = it_index[0];
-								rot_end = it_index[1];
-
-								sector_position = (float)vsn_offset / (float)(it_index[1] - it_index[0]);
-
-								if (sector_position >= 1.0f)
-									sector_position -= 1.0f;
-
-								sector_volume = decbuf[0];
-								sector_index = decbuf[2];
-								++sector_headers;
-							}
-						}
-					} else if (byte_state >= 1000 && byte_state < 1343) {
-						buf[byte_state - 1000] = shifter;
-
-						if (++byte_state == 1343) {
-							int vsn_time = time_basis - time_left;
-							uint8_t chksum = 0;
-							uint32_t invalid = 0;
-
-							for(int i=0; i<343; ++i) {
-								const uint8_t z0 = kGCR6Decoder[buf[i]];
-								invalid += (z0 >> 7);
-								chksum ^= z0;
-
-								decbuf[i] = chksum & 0x3f;
-							}
-
-							if (invalid)
-								printf("%u invalid GCR bytes encountered\n", invalid);
-
-							bool checksumOK = !chksum;
-
-							if (!checksumOK && g_verbosity >= 1) {
-								printf("(%d) Checksum mismatch! %02X\n", sector_index, chksum);
-							}
-
-							++data_sectors;
-
-							if (checksumOK)
-								++good_sectors;
-
-							auto& secs = decTrack.mSectors;
-							secs.emplace_back();
-							auto& sector = secs.back();
-
-							sector.mbMFM = false;
-							sector.mAddressMark = sector_volume;
-							sector.mComputedAddressCRC = 0;
-							sector.mRecordedAddressCRC = 0;
-							sector.mComputedCRC = 0;
-							sector.mRecordedCRC = chksum;
-							sector.mSectorSize = 256;
-							sector.mWeakOffset = -1;
-							sector.mIndex = sector_index;
-							sector.mRawStart = raw_start;
-							sector.mRawEnd = vsn_time;
-							sector.mPosition = sector_position;
-							sector.mEndingPosition = (float)(vsn_time - rot_start) / (float)(rot_end - rot_start);
-							sector.mEndingPosition -= floorf(sector.mEndingPosition);
-
-							// Decode the sector data.
-							//
-							// Apple II sector data uses 6-and-2 encoding to encode 256 data bytes as 342 GCR
-							// bytes, plus an additional checksum byte. Decoding first involves an adjacent-XOR
-							// step as part of the checksum pass (already done above). Next, the two bits from
-							// the fragments are combined with 6 bits from the data payload.
-
-							const uint8_t invert = g_invertBit7 ? 0x80 : 0x00;
-							for(int i=0; i<256; ++i) {
-								uint8_t c = decbuf[i + 86] << 2;
-								uint8_t d;
-
-								if (i >= 172)
-									d = (decbuf[i - 172] >> 4) & 0x03;
-								else if (i >= 86)
-									d = (decbuf[i - 86] >> 2) & 0x03;
-								else
-									d = (decbuf[i] >> 0) & 0x03;
-
-								sector.mData[i] = (c + ((d & 2) >> 1) + ((d & 1) << 1)) ^ invert;
-							}
-
-							byte_state = 1;
-							sector_index = -1;
-						}
-					}
-				}
-			} else {
-				++bit_state;
+			if (!budget.Tick())
+				goto done;
 
-				if (bit_state == 8)
-					bit_state = 0;
-			}
+			decoder.AddCell(time_basis - time_left, shifter);
 		}
 	}
 
 done:
-	;
-
-	if (g_verbosity > 0) {
-		printf("%d sector headers decoded\n", sector_headers);
-		printf("%d data sectors decoded\n", data_sectors);
-		printf("%d good sectors decoded\n", good_sectors);
-	}
+	decoder.LogSummary();
 }
 
 ///////////////////////////////////////////////////////////////////////////
 
 void banner() {
+	if (g_quiet)
+		return;
+
 	puts("A8 raw disk conversion utility v" A8RC_VERSION);
 	puts("Copyright (C) 2014-2023 Avery Lee, All Rights Reserved.");
 	puts("Licensed under GNU General Public License, version 2 or later.");
@@ -1135,7 +2520,10 @@ void banner() {
 }
 
 void exit_usage() {
-	puts(R"--(Usage: a8rawconv [options] input output
+	puts(R"--(Usage: a8rawconv [options] input output [-o output...]
+
+Use - as the input or output path to read from stdin or write to stdout
+(single-file formats only; -if/-of must be given). Messages then go to stderr.
 	
 Options:
     -analyze  Analyze flux timing
@@ -1148,6 +2536,8 @@ Options:
             apple2     Calibrate for 300 RPM, 4us bit cell
             mac        Calibrate for variable speed, 2us bit cell
     -b    Dump detailed contents of bad sectors
+    -cache  Cache decoded tracks, skipping unchanged tracks on later runs
+            -cache dir Store cached tracks in directory dir
     -d    Decoding mode
             auto       Try both FM and MFM
             fm         Atari FM only (288 RPM single density)
@@ -1175,7 +2565,7 @@ Options:
             atr        Read as Atari ATR disk image
             atx        Read as Atari ATX disk image
             xfd        Read as Atari XFD disk image
-            kryoflux   Read as KryoFlux raw stream (specify track00.0.raw)
+            kryoflux   Read as KryoFlux raw stream (specify track00.0.raw, or a .zip of them)
             scp        Read as SuperCard Pro image
             scp-ss40   Read as SuperCard Pro image, forcing single-sided, 40-track layout
             scp-ds40   Read as SuperCard Pro image, forcing double-sided, 40-track layout
@@ -1184,9 +2574,20 @@ Options:
             do         Read Apple II DOS 3.3 format (.do/.dsk)
             vfd        Read as PC virtual floppy image (.vfd/.flp)
             adf        Read Amiga image format
+            a8f        Read as a8rawconv compressed flux image
     -I    Invert decoded Apple II GCR data
+    -j    Set number of decoding threads (default: one per CPU)
+            -j 1       Decode on the main thread only
     -l    Show track/sector layout map
-    -of   Set output format:
+    -maxparsers  Limit live sector parsers per track (oldest are dropped first)
+            -maxparsers 64   Keep at most 64 parsers active (default: no limit)
+    -maxspawns   Limit sector parsers started per track
+            -maxspawns 4096  Stop looking for new sectors after 4096 address marks
+    -maxtime     Limit decoding time per track, in milliseconds
+            -maxtime 2000    Give up on a track after two seconds
+    -o    Write an additional output image from the same decode
+            -o disk.atr      Also write disk.atr
+    -of   Set output format (for the next -o switch if there is one, else the output):
             auto       Determine by output name extension
             atr        Write Atari ATR disk image format
             atx        Write Atari ATX disk image format
@@ -1201,18 +2602,31 @@ Options:
             macdsk     Write Macintosh 400/800K DSK image format
             adf        Write Amiga image format
             vfd        Write as PC virtual floppy image (.vfd/.flp)
+            a8f        Write as a8rawconv compressed flux image
     -p    Adjust clock period by percentage (50-200)
             -p 98      Use 98% of normal period (2% fast)
             -p 102     Use 102% of normal period (2% slow)
+    -pll  Number of PLL configurations to run over FM/MFM tracks (1-8)
+            -pll 4     Try the stock PLL and 3 alternates
+            The alternates run together in one extra pass over the flux
     -P    Set post-compensation mode (raw disks only)
             none       No post-compensation; do not adjust flux
             auto       Auto-select post-comp mode based on formats
             mac800k    Apply post-comp for Macintosh 800K disk
+            mfm        Apply post-comp for MFM disk (PC/Atari/Amiga; experimental)
+            fm         Apply post-comp for FM disk (experimental)
+    -q    Quiet: suppress console output other than errors
     -r    Decode backwards (used for flipped tracks)
+    -report Write a JSON report of the decoded tracks and sectors
+            -report out.json   Write report to out.json ("-" for stdout)
     -revs Revolutions to use when imaging from SuperCard Pro
             -revs 2    Image 2 revolutions per track
             -revs 5    Image 5 revolutions per track (default, max)
     -S    Use splice mode when reading/writing directly to SCP device
+    -stats Print time, memory use and throughput for each stage and decoded track,
+            and PLL and sector parser counters for each track
+            (also added to the -report file)
+    -sync Flush output images to disk before replacing the output file
     -t    Restrict processing to single track
             -t 4       Process only track 4
     -tpi  Override track density for Kryoflux stream image sets
@@ -1238,6 +2652,74 @@ void exit_argerr() {
 	exit(1);
 }
 
+// Locate the track and side numbers in a KryoFlux stream filename, which must
+// be for the first track (track00.0.raw).
+bool parse_kf_stream_pattern(const char *fn) {
+	g_inputPathSidePos = 0;
+	g_inputPathSideWidth = 0;
+	g_inputPathCountPos = 0;
+	g_inputPathCountWidth = 0;
+
+	const char *s = strrchr(fn, '.');
+
+	if (s) {
+		while(s != fn && s[-1] >= '0' && s[-1] <= '9') {
+			--s;
+			++g_inputPathSideWidth;
+		}
+		g_inputPathSidePos = (int)(s - fn);
+		
+		if (s != fn && s[-1] == '.') {
+			--s;
+
+			while(s != fn && s[-1] == '0') {
+				++g_inputPathCountWidth;
+				--s;
+			}
+
+			if (s != fn && (s[-1] < '0' || s[-1] > '9'))
+				g_inputPathCountPos = (int)(s - fn);
+		}
+	}
+
+	if (!g_inputPathCountPos || !g_inputPathCountWidth || g_inputPathCountWidth > 10 || !g_inputPathSideWidth || g_inputPathSideWidth > 4)
+		return false;
+
+	g_inputPathSideBase = atoi(std::string(&fn[g_inputPathSidePos], g_inputPathSideWidth).c_str());
+	return true;
+}
+
+void get_default_layout(OutputFormat format, int& trackCount, int& trackStep, int& sides) {
+	switch(format) {
+		case kOutputFormat_AppleII_DO:
+		case kOutputFormat_AppleII_PO:
+		case kOutputFormat_AppleII_NIB:
+			trackCount = 35;
+			break;
+
+		case kOutputFormat_Mac_DSK:
+			trackCount = 80;
+			trackStep = 1;
+			sides = 2;
+			break;
+
+		case kOutputFormat_PC_VFD:
+			trackCount = 80;
+			trackStep = 1;
+			sides = 2;
+			break;
+
+		case kOutputFormat_Amiga_ADF:
+			trackCount = 80;
+			trackStep = 1;
+			sides = 2;
+			break;
+
+		default:
+			break;
+	}
+}
+
 void parse_args(int argc, char **argv) {
 	bool allow_switches = true;
 
@@ -1257,7 +2739,7 @@ void parse_args(int argc, char **argv) {
 	while(argc--) {
 		const char *arg = *argv++;
 
-		if (allow_switches && *arg == '-') {
+		if (allow_switches && arg[0] == '-' && arg[1]) {
 			const char *sw = arg+1;
 
 			if (!strcmp(sw, "-")) {
@@ -1293,6 +2775,13 @@ void parse_args(int argc, char **argv) {
 				}
 			} else if (!strcmp(sw, "b")) {
 				g_dumpBadSectors = true;
+			} else if (!strcmp(sw, "cache")) {
+				if (!argc--) {
+					printf("Missing argument for -cache switch.\n");
+					exit_argerr();
+				}
+
+				g_trackCachePath = *argv++;
 			} else if (!strcmp(sw, "l")) {
 				g_showLayout = true;
 			} else if (!strcmp(sw, "d")) {
@@ -1418,8 +2907,12 @@ void parse_args(int argc, char **argv) {
 					g_inputFormat = kInputFormat_AppleII_NIB;
 				else if (!strcmp(arg, "vfd"))
 					g_inputFormat = kInputFormat_PC_VFD;
+				else if (!strcmp(arg, "adf"))
+					g_inputFormat = kInputFormat_Amiga_ADF;
 				else if (!strcmp(arg, "diskscript"))
 					g_inputFormat = kInputFormat_DiskScript;
+				else if (!strcmp(arg, "a8f"))
+					g_inputFormat = kInputFormat_A8F;
 				else {
 					printf("Unsupported input format type: %s.\n", arg);
 					exit_argerr();
@@ -1457,12 +2950,31 @@ void parse_args(int argc, char **argv) {
 					g_outputFormat = kOutputFormat_Mac_DSK;
 				else if (!strcmp(arg, "vfd"))
 					g_outputFormat = kOutputFormat_PC_VFD;
+				else if (!strcmp(arg, "adf"))
+					g_outputFormat = kOutputFormat_Amiga_ADF;
 				else if (!strcmp(arg, "nib"))
 					g_outputFormat = kOutputFormat_AppleII_NIB;
+				else if (!strcmp(arg, "a8f"))
+					g_outputFormat = kOutputFormat_A8F;
 				else {
 					printf("Unsupported output format type: %s.\n", arg);
 					exit_argerr();
 				}
+			} else if (!strcmp(sw, "o")) {
+				if (!argc--) {
+					printf("Missing argument for -o switch.\n");
+					exit_argerr();
+				}
+
+				arg = *argv++;
+				if (!*arg) {
+					printf("Invalid output path.\n");
+					exit_argerr();
+				}
+
+				// -of applies to the next output path given
+				g_outputs.push_back(OutputTarget { arg, g_outputFormat });
+				g_outputFormat = kOutputFormat_Auto;
 			} else if (!strcmp(sw, "p")) {
 				if (!argc--) {
 					printf("Missing argument for -p switch.\n");
@@ -1481,6 +2993,23 @@ void parse_args(int argc, char **argv) {
 				}
 
 				g_clockPeriodAdjust = period / 100.0f;
+			} else if (!strcmp(sw, "pll")) {
+				if (!argc--) {
+					printf("Missing argument for -pll switch.\n");
+					exit_argerr();
+				}
+
+				arg = *argv++;
+
+				char dummy;
+				unsigned plls;
+				if (1 != sscanf(arg, "%u%c", &plls, &dummy) || plls < 1 || plls > kMaxPLLs)
+				{
+					printf("Invalid PLL count: %s\n", arg);
+					exit_argerr();
+				}
+
+				g_pllCount = (int)plls;
 			} else if (!strcmp(sw, "P")) {
 				if (!argc--) {
 					printf("Missing argument for -P switch.\n");
@@ -1495,6 +3024,10 @@ void parse_args(int argc, char **argv) {
 					g_postcomp = kPostComp_Auto;
 				else if (!strcmp(arg, "mac800k"))
 					g_postcomp = kPostComp_Mac800K;
+				else if (!strcmp(arg, "mfm"))
+					g_postcomp = kPostComp_MFM;
+				else if (!strcmp(arg, "fm"))
+					g_postcomp = kPostComp_FM;
 				else {
 					printf("Unsupported post-compensation type: %s.\n", arg);
 					exit_argerr();
@@ -1509,6 +3042,19 @@ void parse_args(int argc, char **argv) {
 				g_verbosity = 4;
 			} else if (!strcmp(sw, "r")) {
 				g_reverseTracks = true;
+			} else if (!strcmp(sw, "report")) {
+				if (!argc--) {
+					printf("Missing argument for -report switch.\n");
+					exit_argerr();
+				}
+
+				g_reportPath = *argv++;
+			} else if (!strcmp(sw, "q")) {
+				g_quiet = true;
+			} else if (!strcmp(sw, "stats")) {
+				g_stats.Enable();
+			} else if (!strcmp(sw, "sync")) {
+				g_syncOutput = true;
 			} else if (!strcmp(sw, "revs")) {
 				if (!argc--) {
 					printf("Missing argument for -revs switch.\n");
@@ -1526,6 +3072,45 @@ void parse_args(int argc, char **argv) {
 				}
 
 				g_revs = revs;
+			} else if (!strcmp(sw, "maxparsers") || !strcmp(sw, "maxspawns") || !strcmp(sw, "maxtime")) {
+				if (!argc--) {
+					printf("Missing argument for -%s switch.\n", sw);
+					exit_argerr();
+				}
+
+				arg = *argv++;
+
+				char dummy;
+				unsigned limit;
+				if (1 != sscanf(arg, "%u%c", &limit, &dummy))
+				{
+					printf("Invalid limit for -%s switch: %s\n", sw, arg);
+					exit_argerr();
+				}
+
+				if (!strcmp(sw, "maxparsers"))
+					g_maxLiveParsers = limit;
+				else if (!strcmp(sw, "maxspawns"))
+					g_maxParserSpawns = limit;
+				else
+					g_maxTrackDecodeTime = limit;
+			} else if (!strcmp(sw, "j")) {
+				if (!argc--) {
+					printf("Missing argument for -j switch.\n");
+					exit_argerr();
+				}
+
+				arg = *argv++;
+
+				char dummy;
+				unsigned threads;
+				if (1 != sscanf(arg, "%u%c", &threads, &dummy) || threads < 1 || threads > 256)
+				{
+					printf("Invalid thread count: %s\n", arg);
+					exit_argerr();
+				}
+
+				g_threadCount = (int)threads;
 			} else if (!strcmp(sw, "t")) {
 				if (!argc--) {
 					printf("Missing argument for -t switch.\n");
@@ -1596,11 +3181,43 @@ void parse_args(int argc, char **argv) {
 		exit_argerr();
 	}
 
-	if (g_outputPath.empty() && !g_analyze) {
+	if (!g_outputPath.empty())
+		g_outputs.insert(g_outputs.begin(), OutputTarget { g_outputPath, g_outputFormat });
+	else if (g_outputFormat != kOutputFormat_Auto) {
+		printf("Output format specified without an output path. Use -of before the -o switch it applies to.\n");
+		exit_argerr();
+	}
+
+	if (g_outputs.empty() && !g_analyze) {
 		printf("Missing output path.\n");
 		exit_argerr();
 	}
 
+	for(size_t i=0; i<g_outputs.size(); ++i) {
+		for(size_t j=0; j<i; ++j) {
+			if (g_outputs[i].mPath == g_outputs[j].mPath) {
+				printf("Output path specified more than once: %s\n", g_outputs[i].mPath.c_str());
+				exit_argerr();
+			}
+		}
+	}
+
+	// The report would otherwise be appended to the image, or overwrite it,
+	// when the two paths are the same -- notably both - for standard output.
+	if (!g_reportPath.empty()) {
+		for(const OutputTarget& output : g_outputs) {
+			if (output.mPath == g_reportPath) {
+				printf("Report path is the same as an output path: %s\n", g_reportPath.c_str());
+				exit_argerr();
+			}
+		}
+
+		if (g_reportPath == g_inputPath && g_reportPath != "-") {
+			printf("Report path is the same as the input path: %s\n", g_reportPath.c_str());
+			exit_argerr();
+		}
+	}
+
 	if (g_inputFormat == kInputFormat_Auto) {
 		if (g_inputPath.compare(0, 5, "scp0:") == 0
 			|| g_inputPath.compare(0, 5, "scp1:") == 0)
@@ -1614,7 +3231,7 @@ void parse_args(int argc, char **argv) {
 
 				std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return tolower((unsigned char)c); });
 
-				if (ext == "raw")
+				if (ext == "raw" || ext == "zip")
 					g_inputFormat = kInputFormat_KryoFluxStream;
 				else if (ext == "scp")
 					g_inputFormat = kInputFormat_SCP_Auto;
@@ -1638,6 +3255,8 @@ void parse_args(int argc, char **argv) {
 					g_inputFormat = kInputFormat_Amiga_ADF;
 				else if (ext == "diskscript")
 					g_inputFormat = kInputFormat_DiskScript;
+				else if (ext == "a8f")
+					g_inputFormat = kInputFormat_A8F;
 			}
 		}
 
@@ -1648,47 +3267,69 @@ void parse_args(int argc, char **argv) {
 	}
 
 	if (g_inputFormat == kInputFormat_KryoFluxStream) {
-		// attempt to identify track counter in KryoFlux stream filename
-		const char *fn = g_inputPath.c_str();
-		const char *s = strrchr(fn, '.');
+		const char *extptr = strrchr(g_inputPath.c_str(), '.');
+		std::string ext(extptr ? extptr : "");
 
-		if (s) {
-			g_inputPathSideWidth = 0;
-			while(s != fn && s[-1] >= '0' && s[-1] <= '9') {
-				--s;
-				++g_inputPathSideWidth;
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return tolower((unsigned char)c); });
+
+		if (ext == ".zip") {
+			// use the first stream in the archive that fits the pattern
+			g_inputArchive.reset(new ZipArchive);
+			g_inputArchive->Open(g_inputPath.c_str());
+
+			const ZipArchive& archive = *g_inputArchive;
+
+			std::vector<std::string> names;
+			for(size_t i=0; i<archive.GetEntryCount(); ++i) {
+				const std::string& name = archive.GetEntryName(i);
+
+				// skip Mac OS resource fork entries
+				if (name.compare(0, 9, "__MACOSX/") == 0)
+					continue;
+
+				if (name.size() <= 4)
+					continue;
+
+				std::string entryExt(name, name.size() - 4);
+				std::transform(entryExt.begin(), entryExt.end(), entryExt.begin(), [](char c) { return tolower((unsigned char)c); });
+
+				if (entryExt == ".raw")
+					names.push_back(name);
 			}
-			g_inputPathSidePos = (int)(s - fn);
-			
-			if (s != fn && s[-1] == '.') {
-				--s;
 
-				g_inputPathCountWidth = 0;
-				while(s != fn && s[-1] == '0') {
-					++g_inputPathCountWidth;
-					--s;
+			std::sort(names.begin(), names.end());
+
+			for(const std::string& name : names) {
+				if (parse_kf_stream_pattern(name.c_str())) {
+					g_inputStreamPath = name;
+					break;
 				}
+			}
 
-				if (s != fn && (s[-1] < '0' || s[-1] > '9'))
-					g_inputPathCountPos = (int)(s - fn);
+			if (g_inputStreamPath.empty()) {
+				printf("Unable to find KryoFlux raw track streams in archive: %s. Expected entries named like track00.0.raw.\n", g_inputPath.c_str());
+				exit_usage();
+			}
+		} else {
+			if (!parse_kf_stream_pattern(g_inputPath.c_str())) {
+				printf("Unable to determine filename pattern for KryoFlux raw track streams. Expected pattern: track00.0.raw.\n");
+				exit_usage();
 			}
-		}
 
-		if (!g_inputPathCountPos || !g_inputPathCountWidth || g_inputPathCountWidth > 10 || !g_inputPathSideWidth || g_inputPathSideWidth > 4) {
-			printf("Unable to determine filename pattern for KryoFlux raw track streams. Expected pattern: track00.0.raw.\n");
-			exit_usage();
+			g_inputStreamPath = g_inputPath;
 		}
-
-		g_inputPathSideBase = atoi(std::string(&fn[g_inputPathSidePos], g_inputPathSideWidth).c_str());
 	}
 
-	if (g_outputFormat == kOutputFormat_Auto && !g_analyze) {
-		if (g_outputPath.compare(0, 5, "scp0:") == 0
-			|| g_outputPath.compare(0, 5, "scp1:") == 0)
+	for(OutputTarget& output : g_outputs) {
+		if (output.mFormat != kOutputFormat_Auto || g_analyze)
+			continue;
+
+		if (output.mPath.compare(0, 5, "scp0:") == 0
+			|| output.mPath.compare(0, 5, "scp1:") == 0)
 		{
-			g_outputFormat = kOutputFormat_SCPDirect;
+			output.mFormat = kOutputFormat_SCPDirect;
 		} else {
-			const char *extptr = strrchr(g_outputPath.c_str(), '.');
+			const char *extptr = strrchr(output.mPath.c_str(), '.');
 
 			if (extptr) {
 				std::string ext(extptr+1);
@@ -1696,33 +3337,35 @@ void parse_args(int argc, char **argv) {
 				std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return tolower((unsigned char)c); });
 
 				if (ext == "atr") {
-					g_outputFormat = kOutputFormat_Atari_ATR;
+					output.mFormat = kOutputFormat_Atari_ATR;
 				} else if (ext == "atx") {
-					g_outputFormat = kOutputFormat_Atari_ATX;
+					output.mFormat = kOutputFormat_Atari_ATX;
 				} else if (ext == "xfd") {
-					g_outputFormat = kOutputFormat_Atari_XFD;
+					output.mFormat = kOutputFormat_Atari_XFD;
 				} else if (ext == "scp") {
-					g_outputFormat = kOutputFormat_SCP_Auto;
+					output.mFormat = kOutputFormat_SCP_Auto;
 				} else if (ext == "dsk") {
-					g_outputFormat = !autoDecoder && g_encoding_macgcr ? kOutputFormat_Mac_DSK : kOutputFormat_AppleII_DO;
+					output.mFormat = !autoDecoder && g_encoding_macgcr ? kOutputFormat_Mac_DSK : kOutputFormat_AppleII_DO;
 				} else if (ext == "do") {
-					g_outputFormat = kOutputFormat_AppleII_DO;
+					output.mFormat = kOutputFormat_AppleII_DO;
 				} else if (ext == "po") {
-					g_outputFormat = kOutputFormat_AppleII_PO;
+					output.mFormat = kOutputFormat_AppleII_PO;
 				} else if (ext == "nib") {
-					g_outputFormat = kOutputFormat_AppleII_NIB;
+					output.mFormat = kOutputFormat_AppleII_NIB;
 				} else if (ext == "vfd") {
-					g_outputFormat = kOutputFormat_PC_VFD;
+					output.mFormat = kOutputFormat_PC_VFD;
 				} else if (ext == "flp") {
-					g_outputFormat = kOutputFormat_PC_VFD;
+					output.mFormat = kOutputFormat_PC_VFD;
 				} else if (ext == "adf") {
-					g_outputFormat = kOutputFormat_Amiga_ADF;
+					output.mFormat = kOutputFormat_Amiga_ADF;
+				} else if (ext == "a8f") {
+					output.mFormat = kOutputFormat_A8F;
 				}
 			}
 		}
 
-		if (g_outputFormat == kOutputFormat_Auto) {
-			printf("Unable to determine output format from output path: %s. Use -of to override output format.\n", g_outputPath.c_str());
+		if (output.mFormat == kOutputFormat_Auto) {
+			printf("Unable to determine output format from output path: %s. Use -of to override output format.\n", output.mPath.c_str());
 			exit_usage();
 		}
 	}
@@ -1734,61 +3377,66 @@ void parse_args(int argc, char **argv) {
 		g_encoding_macgcr = false;
 		g_encoding_a2gcr = false;
 
-		switch(g_outputFormat) {
-			case kOutputFormat_AppleII_DO:
-			case kOutputFormat_AppleII_PO:
-			case kOutputFormat_AppleII_NIB:
-				g_encoding_a2gcr = true;
-				break;
+		// enable the decoders needed by all of the outputs
+		for(const OutputTarget& output : g_outputs) {
+			switch(output.mFormat) {
+				case kOutputFormat_AppleII_DO:
+				case kOutputFormat_AppleII_PO:
+				case kOutputFormat_AppleII_NIB:
+					g_encoding_a2gcr = true;
+					break;
 
-			case kOutputFormat_Mac_DSK:
-				g_encoding_macgcr = true;
-				break;
+				case kOutputFormat_Mac_DSK:
+					g_encoding_macgcr = true;
+					break;
 
-			case kOutputFormat_PC_VFD:
-				g_encoding_pcmfm = true;
-				break;
+				case kOutputFormat_PC_VFD:
+					g_encoding_pcmfm = true;
+					break;
 
-			case kOutputFormat_Amiga_ADF:
-				g_encoding_amigamfm = true;
-				break;
+				case kOutputFormat_Amiga_ADF:
+					g_encoding_amigamfm = true;
+					break;
 
-			default:
-				g_encoding_fm = true;
-				g_encoding_mfm = true;
-				break;
+				default:
+					g_encoding_fm = true;
+					g_encoding_mfm = true;
+					break;
+			}
 		}
 	}
 
+	// Decoded formats with fixed geometries set the default layout. Only one
+	// layout can be decoded in a run, so these outputs have to agree on it.
 	if (!g_layout_set) {
-		switch(g_outputFormat) {
-			case kOutputFormat_AppleII_DO:
-			case kOutputFormat_AppleII_PO:
-			case kOutputFormat_AppleII_NIB:
-				g_trackCount = 35;
-				break;
-
-			case kOutputFormat_Mac_DSK:
-				g_trackCount = 80;
-				g_trackStep = 1;
-				g_sides = 2;
-				break;
+		const OutputTarget *layoutOutput = nullptr;
+		int layoutTrackCount = g_trackCount;
+		int layoutTrackStep = g_trackStep;
+		int layoutSides = g_sides;
 
-			case kOutputFormat_PC_VFD:
-				g_trackCount = 80;
-				g_trackStep = 1;
-				g_sides = 2;
-				break;
-
-			case kOutputFormat_Amiga_ADF:
-				g_trackCount = 80;
-				g_trackStep = 1;
-				g_sides = 2;
-				break;
+		for(const OutputTarget& output : g_outputs) {
+			if (is_raw_output_format(output.mFormat))
+				continue;
 
-			default:
-				break;
+			int trackCount = g_trackCount;
+			int trackStep = g_trackStep;
+			int sides = g_sides;
+			get_default_layout(output.mFormat, trackCount, trackStep, sides);
+
+			if (!layoutOutput) {
+				layoutOutput = &output;
+				layoutTrackCount = trackCount;
+				layoutTrackStep = trackStep;
+				layoutSides = sides;
+			} else if (trackCount != layoutTrackCount || trackStep != layoutTrackStep || sides != layoutSides) {
+				printf("Output images %s and %s have different disk geometries. Use -g to set the geometry to decode.\n", layoutOutput->mPath.c_str(), output.mPath.c_str());
+				exit_argerr();
+			}
 		}
+
+		g_trackCount = layoutTrackCount;
+		g_trackStep = layoutTrackStep;
+		g_sides = layoutSides;
 	}
 }
 
@@ -1833,29 +3481,65 @@ void show_layout() {
 }
 
 int main(int argc, char **argv) {
+	// If an image is streamed through stdin or stdout, move all console output
+	// over to stderr before anything is printed, so that it doesn't get mixed
+	// into a piped image.
+	for(int i=1; i<argc; ++i) {
+		if (!strcmp(argv[i], "-")) {
+			g_stdoutData = detach_stdout();
+			break;
+		}
+	}
+
+	// Quiet mode is picked up early to skip the banner, but console output
+	// is only cut off once the command line has been accepted, so that
+	// usage errors are still shown.
+	for(int i=1; i<argc && strcmp(argv[i], "--"); ++i) {
+		if (!strcmp(argv[i], "-q")) {
+			g_quiet = true;
+			break;
+		}
+	}
+
 	parse_args(argc, argv);
 
+	if (g_quiet)
+		silence_stdout();
+
+	// Catch an unwritable output before spending time on the decode.
+	for(const OutputTarget& output : g_outputs) {
+		if (output.mFormat != kOutputFormat_SCPDirect)
+			check_output_file(output.mPath.c_str());
+	}
+
+	if (!g_reportPath.empty())
+		check_output_file(g_reportPath.c_str());
+
 	bool src_raw = false;
 	bool src_gcr = false;
 	bool dst_raw = false;
+	bool dst_decoded = false;
 
-	switch(g_outputFormat) {
-		case kOutputFormat_SCP_Auto:
-		case kOutputFormat_SCP_ForceSS40:
-		case kOutputFormat_SCP_ForceDS40:
-		case kOutputFormat_SCP_ForceSS80:
-		case kOutputFormat_SCP_ForceDS80:
-		case kOutputFormat_SCPDirect:
+	// Writing directly to a SuperCard Pro device needs splice points.
+	bool dst_spliced = false;
+
+	for(const OutputTarget& output : g_outputs) {
+		if (is_raw_output_format(output.mFormat))
 			dst_raw = true;
-			break;
+		else
+			dst_decoded = true;
+
+		if (output.mFormat == kOutputFormat_SCPDirect)
+			dst_spliced = true;
 	}
 
 	RawDisk raw_disk;
+	StatsTimer stageTimer;
 
 	switch(g_inputFormat) {
 		case kInputFormat_KryoFluxStream:
 			raw_disk.mSideCount = g_sides;
-			kf_read(raw_disk, g_trackCount, g_trackStep, g_inputPath.c_str(), g_inputPathSidePos, g_inputPathSideWidth, g_inputPathSideBase, g_inputPathCountPos, g_inputPathCountWidth, g_trackSelect, g_kryoflux_48tpi);
+			kf_read(raw_disk, g_trackCount, g_trackStep, g_inputStreamPath.c_str(), g_inputPathSidePos, g_inputPathSideWidth, g_inputPathSideBase, g_inputPathCountPos, g_inputPathCountWidth, g_trackSelect, g_kryoflux_48tpi, g_inputArchive.get());
 			src_raw = true;
 			break;
 
@@ -1909,6 +3593,11 @@ int main(int argc, char **argv) {
 			src_raw = true;
 			break;
 
+		case kInputFormat_A8F:
+			a8f_read(raw_disk, g_inputPath.c_str(), g_trackSelect);
+			src_raw = true;
+			break;
+
 		case kInputFormat_AppleII_DO:
 			read_apple2_dsk(g_disk, g_inputPath.c_str(), g_trackSelect, false);
 			src_gcr = true;
@@ -1934,6 +3623,15 @@ int main(int argc, char **argv) {
 			break;
 	}
 
+	g_stats.AddStageTime(kStatsStage_Read, stageTimer.Lap());
+	g_stats.MeasureRawDisk(raw_disk);
+	g_stats.MeasureDisk(g_disk);
+
+	// The report is built from the decoded sectors, which raw to raw
+	// conversions don't produce.
+	if (src_raw && !dst_decoded && !g_reportPath.empty())
+		fatal("A report can only be written when a decoded output format is used.");
+
 	// apply post-compensation if we have a raw disk
 	if (src_raw) {
 		if (g_postcomp == kPostComp_Auto) {
@@ -1943,7 +3641,9 @@ int main(int argc, char **argv) {
 				g_postcomp = kPostComp_None;
 		}
 
+		stageTimer.Lap();
 		postcomp_disk(raw_disk, g_postcomp);
+		g_stats.AddStageTime(kStatsStage_PostComp, stageTimer.Lap());
 	}
 
 	// sync the global params with the actual disk geometry we got, and run analysis if enabled
@@ -1955,15 +3655,17 @@ int main(int argc, char **argv) {
 
 		// if the layout hasn't been forced and the destination isn't also raw, then use the
 		// min of what we expect and what we have
-		if (!dst_raw) {
+		if (dst_decoded) {
 			// raw -> decoded -- use min of geometry and raw disk
 			g_trackCount = std::min<int>(g_trackCount, raw_disk.mTrackCount);
-			raw_disk.mTrackCount = g_trackCount;
-
 			g_trackStep = raw_disk.mTrackStep;
-
 			g_sides = std::min<int>(g_sides, raw_disk.mSideCount);
-			raw_disk.mSideCount = g_sides;
+
+			// raw outputs still get all of the raw disk
+			if (!dst_raw) {
+				raw_disk.mTrackCount = g_trackCount;
+				raw_disk.mSideCount = g_sides;
+			}
 		} else {
 			// raw -> raw -- use source geometry
 			g_trackCount = g_disk.mTrackCount;
@@ -1980,145 +3682,179 @@ int main(int argc, char **argv) {
 		update_disk_interleave(g_disk, g_interleave);
 	}
 
-	// Figure out if we need a splice point for the destination format
-	bool dst_spliced = false;
-	switch(g_outputFormat) {
-		case kOutputFormat_Atari_ATX:
-		case kOutputFormat_Atari_ATR:
-		case kOutputFormat_Atari_XFD:
-		case kOutputFormat_SCP_Auto:
-		case kOutputFormat_SCP_ForceSS40:
-		case kOutputFormat_SCP_ForceDS40:
-		case kOutputFormat_SCP_ForceSS80:
-		case kOutputFormat_SCP_ForceDS80:
-		case kOutputFormat_AppleII_DO:
-		case kOutputFormat_AppleII_PO:
-		case kOutputFormat_AppleII_NIB:
-		case kOutputFormat_PC_VFD:
-		case kOutputFormat_Amiga_ADF:
-			dst_spliced = false;
-			break;
-
-		case kOutputFormat_SCPDirect:
-			dst_spliced = true;
-			break;
-	}
-
 	if (src_raw && g_reverseTracks)
 		reverse_tracks(raw_disk);
 
 	// Check if we are going from raw or decoded source.
 	if (src_raw) {
+		g_synthesizedFlux = raw_disk.mSynthesized;
+
 		// Raw -- if the destination is decoded then we need
 		// to decode tracks. If the destination is raw but requires splice points,
 		// then we may need to decode the tracks if we didn't already have splice
 		// points.
-		if (!dst_raw || dst_spliced) {
-			g_disk.mTrackCount = raw_disk.mTrackCount;
+		if (dst_decoded || dst_spliced) {
+			g_disk.mTrackCount = dst_decoded ? g_trackCount : raw_disk.mTrackCount;
 			g_disk.mTrackStep = raw_disk.mTrackStep;
-			g_disk.mSideCount = raw_disk.mSideCount;
+			g_disk.mSideCount = dst_decoded ? g_sides : raw_disk.mSideCount;
+
+			stageTimer.Lap();
 
-			for(int i=0; i<raw_disk.mTrackCount; ++i) {
+			if (!g_trackCachePath.empty())
+				g_trackCache.Init(g_trackCachePath.c_str(), compute_decode_settings_hash());
+
+			for(int i=0; i<g_disk.mTrackCount; ++i) {
 				if (g_trackSelect >= 0 && g_trackSelect != i)
 					continue;
 
-				for(int side=0; side < raw_disk.mSideCount; ++side) {
+				for(int side=0; side < g_disk.mSideCount; ++side) {
 					RawTrack& raw_track = raw_disk.mPhysTracks[side][i * raw_disk.mTrackStep];
 
 					// if we just need splice points and we already have them, skip this
 					// track
-					if (dst_raw && raw_track.mSpliceStart >= 0)
+					if (!dst_decoded && raw_track.mSpliceStart >= 0)
 						continue;
 
 					process_track(raw_track);
 				}
 			}
 
-			if (dst_spliced)
+			g_stats.AddStageTime(kStatsStage_Decode, stageTimer.Lap());
+
+			if (dst_spliced) {
 				find_splice_points(raw_disk, g_disk);
+				g_stats.AddStageTime(kStatsStage_SpliceFind, stageTimer.Lap());
+			}
 		}
-	} else if (!src_raw) {
-		// Decoded -- if the destination is raw, then we need to encode tracks.
-		if (dst_raw)
-			encode_disk(raw_disk, g_disk, g_clockPeriodAdjust, g_trackSelect, src_gcr, g_encode_precise);
 	}
 
-	if (g_showLayout && (!src_raw || !dst_raw))
+	// Sift the decoded sectors once for the encoder and all of the writers.
+	stageTimer.Lap();
+	sift_disk(g_disk);
+	g_stats.AddStageTime(kStatsStage_Sift, stageTimer.Lap());
+	g_stats.CountSectors(g_disk, g_trackSelect);
+	g_stats.MeasureDisk(g_disk);
+
+	// Decoded -- if the destination is raw, then we need to encode tracks.
+	if (!src_raw && dst_raw) {
+		stageTimer.Lap();
+		encode_disk(raw_disk, g_disk, g_clockPeriodAdjust, g_trackSelect, src_gcr, g_encode_precise);
+		g_stats.AddStageTime(kStatsStage_Encode, stageTimer.Lap());
+		g_stats.MeasureRawDisk(raw_disk);
+	}
+
+	if (g_showLayout && (!src_raw || dst_decoded))
 		show_layout();
 
-	switch(g_outputFormat) {
-		case kOutputFormat_Atari_ATX:
-			write_atx(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+	// The image writers only read the disks, so they run in parallel with
+	// their messages printed in order afterward. Writing to a SuperCard Pro
+	// device drives the hardware, so that is done separately at the end.
+	std::vector<MessageLog> logs(g_outputs.size());
 
-		case kOutputFormat_Atari_ATR:
-			write_atr(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+	stageTimer.Lap();
 
-		case kOutputFormat_Atari_XFD:
-			write_xfd(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+	parallel_for(g_outputs.size(), [&](size_t idx) {
+		const char *path = g_outputs[idx].mPath.c_str();
+		MessageLog& log = logs[idx];
 
-		case kOutputFormat_SCP_Auto:
-			scp_write(raw_disk, g_outputPath.c_str(), g_trackSelect, 0, 0);
-			break;
+		switch(g_outputs[idx].mFormat) {
+			case kOutputFormat_Atari_ATX:
+				write_atx(path, g_disk, g_trackSelect, log);
+				break;
 
-		case kOutputFormat_SCP_ForceSS40:
-			scp_write(raw_disk, g_outputPath.c_str(), g_trackSelect, 48, 1);
-			break;
+			case kOutputFormat_Atari_ATR:
+				write_atr(path, g_disk, g_trackSelect, log);
+				break;
 
-		case kOutputFormat_SCP_ForceDS40:
-			scp_write(raw_disk, g_outputPath.c_str(), g_trackSelect, 48, 2);
-			break;
+			case kOutputFormat_Atari_XFD:
+				write_xfd(path, g_disk, g_trackSelect, log);
+				break;
 
-		case kOutputFormat_SCP_ForceSS80:
-			scp_write(raw_disk, g_outputPath.c_str(), g_trackSelect, 96, 1);
-			break;
+			case kOutputFormat_SCP_Auto:
+				scp_write(raw_disk, path, g_trackSelect, 0, 0, log);
+				break;
 
-		case kOutputFormat_SCP_ForceDS80:
-			scp_write(raw_disk, g_outputPath.c_str(), g_trackSelect, 96, 2);
-			break;
+			case kOutputFormat_SCP_ForceSS40:
+				scp_write(raw_disk, path, g_trackSelect, 48, 1, log);
+				break;
 
-		case kOutputFormat_SCPDirect:
-			if (g_erase_odd_tracks && raw_disk.mTrackStep == 2) {
-				for(int side=0; side<raw_disk.mSideCount; ++side) {
-					for(int i=0; i<raw_disk.mTrackCount; ++i) {
-						RawTrack& odd_track = raw_disk.mPhysTracks[side][i*2+1];
+			case kOutputFormat_SCP_ForceDS40:
+				scp_write(raw_disk, path, g_trackSelect, 48, 2, log);
+				break;
 
-						odd_track.mIndexTimes.clear();
-						odd_track.mTransitions.clear();
-					}
-				}
-				raw_disk.mTrackStep = 1;
-				raw_disk.mTrackCount *= 2;
-			}
-			scp_direct_write(raw_disk, g_outputPath.c_str(), g_trackSelect, g_high_density, g_splice_mode);
-			break;
+			case kOutputFormat_SCP_ForceSS80:
+				scp_write(raw_disk, path, g_trackSelect, 96, 1, log);
+				break;
 
-		case kOutputFormat_AppleII_DO:
-			write_apple2_dsk(g_outputPath.c_str(), g_disk, g_trackSelect, false, false);
-			break;
+			case kOutputFormat_SCP_ForceDS80:
+				scp_write(raw_disk, path, g_trackSelect, 96, 2, log);
+				break;
 
-		case kOutputFormat_AppleII_PO:
-			write_apple2_dsk(g_outputPath.c_str(), g_disk, g_trackSelect, true, false);
-			break;
+			case kOutputFormat_A8F:
+				a8f_write(raw_disk, path, g_trackSelect, log);
+				break;
 
-		case kOutputFormat_Mac_DSK:
-			write_apple2_dsk(g_outputPath.c_str(), g_disk, g_trackSelect, false, true);
-			break;
+			case kOutputFormat_AppleII_DO:
+				write_apple2_dsk(path, g_disk, g_trackSelect, false, false, log);
+				break;
 
-		case kOutputFormat_AppleII_NIB:
-			write_apple2_nib(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+			case kOutputFormat_AppleII_PO:
+				write_apple2_dsk(path, g_disk, g_trackSelect, true, false, log);
+				break;
 
-		case kOutputFormat_PC_VFD:
-			write_vfd(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+			case kOutputFormat_Mac_DSK:
+				write_apple2_dsk(path, g_disk, g_trackSelect, false, true, log);
+				break;
 
-		case kOutputFormat_Amiga_ADF:
-			write_adf(g_outputPath.c_str(), g_disk, g_trackSelect);
-			break;
+			case kOutputFormat_AppleII_NIB:
+				write_apple2_nib(path, g_disk, g_trackSelect, log);
+				break;
+
+			case kOutputFormat_PC_VFD:
+				write_vfd(path, g_disk, g_trackSelect, log);
+				break;
+
+			case kOutputFormat_Amiga_ADF:
+				write_adf(path, g_disk, g_trackSelect, log);
+				break;
+		}
+	});
+
+	for(MessageLog& log : logs)
+		log.Flush();
+
+	for(const MessageLog& log : logs) {
+		if (log.HasFailed())
+			fatalf("%s", log.GetError());
+	}
+
+	g_stats.AddStageTime(kStatsStage_Write, stageTimer.Lap());
+
+	for(const OutputTarget& output : g_outputs) {
+		if (output.mFormat != kOutputFormat_SCPDirect)
+			continue;
+
+		if (g_erase_odd_tracks && raw_disk.mTrackStep == 2) {
+			for(int side=0; side<raw_disk.mSideCount; ++side) {
+				for(int i=0; i<raw_disk.mTrackCount; ++i) {
+					RawTrack& odd_track = raw_disk.mPhysTracks[side][i*2+1];
+
+					odd_track.mIndexTimes.clear();
+					odd_track.mTransitions.clear();
+				}
+			}
+			raw_disk.mTrackStep = 1;
+			raw_disk.mTrackCount *= 2;
+		}
+		stageTimer.Lap();
+		scp_direct_write(raw_disk, output.mPath.c_str(), g_trackSelect, g_high_density, g_splice_mode);
+		g_stats.AddStageTime(kStatsStage_Write, stageTimer.Lap());
 	}
 
+	if (!g_reportPath.empty())
+		write_json_report(g_reportPath.c_str(), g_disk, g_trackSelect);
+
+	g_stats.Print();
+
 	return 0;
 }
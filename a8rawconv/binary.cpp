@@ -1,4 +1,7 @@
 #include "stdafx.h"
+#include <limits.h>
+#include "os.h"
+#include "stats.h"
 
 uint32_t read_u32(const uint8_t *p) {
 	return ((uint32_t)p[0])
@@ -7,32 +10,191 @@ uint32_t read_u32(const uint8_t *p) {
 		+ ((uint32_t)p[3] << 24);
 }
 
-void read_raw(void *data, size_t len, FILE *f, const char *path) {
-	if (1 != fread(data, len, 1, f))
-		fatalf("Unable to read from file: %s\n", path);
+InputFile::~InputFile() {
+	Close();
 }
 
-void write_u8(uint8_t v, FILE *f) {
-	putc(v, f);
+void InputFile::Open(const char *path) {
+	Close();
+
+	mPath = path;
+
+	if (!strcmp(path, "-")) {
+		set_binary_mode(stdin);
+
+		mbBuffered = true;
+		mBufferPos = 0;
+
+		for(;;) {
+			const size_t pos = mBuffer.size();
+			mBuffer.resize(pos + 1024*1024);
+
+			const size_t actual = fread(mBuffer.data() + pos, 1, 1024*1024, stdin);
+			mBuffer.resize(pos + actual);
+
+			if (actual < 1024*1024)
+				break;
+		}
+
+		if (ferror(stdin))
+			fatalf("Unable to read from standard input.\n");
+
+		return;
+	}
+
+	mpFile = fopen(path, "rb");
+	if (!mpFile)
+		fatalf("Unable to open input file: %s.\n", path);
+}
+
+void InputFile::Close() {
+	if (mpFile) {
+		fclose(mpFile);
+		mpFile = nullptr;
+	}
+
+	mbBuffered = false;
+	mBuffer.clear();
+	mBufferPos = 0;
+}
+
+bool InputFile::Read(void *dst, size_t len) {
+	return ReadPartial(dst, len) == len;
+}
+
+size_t InputFile::ReadPartial(void *dst, size_t len) {
+	size_t actual;
+
+	if (!mbBuffered)
+		actual = fread(dst, 1, len, mpFile);
+	else {
+		actual = std::min(len, mBuffer.size() - mBufferPos);
+
+		if (actual)
+			memcpy(dst, mBuffer.data() + mBufferPos, actual);
+
+		mBufferPos += actual;
+	}
+
+	g_stats.AddBytesRead(actual);
+	return actual;
+}
+
+bool InputFile::Seek(uint64_t pos) {
+	if (!mbBuffered)
+		return pos <= (uint64_t)LONG_MAX && !fseek(mpFile, (long)pos, SEEK_SET);
+
+	// same as files, seeking past the end is allowed but reads will fail
+	mBufferPos = (size_t)std::min<uint64_t>(pos, mBuffer.size());
+	return true;
+}
+
+uint64_t InputFile::Tell() const {
+	return mbBuffered ? mBufferPos : (uint64_t)ftell(mpFile);
 }
 
-void write_u16(uint16_t v, FILE *f) {
-	putc(v & 0xff, f);
-	putc(v >> 8, f);
+uint64_t InputFile::GetSize() {
+	if (mbBuffered)
+		return mBuffer.size();
+
+	const long pos = ftell(mpFile);
+	fseek(mpFile, 0, SEEK_END);
+	const long len = ftell(mpFile);
+	fseek(mpFile, pos, SEEK_SET);
+
+	return len < 0 ? 0 : (uint64_t)len;
 }
 
-void write_i16(int16_t v, FILE *f) {
-	write_u16((uint16_t)v, f);
+void read_raw(void *data, size_t len, InputFile& f) {
+	if (!f.Read(data, len))
+		fatalf("Unable to read from file: %s\n", f.GetPath());
 }
 
-void write_u32(uint32_t v, FILE *f) {
-	putc(v & 0xff, f);
-	putc((v >> 8) & 0xff, f);
-	putc((v >> 16) & 0xff, f);
-	putc((v >> 24) & 0xff, f);
+void check_output_file(const char *path) {
+	if (!strcmp(path, "-"))
+		return;
+
+	if (g_syncOutput) {
+		// the output is renamed into place, so it's the directory that needs
+		// to be writable
+		const std::string tempPath = get_temp_path(path);
+
+		if (!probe_writable_path(tempPath.c_str()))
+			fatalf("Unable to open output file: %s.\n", tempPath.c_str());
+
+		return;
+	}
+
+	// open for append so that an existing file isn't truncated before the
+	// new image is ready, and don't leave behind an empty file that wasn't
+	// there before
+	FILE *fi = fopen(path, "rb");
+	const bool existed = fi != nullptr;
+
+	if (fi)
+		fclose(fi);
+
+	FILE *fo = fopen(path, "ab");
+	if (!fo)
+		fatalf("Unable to open output file: %s.\n", path);
+
+	fclose(fo);
+
+	if (!existed)
+		remove(path);
 }
 
-void write_pad(int n, FILE *f) {
-	while(n--)
-		putc(0, f);
+bool BinaryWriter::WriteFile(const char *path, MessageLog& log) const {
+	g_stats.AddBytesWritten(mBuffer.size());
+
+	if (!strcmp(path, "-")) {
+		// standard output was set aside for image data by detach_stdout()
+		A8RC_RT_ASSERT(g_stdoutData);
+
+		if ((!mBuffer.empty() && 1 != fwrite(mBuffer.data(), mBuffer.size(), 1, g_stdoutData)) || fflush(g_stdoutData)) {
+			log.Fail("Unable to write to standard output.\n");
+			return false;
+		}
+
+		return true;
+	}
+
+	const std::string tempPath = g_syncOutput ? get_temp_path(path) : std::string();
+	const char *writePath = g_syncOutput ? tempPath.c_str() : path;
+
+	FILE *fo = fopen(writePath, "wb");
+	if (!fo) {
+		log.Fail("Unable to open output file: %s.\n", writePath);
+		return false;
+	}
+
+	// the whole file goes out in one write, so there's no point buffering it
+	setvbuf(fo, nullptr, _IONBF, 0);
+
+	const char *error = nullptr;
+	const char *errorPath = writePath;
+
+	if (!mBuffer.empty() && 1 != fwrite(mBuffer.data(), mBuffer.size(), 1, fo))
+		error = "Unable to write to output file: %s.\n";
+	else if (g_syncOutput && !sync_file(fo))
+		error = "Unable to flush output file to disk: %s.\n";
+
+	if (fclose(fo) && !error)
+		error = "Unable to write to output file: %s.\n";
+
+	if (!error && g_syncOutput && !rename_file_replace(writePath, path)) {
+		error = "Unable to replace output file: %s.\n";
+		errorPath = path;
+	}
+
+	if (error) {
+		// don't leave the temporary file behind; the output itself is still intact
+		if (g_syncOutput)
+			remove(tempPath.c_str());
+
+		log.Fail(error, errorPath);
+		return false;
+	}
+
+	return true;
 }
@@ -1,6 +1,8 @@
 #ifndef f_BINARY_H
 #define f_BINARY_H
 
+class MessageLog;
+
 inline uint16_t swizzle_u16_from_le(uint16_t v) {
 	return v;
 }
@@ -25,14 +27,202 @@ inline uint16_t read_u32_le(const uint8_t *p) {
 	return swizzle_u32_from_le(*(const uint32_t *)p);
 }
 
+inline uint32_t read_u32_be(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24)
+		+ ((uint32_t)p[1] << 16)
+		+ ((uint32_t)p[2] << 8)
+		+ ((uint32_t)p[3]);
+}
+
+inline void write_u64_be(uint8_t *p, uint64_t v) {
+	for(int i=7; i>=0; --i) {
+		p[i] = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
 uint32_t read_u32(const uint8_t *p);
 
-void read_raw(void *data, size_t len, FILE *f, const char *path);
+// Input image file, which is standard input when the path is "-". Pipes
+// can't seek, so standard input is read into memory in one pass when it is
+// opened, and reads and seeks then come from the buffer.
+class InputFile {
+public:
+	InputFile() = default;
+	~InputFile();
+
+	InputFile(const InputFile&) = delete;
+	InputFile& operator=(const InputFile&) = delete;
+
+	// Open the file for reading. Failure is fatal.
+	void Open(const char *path);
+	void Close();
+
+	const char *GetPath() const { return mPath.c_str(); }
+
+	// Read exactly len bytes. Returns false if the file ends first.
+	bool Read(void *dst, size_t len);
+
+	// Read up to len bytes and return the number read.
+	size_t ReadPartial(void *dst, size_t len);
+
+	bool Seek(uint64_t pos);
+	uint64_t Tell() const;
+	uint64_t GetSize();
+
+private:
+	FILE *mpFile = nullptr;
+	std::string mPath;
+	bool mbBuffered = false;
+	std::vector<uint8_t> mBuffer;
+	size_t mBufferPos = 0;
+};
+
+void read_raw(void *data, size_t len, InputFile& f);
+
+// Bounds-checked reader over an in-memory buffer, for parsing files that may
+// be truncated or corrupt. A read past the end fails the reader and returns
+// zeroes, so a run of reads only needs to be checked once at the end.
+class BinaryReader {
+public:
+	BinaryReader(const void *src, size_t len)
+		: mpSrc((const uint8_t *)src), mpEnd((const uint8_t *)src + len) {}
+
+	bool IsValid() const { return mbValid; }
+	bool IsAtEnd() const { return mpSrc == mpEnd; }
+	size_t GetRemaining() const { return (size_t)(mpEnd - mpSrc); }
+
+	// Return a pointer to the next len bytes and skip over them, or null if
+	// there aren't that many left.
+	const uint8_t *GetSpan(size_t len) {
+		if (GetRemaining() < len) {
+			mbValid = false;
+			mpSrc = mpEnd;
+			return nullptr;
+		}
+
+		const uint8_t *p = mpSrc;
+		mpSrc += len;
+		return p;
+	}
+
+	bool GetBytes(void *dst, size_t len) {
+		const uint8_t *p = GetSpan(len);
+
+		if (!p) {
+			memset(dst, 0, len);
+			return false;
+		}
+
+		memcpy(dst, p, len);
+		return true;
+	}
+
+	uint8_t GetU8() {
+		const uint8_t *p = GetSpan(1);
+		return p ? p[0] : 0;
+	}
+
+	uint16_t GetU16() {
+		const uint8_t *p = GetSpan(2);
+		return p ? (uint16_t)(p[0] + ((uint32_t)p[1] << 8)) : 0;
+	}
+
+	uint32_t GetU32() {
+		const uint8_t *p = GetSpan(4);
+		return p ? read_u32(p) : 0;
+	}
+
+private:
+	const uint8_t *mpSrc;
+	const uint8_t *mpEnd;
+	bool mbValid = true;
+};
+
+// Growable in-memory buffer for building an output file, which is then
+// written out in one go. Values are appended little-endian unless noted.
+class BinaryWriter {
+public:
+	void Reserve(size_t n) { mBuffer.reserve(n); }
+
+	size_t GetSize() const { return mBuffer.size(); }
+	uint8_t *GetData() { return mBuffer.data(); }
+
+	void PutU8(uint8_t v) {
+		mBuffer.push_back(v);
+	}
+
+	void PutU16(uint16_t v) {
+		uint8_t *p = Extend(2);
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+	}
+
+	void PutI16(int16_t v) {
+		PutU16((uint16_t)v);
+	}
+
+	void PutU32(uint32_t v) {
+		PatchU32(Extend(4) - mBuffer.data(), v);
+	}
+
+	void PutU16BE(uint16_t v) {
+		uint8_t *p = Extend(2);
+		p[0] = (uint8_t)(v >> 8);
+		p[1] = (uint8_t)v;
+	}
+
+	void PutU32BE(uint32_t v) {
+		uint8_t *p = Extend(4);
+		p[0] = (uint8_t)(v >> 24);
+		p[1] = (uint8_t)(v >> 16);
+		p[2] = (uint8_t)(v >> 8);
+		p[3] = (uint8_t)v;
+	}
+
+	void PutPad(size_t n) {
+		mBuffer.resize(mBuffer.size() + n, 0);
+	}
+
+	void PutBytes(const void *data, size_t len) {
+		if (len)
+			memcpy(Extend(len), data, len);
+	}
+
+	// Overwrite already written bytes, for fields that are only known once
+	// the rest of the file has been built.
+	void PatchU32(size_t offset, uint32_t v) {
+		uint8_t *p = &mBuffer[offset];
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+		p[2] = (uint8_t)(v >> 16);
+		p[3] = (uint8_t)(v >> 24);
+	}
+
+	void PatchBytes(size_t offset, const void *data, size_t len) {
+		memcpy(&mBuffer[offset], data, len);
+	}
+
+	// Write the buffer to a file with a single write. With -sync, the data
+	// goes to a temporary file that is flushed to disk and then renamed over
+	// the output, so the output is never left partially written. Errors are
+	// recorded in the log rather than exiting, as the image writers run on
+	// worker threads.
+	bool WriteFile(const char *path, MessageLog& log) const;
+
+private:
+	uint8_t *Extend(size_t n) {
+		const size_t offset = mBuffer.size();
+		mBuffer.resize(offset + n);
+		return mBuffer.data() + offset;
+	}
+
+	std::vector<uint8_t> mBuffer;
+};
 
-void write_u8(uint8_t v, FILE *f);
-void write_u16(uint16_t v, FILE *f);
-void write_i16(int16_t v, FILE *f);
-void write_u32(uint32_t v, FILE *f);
-void write_pad(int n, FILE *f);
+// Check that an output file can be written before any work is done on it,
+// so that a bad path fails right away instead of after a long decode. An
+// existing file is left as is.
+void check_output_file(const char *path);
 
 #endif
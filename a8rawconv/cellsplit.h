@@ -0,0 +1,86 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_CELLSPLIT_H
+#define f_CELLSPLIT_H
+
+// Clock/data separation for FM and MFM cell streams.
+//
+// The decoders shift raw cells into a register with the most recent cell in
+// bit 0. Once a byte is aligned, the data cells are then in the even bit
+// positions and the clock cells in the odd bit positions, e.g. the MFM $A1
+// sync mark with a missing clock is $4489. These routines split 16, 32, or
+// 64 cells into clock and data halves in one go, and merge them back, a
+// byte at a time through lookup tables.
+
+// Raw cells for the address marks that the decoders sync on.
+static constexpr uint16_t kFMIDAMCells = 0xF57E;		// $FE data with $C7 clock
+static constexpr uint16_t kMFMSyncCells = 0x4489;		// $A1 data with $0A clock (missing clock pulse)
+
+// Clock bits in the high nibble and data bits in the low nibble of each byte
+// of raw cells.
+extern const uint8_t kCellSplitTable[256];
+
+// Each byte spread out to the even bit positions of a word.
+extern const uint16_t kCellSpreadTable[256];
+
+inline void split_cells16(uint16_t cells, uint8_t& clock_bits, uint8_t& data_bits) {
+	const uint8_t lo = kCellSplitTable[cells & 0xFF];
+	const uint8_t hi = kCellSplitTable[cells >> 8];
+
+	clock_bits = (uint8_t)((hi & 0xF0) + (lo >> 4));
+	data_bits = (uint8_t)((hi << 4) + (lo & 0x0F));
+}
+
+// Returns clock bits in the high half and data bits in the low half.
+inline uint32_t split_cells32(uint32_t cells) {
+	uint32_t clock_bits = 0;
+	uint32_t data_bits = 0;
+
+	for(int i=24; i>=0; i -= 8) {
+		const uint8_t v = kCellSplitTable[(cells >> i) & 0xFF];
+
+		clock_bits = (clock_bits << 4) + (v >> 4);
+		data_bits = (data_bits << 4) + (v & 0x0F);
+	}
+
+	return (clock_bits << 16) + data_bits;
+}
+
+// Returns clock bits in the high half and data bits in the low half.
+inline uint64_t split_cells64(uint64_t cells) {
+	const uint32_t hi = split_cells32((uint32_t)(cells >> 32));
+	const uint32_t lo = split_cells32((uint32_t)cells);
+
+	return ((uint64_t)((hi & 0xFFFF0000) + (lo >> 16)) << 32) + ((hi << 16) + (lo & 0xFFFF));
+}
+
+inline uint16_t merge_cells16(uint8_t clock_bits, uint8_t data_bits) {
+	return (uint16_t)((kCellSpreadTable[clock_bits] << 1) + kCellSpreadTable[data_bits]);
+}
+
+inline uint32_t merge_cells32(uint16_t clock_bits, uint16_t data_bits) {
+	return ((uint32_t)merge_cells16((uint8_t)(clock_bits >> 8), (uint8_t)(data_bits >> 8)) << 16)
+		+ merge_cells16((uint8_t)clock_bits, (uint8_t)data_bits);
+}
+
+inline uint64_t merge_cells64(uint32_t clock_bits, uint32_t data_bits) {
+	return ((uint64_t)merge_cells32((uint16_t)(clock_bits >> 16), (uint16_t)(data_bits >> 16)) << 32)
+		+ merge_cells32((uint16_t)clock_bits, (uint16_t)data_bits);
+}
+
+#endif
@@ -1,10 +1,25 @@
 #ifndef f_CHECKSUM_H
 #define f_CHECKSUM_H
 
+// CRC-16 (x^16 + x^12 + x^5 + 1) of each byte value, for updating a CRC a
+// byte at a time.
+extern const uint16_t kCRC16Table[256];
+
+inline uint16_t UpdateCRC(uint16_t crc, uint8_t c) {
+	return (uint16_t)((crc << 8) ^ kCRC16Table[(crc >> 8) ^ c]);
+}
+
 uint16_t ComputeCRC(const uint8_t *buf, size_t len, uint16_t initialCRC = 0xFFFF);
 uint16_t ComputeInvertedCRC(const uint8_t *buf, size_t len, uint16_t initialCRC = 0xFFFF);
 uint32_t ComputeByteSum(const void *buf, size_t len);
 
+// CRC-32 as used by zip and gzip (reflected, polynomial $EDB88320).
+uint32_t ComputeCRC32(const void *buf, size_t len, uint32_t initialCRC = 0);
+
+// Fast 64-bit hash for identifying blocks of data, such as flux streams. This
+// is not a checksum for any on-disk format and may change between versions.
+uint64_t ComputeHash64(const void *buf, size_t len, uint64_t seed = 0);
+
 uint16_t ComputeAddressCRC(uint32_t track, uint32_t side, uint32_t sector, uint32_t sectorSize, bool mfm);
 
 #endif
@@ -18,15 +18,7 @@
 #include "stdafx.h"
 #include "compensation.h"
 
-void postcomp_track_mac800k(RawTrack& track) {
-	size_t n = track.mTransitions.size();
-	if (n < 3)
-		return;
-
-	uint32_t *transitions = track.mTransitions.data();
-	uint32_t t0 = transitions[0];
-	uint32_t t1 = transitions[1];
-
+int postcomp_threshold_mac800k(const RawTrack& track) {
 	// We begin applying correction at approximately 1/45000th of a rotation. For reference, standard
 	// 2us MFM encodings have a minimum spacing of 4us at 300 RPM, or 1/50000th of a rotation. Tracks 0-15
 	// on a Mac 800K disk, OTOH, have a minimum spacing of 2us at 394 RPM, or 1/76142th of a rotation.
@@ -38,39 +30,50 @@ void postcomp_track_mac800k(RawTrack& track) {
 	// tracks. The simple linear mappings we're using here would overcorrect on inner tracks, so it's
 	// clamped after the third zone.
 	//
-	int thresh = (int)(0.5 + track.mSamplesPerRev / 30000.0 * (float)(160 + std::min<int>(track.mPhysTrack, 47)) / 240.0f);
-
-	for(size_t i=2; i<n; ++i) {
-		// shift in next transition time
-		uint32_t t2 = transitions[i];
-
-		// compute deltas between each pair
-		int32_t t01 = (int32_t)(t1 - t0);
-		int32_t t12 = (int32_t)(t2 - t1);
+	return (int)(0.5 + track.mSamplesPerRev / 30000.0 * (float)(160 + std::min<int>(track.mPhysTrack, 47)) / 240.0f);
+}
 
-		// compute anti peak shift delta for any pair that is narrower than the threshold
-		int32_t delta1 = std::max<int32_t>(0, thresh - t01);
-		int32_t delta2 = std::max<int32_t>(0, thresh - t12);
+int postcomp_threshold_mfm(const RawTrack& track) {
+	// This is the threshold from the peak shift pass that used to sit, disabled, in the MFM
+	// decoder. It hasn't been validated against real captures, so it is only applied on request.
+	return (int)(0.5 + track.mSamplesPerRev / 90000.0 * (float)(400 - track.mPhysTrack) / 400.0f);
+}
 
-		// apply correction shift, limited to no more than half the distance rounded down
-		transitions[i-1] = t1 + std::min(std::max<int32_t>(((delta2 - delta1) * 5) / 12, -t01 / 2), t12 / 2);
+int postcomp_threshold_fm(const RawTrack& track) {
+	// The MFM threshold above is for high density MFM, where transitions are at least
+	// 1/100000th of a revolution apart, and sits at 10/9ths of that spacing. FM has a clock
+	// pulse in every bit cell, so its minimum spacing is one FM cell instead; keep the same
+	// ratio to the FM cell length used by the decoder. Like the MFM model, this is unvalidated.
+	const double cells_per_rev = 250000.0 / (288.0 / 60.0) * (g_high_density ? 2 : 1);
 
-		t0 = t1;
-		t1 = t2;
-	}
+	return (int)(0.5 + track.mSamplesPerRev / cells_per_rev * (100000.0 / 90000.0) * (float)(400 - track.mPhysTrack) / 400.0f);
 }
 
 void postcomp_disk(RawDisk& raw_disk, PostCompensationMode mode) {
 	if (mode == kPostComp_None || mode == kPostComp_Auto)
 		return;
 
-	for(auto& tracks : raw_disk.mPhysTracks) {
-		for(auto& track : tracks) {
+	// tracks are independent, so just run them all in parallel
+	parallel_for(2 * RawDisk::kMaxPhysTracks,
+		[&](size_t index) {
+			RawTrack& track = raw_disk.mPhysTracks[index / RawDisk::kMaxPhysTracks][index % RawDisk::kMaxPhysTracks];
+			int thresh = 0;
+
 			switch(mode) {
 				case kPostComp_Mac800K:
-					postcomp_track_mac800k(track);
+					thresh = postcomp_threshold_mac800k(track);
+					break;
+
+				case kPostComp_MFM:
+					thresh = postcomp_threshold_mfm(track);
+					break;
+
+				case kPostComp_FM:
+					thresh = postcomp_threshold_fm(track);
 					break;
 			}
+
+			flux_spread_peaks(track.mTransitions.data(), track.mTransitions.size(), thresh);
 		}
-	}
+	);
 }
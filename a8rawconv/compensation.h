@@ -24,8 +24,13 @@ enum PostCompensationMode : uint8_t {
 	kPostComp_None,
 	kPostComp_Auto,
 	kPostComp_Mac800K,
+	kPostComp_MFM,
+	kPostComp_FM,
 };
 
+// Apply peak shift post-compensation to all tracks of a raw disk, using the
+// model for the given encoding. Auto mode only ever selects the Mac model; the
+// FM/MFM models are unvalidated and must be asked for.
 void postcomp_disk(RawDisk& raw_disk, PostCompensationMode mode);
 
 #endif
@@ -12,12 +12,19 @@
 #include "diskvfd.cpp"
 #include "diskxfd.cpp"
 #include "binary.cpp"
+#include "cellsplit.cpp"
 #include "checksum.cpp"
 #include "disk.cpp"
 #include "encode.cpp"
+#include "fluxtransform.cpp"
+#include "gcr.cpp"
 #include "globals.cpp"
 #include "interleave.cpp"
+#include "jsonreport.cpp"
 #include "os.cpp"
+#include "parallel.cpp"
+#include "rans.cpp"
+#include "rawdiska8f.cpp"
 #include "rawdiskkf.cpp"
 #include "rawdiskscp.cpp"
 #include "rawdiskscpdirect.cpp"
@@ -25,6 +32,9 @@
 #include "reporting.cpp"
 #include "scp.cpp"
 #include "sectorparser.cpp"
+#include "stats.cpp"
+#include "trackcache.cpp"
+#include "zip.cpp"
 
 #if defined(_WIN32)
 	#include "serial_win32.cpp"
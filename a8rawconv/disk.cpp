@@ -60,6 +60,44 @@ bool SectorInfo::HasSameContents(const SectorInfo& other) const {
 	return true;
 }
 
+uint32_t SectorInfo::ComputeDataFieldHash() const {
+	uint32_t hash = mbMFM;
+
+	hash += mAddressMark;
+	hash += mSectorSize;
+	hash += mComputedCRC;
+	hash += (uint32_t)mRecordedCRC << 16;
+
+	for(uint32_t i=0; i<mSectorSize; i+=4) {
+		hash += *(const uint32_t *)&mData[i];
+		hash = (hash >> 1) + (hash << 31);
+	}
+
+	return hash;
+}
+
+bool SectorInfo::HasSameDataField(const SectorInfo& other) const {
+	if (mbMFM != other.mbMFM)
+		return false;
+
+	if (mAddressMark != other.mAddressMark)
+		return false;
+
+	if (mSectorSize != other.mSectorSize)
+		return false;
+
+	if (mComputedCRC != other.mComputedCRC)
+		return false;
+
+	if (mRecordedCRC != other.mRecordedCRC)
+		return false;
+
+	if (memcmp(mData, other.mData, mSectorSize))
+		return false;
+
+	return true;
+}
+
 void reverse_track(RawTrack& raw_track) {
 	uint32_t max_time = 0;
 
@@ -73,13 +111,8 @@ void reverse_track(RawTrack& raw_track) {
 		max_time = std::max(max_time, (uint32_t)raw_track.mSpliceEnd);
 
 	// reverse all time values
-	auto rev_time = [=](uint32_t t) { return max_time - t; };
-
-	std::transform(raw_track.mIndexTimes.begin(), raw_track.mIndexTimes.end(), raw_track.mIndexTimes.begin(), rev_time);
-	std::reverse(raw_track.mIndexTimes.begin(), raw_track.mIndexTimes.end());
-
-	std::transform(raw_track.mTransitions.begin(), raw_track.mTransitions.end(), raw_track.mTransitions.begin(), rev_time);
-	std::reverse(raw_track.mTransitions.begin(), raw_track.mTransitions.end());
+	flux_reverse(raw_track.mIndexTimes.data(), raw_track.mIndexTimes.size(), max_time);
+	flux_reverse(raw_track.mTransitions.data(), raw_track.mTransitions.size(), max_time);
 
 	if (raw_track.mSpliceStart >= 0 && raw_track.mSpliceEnd >= 0) {
 		std::swap(raw_track.mSpliceStart, raw_track.mSpliceEnd);
@@ -144,6 +177,15 @@ void find_splice_points(RawDisk& raw_disk, const DiskInfo& decoded_disk) {
 }
 
 void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *>& secptrs) {
+	if (track_info.mbSifted) {
+		secptrs.clear();
+
+		for(uint32_t idx : track_info.mSiftedSectors)
+			secptrs.push_back(&track_info.mSectors[idx]);
+
+		return;
+	}
+
 	std::vector<SectorInfo *> newsecptrs;
 
 	// gather sectors from track
@@ -263,6 +305,7 @@ void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *
 
 			// check if we had more than one sector in this position that we kept
 			bool clean_sift = true;
+			int variants = 1;
 
 			if (subgroup.size() > 1 && mismatch) {
 				// Alright, we have multiple sectors in the same place with different contents. Let's see
@@ -293,6 +336,8 @@ void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *
 					++hashedSectors[hsref];
 				}
 
+				variants = (int)hashedSectors.size();
+
 				// check if we now only have one sector left; this can happen if the first read was bad
 				// and the rest were good
 				if (hashedSectors.size() == 1) {
@@ -369,6 +414,10 @@ void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *
 			best_sector->mPosition = position0;
 			best_sector->mEndingPosition = posend0;
 
+			best_sector->mSiftReads = (uint16_t)std::min<int>(n1, 0xFFFF);
+			best_sector->mSiftDiscardedReads = (uint16_t)std::min<int>(n1 - n2, 0xFFFF);
+			best_sector->mSiftVariants = (uint16_t)std::min<int>(variants, 0xFFFF);
+
 			newsecptrs.push_back(best_sector);
 			++sector_count;
 
@@ -388,3 +437,24 @@ void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *
 		}
 	);
 }
+
+void sift_disk(DiskInfo& disk) {
+	std::vector<SectorInfo *> secptrs;
+
+	for(int i=0; i<disk.mTrackCount; ++i) {
+		for(int side=0; side<disk.mSideCount; ++side) {
+			TrackInfo& track_info = disk.mPhysTracks[side][i * disk.mTrackStep];
+
+			if (track_info.mbSifted)
+				continue;
+
+			sift_sectors(track_info, i, secptrs);
+
+			track_info.mSiftedSectors.clear();
+			for(const SectorInfo *sec : secptrs)
+				track_info.mSiftedSectors.push_back((uint32_t)(sec - track_info.mSectors.data()));
+
+			track_info.mbSifted = true;
+		}
+	}
+}
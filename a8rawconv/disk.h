@@ -90,15 +90,43 @@ struct SectorInfo {
 	uint16_t mComputedAddressCRC;
 	uint32_t mRecordedCRC;
 	uint32_t mComputedCRC;
+
+	// Set by sift_sectors() on the sectors that it keeps: the number of reads
+	// found at this position, how many of them were discarded for CRC errors,
+	// and how many different versions of the contents were left after that.
+	uint16_t mSiftReads;
+	uint16_t mSiftDiscardedReads;
+	uint16_t mSiftVariants;
+
 	uint8_t mData[1024];
 
 	uint32_t ComputeContentHash() const;
 	bool HasSameContents(const SectorInfo& other) const;
+
+	// Same as above, but only over what is encoded in the data field.
+	uint32_t ComputeDataFieldHash() const;
+	bool HasSameDataField(const SectorInfo& other) const;
+};
+
+enum DecodeLimitFlags : uint8_t {
+	kDecodeLimit_LiveParsers	= 0x01,
+	kDecodeLimit_ParserSpawns	= 0x02,
+	kDecodeLimit_WallTime		= 0x04
 };
 
 struct TrackInfo {
 	std::vector<SectorInfo> mSectors;
 	std::vector<uint8_t> mGCRData;
+
+	// Decode limits that were hit while decoding this track (DecodeLimitFlags).
+	// If nonzero, the sector list is a best-effort result.
+	uint8_t mDecodeLimitsHit = 0;
+
+	// Result of sift_disk(): the sectors kept, as indices into mSectors in
+	// angular order. Sifting adjusts the kept sectors, so it must only happen
+	// once per track.
+	std::vector<uint32_t> mSiftedSectors;
+	bool mbSifted = false;
 };
 
 struct DiskInfo {
@@ -119,4 +147,9 @@ void reverse_tracks(RawDisk& raw_disk);
 void find_splice_points(RawDisk& raw_disk, const DiskInfo& decoded_disk);
 void sift_sectors(TrackInfo& track_info, int track_num, std::vector<SectorInfo *>& secptrs);
 
+// Sift all tracks of a disk up front, so that the encoder and the image
+// writers can use the results concurrently. sift_sectors() returns the stored
+// result for a track once it has been sifted.
+void sift_disk(DiskInfo& disk);
+
 #endif
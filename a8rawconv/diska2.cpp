@@ -14,9 +14,8 @@ void read_apple2_dsk(DiskInfo& disk, const char *path, int track, bool useProDOS
 
 	printf("Reading Apple II disk image (%s ordering): %s\n", useProDOSOrder ? "ProDOS" : "DOS 3.3", path);
 
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
 	// read tracks
 	const int (&sectorOrder)[16] = useProDOSOrder ? kLogicalToPhysicalA2ProDOS : kLogicalToPhysicalA2DOS;
@@ -33,7 +32,7 @@ void read_apple2_dsk(DiskInfo& disk, const char *path, int track, bool useProDOS
 		for(int j=0; j<16; ++j) {
 			SectorInfo& si = track_info.mSectors[j];
 
-			if (1 != fread(si.mData, 256, 1, fi))
+			if (!fi.Read(si.mData, 256))
 				fatalf("Unable to read data from input file: %s.\n", path);
 
 			si.mAddressMark = 0xFE;		// default DOS 3.3 volume number
@@ -46,22 +45,16 @@ void read_apple2_dsk(DiskInfo& disk, const char *path, int track, bool useProDOS
 			si.mPosition = (float)si.mIndex / 16.0f;
 		}
 	}
-
-	fclose(fi);
 }
 
-void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDOSOrder, bool mac_format) {
+void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDOSOrder, bool mac_format, MessageLog& log) {
 	uint32_t sector_size = mac_format ? 512 : 256;
 	uint32_t sectors_per_track = 16;
 
 	if (mac_format)
-		printf("Writing 3.5\" Mac / Apple II Unidisk disk image: %s\n", path);
+		log.Printf("Writing 3.5\" Mac / Apple II Unidisk disk image: %s\n", path);
 	else
-		printf("Writing Apple II disk image (%s ordering): %s\n", useProDOSOrder ? "ProDOS" : "DOS 3.3", path);
-
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+		log.Printf("Writing Apple II disk image (%s ordering): %s\n", useProDOSOrder ? "ProDOS" : "DOS 3.3", path);
 
 	// write tracks
 	const int (&sectorOrder)[16] = useProDOSOrder ? kLogicalToPhysicalA2ProDOS : kLogicalToPhysicalA2DOS;
@@ -73,6 +66,9 @@ void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDO
 	const int track_count = mac_format ? 80 : 35;
 	const int sides = mac_format ? disk.mSideCount : 1;
 
+	BinaryWriter writer;
+	writer.Reserve(track_count * sides * sectors_per_track * sector_size);
+
 	for(int i=0; i<track_count; ++i) {
 		for (int side=0; side<sides; ++side) {
 			TrackInfo& track_info = disk.mPhysTracks[side][mac_format ? i : i*2];
@@ -96,7 +92,7 @@ void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDO
 
 				if (secptr->mIndex >= 0 && secptr->mIndex < (int)sectorsPerTrack) {
 					if (secptrs2[secptr->mIndex])
-						printf("WARNING: Variable sectors not supported by DSK/DO format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
+						log.Printf("WARNING: Variable sectors not supported by DSK/DO format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
 					else
 						secptrs2[secptr->mIndex] = secptr;
 				}
@@ -121,45 +117,46 @@ void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDO
 					memcpy(secbuf, sec->mData, sector_size);
 
 					if (sec->mSectorSize != sector_size) {
-						printf("WARNING: Variable sector size not supported by DSK format. Writing out truncated data for track %d, sector %d.\n", i, physec+1);
+						log.Printf("WARNING: Variable sector size not supported by DSK format. Writing out truncated data for track %d, sector %d.\n", i, physec+1);
 						++badSectors;
 					} else if (sec->mRecordedCRC != sec->mComputedCRC) {
-						printf("WARNING: CRC error encoding not supported by DSK format. Ignoring CRC error for track %d, sector %d.\n", i, physec+1);
+						log.Printf("WARNING: CRC error encoding not supported by DSK format. Ignoring CRC error for track %d, sector %d.\n", i, physec+1);
 						++badSectors;
 					} else if (sec->mWeakOffset >= 0) {
-						printf("WARNING: Weak sector encoding not supported by DSK format. Ignoring error for track %d, sector %d.\n", i, physec+1);
+						log.Printf("WARNING: Weak sector encoding not supported by DSK format. Ignoring error for track %d, sector %d.\n", i, physec+1);
 						++badSectors;
 					}
 				}
 
-				fwrite(secbuf, sector_size, 1, fo);
+				writer.PutBytes(secbuf, sector_size);
 			}
 
 			if (missingSectorMask) {
 				if (!seenMissingWarning) {
 					seenMissingWarning = true;
-					printf("WARNING: Missing sectors not supported by DSK/DO format. Writing out null data.\n");
+					log.Printf("WARNING: Missing sectors not supported by DSK/DO format. Writing out null data.\n");
 				}
 
 				if (missingSectorMask == (1 << sectorsPerTrack) - 1)
-					printf("WARNING: No sectors found on track %u.\n", i);
+					log.Printf("WARNING: No sectors found on track %u.\n", i);
 				else {
-					printf("WARNING: Track %u: missing sectors:", i);
+					log.Printf("WARNING: Track %u: missing sectors:", i);
 
 					for(uint32_t j=0; j<sectorsPerTrack; ++j) {
 						if (missingSectorMask & (1 << j))
-							printf(" %u", j+1);
+							log.Printf(" %u", j+1);
 					}
 
-					printf("\n");
+					log.Printf("\n");
 				}
 			}
 		}
 	}
 
-	fclose(fo);
+	if (!writer.WriteFile(path, log))
+		return;
 
-	printf("%d missing sector%s, %d sector%s with errors\n"
+	log.Printf("%d missing sector%s, %d sector%s with errors\n"
 		, missingSectors, missingSectors == 1 ? "" : "s"
 		, badSectors, badSectors == 1 ? "" : "s");
 }
@@ -167,18 +164,19 @@ void write_apple2_dsk(const char *path, DiskInfo& disk, int track, bool useProDO
 void read_apple2_nib(RawDisk& raw_disk, const char *path, int selected_track) {
 	printf("Reading Apple II nibble image: %s\n", path);
 
-	FILE *fi = fopen(g_inputPath.c_str(), "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
 	// The image should be exactly $1A00 * 35 tracks = 232,960 bytes. We allocate
 	// 5 bytes over for the sync detection below.
 	std::unique_ptr<uint8_t[]> buf(new uint8_t[0x1A00 * 35 + 5]);
 
-	if (1 != fread(buf.get(), 0x1A00 * 35, 1, fi))
+	if (!fi.Read(buf.get(), 0x1A00 * 35))
 		fatal_read();
 
-	fclose(fi);
+	fi.Close();
+
+	raw_disk.mSynthesized = true;
 
 	// For now, take the easy/lazy out, and synthesize flux from the bytes.
 	// This will result in bogus timing for sync bytes, but NIB doesn't
@@ -243,15 +241,16 @@ void read_apple2_nib(RawDisk& raw_disk, const char *path, int selected_track) {
 	}
 };
 
-void write_apple2_nib(const char *path, const DiskInfo& disk, int track) {
-	printf("Writing Apple II nibble disk image: %s\n", path);
+void write_apple2_nib(const char *path, const DiskInfo& disk, int track, MessageLog& log) {
+	log.Printf("Writing Apple II nibble disk image: %s\n", path);
 
-	if (disk.mPhysTracks[0][0].mGCRData.size() < 0x1A00)
-		fatalf("No GCR data present. Apple II GCR decoding must be used for nibble output.\n");
+	if (disk.mPhysTracks[0][0].mGCRData.size() < 0x1A00) {
+		log.Fail("No GCR data present. Apple II GCR decoding must be used for nibble output.\n");
+		return;
+	}
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+	BinaryWriter writer;
+	writer.Reserve(0x1A00 * 35);
 
 	// write tracks
 	char nibbuf[0x1A00];
@@ -265,7 +264,7 @@ void write_apple2_nib(const char *path, const DiskInfo& disk, int track) {
 
 		if (max_offset <= 0) {
 			if (max_offset < 0)
-				printf("WARNING: Track %u is short (<$1A00 bytes) and will be padded.\n", track);
+				log.Printf("WARNING: Track %u is short (<$1A00 bytes) and will be padded.\n", track);
 
 			max_offset = 0;
 			memcpy(nibbuf, p, track_len);
@@ -296,8 +295,8 @@ void write_apple2_nib(const char *path, const DiskInfo& disk, int track) {
 			memcpy(nibbuf, p + track_offset, 0x1A00);
 		}
 
-		fwrite(nibbuf, 0x1A00, 1, fo);
+		writer.PutBytes(nibbuf, 0x1A00);
 	}
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
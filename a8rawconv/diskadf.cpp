@@ -20,15 +20,14 @@
 void read_adf(DiskInfo& disk, const char *path, int track_select) {
 	printf("Reading ADF file: %s\n", path);
 
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
 	// read in all sectors
 	std::vector<uint8_t> sector_data(512 * 1760, 0);
 
-	read_raw(sector_data.data(), sector_data.size(), fi, path);
-	fclose(fi);
+	read_raw(sector_data.data(), sector_data.size(), fi);
+	fi.Close();
 
 	for(uint32_t cyl = 0; cyl < 80; ++cyl) {
 		for(uint32_t head = 0; head < 2; ++head) {
@@ -69,15 +68,14 @@ void read_adf(DiskInfo& disk, const char *path, int track_select) {
 	disk.mPrimarySectorsPerTrack = 11;
 }
 
-void write_adf(const char *path, DiskInfo& disk, int track) {
+void write_adf(const char *path, DiskInfo& disk, int track, MessageLog& log) {
 	const uint32_t sector_size = 512;
 	const uint32_t sectors_per_track = 11;
 
-	printf("Writing ADF file: %s\n", path);
+	log.Printf("Writing ADF file: %s\n", path);
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+	BinaryWriter writer;
+	writer.Reserve(80 * 2 * sectors_per_track * sector_size);
 
 	for(int i=0; i<80; ++i) {
 		for(int head=0; head<2; ++head) {
@@ -98,7 +96,7 @@ void write_adf(const char *path, DiskInfo& disk, int track) {
 
 				if (secptr->mIndex >= 0 && secptr->mIndex < 11) {
 					if (secptrs2[secptr->mIndex])
-						printf("WARNING: Variable sectors not supported by ADF format. Discarding duplicate physical sector for cylinder %d, head %d, sector %d.\n", i, head, secptr->mIndex);
+						log.Printf("WARNING: Variable sectors not supported by ADF format. Discarding duplicate physical sector for cylinder %d, head %d, sector %d.\n", i, head, secptr->mIndex);
 					else
 						secptrs2[secptr->mIndex] = secptr;
 				}
@@ -112,24 +110,24 @@ void write_adf(const char *path, DiskInfo& disk, int track) {
 
 				if (!sec) {
 					if (track < 0 || track == i)
-						printf("WARNING: Missing sectors not supported by ADF format. Writing out null data for cylinder %d, head %d, sector %d.\n", i, head, j+1);
+						log.Printf("WARNING: Missing sectors not supported by ADF format. Writing out null data for cylinder %d, head %d, sector %d.\n", i, head, j+1);
 
 					memset(secbuf, 0, sizeof secbuf);
 				} else {
 					memcpy(secbuf, sec->mData, sector_size);
 
 					if (sec->mSectorSize != sector_size)
-						printf("WARNING: Variable sector size not supported by ADF format. Writing out truncated data for cylinder %d, head %d, sector %d.\n", i, head, j+1);
+						log.Printf("WARNING: Variable sector size not supported by ADF format. Writing out truncated data for cylinder %d, head %d, sector %d.\n", i, head, j+1);
 					else if (sec->mRecordedCRC != sec->mComputedCRC)
-						printf("WARNING: CRC error encoding not supported by ADF format. Ignoring CRC error for cylinder %d, head %d, sector %d.\n", i, head, j+1);
+						log.Printf("WARNING: CRC error encoding not supported by ADF format. Ignoring CRC error for cylinder %d, head %d, sector %d.\n", i, head, j+1);
 					else if (sec->mWeakOffset >= 0)
-						printf("WARNING: Weak sector encoding not supported by ADF format. Ignoring error for cylinder %d, head %d, sector %d.\n", i, head, j+1);
+						log.Printf("WARNING: Weak sector encoding not supported by ADF format. Ignoring error for cylinder %d, head %d, sector %d.\n", i, head, j+1);
 				}
 
-				fwrite(secbuf, sector_size, 1, fo);
+				writer.PutBytes(secbuf, sector_size);
 			}
 		}
 	}
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
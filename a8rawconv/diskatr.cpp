@@ -5,11 +5,10 @@ void read_atr(DiskInfo& disk, const char *path, int track_select) {
 
 	printf("Reading ATR file: %s\n", path);
 
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
-	read_raw(header, 16, fi, path);
+	read_raw(header, 16, fi);
 
 	// check signature
 	if (header[0] != 0x96 || header[1] != 0x02)
@@ -65,12 +64,12 @@ void read_atr(DiskInfo& disk, const char *path, int track_select) {
 	if (short_boot_sectors) {
 		// read in 3 SD boot sectors
 		for(int i=0; i<3; ++i)
-			read_raw(sector_data.data() + i*256, 128, fi, path);
+			read_raw(sector_data.data() + i*256, 128, fi);
 
 		// read in remaining DD sectors
-		read_raw(sector_data.data() + 3*256, sector_data.size() - 3*256, fi, path);
+		read_raw(sector_data.data() + 3*256, sector_data.size() - 3*256, fi);
 	} else {
-		read_raw(sector_data.data(), sector_data.size(), fi, path);
+		read_raw(sector_data.data(), sector_data.size(), fi);
 	}
 
 	// if we had long DD boot sectors, check whether they were stored as 128b or not
@@ -146,11 +145,9 @@ void read_atr(DiskInfo& disk, const char *path, int track_select) {
 	disk.mSideCount = sides;
 	disk.mPrimarySectorSize = sector_size;
 	disk.mPrimarySectorsPerTrack = sectors_per_track;
-
-	fclose(fi);
 }
 
-void write_atr(const char *path, DiskInfo& disk, int selected_track) {
+void write_atr(const char *path, DiskInfo& disk, int selected_track, MessageLog& log) {
 	uint32_t sector_size = 128;
 	uint32_t sectors_per_track = 18;
 	int sides = disk.mSideCount;
@@ -167,17 +164,15 @@ void write_atr(const char *path, DiskInfo& disk, int selected_track) {
 
 	if (sector_size >= 256) {
 		if (disk.mSideCount > 1)
-			printf("Writing DSDD ATR file: %s\n", path);
+			log.Printf("Writing DSDD ATR file: %s\n", path);
 		else
-			printf("Writing double density ATR file: %s\n", path);
+			log.Printf("Writing double density ATR file: %s\n", path);
 	} else if (sectors_per_track > 18)
-		printf("Writing enhanced density ATR file: %s\n", path);
+		log.Printf("Writing enhanced density ATR file: %s\n", path);
 	else
-		printf("Writing single density ATR file: %s\n", path);
+		log.Printf("Writing single density ATR file: %s\n", path);
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+	BinaryWriter writer;
 
 	const uint32_t data_tracks = std::min<uint32_t>(disk.mTrackCount, disk.mTrackStep > 1 ? 40 : 80);
 	const uint32_t total_sectors = sides * data_tracks * sectors_per_track;
@@ -185,12 +180,13 @@ void write_atr(const char *path, DiskInfo& disk, int selected_track) {
 	const uint32_t total_paras = total_bytes >> 4;
 
 	// write header
-	write_u8(0x96, fo);
-	write_u8(0x02, fo);
-	write_u16((uint16_t)total_paras, fo);
-	write_u16(sector_size, fo);
-	write_u16((uint16_t)(total_paras >> 16), fo);
-	write_pad(8, fo);
+	writer.Reserve(16 + total_bytes);
+	writer.PutU8(0x96);
+	writer.PutU8(0x02);
+	writer.PutU16((uint16_t)total_paras);
+	writer.PutU16(sector_size);
+	writer.PutU16((uint16_t)(total_paras >> 16));
+	writer.PutPad(8);
 
 	// write tracks
 	char secbuf[256];
@@ -218,7 +214,7 @@ void write_atr(const char *path, DiskInfo& disk, int selected_track) {
 
 				if (secptr->mIndex >= 1 && secptr->mIndex <= (int)sectors_per_track) {
 					if (secptrs2[secptr->mIndex - 1])
-						printf("WARNING: Variable sectors not supported by ATR format. Discarding duplicate physical sector for track %d, sector %d.\n", track, secptr->mIndex);
+						log.Printf("WARNING: Variable sectors not supported by ATR format. Discarding duplicate physical sector for track %d, sector %d.\n", track, secptr->mIndex);
 					else
 						secptrs2[secptr->mIndex - 1] = secptr;
 				}
@@ -232,16 +228,16 @@ void write_atr(const char *path, DiskInfo& disk, int selected_track) {
 
 				if (!sec) {
 					if (selected_track < 0 || selected_track == track)
-						printf("WARNING: Missing sectors not supported by ATR format. Writing out null data for track %d.%d, sector %d.\n", track, side, j+1);
+						log.Printf("WARNING: Missing sectors not supported by ATR format. Writing out null data for track %d.%d, sector %d.\n", track, side, j+1);
 				} else {
 					if (sec->mSectorSize != sector_size)
-						printf("WARNING: Variable sector size not supported by ATR format. Writing out truncated data for track %d, sector %d.\n", track, j+1);
+						log.Printf("WARNING: Variable sector size not supported by ATR format. Writing out truncated data for track %d, sector %d.\n", track, j+1);
 					else if (sec->mRecordedCRC != sec->mComputedCRC)
-						printf("WARNING: CRC error encoding not supported by ATR format. Ignoring CRC error for track %d, sector %d.\n", track, j+1);
+						log.Printf("WARNING: CRC error encoding not supported by ATR format. Ignoring CRC error for track %d, sector %d.\n", track, j+1);
 					else if (sec->mAddressMark != 0xFB)
-						printf("WARNING: Deleted sector encoding not supported by ATR format. Ignoring error for track %d, sector %d.\n", track, j+1);
+						log.Printf("WARNING: Deleted sector encoding not supported by ATR format. Ignoring error for track %d, sector %d.\n", track, j+1);
 					else if (sec->mWeakOffset >= 0)
-						printf("WARNING: Weak sector encoding not supported by ATR format. Ignoring error for track %d, sector %d.\n", track, j+1);
+						log.Printf("WARNING: Weak sector encoding not supported by ATR format. Ignoring error for track %d, sector %d.\n", track, j+1);
 				}
 			}
 		}
@@ -256,12 +252,12 @@ void write_atr(const char *path, DiskInfo& disk, int selected_track) {
 
 		// boot sectors are always written as 128 bytes
 		if (vsec <= 3)
-			fwrite(secbuf, 128, 1, fo);
+			writer.PutBytes(secbuf, 128);
 		else
-			fwrite(secbuf, sector_size, 1, fo);
+			writer.PutBytes(secbuf, sector_size);
 
 		++vsec;
 	}
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
@@ -63,28 +63,27 @@ struct ATXTrackChunkHeader {
 };
 
 void read_atx(DiskInfo& disk, const char *path, int track) {
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open file: %s\n", path);
+	InputFile fi;
+	fi.Open(path);
 
 	ATXFileHeader filehdr;
-	read_raw(&filehdr, sizeof filehdr, fi, path);
+	read_raw(&filehdr, sizeof filehdr, fi);
 
 	if (memcmp(&filehdr.mSignature, "AT8X", 4))
 		fatalf("Cannot read ATX file %s: incorrect signature; possibly not an ATX file\n", path);
 
 	for(;;) {
 		ATXTrackHeader trkhdr;
-		uint32_t trkbase = (uint32_t)ftell(fi);
+		uint32_t trkbase = (uint32_t)fi.Tell();
 
-		if (1 != fread(&trkhdr.mSize, 8, 1, fi))
+		if (!fi.Read(&trkhdr.mSize, 8))
 			break;
 
 		if (trkhdr.mSize < 8 || trkhdr.mSize >= 0x8000000U)
 			fatal_read();
 
 		if (trkhdr.mType != 0) {
-			fseek(fi, trkbase + trkhdr.mSize, SEEK_SET);
+			fi.Seek(trkbase + trkhdr.mSize);
 			continue;
 		}
 
@@ -92,12 +91,12 @@ void read_atx(DiskInfo& disk, const char *path, int track) {
 		if (trkhdr.mSize < sizeof(trkhdr))
 			fatal("Invalid track header in ATX file.\n");
 
-		read_raw(&trkhdr.mTrackNum, sizeof(trkhdr) - 8, fi, path);
+		read_raw(&trkhdr.mTrackNum, sizeof(trkhdr) - 8, fi);
 
 		// check track number
 		if (trkhdr.mTrackNum > 40) {
 			printf("WARNING: Ignoring track in ATX file: %u\n", trkhdr.mTrackNum);
-			fseek(fi, trkbase + trkhdr.mSize, SEEK_SET);
+			fi.Seek(trkbase + trkhdr.mSize);
 			continue;
 		}
 
@@ -107,7 +106,7 @@ void read_atx(DiskInfo& disk, const char *path, int track) {
 		TrackInfo& track_info = disk.mPhysTracks[0][trkhdr.mTrackNum * 2];
 
 		std::vector<uint8_t> rawtrack(trkhdr.mSize);
-		read_raw(rawtrack.data() + sizeof(trkhdr), trkhdr.mSize - sizeof(trkhdr), fi, path);
+		read_raw(rawtrack.data() + sizeof(trkhdr), trkhdr.mSize - sizeof(trkhdr), fi);
 
 		// parse track chunks
 		if (trkhdr.mSize >= sizeof(trkhdr) + 8) {
@@ -207,18 +206,12 @@ void read_atx(DiskInfo& disk, const char *path, int track) {
 		}
 
 		// next track
-		fseek(fi, trkbase + trkhdr.mSize, SEEK_SET);
+		fi.Seek(trkbase + trkhdr.mSize);
 	}
-
-	fclose(fi);
 }
 
-void write_atx(const char *path, DiskInfo& disk, int track) {
-	printf("Writing ATX file: %s\n", path);
-
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+void write_atx(const char *path, DiskInfo& disk, int track, MessageLog& log) {
+	log.Printf("Writing ATX file: %s\n", path);
 
 	// check if we have enhanced density
 	bool has_mfm = false;
@@ -237,22 +230,24 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 			break;
 	}
 
+	BinaryWriter writer;
+
 	// write header
-	fwrite("AT8X", 4, 1, fo);
-	write_u16(1, fo);		// major version
-	write_u16(1, fo);		// minor version
-	write_u16(0x5241, fo);		// creator ('AR')
-	write_u16(0, fo);		// creator version
-	write_u32(0, fo);		// flags
-	write_u16(0, fo);		// image type
-	write_u8(has_mfm ? 1 : 0, fo);		// density
-	write_u8(0, fo);		// [pad]
-	write_u32(0, fo);		// image ID
-	write_u16(0, fo);		// image version
-	write_u16(0, fo);		// [pad]
-	write_u32(48, fo);		// track data offset
-	write_u32(0, fo);		// total size
-	write_pad(12, fo);
+	writer.PutBytes("AT8X", 4);
+	writer.PutU16(1);		// major version
+	writer.PutU16(1);		// minor version
+	writer.PutU16(0x5241);		// creator ('AR')
+	writer.PutU16(0);		// creator version
+	writer.PutU32(0);		// flags
+	writer.PutU16(0);		// image type
+	writer.PutU8(has_mfm ? 1 : 0);		// density
+	writer.PutU8(0);		// [pad]
+	writer.PutU32(0);		// image ID
+	writer.PutU16(0);		// image version
+	writer.PutU16(0);		// [pad]
+	writer.PutU32(48);		// track data offset
+	writer.PutU32(0);		// total size
+	writer.PutPad(12);
 
 	// write tracks
 	int phantom_sectors = 0;
@@ -295,30 +290,30 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 		};
 
 		if (track_has_fm && track_has_mfm)
-			printf("WARNING: Track %2u has mixed FM and MFM sectors, which is not supported by ATX.\n", i);
+			log.Printf("WARNING: Track %2u has mixed FM and MFM sectors, which is not supported by ATX.\n", i);
 
 		// write track header
-		write_u32(32					// track header
+		writer.PutU32(32					// track header
 			+ 8 + 8*num_secs			// sector info chunk
 			+ 8 + 128*num_secs			// sector data chunk
 			+ 8*weak_count				// weak chunks
 			+ 8*ext_count				// extended sector info chunks
-			+ 8, fo);					// terminator chunk
-		write_u16(0, fo);			// type
-		write_u16(0, fo);			// [pad]
-		write_u8(i, fo);			// track number
-		write_u8(0, fo);			// [pad]
-		write_u16(num_secs, fo);	// sector count
-		write_u16(0, fo);			// rate
-		write_pad(2, fo);			// [pad]
-		write_u32(track_has_mfm ? 2 : 0, fo);			// flags
-		write_u32(32, fo);			// data offset
-		write_pad(8, fo);			// [pad]
+			+ 8);					// terminator chunk
+		writer.PutU16(0);			// type
+		writer.PutU16(0);			// [pad]
+		writer.PutU8(i);			// track number
+		writer.PutU8(0);			// [pad]
+		writer.PutU16(num_secs);	// sector count
+		writer.PutU16(0);			// rate
+		writer.PutPad(2);			// [pad]
+		writer.PutU32(track_has_mfm ? 2 : 0);			// flags
+		writer.PutU32(32);			// data offset
+		writer.PutPad(8);			// [pad]
 
 		// write sector list header
-		write_u32(8 + 8 * num_secs, fo);
-		write_u8(1, fo);
-		write_pad(3, fo);
+		writer.PutU32(8 + 8 * num_secs);
+		writer.PutU8(1);
+		writer.PutPad(3);
 
 		// write out sector headers
 
@@ -330,7 +325,7 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 		{
 			auto *sec_ptr = *it;
 
-			write_u8(sec_ptr->mIndex, fo);
+			writer.PutU8(sec_ptr->mIndex);
 
 			uint8_t fdcStatus = 0;
 
@@ -338,9 +333,9 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 			fdcStatus += (~sec_ptr->mAddressMark & 2) << 4;
 
 			if (sec_ptr->mAddressMark == 0xF8)
-				printf("WARNING: Track %2d, sector %2d: Deleted sector found.\n", i, sec_ptr->mIndex);
+				log.Printf("WARNING: Track %2d, sector %2d: Deleted sector found.\n", i, sec_ptr->mIndex);
 			else if (sec_ptr->mAddressMark != 0xFB)
-				printf("WARNING: Track %2d, sector %2d: User-defined sector found (%02X).\n", i, sec_ptr->mIndex, sec_ptr->mAddressMark);
+				log.Printf("WARNING: Track %2d, sector %2d: User-defined sector found (%02X).\n", i, sec_ptr->mIndex, sec_ptr->mAddressMark);
 
 			// set both CRC and missing sector bits if the address CRC didn't match
 			// set CRC error flag only if the data frame CRC didn't match
@@ -351,7 +346,7 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 
 			// set lost data, and DRQ flags if sector is long
 			if (sec_ptr->mSectorSize != 128) {
-				printf("WARNING: Track %2d, sector %2d: Long sector of %u bytes found.\n", i, sec_ptr->mIndex, sec_ptr->mSectorSize);
+				log.Printf("WARNING: Track %2d, sector %2d: Long sector of %u bytes found.\n", i, sec_ptr->mIndex, sec_ptr->mSectorSize);
 
 				// We need to preserve the CRC flag for long reads. 810s appear to read the status byte
 				// immediately, whereas 1050s wait for the FDC to complete the sector read first.
@@ -368,57 +363,57 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 			if (fdcStatus)
 				++error_sectors;
 
-			write_u8(fdcStatus, fo);
-			write_u16((uint16_t)((int)(sec_ptr->mPosition * 26042) % 26042), fo);
-			write_u32(data_offset, fo);
+			writer.PutU8(fdcStatus);
+			writer.PutU16((uint16_t)((int)(sec_ptr->mPosition * 26042) % 26042));
+			writer.PutU32(data_offset);
 			data_offset += 128;
 		};
 
 		// write out sector data
-		write_u32((data_offset - base_data_offset) + 8, fo);
-		write_u8(0, fo);
-		write_pad(3, fo);
+		writer.PutU32((data_offset - base_data_offset) + 8);
+		writer.PutU8(0);
+		writer.PutPad(3);
 
 		for(auto it = secptrs.begin(), itEnd = secptrs.end();
 			it != itEnd;
 			++it)
 		{
 			auto *sec_ptr = *it;
-			fwrite(sec_ptr->mData, 128, 1, fo);
+			writer.PutBytes(sec_ptr->mData, 128);
 		};
 
 		// write out weak chunk and long sector info
 		for(int j=0; j<num_secs; ++j) {
 			const SectorInfo& si = *secptrs[j];
 			if (si.mWeakOffset >= 0) {
-				write_u32(8, fo);
-				write_u8(0x10, fo);
-				write_u8((uint8_t)j, fo);
-				write_u16((uint16_t)secptrs[j]->mWeakOffset, fo);
+				writer.PutU32(8);
+				writer.PutU8(0x10);
+				writer.PutU8((uint8_t)j);
+				writer.PutU16((uint16_t)secptrs[j]->mWeakOffset);
 			}
 
 			if (si.mSectorSize > 256) {
-				write_u32(8, fo);
-				write_u8(0x11, fo);
-				write_u8((uint8_t)j, fo);
+				writer.PutU32(8);
+				writer.PutU8(0x11);
+				writer.PutU8((uint8_t)j);
 
 				uint16_t sscode = 2;
 
 				if (si.mSectorSize >= 1024)
 					sscode = 3;
 
-				write_u16((uint16_t)sscode, fo);
+				writer.PutU16((uint16_t)sscode);
 			}
 		};
 
 		// write end of track chunks
-		write_u32(0, fo);
-		write_u32(0, fo);
+		writer.PutU32(0);
+		writer.PutU32(0);
 
 		// report any missing sectors
 		if (std::find(std::begin(sector_map), std::end(sector_map), true) == std::end(sector_map)) {
 			if (track < 0 || track == i) {
-				printf("WARNING: No sectors found for track %d -- possibly unformatted.\n", i);
+				log.Printf("WARNING: No sectors found for track %d -- possibly unformatted.\n", i);
 				missing_sectors += 18;
 			}
 		} else {
@@ -432,7 +427,7 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 			if (!missingSecs.empty()) {
 				std::sort(missingSecs.begin(), missingSecs.end());
 
-				printf("WARNING: Track %2d: Missing sectors:", i);
+				log.Printf("WARNING: Track %2d: Missing sectors:", i);
 
 				int skipComma = 1;
 
@@ -440,12 +435,12 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 					it != itEnd;
 					++it)
 				{
-					printf(", %d" + skipComma, *it);
+					log.Printf(", %d" + skipComma, *it);
 
 					skipComma = 0;
 				}
 
-				printf(".\n");
+				log.Printf(".\n");
 			}
 
 			missing_sectors += (int)missingSecs.size();
@@ -453,14 +448,12 @@ void write_atx(const char *path, DiskInfo& disk, int track) {
 	}
 
 	// back-patch size
-	uint32_t total_size = ftell(fo);
-	fseek(fo, 32, SEEK_SET);
-	write_u32(total_size, fo);
+	writer.PatchU32(32, (uint32_t)writer.GetSize());
 
-	printf("%d missing sector%s, %d phantom sector%s, %d sector%s with errors\n"
+	log.Printf("%d missing sector%s, %d phantom sector%s, %d sector%s with errors\n"
 		, missing_sectors, missing_sectors == 1 ? "" : "s"
 		, phantom_sectors, phantom_sectors == 1 ? "" : "s"
 		, error_sectors, error_sectors == 1 ? "" : "s");
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
\ No newline at end of file
@@ -22,12 +22,11 @@ void read_vfd(DiskInfo& disk, const char *path, int track_select) {
 
 	printf("Reading VFD/FLP file: %s\n", path);
 
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
-	auto actual = fread(image.data(), 1, image.size(), fi);
-	fclose(fi);
+	auto actual = fi.ReadPartial(image.data(), image.size());
+	fi.Close();
 
 	if (actual < 0)
 		fatalf("Unable to read input file: %s.\n", path);
@@ -133,7 +132,7 @@ void read_vfd(DiskInfo& disk, const char *path, int track_select) {
 	}
 }
 
-void write_vfd(const char *path, DiskInfo& disk, int track) {
+void write_vfd(const char *path, DiskInfo& disk, int track, MessageLog& log) {
 	int sector_size = 512;
 	int sectors_per_track = 9;
 	int sides = disk.mSideCount;
@@ -157,11 +156,10 @@ void write_vfd(const char *path, DiskInfo& disk, int track) {
 	else
 		sectors_per_track = 8;
 
-	printf("Writing %uK FLP/VFD file: %s\n", (sector_size * sectors_per_track * sides * tracks) >> 10, path);
+	log.Printf("Writing %uK FLP/VFD file: %s\n", (sector_size * sectors_per_track * sides * tracks) >> 10, path);
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+	BinaryWriter writer;
+	writer.Reserve(sector_size * sectors_per_track * sides * tracks);
 
 	// write tracks
 	char secbuf[512];
@@ -187,7 +185,7 @@ void write_vfd(const char *path, DiskInfo& disk, int track) {
 
 				if (secptr->mIndex >= 1 && secptr->mIndex <= (int)sectors_per_track) {
 					if (secptrs2[secptr->mIndex - 1])
-						printf("WARNING: Variable sectors not supported by FLP/VFD format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
+						log.Printf("WARNING: Variable sectors not supported by FLP/VFD format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
 					else
 						secptrs2[secptr->mIndex - 1] = secptr;
 				}
@@ -201,16 +199,16 @@ void write_vfd(const char *path, DiskInfo& disk, int track) {
 
 				if (!sec) {
 					if (track < 0 || track == i)
-						printf("WARNING: Missing sectors not supported by FLP/VFD format. Writing out null data for track %d.%d, sector %d.\n", i, side, j+1);
+						log.Printf("WARNING: Missing sectors not supported by FLP/VFD format. Writing out null data for track %d.%d, sector %d.\n", i, side, j+1);
 				} else {
 					if (sec->mSectorSize != sector_size)
-						printf("WARNING: Variable sector size not supported by FLP/VFD format. Writing out truncated data for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Variable sector size not supported by FLP/VFD format. Writing out truncated data for track %d, sector %d.\n", i, j+1);
 					else if (sec->mRecordedCRC != sec->mComputedCRC)
-						printf("WARNING: CRC error encoding not supported by FLP/VFD format. Ignoring CRC error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: CRC error encoding not supported by FLP/VFD format. Ignoring CRC error for track %d, sector %d.\n", i, j+1);
 					else if (sec->mAddressMark != 0xFB)
-						printf("WARNING: Deleted sector encoding not supported by FLP/VFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Deleted sector encoding not supported by FLP/VFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
 					else if (sec->mWeakOffset >= 0)
-						printf("WARNING: Weak sector encoding not supported by FLP/VFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Weak sector encoding not supported by FLP/VFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
 				}
 			}
 		}
@@ -226,10 +224,10 @@ void write_vfd(const char *path, DiskInfo& disk, int track) {
 				c = ~c;
 		}
 
-		fwrite(secbuf, sector_size, 1, fo);
+		writer.PutBytes(secbuf, sector_size);
 
 		++vsec;
 	}
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
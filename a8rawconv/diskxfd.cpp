@@ -22,13 +22,12 @@ void read_xfd(DiskInfo& disk, const char *path, int track_select) {
 
 	printf("Reading XFD file: %s\n", path);
 
-	FILE *fi = fopen(path, "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
-	auto actual = fread(image.data(), 1, image.size(), fi);
+	auto actual = fi.ReadPartial(image.data(), image.size());
 
-	fclose(fi);
+	fi.Close();
 
 	if (actual < 0)
 		fatalf("Unable to read input file: %s.\n", path);
@@ -130,7 +129,7 @@ void read_xfd(DiskInfo& disk, const char *path, int track_select) {
 	}
 }
 
-void write_xfd(const char *path, DiskInfo& disk, int selected_track) {
+void write_xfd(const char *path, DiskInfo& disk, int selected_track, MessageLog& log) {
 	int sector_size = 512;
 	int sectors_per_track = 9;
 	int sides = disk.mSideCount;
@@ -155,18 +154,18 @@ void write_xfd(const char *path, DiskInfo& disk, int selected_track) {
 	} else if (sector_size == 256 && sectors_per_track == 18 && mfm) {
 		// double density or DSDD
 	} else {
-		fatalf("Unsupported geometry for XFD: %d sectors/track, %s, %s encoding.\n"
+		log.Fail("Unsupported geometry for XFD: %d sectors/track, %s, %s encoding.\n"
 			, sectors_per_track
 			, sides > 1 ? "2 sides" : "1 side"
 			, mfm ? "MFM" : "FM"
 		);
+		return;
 	}
 
-	printf("Writing %uK XFD file: %s\n", (sector_size * sectors_per_track * sides * tracks) >> 10, path);
+	log.Printf("Writing %uK XFD file: %s\n", (sector_size * sectors_per_track * sides * tracks) >> 10, path);
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Unable to open output file: %s.\n", path);
+	BinaryWriter writer;
+	writer.Reserve(sector_size * sectors_per_track * sides * tracks);
 
 	// write tracks
 	char secbuf[256];
@@ -194,7 +193,7 @@ void write_xfd(const char *path, DiskInfo& disk, int selected_track) {
 
 				if (secptr->mIndex >= 1 && secptr->mIndex <= (int)sectors_per_track) {
 					if (secptrs2[secptr->mIndex - 1])
-						printf("WARNING: Variable sectors not supported by XFD format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
+						log.Printf("WARNING: Variable sectors not supported by XFD format. Discarding duplicate physical sector for track %d, sector %d.\n", i, secptr->mIndex);
 					else
 						secptrs2[secptr->mIndex - 1] = secptr;
 				}
@@ -208,16 +207,16 @@ void write_xfd(const char *path, DiskInfo& disk, int selected_track) {
 
 				if (!sec) {
 					if (selected_track < 0 || selected_track == track)
-						printf("WARNING: Missing sectors not supported by XFD format. Writing out null data for track %d.%d, sector %d.\n", i, side, j+1);
+						log.Printf("WARNING: Missing sectors not supported by XFD format. Writing out null data for track %d.%d, sector %d.\n", i, side, j+1);
 				} else {
 					if (sec->mSectorSize != sector_size)
-						printf("WARNING: Variable sector size not supported by XFD format. Writing out truncated data for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Variable sector size not supported by XFD format. Writing out truncated data for track %d, sector %d.\n", i, j+1);
 					else if (sec->mRecordedCRC != sec->mComputedCRC)
-						printf("WARNING: CRC error encoding not supported by XFD format. Ignoring CRC error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: CRC error encoding not supported by XFD format. Ignoring CRC error for track %d, sector %d.\n", i, j+1);
 					else if (sec->mAddressMark != 0xFB)
-						printf("WARNING: Deleted sector encoding not supported by XFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Deleted sector encoding not supported by XFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
 					else if (sec->mWeakOffset >= 0)
-						printf("WARNING: Weak sector encoding not supported by XFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
+						log.Printf("WARNING: Weak sector encoding not supported by XFD format. Ignoring error for track %d, sector %d.\n", i, j+1);
 				}
 			}
 		}
@@ -231,10 +230,10 @@ void write_xfd(const char *path, DiskInfo& disk, int selected_track) {
 			memcpy(secbuf, sec->mData, sector_size);
 		}
 
-		fwrite(secbuf, sector_size, 1, fo);
+		writer.PutBytes(secbuf, sector_size);
 
 		++vsec;
 	}
 
-	fclose(fo);
+	writer.WriteFile(path, log);
 }
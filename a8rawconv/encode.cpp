@@ -1,4 +1,5 @@
 #include "stdafx.h"
+#include "stats.h"
 
 // Nominal cell times for encodings at 5ns/tick @ 360 RPM
 const uint32_t kNominalFMBitCellTime	= 640;	// 4us @ 288 RPM = 3.200us @ 360 RPM (Atari FM)
@@ -15,6 +16,139 @@ static const uint8_t kGCR6Encoder[64]={
 	0xF7, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
 };
 
+// Positions of the set bits in each byte, counting from the MSB. The encoders
+// use this to emit the transitions for a byte's worth of cells at once.
+struct CellPositions {
+	uint8_t mCount;
+	uint8_t mPos[8];
+};
+
+class CellPositionTable {
+public:
+	CellPositionTable() {
+		for(int v=0; v<256; ++v) {
+			CellPositions& entry = mEntries[v];
+
+			entry.mCount = 0;
+
+			for(int i=0; i<8; ++i) {
+				if (v & (0x80 >> i))
+					entry.mPos[entry.mCount++] = (uint8_t)i;
+			}
+		}
+	}
+
+	CellPositions mEntries[256];
+};
+
+static const CellPositionTable kCellPositionTable;
+
+// Transition shifts for encodings without precompensation.
+static const uint32_t kNoShift[3] = { 0, 0, 0 };
+
+// An encoded stretch of flux, with times relative to its start.
+struct EncodedField {
+	std::vector<uint32_t> mStream;
+	uint32_t mDuration;
+	uint32_t mMFMShifter;
+};
+
+// Data fields encoded during an encode_disk() call. A sector's data field only
+// depends on its contents and the encoding parameters, unlike its address
+// field, so disks full of identical sectors only need each distinct data
+// field encoded once. Tracks are encoded in parallel, so the cache is shared
+// under a lock; fields are never removed and so can be used after unlocking.
+//
+// Each entry holds the flux for its field, several times the size of the
+// sector data, so a disk of all different sectors would otherwise keep a copy
+// of its whole encoding here. Fields past the memory limit are encoded every
+// time instead of being added.
+class DataFieldCache {
+public:
+	enum : uint64_t { kMaxMemorySize = 16 << 20 };
+
+	// Encoding parameters that the field depends on besides the sector contents.
+	struct Params {
+		uint32_t mEncoding;
+		uint32_t mBitCellTime;
+		uint32_t mMFMShifter;
+		bool mbPrecompEnabled;
+
+		bool operator==(const Params& other) const {
+			return mEncoding == other.mEncoding
+				&& mBitCellTime == other.mBitCellTime
+				&& mMFMShifter == other.mMFMShifter
+				&& mbPrecompEnabled == other.mbPrecompEnabled;
+		}
+	};
+
+	const EncodedField *Find(const SectorInfo& sec, const Params& params, uint32_t hash) const {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		const auto range = mEntries.equal_range(hash);
+		for(auto it = range.first; it != range.second; ++it) {
+			const Entry& entry = it->second;
+
+			if (entry.mParams == params && entry.Matches(sec))
+				return &entry.mField;
+		}
+
+		return nullptr;
+	}
+
+	void Add(const SectorInfo& sec, const Params& params, uint32_t hash, EncodedField&& field) {
+		const uint64_t entrySize = sizeof(std::pair<const uint32_t, Entry>) + sec.mSectorSize + field.mStream.size() * sizeof(uint32_t);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if (mMemorySize + entrySize > kMaxMemorySize)
+			return;
+
+		mMemorySize += entrySize;
+
+		Entry& entry = mEntries.emplace(hash, Entry())->second;
+		entry.mParams = params;
+		entry.mbMFM = sec.mbMFM;
+		entry.mAddressMark = sec.mAddressMark;
+		entry.mRecordedCRC = sec.mRecordedCRC;
+		entry.mComputedCRC = sec.mComputedCRC;
+		entry.mData.assign(sec.mData, sec.mData + sec.mSectorSize);
+		entry.mField = std::move(field);
+	}
+
+	uint64_t GetMemorySize() const {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		return mMemorySize;
+	}
+
+private:
+	// The parts of a sector that its data field is encoded from; see
+	// SectorInfo::HasSameDataField().
+	struct Entry {
+		Params mParams;
+		bool mbMFM;
+		uint8_t mAddressMark;
+		uint32_t mRecordedCRC;
+		uint32_t mComputedCRC;
+		std::vector<uint8_t> mData;
+		EncodedField mField;
+
+		bool Matches(const SectorInfo& sec) const {
+			return mbMFM == sec.mbMFM
+				&& mAddressMark == sec.mAddressMark
+				&& mRecordedCRC == sec.mRecordedCRC
+				&& mComputedCRC == sec.mComputedCRC
+				&& mData.size() == sec.mSectorSize
+				&& !memcmp(mData.data(), sec.mData, mData.size());
+		}
+	};
+
+	mutable std::mutex mMutex;
+	std::unordered_multimap<uint32_t, Entry> mEntries;
+	uint64_t mMemorySize = 0;
+};
+
 class SectorEncoder {
 public:
 	SectorEncoder()	{
@@ -25,10 +159,67 @@ public:
 		mBitCellTime = bct;
 	}
 
+	// Most flux transitions that one encoded byte can produce. FM can have a
+	// transition in every one of its 16 cells, and weak FM bytes have 10. MFM
+	// never has transitions in adjacent cells, and Apple II GCR has only 8
+	// cells per byte.
+	enum : uint32_t {
+		kMaxTransitionsPerByteFM = 16,
+		kMaxTransitionsPerByteMFM = 8,
+		kMaxTransitionsPerByteA2GCR = 8
+	};
+
+	// Reserve the stream for a sector of the given number of encoded bytes.
+	// The stream only stays within this if the caller counts every byte it
+	// encodes for the sector, including gaps.
+	void ReserveBytes(uint32_t bytes, uint32_t maxTransitionsPerByte) {
+		mStream.reserve(bytes * maxTransitionsPerByte);
+	}
+
 	void SetPrecompEnabled(bool enabled) {
 		mbPrecompEnabled = enabled;
 	}
 
+	// Encode the data field of a sector through encodeFn, or copy it from the
+	// cache if an identical field has already been encoded. Sectors with weak
+	// bytes are always encoded, since the weak byte encoding isn't relative
+	// to the current time.
+	template<typename T>
+	void EncodeDataField(DataFieldCache& cache, uint32_t encoding, const SectorInfo& sec, const T& encodeFn) {
+		if (sec.mWeakOffset >= 0) {
+			encodeFn();
+			return;
+		}
+
+		const DataFieldCache::Params params { encoding, mBitCellTime, mMFMShifter, mbPrecompEnabled };
+		const uint32_t hash = sec.ComputeDataFieldHash();
+
+		if (const EncodedField *field = cache.Find(sec, params, hash)) {
+			const size_t offset = mStream.size();
+			const uint32_t start = mTime;
+
+			mStream.resize(offset + field->mStream.size());
+			std::transform(field->mStream.begin(), field->mStream.end(), mStream.begin() + offset, [=](uint32_t t) { return start + t; });
+
+			mTime += field->mDuration;
+			mMFMShifter = field->mMFMShifter;
+			return;
+		}
+
+		const size_t offset = mStream.size();
+		const uint32_t start = mTime;
+
+		encodeFn();
+
+		EncodedField field;
+		field.mStream.resize(mStream.size() - offset);
+		std::transform(mStream.begin() + offset, mStream.end(), field.mStream.begin(), [=](uint32_t t) { return t - start; });
+		field.mDuration = mTime - start;
+		field.mMFMShifter = mMFMShifter;
+
+		cache.Add(sec, params, hash, std::move(field));
+	}
+
 	void BeginCritical() {
 		mCriticalStart = mTime;
 	}
@@ -46,18 +237,12 @@ public:
 	}
 
 	void EncodePartialByteFM(uint8_t clock, uint8_t data, int bits) {
-		for(int i=0; i<bits; ++i) {
-			if (clock & 0x80)
-				mStream.push_back(mTime);
-
-			if (data & 0x80)
-				mStream.push_back(mTime + mBitCellTime);
+		// clock and data cells alternate, clock first
+		const uint32_t cells = merge_cells16(clock, data) & (0xFFFF0000 >> (bits * 2));
 
-			clock += clock;
-			data += data;
+		EmitCells(cells, 0, 0, kNoShift);
 
-			mTime += mBitCellTime*2;
-		}		
+		mTime += mBitCellTime*2*bits;
 	}
 
 	void EncodeWeakByteFM() {
@@ -83,69 +268,35 @@ public:
 	}
 
 	void EncodeByteMFM(uint8_t clock_mask, uint8_t data, int bits) {
-		static const uint8_t kExpand4[16] = {
-			0b0'00000000,
-			0b0'00000001,
-			0b0'00000100,
-			0b0'00000101,
-			0b0'00010000,
-			0b0'00010001,
-			0b0'00010100,
-			0b0'00010101,
-			0b0'01000000,
-			0b0'01000001,
-			0b0'01000100,
-			0b0'01000101,
-			0b0'01010000,
-			0b0'01010001,
-			0b0'01010100,
-			0b0'01010101,
-		};
-
 		// shift in data bits only
-		mMFMShifter = (mMFMShifter & 0xFF0000) + (kExpand4[data >> 4] << 8) + kExpand4[data & 15];
+		mMFMShifter = (mMFMShifter & 0xFF0000) + merge_cells16(0, data);
 
 		// recompute new clock bits
-		uint32_t clockMask32 = (kExpand4[clock_mask >> 4] << 8) + kExpand4[clock_mask & 15];
+		uint32_t clockMask32 = merge_cells16(0, clock_mask);
 
 		mMFMShifter += ~((mMFMShifter << 1) | (mMFMShifter >> 1)) & (clockMask32 << 1);
 
 		// shift out data and clock bits
-		int bits2 = bits * 2;
+		const int bits2 = bits * 2;
+		const uint32_t cells = mMFMShifter & (0xFFFF0000 >> bits2) & 0xFFFF;
 
 		if (mbPrecompEnabled) {
 			// write precompensation -- shift flux transitions by 125us next to adjacent transitions
-			for(int i=0; i<bits2; ++i) {
-				if (mMFMShifter & 0x8000) {
-					uint32_t adjacentBits = mMFMShifter & 0x22000;
-
-					if (adjacentBits == 0x20000) {
-						// close to prior transition -- shift backwards 1/16th of a bit cell
-						mStream.push_back(mTime);
-					} else if (adjacentBits == 0x2000) {
-						// close to next transition -- shift forwards 1/16th of a bit cell
-						mStream.push_back(mTime + (mBitCellTime >> 3));
-					} else {
-						// no transitions nearly -- use nominal delay
-						mStream.push_back(mTime + (mBitCellTime >> 4));
-					}
-
-				}
-
-				mMFMShifter += mMFMShifter;
-
-				mTime += mBitCellTime;
-			}
+			//
+			// Transitions close to a prior transition are shifted backwards 1/16th of a bit cell,
+			// and ones close to the next transition forwards 1/16th of a bit cell; otherwise the
+			// nominal delay is used. Cells past the end of the shifter read as no transition.
+			const uint32_t prior = (mMFMShifter >> 2) & 0xFFFF;
+			const uint32_t next = (mMFMShifter << 2) & 0xFFFF;
+			const uint32_t shifts[3] = { mBitCellTime >> 4, 0, mBitCellTime >> 3 };
+
+			EmitCells(cells, cells & prior & ~next, cells & next & ~prior, shifts);
 		} else {
-			for(int i=0; i<bits2; ++i) {
-				if (mMFMShifter & 0x8000)
-					mStream.push_back(mTime);
-
-				mMFMShifter += mMFMShifter;
-
-				mTime += mBitCellTime;
-			}
+			EmitCells(cells, 0, 0, kNoShift);
 		}
+
+		mMFMShifter <<= bits2;
+		mTime += mBitCellTime * bits2;
 	}
 
 	void EncodeWeakByteMFM() {
@@ -167,13 +318,9 @@ public:
 	}
 
 	void EncodeByteGCR(uint8_t data) {
-		for(int i=0; i<8; ++i) {
-			if (data & 0x80)
-				mStream.push_back(mTime);
+		EmitCells((uint32_t)data << 8, 0, 0, kNoShift);
 
-			data <<= 1;
-			mTime += mBitCellTime;
-		}
+		mTime += mBitCellTime*8;
 	}
 
 	void EncodeSyncByteGCR() {
@@ -189,6 +336,33 @@ public:
 			EncodeSyncByteGCR();
 	}
 
+private:
+	// Emit a transition for each set bit of 16 cells, MSB first, one bit cell
+	// apart from the current time. Each transition is delayed by shifts[0],
+	// or by shifts[1] or shifts[2] if its bit is set in early or late.
+	void EmitCells(uint32_t cells, uint32_t early, uint32_t late, const uint32_t shifts[3]) {
+		const CellPositions& hi = kCellPositionTable.mEntries[cells >> 8];
+		const CellPositions& lo = kCellPositionTable.mEntries[cells & 0xFF];
+
+		const size_t offset = mStream.size();
+		mStream.resize(offset + hi.mCount + lo.mCount);
+
+		uint32_t *dst = mStream.data() + offset;
+
+		for(int i=0; i<hi.mCount; ++i) {
+			const int bit = 15 - hi.mPos[i];
+
+			*dst++ = mTime + hi.mPos[i] * mBitCellTime + shifts[((early >> bit) & 1) + ((late >> bit) & 1) * 2];
+		}
+
+		for(int i=0; i<lo.mCount; ++i) {
+			const int bit = 7 - lo.mPos[i];
+
+			*dst++ = mTime + (lo.mPos[i] + 8) * mBitCellTime + shifts[((early >> bit) & 1) + ((late >> bit) & 1) * 2];
+		}
+	}
+
+public:
 	std::vector<uint32_t> mStream;
 	uint32_t mTime = 0;
 	uint32_t mCriticalStart = ~0;
@@ -206,7 +380,13 @@ struct SectorCopy {
 	uint32_t mEncodeEnd;
 };
 
-void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double periodMultiplier, bool a2gcr, bool precise) {
+enum DataFieldEncoding : uint32_t {
+	kDataField_A2GCR,
+	kDataField_MFM,
+	kDataField_FM
+};
+
+void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double periodMultiplier, bool a2gcr, bool precise, DataFieldCache& cache, MessageLog& log) {
 	uint32_t bitCellTime = (uint32_t)(0.5 + kNominalFMBitCellTime * periodMultiplier);
 
 	// check if we have MFM sectors
@@ -264,6 +444,10 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			SectorEncoder& enc = sector_encoders[i];
 			enc.SetBitCellTime(bitCellTime);
 
+			// 21 sync bytes, 14 address field bytes, and the data field of
+			// 343 bytes between 3 byte prologue and epilogue
+			enc.ReserveBytes(21 + 14 + 3 + 343 + 3, SectorEncoder::kMaxTransitionsPerByteA2GCR);
+
 			bool first_sec = (&sec == lowest_sec);
 
 			// Minimal layout that we need:
@@ -309,46 +493,48 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			enc.EncodeByteGCR(0xAA);
 			enc.EncodeByteGCR(0xEB);
 			enc.EncodeSyncBytesGCR(6);
-			enc.EncodeByteGCR(0xD5);
-			enc.EncodeByteGCR(0xAA);
-			enc.EncodeByteGCR(0xAD);
+			enc.EncodeDataField(cache, kDataField_A2GCR, sec, [&] {
+				enc.EncodeByteGCR(0xD5);
+				enc.EncodeByteGCR(0xAA);
+				enc.EncodeByteGCR(0xAD);
 
-			// prenibble data block using 6-2 encoding
-			uint8_t nibblebuf[344];
+				// prenibble data block using 6-2 encoding
+				uint8_t nibblebuf[344];
 
-			nibblebuf[0] = 0;
+				nibblebuf[0] = 0;
 
-			// prenibble whole fragment bytes
-			for(int j=0; j<84; ++j) {
-				const uint8_t a = sec.mData[j] & 3;
-				const uint8_t b = sec.mData[j + 86] & 3;
-				const uint8_t c = sec.mData[j + 172] & 3;
-				const uint8_t v = a + (b << 2) + (c << 4);
+				// prenibble whole fragment bytes
+				for(int j=0; j<84; ++j) {
+					const uint8_t a = sec.mData[j] & 3;
+					const uint8_t b = sec.mData[j + 86] & 3;
+					const uint8_t c = sec.mData[j + 172] & 3;
+					const uint8_t v = a + (b << 2) + (c << 4);
 
-				nibblebuf[j + 1] = ((v >> 1) & 0x15) + ((v << 1) & 0x2A);
-			}
+					nibblebuf[j + 1] = ((v >> 1) & 0x15) + ((v << 1) & 0x2A);
+				}
 
-			// prenibble partial fragment bytes
-			for(int j=84; j<86; ++j) {
-				const uint8_t a = sec.mData[j] & 3;
-				const uint8_t b = sec.mData[j + 86] & 3;
-				const uint8_t v = a + (b << 2);
+				// prenibble partial fragment bytes
+				for(int j=84; j<86; ++j) {
+					const uint8_t a = sec.mData[j] & 3;
+					const uint8_t b = sec.mData[j + 86] & 3;
+					const uint8_t v = a + (b << 2);
 
-				nibblebuf[j + 1] = ((v >> 1) & 0x15) + ((v << 1) & 0x2A);
-			}
+					nibblebuf[j + 1] = ((v >> 1) & 0x15) + ((v << 1) & 0x2A);
+				}
 
-			// prenibble base bits 2-7
-			for(int j=0; j<256; ++j) {
-				nibblebuf[j + 87] = sec.mData[j] >> 2;
-			}
+				// prenibble base bits 2-7
+				for(int j=0; j<256; ++j) {
+					nibblebuf[j + 87] = sec.mData[j] >> 2;
+				}
 
-			nibblebuf[343] = 0;
+				nibblebuf[343] = 0;
+
+				// apply adjacent XOR encoding and encode to GCR
+				for(int j = 0; j < 343; ++j) {
+					enc.EncodeByteGCR(kGCR6Encoder[nibblebuf[j] ^ nibblebuf[j + 1]]);
+				}
+			});
 
-			// apply adjacent XOR encoding and encode to GCR
-			for(int j = 0; j < 343; ++j) {
-				enc.EncodeByteGCR(kGCR6Encoder[nibblebuf[j] ^ nibblebuf[j + 1]]);
-			}
-			
 			enc.EncodeByteGCR(0xD5);
 			enc.EncodeByteGCR(0xAA);
 			enc.EncodeByteGCR(0xEB);
@@ -362,6 +548,10 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			enc.SetBitCellTime(bitCellTime);
 			enc.SetPrecompEnabled(dst.mPhysTrack >= 40);
 
+			// 12 byte gap, 10 byte header, 34 byte gap, the data field or its
+			// 40 byte padding, 24 byte trailer, and the flush
+			enc.ReserveBytes(12 + 10 + 34 + std::max<uint32_t>(sec.mSectorSize + 6, 40) + 24 + 1, SectorEncoder::kMaxTransitionsPerByteMFM);
+
 			bool first_sec = (&sec == lowest_sec);
 
 			for(int j=0; j<11; ++j)
@@ -408,33 +598,35 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 
 			// check if the data field is actually encoded
 			if (sec.mAddressMark) {
-				// write DAM
-				enc.EncodeByteMFM(0xFB, 0xA1);
-				enc.EncodeByteMFM(0xFB, 0xA1);
-				enc.EncodeByteMFM(0xFB, 0xA1);
-				enc.EncodeByteMFM(sec.mAddressMark);
-
-				// write payload
-				for(uint32_t i=0; i<sec.mSectorSize; ++i)
-					enc.EncodeByteMFM(~sec.mData[i]);
-
-				// compute and write CRC
-				const uint8_t secdhdr[4] = {
-					0xA1,
-					0xA1,
-					0xA1,
-					sec.mAddressMark,
-				};
-
-				uint16_t crc2 = ComputeCRC(secdhdr, 4);
-
-				crc2 = ComputeInvertedCRC(sec.mData, sec.mSectorSize, crc2);
-
-				if (sec.mRecordedCRC != sec.mComputedCRC)
-					crc2 = ~crc2;
-
-				enc.EncodeByteMFM((uint8_t)(crc2 >> 8));
-				enc.EncodeByteMFM((uint8_t)(crc2 >> 0));
+				enc.EncodeDataField(cache, kDataField_MFM, sec, [&] {
+					// write DAM
+					enc.EncodeByteMFM(0xFB, 0xA1);
+					enc.EncodeByteMFM(0xFB, 0xA1);
+					enc.EncodeByteMFM(0xFB, 0xA1);
+					enc.EncodeByteMFM(sec.mAddressMark);
+
+					// write payload
+					for(uint32_t i=0; i<sec.mSectorSize; ++i)
+						enc.EncodeByteMFM(~sec.mData[i]);
+
+					// compute and write CRC
+					const uint8_t secdhdr[4] = {
+						0xA1,
+						0xA1,
+						0xA1,
+						sec.mAddressMark,
+					};
+
+					uint16_t crc2 = ComputeCRC(secdhdr, 4);
+
+					crc2 = ComputeInvertedCRC(sec.mData, sec.mSectorSize, crc2);
+
+					if (sec.mRecordedCRC != sec.mComputedCRC)
+						crc2 = ~crc2;
+
+					enc.EncodeByteMFM((uint8_t)(crc2 >> 8));
+					enc.EncodeByteMFM((uint8_t)(crc2 >> 0));
+				});
 			} else {
 				// no data field -- write padding bytes
 				for(int i=0; i<40; ++i)
@@ -456,6 +648,10 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			SectorEncoder& enc = sector_encoders[i];
 			enc.SetBitCellTime(bitCellTime);
 
+			// index mark, 6 byte gap, 7 byte header, 17 byte gap, the data
+			// field or its 50 byte padding, and the 9 byte trailer
+			enc.ReserveBytes(2 + 6 + 7 + 17 + std::max<uint32_t>(sec.mSectorSize + 3, 50) + 9, SectorEncoder::kMaxTransitionsPerByteFM);
+
 			const bool first_sec = (&sec == lowest_sec);
 
 			if (first_sec) {
@@ -520,34 +716,36 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 				enc.EncodeByteFM(0x00);
 
 			if (sec.mAddressMark) {
-				uint8_t secdat[1024 + 3];
-				secdat[0] = sec.mAddressMark;
-
-				for(uint32_t j=0; j<sec.mSectorSize; ++j)
-					secdat[j+1] = ~sec.mData[j];
-
-				secdat[sec.mSectorSize + 1] = (uint8_t)(sec.mRecordedCRC >> 8);
-				secdat[sec.mSectorSize + 2] = (uint8_t)sec.mRecordedCRC;
-
-				enc.EncodeByteFM(0xC7, secdat[0]);
-
-				// If this sector has a CRC error AND it's a long sector, don't bother writing
-				// out the full sector to save room on the track.
-				if (sec.mComputedCRC != sec.mRecordedCRC && sec.mSectorSize > 128) {
-					for(uint32_t j=1; j<131; ++j) {
-						if (sec.mWeakOffset >= 0 && j >= (uint32_t)sec.mWeakOffset+1)
-							enc.EncodeWeakByteFM();
-						else
-							enc.EncodeByteFM(secdat[j]);
-					}
-				} else {
-					for(uint32_t j=1; j<sec.mSectorSize + 3; ++j) {
-						if (sec.mWeakOffset >= 0 && j >= (uint32_t)sec.mWeakOffset+1) {
-							enc.EncodeWeakByteFM();
-						} else
-							enc.EncodeByteFM(secdat[j]);
+				enc.EncodeDataField(cache, kDataField_FM, sec, [&] {
+					uint8_t secdat[1024 + 3];
+					secdat[0] = sec.mAddressMark;
+
+					for(uint32_t j=0; j<sec.mSectorSize; ++j)
+						secdat[j+1] = ~sec.mData[j];
+
+					secdat[sec.mSectorSize + 1] = (uint8_t)(sec.mRecordedCRC >> 8);
+					secdat[sec.mSectorSize + 2] = (uint8_t)sec.mRecordedCRC;
+
+					enc.EncodeByteFM(0xC7, secdat[0]);
+
+					// If this sector has a CRC error AND it's a long sector, don't bother writing
+					// out the full sector to save room on the track.
+					if (sec.mComputedCRC != sec.mRecordedCRC && sec.mSectorSize > 128) {
+						for(uint32_t j=1; j<131; ++j) {
+							if (sec.mWeakOffset >= 0 && j >= (uint32_t)sec.mWeakOffset+1)
+								enc.EncodeWeakByteFM();
+							else
+								enc.EncodeByteFM(secdat[j]);
+						}
+					} else {
+						for(uint32_t j=1; j<sec.mSectorSize + 3; ++j) {
+							if (sec.mWeakOffset >= 0 && j >= (uint32_t)sec.mWeakOffset+1) {
+								enc.EncodeWeakByteFM();
+							} else
+								enc.EncodeByteFM(secdat[j]);
+						}
 					}
-				}
+				});
 			} else {
 				for(int j=0; j<50; ++j)
 					enc.EncodeByteFM(0x00);
@@ -561,6 +759,14 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 		}
 	}
 
+	if (g_stats.IsEnabled()) {
+		uint64_t streamBytes = 0;
+		for(const SectorEncoder& enc : sector_encoders)
+			streamBytes += enc.mStream.capacity() * sizeof(uint32_t);
+
+		g_stats.NoteMemory(kStatsMemory_EncoderStreams, streamBytes);
+	}
+
 	// Compute byte time. We align all sectors to bits since a format normally maintains byte
 	// alignment for the address fields, and this is easier on the PLL. FM and MFM use two bit
 	// cells per data bit, while GCR uses one bit cell per encoded bit.
@@ -605,7 +811,7 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			copies.push_back(copy);
 
 			if (!j && g_verbosity >= 1) {
-				printf("Encoding track %2u, sector %2u at %.3f-%.3f (critical %.3f-%.3f)\n"
+				log.Printf("Encoding track %2u, sector %2u at %.3f-%.3f (critical %.3f-%.3f)\n"
 					, track
 					, sec.mIndex
 					, fmod(encodingPosition / (200000000.0 / 6.0), 1.0)
@@ -637,7 +843,7 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 
 			if (lo > hi) {
 				if (reportedOverlaps.insert(std::make_pair((int)cp0.mpSector->mIndex, (int)cp1.mpSector->mIndex)).second) {
-					printf("WARNING: Track %u, sectors %u and %u overlapped by %.1f bytes during encoding. Encoded track may not work.\n"
+					log.Printf("WARNING: Track %u, sectors %u and %u overlapped by %.1f bytes during encoding. Encoded track may not work.\n"
 						, track
 						, cp0.mpSector->mIndex
 						, cp1.mpSector->mIndex
@@ -658,6 +864,12 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 	}
 
 	// encode unified bitstream
+	size_t streamTotal = 0;
+	for(const SectorEncoder& enc : sector_encoders)
+		streamTotal += enc.mStream.size();
+
+	dst.mTransitions.reserve(streamTotal * 7 + 1024);
+
 	uint32_t time_last = 0;
 
 	for(size_t i=0; i<numcopies; ++i) {
@@ -670,7 +882,7 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 			dst.mSpliceEnd = dst.mSpliceStart + (dst.mIndexTimes[2] - dst.mIndexTimes[1]);
 
 			if (g_verbosity >= 2) {
-				printf("Using [%u, %u] as the splice points for track\n", dst.mSpliceStart, dst.mSpliceEnd);
+				log.Printf("Using [%u, %u] as the splice points for track\n", dst.mSpliceStart, dst.mSpliceEnd);
 			}
 		}
 
@@ -695,15 +907,18 @@ void encode_track(RawTrack& dst, TrackInfo& src, int track, int side, double per
 		A8RC_RT_ASSERT(xfer_end <= cp.mpEncodedSector->mTime);
 
 		if (g_verbosity >= 2)
-			printf("Encoding %u-%u of sector %u (critical %u-%u) to %u-%u\n", xfer_start, xfer_end, cp.mpSector->mIndex, cp.mpEncodedSector->mCriticalStart, cp.mpEncodedSector->mCriticalEnd, cp.mEncodeStart, cp.mEncodeEnd);
+			log.Printf("Encoding %u-%u of sector %u (critical %u-%u) to %u-%u\n", xfer_start, xfer_end, cp.mpSector->mIndex, cp.mpEncodedSector->mCriticalStart, cp.mpEncodedSector->mCriticalEnd, cp.mEncodeStart, cp.mEncodeEnd);
 
 		if (xfer_end > xfer_start) {
 			const auto& src_stream = cp.mpEncodedSector->mStream;
 			auto xfer1 = std::lower_bound(src_stream.begin(), src_stream.end(), xfer_start);
 			auto xfer2 = std::lower_bound(xfer1, src_stream.end(), xfer_end);
 
-			for(auto it = xfer1; it != xfer2; ++it)
-				dst.mTransitions.push_back(cp.mPosition + *it);
+			const size_t dstOffset = dst.mTransitions.size();
+			const uint32_t position = cp.mPosition;
+
+			dst.mTransitions.resize(dstOffset + (xfer2 - xfer1));
+			std::transform(xfer1, xfer2, dst.mTransitions.begin() + dstOffset, [=](uint32_t t) { return position + t; });
 		}
 
 		time_last = cp.mEncodeEnd;
@@ -716,19 +931,39 @@ void encode_disk(RawDisk& dst, DiskInfo& src, double periodMultiplier, int track
 	dst.mSideCount = src.mSideCount;
 	dst.mSynthesized = true;
 
+	// Tracks are independent, so encode them in parallel and then print
+	// their messages in track order.
+	std::vector<std::pair<int, int>> jobs;
+
 	for(int i=0; i<src.mTrackCount; ++i) {
 		if (trackSelect >= 0 && trackSelect != i)
 			continue;
 
-		for(int j=0; j<src.mSideCount; ++j) {
-			if (g_verbosity >= 1) {
-				if (src.mSideCount > 1)
-					printf("Encoding track %u, side %u\n", i, j);
-				else
-					printf("Encoding track %u\n", i);
-			}
+		for(int j=0; j<src.mSideCount; ++j)
+			jobs.emplace_back(i, j);
+	}
 
-			encode_track(dst.mPhysTracks[j][i * src.mTrackStep], src.mPhysTracks[j][i * src.mTrackStep], i, j, periodMultiplier, a2gcr, precise);
+	std::vector<MessageLog> logs(jobs.size());
+	DataFieldCache cache;
+
+	parallel_for(jobs.size(), [&](size_t k) {
+		const int i = jobs[k].first;
+		const int j = jobs[k].second;
+		MessageLog& log = logs[k];
+
+		if (g_verbosity >= 1) {
+			if (src.mSideCount > 1)
+				log.Printf("Encoding track %u, side %u\n", i, j);
+			else
+				log.Printf("Encoding track %u\n", i);
 		}
-	}
+
+		encode_track(dst.mPhysTracks[j][i * src.mTrackStep], src.mPhysTracks[j][i * src.mTrackStep], i, j, periodMultiplier, a2gcr, precise, cache, log);
+	});
+
+	if (g_stats.IsEnabled())
+		g_stats.NoteMemory(kStatsMemory_EncoderFieldCache, cache.GetMemorySize());
+
+	for(MessageLog& log : logs)
+		log.Flush();
 }
@@ -0,0 +1,239 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+
+void flux_rescale(uint32_t *dst, const uint32_t *src, size_t n, double scale) {
+	size_t i = 0;
+
+#if A8RC_FLUX_SSE2
+	// SSE2 only has signed conversions, so blocks with timestamps or results
+	// of 2^31 or above are left to the scalar path. The out of range result
+	// from the conversion is $80000000, which can't otherwise occur.
+	const __m128d vscale = _mm_set1_pd(scale);
+	const __m128d vhalf = _mm_set1_pd(0.5);
+	const __m128i voverflow = _mm_set1_epi32(INT32_MIN);
+
+	for(; i + 4 <= n; i += 4) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+		if (!_mm_movemask_ps(_mm_castsi128_ps(v))) {
+			const __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(v), vscale), vhalf);
+			const __m128d hi = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE)), vscale), vhalf);
+			const __m128i r = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+
+			if (!_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(r, voverflow)))) {
+				_mm_storeu_si128((__m128i *)(dst + i), r);
+				continue;
+			}
+		}
+
+		for(size_t j = i; j < i + 4; ++j)
+			dst[j] = (uint32_t)((double)src[j] * scale + 0.5);
+	}
+#endif
+
+	for(; i < n; ++i)
+		dst[i] = (uint32_t)((double)src[i] * scale + 0.5);
+}
+
+void flux_reverse(uint32_t *times, size_t n, uint32_t max_time) {
+	// Swap and mirror from both ends toward the middle, so that this takes
+	// one pass instead of separate passes to mirror and reverse.
+	size_t i = 0;
+	size_t j = n;
+
+#if A8RC_FLUX_SSE2
+	const __m128i vmax = _mm_set1_epi32((int)max_time);
+
+	while(j - i >= 8) {
+		const __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(times + i)), 0x1B);
+		const __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(times + j - 4)), 0x1B);
+
+		_mm_storeu_si128((__m128i *)(times + i), _mm_sub_epi32(vmax, b));
+		_mm_storeu_si128((__m128i *)(times + j - 4), _mm_sub_epi32(vmax, a));
+
+		i += 4;
+		j -= 4;
+	}
+#endif
+
+	while(j - i >= 2) {
+		const uint32_t a = times[i];
+		const uint32_t b = times[j - 1];
+
+		times[i] = max_time - b;
+		times[j - 1] = max_time - a;
+
+		++i;
+		--j;
+	}
+
+	if (j > i)
+		times[i] = max_time - times[i];
+}
+
+namespace {
+	inline int32_t spread_peak(uint32_t t0, uint32_t t1, uint32_t t2, int32_t thresh) {
+		// compute deltas between each pair
+		const int32_t t01 = (int32_t)(t1 - t0);
+		const int32_t t12 = (int32_t)(t2 - t1);
+
+		// compute anti peak shift delta for any pair that is narrower than the threshold
+		const int32_t delta1 = std::max<int32_t>(0, thresh - t01);
+		const int32_t delta2 = std::max<int32_t>(0, thresh - t12);
+
+		// apply correction shift, limited to no more than half the distance rounded down
+		return std::min(std::max<int32_t>(((delta2 - delta1) * 5) / 12, -t01 / 2), t12 / 2);
+	}
+
+#if A8RC_FLUX_SSE2
+	inline __m128i min_epi32(__m128i a, __m128i b) {
+		const __m128i mask = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+	}
+
+	inline __m128i max_epi32(__m128i a, __m128i b) {
+		const __m128i mask = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// Signed division by 2 rounding toward zero, as in C.
+	inline __m128i div2_epi32(__m128i a) {
+		return _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1);
+	}
+#endif
+}
+
+void flux_spread_peaks(uint32_t *times, size_t n, int32_t thresh) {
+	if (n < 3)
+		return;
+
+	// Each transition is adjusted based on the original times of its
+	// neighbors, so the original time of the previous transition has to be
+	// carried along as the array is overwritten.
+	uint32_t t0 = times[0];
+	size_t i = 1;
+
+#if A8RC_FLUX_SSE2
+	// The 5/12 gain is done as a 16-bit multiply by 5 and a 0.16 fixed point
+	// multiply by 1/12, which matches the division for products below 8192.
+	// Larger thresholds are left to the scalar path, as are blocks with
+	// out of order transitions, where the deltas aren't bounded by the
+	// threshold.
+	if (thresh > 0 && thresh * 5 < 8192) {
+		const __m128i vthresh = _mm_set1_epi32(thresh);
+		const __m128i vzero = _mm_setzero_si128();
+		const __m128i vgain = _mm_set1_epi32(5);
+		const __m128i vrecip12 = _mm_set1_epi32(5462);
+		__m128i prev = _mm_slli_si128(_mm_cvtsi32_si128((int)t0), 12);
+
+		for(; i + 4 < n; i += 4) {
+			const __m128i v1 = _mm_loadu_si128((const __m128i *)(times + i));
+			const __m128i v0 = _mm_or_si128(_mm_srli_si128(prev, 12), _mm_slli_si128(v1, 4));
+			const __m128i v2 = _mm_loadu_si128((const __m128i *)(times + i + 1));
+
+			const __m128i t01 = _mm_sub_epi32(v1, v0);
+			const __m128i t12 = _mm_sub_epi32(v2, v1);
+
+			if (_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(t01, t12)))) {
+				t0 = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(prev, 12));
+
+				for(size_t j = i; j < i + 4; ++j) {
+					const uint32_t t1 = times[j];
+
+					times[j] = t1 + spread_peak(t0, t1, times[j + 1], thresh);
+					t0 = t1;
+				}
+
+				prev = v1;
+				continue;
+			}
+
+			const __m128i delta1 = max_epi32(vzero, _mm_sub_epi32(vthresh, t01));
+			const __m128i delta2 = max_epi32(vzero, _mm_sub_epi32(vthresh, t12));
+
+			// (delta2 - delta1) * 5 / 12, rounding toward zero
+			const __m128i d = _mm_sub_epi32(delta2, delta1);
+			const __m128i sign = _mm_srai_epi32(d, 31);
+			const __m128i absd = _mm_sub_epi32(_mm_xor_si128(d, sign), sign);
+			const __m128i absq = _mm_mulhi_epu16(_mm_mullo_epi16(absd, vgain), vrecip12);
+			const __m128i q = _mm_sub_epi32(_mm_xor_si128(absq, sign), sign);
+
+			const __m128i shift = min_epi32(max_epi32(q, _mm_sub_epi32(vzero, div2_epi32(t01))), div2_epi32(t12));
+
+			_mm_storeu_si128((__m128i *)(times + i), _mm_add_epi32(v1, shift));
+			prev = v1;
+		}
+
+		t0 = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(prev, 12));
+	}
+#endif
+
+	for(; i + 1 < n; ++i) {
+		const uint32_t t1 = times[i];
+
+		times[i] = t1 + spread_peak(t0, t1, times[i + 1], thresh);
+		t0 = t1;
+	}
+}
+
+FluxWindow flux_window(const std::vector<uint32_t>& times, uint32_t start, uint32_t end) {
+	auto it1 = std::lower_bound(times.begin(), times.end(), start);
+	auto it2 = std::upper_bound(it1, times.end(), end);
+
+	return FluxWindow { (size_t)(it1 - times.begin()), (size_t)(it2 - times.begin()) };
+}
+
+void flux_pack16(std::vector<uint16_t>& dst, const uint32_t *times, size_t n, uint32_t base, bool bigEndian, std::vector<uint32_t> *offsets) {
+	// Overflow words are rare, so size for one word per transition with a
+	// bit of slack and let the vector grow if needed.
+	dst.reserve(dst.size() + n + (n >> 6) + 1);
+
+	if (offsets)
+		offsets->reserve(offsets->size() + n + 1);
+
+	uint32_t last_time = base;
+
+	for(size_t i = 0; i < n; ++i) {
+		uint32_t t = times[i];
+
+		if (offsets)
+			offsets->push_back((uint32_t)dst.size());
+
+		// we can't encode a delay of 0, so push the transition back
+		if (t <= last_time)
+			t = last_time + 1;
+
+		uint32_t delay = t - last_time;
+
+		while(delay >= 0x10000) {
+			dst.push_back(0);
+			delay -= 0x10000;
+		}
+
+		// a delay that is an exact multiple of 64K would end in a zero
+		// word, which reads as more overflow -- write it one tick late
+		if (!delay) {
+			delay = 1;
+			++t;
+		}
+
+		dst.push_back(bigEndian ? swizzle_u16_to_be((uint16_t)delay) : (uint16_t)delay);
+		last_time = t;
+	}
+}
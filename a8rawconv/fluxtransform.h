@@ -0,0 +1,68 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_FLUXTRANSFORM_H
+#define f_FLUXTRANSFORM_H
+
+// Bulk transforms on flux transition and index timestamps.
+//
+// These are shared by the raw image writers and the track reverser, which
+// otherwise would each walk the timestamps one at a time. SSE2 is used where
+// the compiler targets it; the results are identical either way.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define A8RC_FLUX_SSE2 1
+#else
+	#define A8RC_FLUX_SSE2 0
+#endif
+
+// Half-open range of indices into a timestamp array.
+struct FluxWindow {
+	size_t mStart;
+	size_t mEnd;
+};
+
+// Rescale timestamps to a new timebase, rounding to nearest. dst may be the
+// same as src.
+void flux_rescale(uint32_t *dst, const uint32_t *src, size_t n, double scale);
+
+// Mirror timestamps in place about max_time, so that the result is still in
+// ascending order.
+void flux_reverse(uint32_t *times, size_t n, uint32_t max_time);
+
+// Push apart transitions that are closer than a threshold to counter peak
+// shift. Each transition is moved by 5/12ths of the difference between how
+// far its neighbors on either side are inside the threshold, limited to half
+// the distance to either neighbor. The first and last transitions are left
+// alone.
+void flux_spread_peaks(uint32_t *times, size_t n, int32_t thresh);
+
+// Find the range of timestamps within [start, end].
+FluxWindow flux_window(const std::vector<uint32_t>& times, uint32_t start, uint32_t end);
+
+// Pack timestamps as 16-bit deltas from a base time, with a zero word for
+// each 64K ticks of overflow. A timestamp that would give a zero delta or an
+// exact multiple of 64K is written one tick late, and the following deltas
+// are taken from the time actually written so that the error doesn't
+// accumulate. The words are appended to dst in big or little endian order.
+//
+// If offsets is given, the word offset in dst of each transition, starting
+// with its overflow words, is appended to it.
+void flux_pack16(std::vector<uint16_t>& dst, const uint32_t *times, size_t n, uint32_t base, bool bigEndian, std::vector<uint32_t> *offsets = nullptr);
+
+#endif
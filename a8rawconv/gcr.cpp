@@ -0,0 +1,244 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+
+#if A8RC_GCR_SSSE3
+	#include <tmmintrin.h>
+
+	#if defined(__GNUC__) || defined(__clang__)
+		#define A8RC_TARGET_SSSE3 __attribute__((target("ssse3")))
+	#else
+		#include <intrin.h>
+		#define A8RC_TARGET_SSSE3
+	#endif
+#endif
+
+const uint8_t kGCR6Decoder[256]={
+#define IL 255
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,
+
+	// $90
+	IL,IL,IL,IL,IL,IL, 0, 1,IL,IL, 2, 3,IL, 4, 5, 6,
+
+	// $A0
+	IL,IL,IL,IL,IL,IL, 7, 8,IL,IL, 8, 9,10,11,12,13,
+
+	// $B0
+	IL,IL,14,15,16,17,18,19,IL,20,21,22,23,24,25,26,
+
+	// $C0
+	IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,IL,27,IL,28,29,30,
+
+	// $D0
+	IL,IL,IL,31,IL,IL,32,33,IL,34,35,36,37,38,39,40,
+
+	// $E0
+	IL,IL,IL,IL,IL,41,42,43,IL,44,45,46,47,48,49,50,
+
+	// $F0
+	IL,IL,51,52,53,54,55,56,IL,57,58,59,60,61,62,63,
+#undef IL
+};
+
+namespace {
+#if A8RC_GCR_SSSE3
+	bool cpu_has_ssse3() {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_cpu_supports("ssse3") != 0;
+#else
+		int info[4];
+		__cpuid(info, 1);
+
+		return (info[2] & (1 << 9)) != 0;
+#endif
+	}
+
+	// Translate whole blocks of 16 bytes, returning the number of bytes done.
+	A8RC_TARGET_SSSE3 size_t gcr6_translate_ssse3(uint8_t *dst, const uint8_t *src, size_t n, uint32_t& invalid) {
+		size_t i = 0;
+
+		// All valid disk bytes are $96 or above, so each of the high rows of
+		// the table can be looked up with a shuffle on the low nibble and the
+		// results selected by the high nibble. Bytes in the low rows are left
+		// at $FF.
+		__m128i rows[7];
+		for(int j=0; j<7; ++j)
+			rows[j] = _mm_loadu_si128((const __m128i *)(kGCR6Decoder + 0x90 + 16*j));
+
+		const __m128i nibmask = _mm_set1_epi8(0x0F);
+
+		for(; i + 16 <= n; i += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+			const __m128i lo = _mm_and_si128(v, nibmask);
+			const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibmask);
+			__m128i r = _mm_set1_epi8((char)0xFF);
+
+			for(int j=0; j<7; ++j) {
+				const __m128i sel = _mm_cmpeq_epi8(hi, _mm_set1_epi8((char)(9 + j)));
+
+				r = _mm_or_si128(_mm_andnot_si128(sel, r), _mm_and_si128(sel, _mm_shuffle_epi8(rows[j], lo)));
+			}
+
+			_mm_storeu_si128((__m128i *)(dst + i), r);
+
+			// invalid bytes are rare, so just count them off
+			for(uint32_t mask = (uint32_t)_mm_movemask_epi8(r); mask; mask &= mask - 1)
+				++invalid;
+		}
+
+		return i;
+	}
+#endif
+}
+
+uint32_t gcr6_translate(uint8_t *dst, const uint8_t *src, size_t n) {
+	uint32_t invalid = 0;
+	size_t i = 0;
+
+#if A8RC_GCR_SSSE3
+	static const bool useSSSE3 = cpu_has_ssse3();
+
+	if (useSSSE3)
+		i = gcr6_translate_ssse3(dst, src, n, invalid);
+#endif
+
+	for(; i < n; ++i) {
+		const uint8_t x = kGCR6Decoder[src[i]];
+
+		dst[i] = x;
+		invalid += x >> 7;
+	}
+
+	return invalid;
+}
+
+uint8_t gcr6_decode_a2_sector(uint8_t *dst, const uint8_t *src, uint32_t& invalid, bool invertBit7) {
+	// 343 disk bytes, padded out to a whole number of words.
+	uint8_t buf[344];
+
+	buf[343] = 0;
+	invalid = gcr6_translate(buf, src, 343);
+
+	// Each byte is stored XORed with the previous one, so undo that with a
+	// running XOR. This is done a word at a time by folding each word onto
+	// itself and then bringing in the last byte of the previous word.
+	uint64_t carry = 0;
+
+	for(int i=0; i<344; i += 8) {
+		uint64_t v;
+		memcpy(&v, buf + i, 8);
+
+		v ^= v << 8;
+		v ^= v << 16;
+		v ^= v << 32;
+		v ^= carry;
+
+		carry = (v >> 56) * 0x0101010101010101ULL;
+
+		memcpy(buf + i, &v, 8);
+	}
+
+	// The running XOR through the checksum byte leaves zero for a good sector.
+	const uint8_t chksum = buf[342];
+
+	// The first 86 bytes hold the low two bits of each data byte, bit
+	// reversed, for bytes i, i+86, and i+172 in bits 0-1, 2-3, and 4-5.
+	// The remaining 256 bytes hold the upper six bits.
+	static const uint8_t kSwap2[4] = { 0, 2, 1, 3 };
+	const uint8_t invert = invertBit7 ? 0x80 : 0x00;
+
+	for(int i=0; i<86; ++i) {
+		const uint8_t frag = buf[i];
+
+		dst[i] = (uint8_t)((buf[i + 86] << 2) + kSwap2[frag & 3]) ^ invert;
+		dst[i + 86] = (uint8_t)((buf[i + 172] << 2) + kSwap2[(frag >> 2) & 3]) ^ invert;
+
+		if (i < 84)
+			dst[i + 172] = (uint8_t)((buf[i + 258] << 2) + kSwap2[(frag >> 4) & 3]) ^ invert;
+	}
+
+	return chksum;
+}
+
+void gcr6_decode_mac_sector(uint8_t *dst, const uint8_t *src, uint32_t& invalid, uint32_t& computedChecksum, uint32_t& recordedChecksum) {
+	uint8_t buf[704];
+
+	buf[703] = 0;
+	invalid = gcr6_translate(buf, src, 703);
+
+	// Merge the 2-bit fragments in the first byte of each group of four into
+	// the other three. The last group only has two data bytes.
+	for(int i=0; i<175; ++i) {
+		const uint8_t x0 = buf[i*4];
+
+		dst[i*3+0] = buf[i*4+1] + ((x0 << 2) & 0xc0);
+		dst[i*3+1] = buf[i*4+2] + ((x0 << 4) & 0xc0);
+
+		if (i < 174)
+			dst[i*3+2] = buf[i*4+3] + ((x0 << 6) & 0xc0);
+	}
+
+	// Undo the checksum chain. This has to be done serially as each byte is
+	// XORed with a running sum of the ones before it.
+	uint8_t checksumA = 0;
+	uint8_t checksumB = 0;
+	uint8_t checksumC = 0;
+	uint8_t carry = 0;
+
+	for(int i=0; i<175; ++i) {
+		checksumC = (checksumC << 1) + (checksumC >> 7);
+
+		const uint8_t y0 = dst[i*3+0] ^ checksumC;
+		const uint32_t tmpSumA = (uint32_t)checksumA + y0 + (checksumC & 1);
+		checksumA = (uint8_t)tmpSumA;
+		carry = (uint8_t)(tmpSumA >> 8);
+
+		const uint8_t y1 = dst[i*3+1] ^ checksumA;
+		const uint32_t tmpSumB = (uint32_t)checksumB + y1 + carry;
+		checksumB = (uint8_t)tmpSumB;
+		carry = (uint8_t)(tmpSumB >> 8);
+
+		dst[i*3+0] = y0;
+		dst[i*3+1] = y1;
+
+		if (i < 174) {
+			const uint8_t y2 = dst[i*3+2] ^ checksumB;
+			const uint32_t tmpSumC = (uint32_t)checksumC + y2 + carry;
+			checksumC = (uint8_t)tmpSumC;
+			carry = (uint8_t)(tmpSumC >> 8);
+
+			dst[i*3+2] = y2;
+		}
+	}
+
+	const uint8_t z0 = buf[699];
+	const uint8_t decCheckA = buf[700] + ((z0 << 2) & 0xc0);
+	const uint8_t decCheckB = buf[701] + ((z0 << 4) & 0xc0);
+	const uint8_t decCheckC = buf[702] + ((z0 << 6) & 0xc0);
+
+	computedChecksum = ((uint32_t)checksumA << 16) + ((uint32_t)checksumB << 8) + (uint32_t)checksumC;
+	recordedChecksum = ((uint32_t)decCheckA << 16) + ((uint32_t)decCheckB << 8) + (uint32_t)decCheckC;
+}
@@ -0,0 +1,55 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_GCR_H
+#define f_GCR_H
+
+// 6&2 GCR denibblizing for Apple II and Macintosh sector data fields.
+//
+// The decoders collect the disk bytes for a whole data field and then hand
+// them off here. The disk bytes are translated to 6-bit values in one pass,
+// after which the checksum chain and the merging of the 2-bit fragments are
+// run over the translated buffer, rather than doing all three a byte at a
+// time.
+//
+// On x86, SSSE3 shuffles are used for the translation if the CPU supports
+// them, which is checked at run time so that no compiler flags are needed;
+// otherwise, it goes through the lookup table.
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+	#define A8RC_GCR_SSSE3 1
+#else
+	#define A8RC_GCR_SSSE3 0
+#endif
+
+// 6-bit values for valid disk bytes, or $FF for invalid ones.
+extern const uint8_t kGCR6Decoder[256];
+
+// Translate disk bytes to 6-bit values. Returns the number of invalid bytes,
+// which are translated to $FF.
+uint32_t gcr6_translate(uint8_t *dst, const uint8_t *src, size_t n);
+
+// Decode an Apple II 6&2 data field of 342 disk bytes plus checksum to 256
+// bytes. Returns the residual checksum, which is zero for a good sector.
+uint8_t gcr6_decode_a2_sector(uint8_t *dst, const uint8_t *src, uint32_t& invalid, bool invertBit7);
+
+// Decode a Macintosh data field of 699 disk bytes plus four checksum bytes
+// to 524 bytes. The checksum computed over the data and the checksum
+// recorded on disk are returned as 24-bit values.
+void gcr6_decode_mac_sector(uint8_t *dst, const uint8_t *src, uint32_t& invalid, uint32_t& computedChecksum, uint32_t& recordedChecksum);
+
+#endif
@@ -4,3 +4,8 @@ std::string g_inputPath;
 
 int g_verbosity;
 bool g_dumpBadSectors;
+int g_threadCount;
+bool g_syncOutput;
+bool g_high_density = false;
+FILE *g_stdoutData;
+bool g_quiet;
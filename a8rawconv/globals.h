@@ -4,5 +4,16 @@
 extern std::string g_inputPath;
 extern int g_verbosity;
 extern bool g_dumpBadSectors;
+extern int g_threadCount;
+extern bool g_syncOutput;
+
+// Tracks are high density (-H): twice the bit rate of the normal encodings.
+extern bool g_high_density;
+
+// Original stdout when an image is being written to it (output path "-").
+extern FILE *g_stdoutData;
+
+// Console output on stdout is discarded (-q); errors go to stderr.
+extern bool g_quiet;
 
 #endif
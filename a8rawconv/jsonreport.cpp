@@ -0,0 +1,335 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include <limits.h>
+#include <math.h>
+#include "jsonreport.h"
+#include "stats.h"
+
+void JsonWriter::BeginObject(const char *name, bool compact) {
+	BeginValue(name);
+	mText += '{';
+	mScopes.push_back(Scope { false, compact || (!mScopes.empty() && mScopes.back().mbCompact), true });
+}
+
+void JsonWriter::EndObject() {
+	const Scope scope = mScopes.back();
+	mScopes.pop_back();
+
+	if (!scope.mbCompact && !scope.mbEmpty) {
+		mText += '\n';
+		mText.append(mScopes.size(), '\t');
+	}
+
+	mText += '}';
+
+	if (mScopes.empty())
+		mText += '\n';
+}
+
+void JsonWriter::BeginArray(const char *name, bool compact) {
+	BeginValue(name);
+	mText += '[';
+	mScopes.push_back(Scope { true, compact || (!mScopes.empty() && mScopes.back().mbCompact), true });
+}
+
+void JsonWriter::EndArray() {
+	const Scope scope = mScopes.back();
+	mScopes.pop_back();
+
+	if (!scope.mbCompact && !scope.mbEmpty) {
+		mText += '\n';
+		mText.append(mScopes.size(), '\t');
+	}
+
+	mText += ']';
+}
+
+void JsonWriter::WriteInt(const char *name, int64_t v) {
+	BeginValue(name);
+
+	char buf[32];
+	snprintf(buf, sizeof buf, "%lld", (long long)v);
+	mText += buf;
+}
+
+void JsonWriter::WriteFloat(const char *name, double v, int decimals) {
+	BeginValue(name);
+
+	// JSON has no representation for infinities or NaNs
+	if (!isfinite(v)) {
+		mText += "null";
+		return;
+	}
+
+	char buf[64];
+	snprintf(buf, sizeof buf, "%.*f", decimals, v);
+	mText += buf;
+}
+
+void JsonWriter::WriteBool(const char *name, bool v) {
+	BeginValue(name);
+	mText += v ? "true" : "false";
+}
+
+void JsonWriter::WriteString(const char *name, const char *s) {
+	BeginValue(name);
+	AppendString(s);
+}
+
+void JsonWriter::BeginValue(const char *name) {
+	if (mScopes.empty())
+		return;
+
+	Scope& scope = mScopes.back();
+
+	if (!scope.mbEmpty)
+		mText += scope.mbCompact ? ", " : ",";
+
+	scope.mbEmpty = false;
+
+	if (!scope.mbCompact) {
+		mText += '\n';
+		mText.append(mScopes.size(), '\t');
+	}
+
+	if (name) {
+		AppendString(name);
+		mText += ": ";
+	}
+}
+
+void JsonWriter::AppendString(const char *s) {
+	mText += '"';
+
+	while(const char c = *s++) {
+		switch(c) {
+			case '"':	mText += "\\\""; break;
+			case '\\':	mText += "\\\\"; break;
+			case '\n':	mText += "\\n"; break;
+			case '\r':	mText += "\\r"; break;
+			case '\t':	mText += "\\t"; break;
+
+			default:
+				if ((unsigned char)c < 0x20) {
+					char buf[8];
+					snprintf(buf, sizeof buf, "\\u%04x", (unsigned char)c);
+					mText += buf;
+				} else
+					mText += c;
+				break;
+		}
+	}
+
+	mText += '"';
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+	// Find the most common value in a list, preferring the smaller value in a tie.
+	int find_most_common(std::vector<int> values) {
+		std::sort(values.begin(), values.end());
+
+		int best = values.empty() ? 0 : values.front();
+		size_t bestCount = 0;
+
+		for(size_t i = 0; i < values.size(); ) {
+			size_t j = i;
+			while(j < values.size() && values[j] == values[i])
+				++j;
+
+			if (j - i > bestCount) {
+				bestCount = j - i;
+				best = values[i];
+			}
+
+			i = j;
+		}
+
+		return best;
+	}
+}
+
+void write_json_report(const char *path, const DiskInfo& disk, int selected_track) {
+	// The sector numbering expected on each track is taken from the most
+	// common lowest and highest sector numbers across the tracks, which
+	// handles both 0-based (GCR, Amiga) and 1-based (FM/MFM) formats.
+	std::vector<int> lowIndices;
+	std::vector<int> highIndices;
+
+	for(int i=0; i<disk.mTrackCount; ++i) {
+		if (selected_track >= 0 && selected_track != i)
+			continue;
+
+		for(int side=0; side<disk.mSideCount; ++side) {
+			const TrackInfo& track_info = disk.mPhysTracks[side][i * disk.mTrackStep];
+
+			if (track_info.mSiftedSectors.empty())
+				continue;
+
+			int lo = INT_MAX;
+			int hi = INT_MIN;
+
+			for(uint32_t idx : track_info.mSiftedSectors) {
+				lo = std::min(lo, track_info.mSectors[idx].mIndex);
+				hi = std::max(hi, track_info.mSectors[idx].mIndex);
+			}
+
+			lowIndices.push_back(lo);
+			highIndices.push_back(hi);
+		}
+	}
+
+	int expectedLo = find_most_common(lowIndices);
+	int expectedHi = find_most_common(highIndices);
+
+	if (lowIndices.empty() || expectedHi < expectedLo || expectedHi - expectedLo >= 64) {
+		expectedLo = 0;
+		expectedHi = -1;
+	}
+
+	JsonWriter json;
+	json.BeginObject();
+	json.WriteInt("version", 1);
+	json.WriteString("input", g_inputPath.c_str());
+
+	json.BeginObject("geometry", true);
+	json.WriteInt("tracks", disk.mTrackCount);
+	json.WriteInt("sides", disk.mSideCount);
+	json.WriteInt("track_step", disk.mTrackStep);
+	json.EndObject();
+
+	json.BeginArray("expected_sector_range", true);
+	if (expectedHi >= expectedLo) {
+		json.WriteInt(nullptr, expectedLo);
+		json.WriteInt(nullptr, expectedHi);
+	}
+	json.EndArray();
+
+	uint32_t totalSectors = 0;
+	uint32_t totalAddressCRCErrors = 0;
+	uint32_t totalDataCRCErrors = 0;
+	uint32_t totalWeakSectors = 0;
+	uint32_t totalPhantomSectors = 0;
+	uint32_t totalMissingSectors = 0;
+	uint32_t totalDiscardedReads = 0;
+	uint32_t totalLimitedTracks = 0;
+
+	json.BeginArray("tracks");
+
+	for(int i=0; i<disk.mTrackCount; ++i) {
+		if (selected_track >= 0 && selected_track != i)
+			continue;
+
+		for(int side=0; side<disk.mSideCount; ++side) {
+			const TrackInfo& track_info = disk.mPhysTracks[side][i * disk.mTrackStep];
+
+			// count copies of each sector number on the track to find phantoms
+			std::unordered_map<int, uint32_t> indexCounts;
+			for(uint32_t idx : track_info.mSiftedSectors)
+				++indexCounts[track_info.mSectors[idx].mIndex];
+
+			uint32_t phantomSectors = 0;
+			for(const auto& entry : indexCounts)
+				phantomSectors += entry.second - 1;
+
+			json.BeginObject();
+			json.WriteInt("track", i);
+			json.WriteInt("side", side);
+			json.WriteInt("sector_count", (int64_t)track_info.mSiftedSectors.size());
+			json.WriteInt("phantom_sectors", phantomSectors);
+			json.WriteBool("decode_limits_hit", track_info.mDecodeLimitsHit != 0);
+
+			json.BeginArray("missing_sectors", true);
+			for(int index = expectedLo; index <= expectedHi; ++index) {
+				if (!indexCounts.count(index)) {
+					json.WriteInt(nullptr, index);
+					++totalMissingSectors;
+				}
+			}
+			json.EndArray();
+
+			json.BeginArray("sectors");
+
+			for(uint32_t idx : track_info.mSiftedSectors) {
+				const SectorInfo& sec = track_info.mSectors[idx];
+				const bool addressCRCOK = sec.mRecordedAddressCRC == sec.mComputedAddressCRC;
+				const bool dataCRCOK = sec.mRecordedCRC == sec.mComputedCRC;
+
+				json.BeginObject(nullptr, true);
+				json.WriteInt("index", sec.mIndex);
+				json.WriteFloat("position", sec.mPosition, 4);
+				json.WriteInt("size", sec.mSectorSize);
+				json.WriteInt("address_mark", sec.mAddressMark);
+				json.WriteBool("address_crc_ok", addressCRCOK);
+				json.WriteBool("data_crc_ok", dataCRCOK);
+				json.WriteInt("weak_offset", sec.mWeakOffset);
+				json.WriteBool("phantom", indexCounts[sec.mIndex] > 1);
+				json.WriteInt("reads", sec.mSiftReads);
+				json.WriteInt("duplicate_count", sec.mSiftReads ? sec.mSiftReads - 1 : 0);
+				json.WriteInt("discarded_reads", sec.mSiftDiscardedReads);
+				json.WriteInt("variants", sec.mSiftVariants);
+				json.EndObject();
+
+				if (!addressCRCOK)
+					++totalAddressCRCErrors;
+
+				if (!dataCRCOK)
+					++totalDataCRCErrors;
+
+				if (sec.mWeakOffset >= 0)
+					++totalWeakSectors;
+
+				totalDiscardedReads += sec.mSiftDiscardedReads;
+			}
+
+			json.EndArray();
+			json.EndObject();
+
+			totalSectors += (uint32_t)track_info.mSiftedSectors.size();
+			totalPhantomSectors += phantomSectors;
+
+			if (track_info.mDecodeLimitsHit)
+				++totalLimitedTracks;
+		}
+	}
+
+	json.EndArray();
+
+	json.BeginObject("summary");
+	json.WriteInt("sectors", totalSectors);
+	json.WriteInt("address_crc_errors", totalAddressCRCErrors);
+	json.WriteInt("data_crc_errors", totalDataCRCErrors);
+	json.WriteInt("weak_sectors", totalWeakSectors);
+	json.WriteInt("phantom_sectors", totalPhantomSectors);
+	json.WriteInt("missing_sectors", totalMissingSectors);
+	json.WriteInt("discarded_reads", totalDiscardedReads);
+	json.WriteInt("tracks_with_decode_limits_hit", totalLimitedTracks);
+	json.EndObject();
+
+	g_stats.WriteJson(json);
+
+	json.EndObject();
+
+	BinaryWriter writer;
+	writer.PutBytes(json.GetText().data(), json.GetText().size());
+	MessageLog log;
+	if (!writer.WriteFile(path, log))
+		fatalf("%s", log.GetError());
+}
@@ -0,0 +1,56 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_JSONREPORT_H
+#define f_JSONREPORT_H
+
+// Minimal JSON text builder. Members of an object are named; elements of an
+// array pass a null name. Objects begun as compact are written on one line.
+class JsonWriter {
+public:
+	void BeginObject(const char *name = nullptr, bool compact = false);
+	void EndObject();
+	void BeginArray(const char *name = nullptr, bool compact = false);
+	void EndArray();
+
+	void WriteInt(const char *name, int64_t v);
+	void WriteFloat(const char *name, double v, int decimals);
+	void WriteBool(const char *name, bool v);
+	void WriteString(const char *name, const char *s);
+
+	const std::string& GetText() const { return mText; }
+
+private:
+	void BeginValue(const char *name);
+	void AppendString(const char *s);
+
+	struct Scope {
+		bool mbArray;
+		bool mbCompact;
+		bool mbEmpty;
+	};
+
+	std::string mText;
+	std::vector<Scope> mScopes;
+};
+
+// Write the -report file: the disk geometry and the sift results for each
+// track, so that bad, weak, phantom and missing sectors can be found without
+// parsing the console output.
+void write_json_report(const char *path, const DiskInfo& disk, int selected_track);
+
+#endif
@@ -17,6 +17,22 @@
 
 #include "stdafx.h"
 #include <time.h>
+#include <chrono>
+
+#ifdef _WIN32
+	#define NOMINMAX
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+	#include <psapi.h>
+	#include <io.h>
+	#include <fcntl.h>
+#else
+	#include <unistd.h>
+	#include <sys/resource.h>
+	#include <sys/stat.h>
+	#include <errno.h>
+	#include <fcntl.h>
+#endif
 
 uint64_t get_time64() {
 	static_assert(sizeof(time_t) > 4, "time_t is 32-bit when ideally it should be 64-bit.");
@@ -24,6 +40,52 @@ uint64_t get_time64() {
 	return (uint64_t)time(nullptr);
 }
 
+uint64_t get_monotonic_time_us() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t get_process_cpu_time_us() {
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+		return 0;
+
+	// FILETIMEs are in 100ns units
+	const uint64_t kernel = ((uint64_t)kernelTime.dwHighDateTime << 32) + kernelTime.dwLowDateTime;
+	const uint64_t user = ((uint64_t)userTime.dwHighDateTime << 32) + userTime.dwLowDateTime;
+
+	return (kernel + user) / 10;
+#else
+	rusage usage {};
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+
+	return (uint64_t)usage.ru_utime.tv_sec * 1000000 + (uint64_t)usage.ru_utime.tv_usec
+		+ (uint64_t)usage.ru_stime.tv_sec * 1000000 + (uint64_t)usage.ru_stime.tv_usec;
+#endif
+}
+
+uint64_t get_peak_rss_bytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+		return 0;
+
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage {};
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+
+	// ru_maxrss is in bytes on macOS and kilobytes elsewhere
+	#ifdef __APPLE__
+		return (uint64_t)usage.ru_maxrss;
+	#else
+		return (uint64_t)usage.ru_maxrss * 1024;
+	#endif
+#endif
+}
+
 std::string get_localtime_scp_us() {
 	// get current time as UTC
 	time_t now = time(nullptr);
@@ -46,3 +108,117 @@ std::string get_localtime_scp_us() {
 
 	return std::string(buf);
 }
+
+bool sync_file(FILE *f) {
+	if (fflush(f))
+		return false;
+
+#ifdef _WIN32
+	return !_commit(_fileno(f));
+#else
+	return !fsync(fileno(f));
+#endif
+}
+
+bool rename_file_replace(const char *from, const char *to) {
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return !rename(from, to);
+#endif
+}
+
+std::string get_temp_path(const char *path) {
+#ifdef _WIN32
+	const unsigned long pid = GetCurrentProcessId();
+#else
+	const unsigned long pid = (unsigned long)getpid();
+#endif
+
+	char suffix[32];
+	snprintf(suffix, sizeof suffix, ".%lu.tmp", pid);
+
+	return std::string(path) + suffix;
+}
+
+bool probe_writable_path(const char *path) {
+#ifdef _WIN32
+	HANDLE h = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (h != INVALID_HANDLE_VALUE) {
+		CloseHandle(h);
+		DeleteFileA(path);
+		return true;
+	}
+
+	if (GetLastError() != ERROR_FILE_EXISTS)
+		return false;
+#else
+	const int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+		return true;
+	}
+
+	if (errno != EEXIST)
+		return false;
+#endif
+
+	FILE *f = fopen(path, "ab");
+	if (!f)
+		return false;
+
+	fclose(f);
+	return true;
+}
+
+bool create_directory(const char *path) {
+#ifdef _WIN32
+	return CreateDirectoryA(path, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return !mkdir(path, 0777) || errno == EEXIST;
+#endif
+}
+
+void set_binary_mode(FILE *f) {
+#ifdef _WIN32
+	_setmode(_fileno(f), _O_BINARY);
+#endif
+}
+
+FILE *detach_stdout() {
+	fflush(stdout);
+
+#ifdef _WIN32
+	const int dataFd = _dup(_fileno(stdout));
+	FILE *data = dataFd >= 0 ? _fdopen(dataFd, "wb") : nullptr;
+
+	if (data) {
+		_setmode(dataFd, _O_BINARY);
+		_dup2(_fileno(stderr), _fileno(stdout));
+	}
+#else
+	const int dataFd = dup(fileno(stdout));
+	FILE *data = dataFd >= 0 ? fdopen(dataFd, "wb") : nullptr;
+
+	if (data)
+		dup2(fileno(stderr), fileno(stdout));
+#endif
+
+	if (!data)
+		fatalf("Unable to redirect standard output.\n");
+
+	return data;
+}
+
+void silence_stdout() {
+	fflush(stdout);
+
+#ifdef _WIN32
+	freopen("NUL", "w", stdout);
+#else
+	freopen("/dev/null", "w", stdout);
+#endif
+}
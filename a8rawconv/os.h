@@ -16,11 +16,50 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #ifndef f_OS_H
+#define f_OS_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
 
 uint64_t get_time64();
+uint64_t get_monotonic_time_us();
+
+// User and kernel CPU time used by all threads of the process so far.
+uint64_t get_process_cpu_time_us();
+
+// Largest resident set size / working set of the process so far, in bytes.
+uint64_t get_peak_rss_bytes();
+
 std::string get_localtime_scp_us();
 
+// Flush a file's contents through to the disk.
+bool sync_file(FILE *f);
+
+// Rename a file, replacing the destination if it exists.
+bool rename_file_replace(const char *from, const char *to);
+
+// Name for a temporary file next to the given path to be renamed over it
+// later. The process ID is included so that two runs writing the same path
+// don't clobber each other's temporary file.
+std::string get_temp_path(const char *path);
+
+// Check that a file can be written at the given path without disturbing
+// anything there. A new file is created exclusively and removed again; an
+// existing file is only opened for append.
+bool probe_writable_path(const char *path);
+
+// Create a directory, succeeding if it already exists.
+bool create_directory(const char *path);
+
+// Switch a standard stream to binary mode, for image data.
+void set_binary_mode(FILE *f);
+
+// Redirect console output on stdout to stderr, so that stdout can carry an
+// image. Returns a binary stream for the original stdout.
+FILE *detach_stdout();
+
+// Discard console output on stdout, for quiet mode.
+void silence_stdout();
+
 #endif
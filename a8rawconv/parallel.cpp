@@ -0,0 +1,66 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include <atomic>
+#include <thread>
+#include "parallel.h"
+
+int get_worker_thread_count() {
+	if (g_threadCount > 0)
+		return g_threadCount;
+
+	const unsigned hwThreads = std::thread::hardware_concurrency();
+
+	return hwThreads ? (int)hwThreads : 1;
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+	const size_t threadCount = std::min<size_t>(count, (size_t)get_worker_thread_count());
+
+	if (threadCount <= 1) {
+		for(size_t i=0; i<count; ++i)
+			fn(i);
+
+		return;
+	}
+
+	std::atomic<size_t> nextItem(0);
+
+	const auto worker = [&] {
+		for(;;) {
+			const size_t i = nextItem++;
+
+			if (i >= count)
+				break;
+
+			fn(i);
+		}
+	};
+
+	// the calling thread does its share of the work too
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+
+	for(size_t i=1; i<threadCount; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for(std::thread& thread : threads)
+		thread.join();
+}
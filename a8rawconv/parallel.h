@@ -0,0 +1,32 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_PARALLEL_H
+#define f_PARALLEL_H
+
+#include <functional>
+
+// Returns the number of worker threads to use, as set by -j; defaults to the
+// number of hardware threads.
+int get_worker_thread_count();
+
+// Runs fn(0) through fn(count-1) on the worker threads, returning once all of
+// them have completed. Items are handed out in order but may complete in any
+// order, so fn must only write to state owned by its item.
+void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+#endif
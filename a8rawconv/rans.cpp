@@ -0,0 +1,154 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include "rans.h"
+
+void RansModel::Build(const uint32_t counts[256]) {
+	uint64_t total = 0;
+	for(int i=0; i<256; ++i)
+		total += counts[i];
+
+	memset(mFreq, 0, sizeof mFreq);
+
+	if (total) {
+		// Scale the counts down, keeping every symbol that occurs, then fix up
+		// the rounding error against the most frequent symbols.
+		uint32_t sum = 0;
+
+		for(int i=0; i<256; ++i) {
+			if (counts[i]) {
+				uint32_t freq = (uint32_t)(((uint64_t)counts[i] * kRansProbScale) / total);
+
+				if (!freq)
+					freq = 1;
+
+				mFreq[i] = (uint16_t)freq;
+				sum += freq;
+			}
+		}
+
+		while(sum != kRansProbScale) {
+			int best = 0;
+			for(int i=1; i<256; ++i) {
+				if (mFreq[i] > mFreq[best])
+					best = i;
+			}
+
+			if (sum < kRansProbScale) {
+				mFreq[best] += (uint16_t)(kRansProbScale - sum);
+				sum = kRansProbScale;
+			} else {
+				// There are at most 256 symbols, so the largest is always
+				// above 1 while the sum is over.
+				const uint32_t excess = std::min<uint32_t>(sum - kRansProbScale, mFreq[best] - 1);
+
+				mFreq[best] -= (uint16_t)excess;
+				sum -= excess;
+			}
+		}
+	}
+
+	InitTables();
+}
+
+void RansModel::Write(BinaryWriter& writer) const {
+	uint32_t symbolCount = 0;
+	for(int i=0; i<256; ++i) {
+		if (mFreq[i])
+			++symbolCount;
+	}
+
+	writer.PutU16((uint16_t)symbolCount);
+
+	for(int i=0; i<256; ++i) {
+		if (mFreq[i]) {
+			writer.PutU8((uint8_t)i);
+			writer.PutU16(mFreq[i]);
+		}
+	}
+}
+
+bool RansModel::Read(BinaryReader& reader) {
+	memset(mFreq, 0, sizeof mFreq);
+
+	const uint32_t symbolCount = reader.GetU16();
+	if (symbolCount > 256)
+		return false;
+
+	uint32_t sum = 0;
+	for(uint32_t i=0; i<symbolCount; ++i) {
+		const uint8_t sym = reader.GetU8();
+		const uint16_t freq = reader.GetU16();
+
+		if (!freq || mFreq[sym])
+			return false;
+
+		mFreq[sym] = freq;
+		sum += freq;
+	}
+
+	if (!reader.IsValid() || (symbolCount && sum != kRansProbScale))
+		return false;
+
+	InitTables();
+	return true;
+}
+
+void RansModel::InitTables() {
+	uint32_t start = 0;
+
+	for(int i=0; i<256; ++i) {
+		mStart[i] = (uint16_t)start;
+
+		if (mFreq[i]) {
+			memset(mSlotToSymbol + start, i, mFreq[i]);
+			start += mFreq[i];
+		}
+	}
+
+	// An empty model can't decode anything valid; point every slot at a
+	// symbol with zero frequency so the decoder runs off the end instead.
+	if (!start)
+		memset(mSlotToSymbol, 0, sizeof mSlotToSymbol);
+}
+
+void RansEncoder::Finish(std::vector<uint8_t>& dst) {
+	for(int i=0; i<4; ++i) {
+		mBytes.push_back((uint8_t)(mState >> 24));
+		mState <<= 8;
+	}
+
+	dst.insert(dst.end(), mBytes.rbegin(), mBytes.rend());
+
+	mBytes.clear();
+	mState = kRansLowerBound;
+}
+
+RansDecoder::RansDecoder(const uint8_t *src, size_t len)
+	: mpSrc(src)
+	, mpEnd(src + len)
+{
+	if (len < 4) {
+		mbOverrun = true;
+		mpSrc = mpEnd;
+		return;
+	}
+
+	mState = read_u32(src);
+	mpSrc += 4;
+}
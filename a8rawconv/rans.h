@@ -0,0 +1,118 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_RANS_H
+#define f_RANS_H
+
+// Static rANS entropy coder over byte symbols, used to compress flux in the
+// native flux image format. Each model is a fixed frequency table built from
+// symbol counts up front and stored alongside the coded data. Several models
+// can be mixed in one coded stream as long as the decoder uses the same model
+// for each symbol as the encoder did.
+//
+// This is the usual byte-wise renormalizing variant: 32-bit state, kept in
+// [kRansLowerBound, kRansLowerBound << 8), with frequencies scaled to a
+// total of 1 << kRansProbBits.
+
+enum : uint32_t {
+	kRansProbBits = 12,
+	kRansProbScale = 1 << kRansProbBits,
+	kRansLowerBound = 1 << 23
+};
+
+class RansModel {
+public:
+	// Build the frequency table from symbol counts. Every symbol with a
+	// nonzero count gets a nonzero frequency.
+	void Build(const uint32_t counts[256]);
+
+	void Write(BinaryWriter& writer) const;
+
+	// Read a table written by Write(). Returns false if it is invalid.
+	bool Read(BinaryReader& reader);
+
+	uint32_t GetFreq(uint8_t sym) const { return mFreq[sym]; }
+	uint32_t GetStart(uint8_t sym) const { return mStart[sym]; }
+	uint8_t GetSymbolAt(uint32_t slot) const { return mSlotToSymbol[slot]; }
+
+private:
+	void InitTables();
+
+	uint16_t mFreq[256];
+	uint16_t mStart[256];
+	uint8_t mSlotToSymbol[kRansProbScale];
+};
+
+// Symbols are encoded in the reverse of the order that they are decoded.
+class RansEncoder {
+public:
+	void Encode(const RansModel& model, uint8_t sym) {
+		const uint32_t freq = model.GetFreq(sym);
+		const uint32_t maxState = ((kRansLowerBound >> kRansProbBits) << 8) * freq;
+
+		while(mState >= maxState) {
+			mBytes.push_back((uint8_t)mState);
+			mState >>= 8;
+		}
+
+		mState = ((mState / freq) << kRansProbBits) + (mState % freq) + model.GetStart(sym);
+	}
+
+	// Flush the coder and append the coded stream to dst, in decoding order.
+	void Finish(std::vector<uint8_t>& dst);
+
+private:
+	uint32_t mState = kRansLowerBound;
+	std::vector<uint8_t> mBytes;
+};
+
+class RansDecoder {
+public:
+	RansDecoder(const uint8_t *src, size_t len);
+
+	uint8_t Decode(const RansModel& model) {
+		const uint32_t slot = mState & (kRansProbScale - 1);
+		const uint8_t sym = model.GetSymbolAt(slot);
+
+		mState = model.GetFreq(sym) * (mState >> kRansProbBits) + slot - model.GetStart(sym);
+
+		while(mState < kRansLowerBound) {
+			if (mpSrc == mpEnd) {
+				mbOverrun = true;
+				break;
+			}
+
+			mState = (mState << 8) + *mpSrc++;
+		}
+
+		return sym;
+	}
+
+	// True if the whole stream was consumed and the coder ended in the state
+	// that the encoder started in, which catches most corruption.
+	bool IsComplete() const {
+		return !mbOverrun && mpSrc == mpEnd && mState == kRansLowerBound;
+	}
+
+private:
+	uint32_t mState = 0;
+	const uint8_t *mpSrc;
+	const uint8_t *mpEnd;
+	bool mbOverrun = false;
+};
+
+#endif
@@ -0,0 +1,459 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include "parallel.h"
+#include "rans.h"
+
+// Native a8rawconv flux image (.a8f).
+//
+// All values are little-endian.
+//
+//	header (32 bytes)
+//		char[4]		signature 'A8FX'
+//		u16			version (1)
+//		u16			header size
+//		u8			track count, track step, side count
+//		u8			flags: bit 0 = synthesized flux
+//		u32			directory offset
+//		u32			directory entry count
+//		u8[12]		reserved
+//
+//	directory, one entry per stored track (12 bytes)
+//		u8			physical track (96 tpi numbering)
+//		u8			side
+//		u16			reserved
+//		u32			track chunk offset
+//		u32			track chunk size
+//
+//	track chunk
+//		u32			samples per revolution (float)
+//		i32			splice start, splice end
+//		u32			index mark count N, followed by N index times
+//		u32			flux transition count
+//		models		high byte model, low byte model (see RansModel::Write())
+//		N+1 block headers: u32 transition count, u32 coded size, u32 escape size
+//		N+1 blocks: coded data, then escape data
+//
+// The flux is split into blocks at the index marks, so each revolution can
+// be decoded on its own. Each transition is stored as the delta from the one
+// before it, or from the index mark starting the block for the first one in
+// a block (0 for the first block). Deltas below $FF00 are coded as a high
+// byte and a low byte with the two models, which are shared by all blocks in
+// the track. Anything longer is coded as an $FF high byte, with the delta in
+// the escape data as a base-128 varint. Times are in the track's own sample
+// units and are stored exactly.
+
+static const uint8_t kA8FSignature[4] = { 'A', '8', 'F', 'X' };
+static const uint16_t kA8FVersion = 1;
+static const uint32_t kA8FHeaderSize = 32;
+static const uint32_t kA8FDirEntrySize = 12;
+static const uint8_t kA8FFlag_Synthesized = 0x01;
+
+static const uint32_t kA8FEscapeThreshold = 0xFF00;
+static const uint8_t kA8FEscapeSymbol = 0xFF;
+
+// Caps for sanity checking counts read from the file.
+static const uint32_t kA8FMaxIndexMarks = 1024;
+static const uint32_t kA8FMaxTransitions = 1U << 26;
+
+namespace {
+	struct A8FTrackRef {
+		int mPhysTrack;
+		int mSide;
+	};
+
+	uint32_t a8f_float_bits(float v) {
+		uint32_t bits;
+		memcpy(&bits, &v, 4);
+		return bits;
+	}
+
+	float a8f_float_from_bits(uint32_t bits) {
+		float v;
+		memcpy(&v, &bits, 4);
+		return v;
+	}
+}
+
+static void a8f_encode_track(const RawTrack& track, BinaryWriter& writer) {
+	const std::vector<uint32_t>& transitions = track.mTransitions;
+	const std::vector<uint32_t>& indexTimes = track.mIndexTimes;
+	const size_t blockCount = indexTimes.size() + 1;
+	const size_t n = transitions.size();
+
+	// split at the index marks and convert to deltas
+	std::vector<size_t> blockEnds(blockCount);
+	std::vector<uint32_t> deltas(n);
+	size_t pos = 0;
+
+	for(size_t blk = 0; blk < blockCount; ++blk) {
+		const size_t end = blk < indexTimes.size()
+			? (size_t)(std::lower_bound(transitions.begin() + pos, transitions.end(), indexTimes[blk]) - transitions.begin())
+			: n;
+
+		uint32_t prev = blk ? indexTimes[blk - 1] : 0;
+		for(; pos < end; ++pos) {
+			deltas[pos] = transitions[pos] - prev;
+			prev = transitions[pos];
+		}
+
+		blockEnds[blk] = end;
+	}
+
+	// build the models over the whole track
+	uint32_t highCounts[256] = {};
+	uint32_t lowCounts[256] = {};
+
+	for(const uint32_t delta : deltas) {
+		if (delta < kA8FEscapeThreshold) {
+			++highCounts[delta >> 8];
+			++lowCounts[delta & 0xFF];
+		} else
+			++highCounts[kA8FEscapeSymbol];
+	}
+
+	std::unique_ptr<RansModel> highModel(new RansModel);
+	std::unique_ptr<RansModel> lowModel(new RansModel);
+	highModel->Build(highCounts);
+	lowModel->Build(lowCounts);
+
+	// code the blocks; the coder runs backwards, the escapes forwards
+	std::vector<uint8_t> blockData;
+	std::vector<uint32_t> blockSizes(blockCount * 3);
+	RansEncoder encoder;
+	size_t blockStart = 0;
+
+	for(size_t blk = 0; blk < blockCount; ++blk) {
+		const size_t blockEnd = blockEnds[blk];
+
+		for(size_t i = blockEnd; i > blockStart; --i) {
+			const uint32_t delta = deltas[i - 1];
+
+			if (delta < kA8FEscapeThreshold) {
+				encoder.Encode(*lowModel, (uint8_t)delta);
+				encoder.Encode(*highModel, (uint8_t)(delta >> 8));
+			} else
+				encoder.Encode(*highModel, kA8FEscapeSymbol);
+		}
+
+		const size_t codedStart = blockData.size();
+		encoder.Finish(blockData);
+
+		const size_t escapeStart = blockData.size();
+		for(size_t i = blockStart; i < blockEnd; ++i) {
+			uint32_t delta = deltas[i];
+
+			if (delta >= kA8FEscapeThreshold) {
+				while(delta >= 0x80) {
+					blockData.push_back((uint8_t)(delta | 0x80));
+					delta >>= 7;
+				}
+
+				blockData.push_back((uint8_t)delta);
+			}
+		}
+
+		blockSizes[blk*3 + 0] = (uint32_t)(blockEnd - blockStart);
+		blockSizes[blk*3 + 1] = (uint32_t)(escapeStart - codedStart);
+		blockSizes[blk*3 + 2] = (uint32_t)(blockData.size() - escapeStart);
+
+		blockStart = blockEnd;
+	}
+
+	writer.PutU32(a8f_float_bits(track.mSamplesPerRev));
+	writer.PutU32((uint32_t)track.mSpliceStart);
+	writer.PutU32((uint32_t)track.mSpliceEnd);
+	writer.PutU32((uint32_t)indexTimes.size());
+
+	for(const uint32_t t : indexTimes)
+		writer.PutU32(t);
+
+	writer.PutU32((uint32_t)n);
+	highModel->Write(writer);
+	lowModel->Write(writer);
+
+	for(const uint32_t v : blockSizes)
+		writer.PutU32(v);
+
+	writer.PutBytes(blockData.data(), blockData.size());
+}
+
+static bool a8f_decode_track(const uint8_t *src, size_t len, RawTrack& track) {
+	BinaryReader reader(src, len);
+
+	track.mSamplesPerRev = a8f_float_from_bits(reader.GetU32());
+	track.mSpliceStart = (int32_t)reader.GetU32();
+	track.mSpliceEnd = (int32_t)reader.GetU32();
+
+	const uint32_t indexCount = reader.GetU32();
+	if (!reader.IsValid() || indexCount > kA8FMaxIndexMarks)
+		return false;
+
+	track.mIndexTimes.resize(indexCount);
+	for(uint32_t& t : track.mIndexTimes)
+		t = reader.GetU32();
+
+	const uint32_t transitionCount = reader.GetU32();
+	if (!reader.IsValid() || transitionCount > kA8FMaxTransitions)
+		return false;
+
+	std::unique_ptr<RansModel> highModel(new RansModel);
+	std::unique_ptr<RansModel> lowModel(new RansModel);
+	if (!highModel->Read(reader) || !lowModel->Read(reader))
+		return false;
+
+	const uint32_t blockCount = indexCount + 1;
+	std::vector<uint32_t> blockSizes(blockCount * 3);
+	for(uint32_t& v : blockSizes)
+		v = reader.GetU32();
+
+	if (!reader.IsValid())
+		return false;
+
+	track.mTransitions.resize(transitionCount);
+	uint32_t *dst = track.mTransitions.data();
+	uint32_t remaining = transitionCount;
+
+	for(uint32_t blk = 0; blk < blockCount; ++blk) {
+		const uint32_t count = blockSizes[blk*3 + 0];
+		const uint8_t *coded = reader.GetSpan(blockSizes[blk*3 + 1]);
+		const uint8_t *escapes = reader.GetSpan(blockSizes[blk*3 + 2]);
+
+		if (!reader.IsValid() || count > remaining)
+			return false;
+
+		remaining -= count;
+
+		RansDecoder decoder(coded, blockSizes[blk*3 + 1]);
+		BinaryReader escapeReader(escapes, blockSizes[blk*3 + 2]);
+		uint32_t t = blk ? track.mIndexTimes[blk - 1] : 0;
+
+		for(uint32_t i = 0; i < count; ++i) {
+			const uint8_t high = decoder.Decode(*highModel);
+			uint32_t delta;
+
+			if (high != kA8FEscapeSymbol)
+				delta = ((uint32_t)high << 8) + decoder.Decode(*lowModel);
+			else {
+				delta = 0;
+
+				for(int shift = 0; ; shift += 7) {
+					const uint8_t c = escapeReader.GetU8();
+
+					if (shift > 28 || !escapeReader.IsValid())
+						return false;
+
+					delta += (uint32_t)(c & 0x7F) << shift;
+
+					if (!(c & 0x80))
+						break;
+				}
+			}
+
+			t += delta;
+			*dst++ = t;
+		}
+
+		if (!decoder.IsComplete() || !escapeReader.IsAtEnd())
+			return false;
+	}
+
+	return !remaining && reader.IsAtEnd();
+}
+
+void a8f_read(RawDisk& raw_disk, const char *path, int selected_track) {
+	printf("Reading a8rawconv flux image: %s\n", path);
+
+	InputFile fi;
+	fi.Open(path);
+
+	uint8_t header[kA8FHeaderSize];
+	if (!fi.Read(header, sizeof header))
+		fatal_read();
+
+	BinaryReader headerReader(header, sizeof header);
+	uint8_t signature[4];
+	headerReader.GetBytes(signature, 4);
+
+	if (memcmp(signature, kA8FSignature, 4))
+		fatalf("Input file does not start with correct a8rawconv flux image signature.\n");
+
+	const uint16_t version = headerReader.GetU16();
+	if (version != kA8FVersion)
+		fatalf("Unsupported a8rawconv flux image version: %u.\n", version);
+
+	headerReader.GetU16();
+	const int trackCount = headerReader.GetU8();
+	const int trackStep = headerReader.GetU8();
+	const int sideCount = headerReader.GetU8();
+	const uint8_t flags = headerReader.GetU8();
+	const uint32_t dirOffset = headerReader.GetU32();
+	const uint32_t dirCount = headerReader.GetU32();
+
+	if (trackStep < 1 || trackStep > 2 || sideCount < 1 || sideCount > 2 || !trackCount || trackCount * trackStep > RawDisk::kMaxPhysTracks)
+		fatalf("Invalid disk geometry in a8rawconv flux image: %d tracks, step %d, %d sides.\n", trackCount, trackStep, sideCount);
+
+	if (dirCount > 2 * RawDisk::kMaxPhysTracks)
+		fatalf("Invalid track directory in a8rawconv flux image.\n");
+
+	raw_disk.mTrackCount = trackCount;
+	raw_disk.mTrackStep = trackStep;
+	raw_disk.mSideCount = sideCount;
+	raw_disk.mSynthesized = (flags & kA8FFlag_Synthesized) != 0;
+
+	// check sizes against the file before allocating for them
+	const uint64_t fileSize = fi.GetSize();
+
+	if ((uint64_t)dirOffset + dirCount * kA8FDirEntrySize > fileSize)
+		fatalf("Invalid track directory in a8rawconv flux image.\n");
+
+	std::vector<uint8_t> dirData(dirCount * kA8FDirEntrySize);
+	if (!fi.Seek(dirOffset) || !fi.Read(dirData.data(), dirData.size()))
+		fatal_read();
+
+	// Read the selected tracks' chunks directly via the directory, then
+	// decode them in parallel.
+	std::vector<A8FTrackRef> tracks;
+	std::vector<std::vector<uint8_t>> chunks;
+	BinaryReader dirReader(dirData.data(), dirData.size());
+	bool trackSeen[2][RawDisk::kMaxPhysTracks] {};
+
+	for(uint32_t i=0; i<dirCount; ++i) {
+		const int physTrack = dirReader.GetU8();
+		const int side = dirReader.GetU8();
+		dirReader.GetU16();
+		const uint32_t offset = dirReader.GetU32();
+		const uint32_t size = dirReader.GetU32();
+
+		if (physTrack >= RawDisk::kMaxPhysTracks || side >= 2 || (uint64_t)offset + size > fileSize)
+			fatalf("Invalid track directory entry in a8rawconv flux image: track %d, side %d.\n", physTrack, side);
+
+		// each track is decoded in place, so a track can only appear once
+		if (trackSeen[side][physTrack])
+			fatalf("Duplicate track directory entry in a8rawconv flux image: track %d, side %d.\n", physTrack, side);
+
+		trackSeen[side][physTrack] = true;
+
+		if (selected_track >= 0 && physTrack != selected_track * trackStep)
+			continue;
+
+		std::vector<uint8_t> chunk(size);
+		if (!fi.Seek(offset) || !fi.Read(chunk.data(), size))
+			fatalf("Unable to read track %d, side %d from input file.\n", physTrack / trackStep, side);
+
+		tracks.push_back(A8FTrackRef { physTrack, side });
+		chunks.push_back(std::move(chunk));
+	}
+
+	fi.Close();
+
+	std::vector<uint8_t> decodeOK(tracks.size());
+
+	parallel_for(tracks.size(), [&](size_t i) {
+		RawTrack& raw_track = raw_disk.mPhysTracks[tracks[i].mSide][tracks[i].mPhysTrack];
+
+		raw_track.mIndexTimes.clear();
+		raw_track.mTransitions.clear();
+
+		decodeOK[i] = a8f_decode_track(chunks[i].data(), chunks[i].size(), raw_track);
+	});
+
+	for(size_t i=0; i<tracks.size(); ++i) {
+		if (!decodeOK[i])
+			fatalf("a8rawconv flux image has corrupted data for track %d, side %d.\n", tracks[i].mPhysTrack / trackStep, tracks[i].mSide);
+	}
+}
+
+void a8f_write(const RawDisk& raw_disk, const char *path, int selected_track, MessageLog& log) {
+	std::vector<A8FTrackRef> tracks;
+
+	for(int i=0; i<raw_disk.mTrackCount; ++i) {
+		if (selected_track >= 0 && selected_track != i)
+			continue;
+
+		for(int side=0; side<raw_disk.mSideCount; ++side) {
+			const int physTrack = i * raw_disk.mTrackStep;
+			const RawTrack& raw_track = raw_disk.mPhysTracks[side][physTrack];
+
+			// skip track if it is empty
+			if (raw_track.mIndexTimes.empty() && raw_track.mTransitions.empty())
+				continue;
+
+			tracks.push_back(A8FTrackRef { physTrack, side });
+		}
+	}
+
+	log.Printf("Writing a8rawconv flux image with %u track%s: %s\n", (unsigned)tracks.size(), tracks.size() == 1 ? "" : "s", path);
+
+	// compress tracks in parallel
+	std::vector<BinaryWriter> chunks(tracks.size());
+
+	parallel_for(tracks.size(), [&](size_t i) {
+		a8f_encode_track(raw_disk.mPhysTracks[tracks[i].mSide][tracks[i].mPhysTrack], chunks[i]);
+	});
+
+	size_t totalSize = kA8FHeaderSize + tracks.size() * kA8FDirEntrySize;
+	size_t totalTransitions = 0;
+
+	for(size_t i=0; i<tracks.size(); ++i) {
+		totalSize += chunks[i].GetSize();
+		totalTransitions += raw_disk.mPhysTracks[tracks[i].mSide][tracks[i].mPhysTrack].mTransitions.size();
+	}
+
+	if (totalSize > UINT32_MAX) {
+		log.Fail("Flux image is too large to write: %s.\n", path);
+		return;
+	}
+
+	BinaryWriter writer;
+	writer.Reserve(totalSize);
+
+	writer.PutBytes(kA8FSignature, 4);
+	writer.PutU16(kA8FVersion);
+	writer.PutU16((uint16_t)kA8FHeaderSize);
+	writer.PutU8((uint8_t)raw_disk.mTrackCount);
+	writer.PutU8((uint8_t)raw_disk.mTrackStep);
+	writer.PutU8((uint8_t)raw_disk.mSideCount);
+	writer.PutU8(raw_disk.mSynthesized ? kA8FFlag_Synthesized : 0);
+	writer.PutU32(kA8FHeaderSize);
+	writer.PutU32((uint32_t)tracks.size());
+	writer.PutPad(12);
+
+	uint32_t offset = kA8FHeaderSize + (uint32_t)tracks.size() * kA8FDirEntrySize;
+
+	for(size_t i=0; i<tracks.size(); ++i) {
+		writer.PutU8((uint8_t)tracks[i].mPhysTrack);
+		writer.PutU8((uint8_t)tracks[i].mSide);
+		writer.PutU16(0);
+		writer.PutU32(offset);
+		writer.PutU32((uint32_t)chunks[i].GetSize());
+
+		offset += (uint32_t)chunks[i].GetSize();
+	}
+
+	for(BinaryWriter& chunk : chunks)
+		writer.PutBytes(chunk.GetData(), chunk.GetSize());
+
+	if (!writer.WriteFile(path, log))
+		return;
+
+	log.Printf("%u flux transitions stored in %u bytes (%.2f bits per transition)\n"
+		, (unsigned)totalTransitions
+		, (unsigned)writer.GetSize()
+		, totalTransitions ? (double)writer.GetSize() * 8.0 / (double)totalTransitions : 0.0);
+}
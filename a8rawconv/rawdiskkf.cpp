@@ -1,4 +1,6 @@
 #include "stdafx.h"
+#include "stats.h"
+#include "zip.h"
 
 class MemStream {
 public:
@@ -16,7 +18,28 @@ private:
 	const uint8_t *const mpSrcBegin;
 };
 
-void kf_read_track(RawTrack& rawTrack, int track, int side, const char *path) {
+// Largest track stream that we will read.
+static const uint32_t kKFMaxStreamSize = 500*1024*1024;
+
+static void kf_read_stream_file(std::vector<uint8_t>& rawstream, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		fatalf("Unable to open input track stream: %s.\n", path);
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	if (len > (long)kKFMaxStreamSize || (unsigned long)len != size_t(len))
+		fatalf("Stream too long: %ld bytes\n", len);
+
+	rawstream.resize((size_t)len);
+	if (fseek(f, 0, SEEK_SET) || (len && 1 != fread(rawstream.data(), (size_t)len, 1, f)))
+		fatalf("Error reading from stream: %s\n", path);
+	fclose(f);
+
+	g_stats.AddBytesRead((uint64_t)len);
+}
+
+void kf_read_track(RawTrack& rawTrack, int track, int side, const char *path, const std::vector<uint8_t>& rawstream) {
 	// KryoFlux system constants (defaults)
 	const double mck = 18432000.0 * 73.0 / 14.0 / 2.0;
 	double sck = mck / 2.0;
@@ -32,20 +55,6 @@ void kf_read_track(RawTrack& rawTrack, int track, int side, const char *path) {
 	if (g_verbosity >= 1)
 		printf("Reading KryoFlux track stream: %s\n", path);
 
-	FILE *f = fopen(path, "rb");
-	if (!f)
-		fatalf("Unable to open input track stream: %s.\n", path);
-
-	fseek(f, 0, SEEK_END);
-	long len = ftell(f);
-	if (len > 500*1024*1024 || (unsigned long)len != size_t(len))
-		fatalf("Stream too long: %ld bytes\n", len);
-
-	std::vector<uint8_t> rawstream((size_t)len);
-	if (fseek(f, 0, SEEK_SET) || 1 != fread(rawstream.data(), (size_t)len, 1, f))
-		fatalf("Error reading from stream: %s\n", path);
-	fclose(f);
-
 	// getc() is painfully slow in VS2010
 	MemStream ms(rawstream.data(), rawstream.data() + rawstream.size());
 
@@ -216,20 +225,27 @@ void kf_read_track(RawTrack& rawTrack, int track, int side, const char *path) {
 	rawTrack.mSpliceEnd = -1;
 }
 
-void kf_read(RawDisk& raw_disk, int trackcount, int trackstep, const char *basepath, int sidepos, int sidewidth, int sidebase, int countpos, int countwidth, int trackselect, bool use_48tpi) {
-	printf("Reading KryoFlux track stream set (%u TPI)...\n", !use_48tpi || trackcount > 40 ? 96 : 48);
+void kf_read(RawDisk& raw_disk, int trackcount, int trackstep, const char *basepath, int sidepos, int sidewidth, int sidebase, int countpos, int countwidth, int trackselect, bool use_48tpi, ZipArchive *archive) {
+	if (archive)
+		printf("Reading KryoFlux track stream set (%u TPI) from archive: %s\n", !use_48tpi || trackcount > 40 ? 96 : 48, archive->GetPath());
+	else
+		printf("Reading KryoFlux track stream set (%u TPI)...\n", !use_48tpi || trackcount > 40 ? 96 : 48);
 
 	if (use_48tpi && trackstep < 2)
 		fatalf("Cannot use a 48tpi stream set with 96tpi geometry.\n");
 
 	const int image_track_step = !use_48tpi && trackstep > 1 ? 2 : 1;
 
+	// Streams in an archive are extracted straight into the stream buffer,
+	// with the path template matched against the entry names.
+	std::vector<uint8_t> rawstream;
+
 	for(int i=0; i<trackcount; ++i) {
 		if (trackselect >= 0 && i != trackselect)
 			continue;
 
 		for(int side=0; side<raw_disk.mSideCount; ++side) {
-			std::string track_filename(g_inputPath);
+			std::string track_filename(basepath);
 
 			char buf[64];
 			sprintf(buf, "%0*u", countwidth, i * image_track_step);
@@ -238,7 +254,21 @@ void kf_read(RawDisk& raw_disk, int trackcount, int trackstep, const char *basep
 			sprintf(buf, "%0*u", sidewidth, side + sidebase);
 			track_filename.replace(sidepos, sidewidth, buf);
 
-			kf_read_track(raw_disk.mPhysTracks[side][i * raw_disk.mTrackStep], i, side, track_filename.c_str());
+			if (archive) {
+				const int entry = archive->FindEntry(track_filename.c_str());
+				if (entry < 0)
+					fatalf("Unable to find input track stream in archive: %s.\n", track_filename.c_str());
+
+				if (archive->GetEntrySize(entry) > kKFMaxStreamSize)
+					fatalf("Stream too long: %u bytes\n", archive->GetEntrySize(entry));
+
+				archive->ReadEntry(entry, rawstream);
+			} else
+				kf_read_stream_file(rawstream, track_filename.c_str());
+
+			g_stats.NoteMemory(kStatsMemory_KryoFluxStream, rawstream.capacity());
+
+			kf_read_track(raw_disk.mPhysTracks[side][i * raw_disk.mTrackStep], i, side, track_filename.c_str(), rawstream);
 		}
 	}
 }
@@ -78,12 +78,11 @@ struct SCPExtensionFooter {
 void scp_read(RawDisk& raw_disk, const char *path, int selected_track, int forced_tpi, int forced_side_step, int forced_tracks, int forced_sides) {
 	printf("Reading SuperCard Pro image: %s\n", path);
 
-	FILE *fi = fopen(g_inputPath.c_str(), "rb");
-	if (!fi)
-		fatalf("Unable to open input file: %s.\n", path);
+	InputFile fi;
+	fi.Open(path);
 
 	SCPFileHeader fileHeader = {0};
-	if (1 != fread(&fileHeader, sizeof(fileHeader), 1, fi))
+	if (!fi.Read(&fileHeader, sizeof(fileHeader)))
 		fatal_read();
 
 	if (memcmp(fileHeader.mSignature, "SCP", 3))
@@ -93,7 +92,7 @@ void scp_read(RawDisk& raw_disk, const char *path, int selected_track, int force
 	// location (absolute position 0x80)
 	if (fileHeader.mFlags & 0x40) {
 		memset(fileHeader.mTrackOffsets, 0, sizeof fileHeader.mTrackOffsets);
-		if (fseek(fi, 0x80, SEEK_SET) || 1 != fread(fileHeader.mTrackOffsets, sizeof fileHeader.mTrackOffsets, 1, fi))
+		if (!fi.Seek(0x80) || !fi.Read(fileHeader.mTrackOffsets, sizeof fileHeader.mTrackOffsets))
 			fatal("Unable to read extended header from input file.");
 	}
 
@@ -145,18 +144,18 @@ void scp_read(RawDisk& raw_disk, const char *path, int selected_track, int force
 			if (!track_offset)
 				continue;
 
-			if (fseek(fi, track_offset, SEEK_SET))
+			if (!fi.Seek(track_offset))
 				fatalf("Unable to read track %d from input file.", i);
 
 			SCPTrackHeader track_hdr = {};
-			if (1 != fread(&track_hdr, sizeof(track_hdr), 1, fi))
+			if (!fi.Read(&track_hdr, sizeof(track_hdr)))
 				fatalf("Unable to read track %d from input file.", i);
 
 			if (memcmp(track_hdr.mSignature, "TRK", 3))
 				fatalf("SCP raw track %d has broken header at %08x with incorrect signature.", image_track, track_offset);
 
 			std::vector<SCPTrackRevolution> revs(fileHeader.mNumRevs);
-			if (1 != fread(revs.data(), sizeof(SCPTrackRevolution)*fileHeader.mNumRevs, 1, fi))
+			if (!fi.Read(revs.data(), sizeof(SCPTrackRevolution)*fileHeader.mNumRevs))
 				fatalf("Unable to read track %d from input file.", i);
 
 			// initialize raw track parameters
@@ -191,8 +190,8 @@ void scp_read(RawDisk& raw_disk, const char *path, int selected_track, int force
 				data_buf.resize(rev.mDataLength);
 
 				if (rev.mDataLength) {
-					if (fseek(fi, track_offset + rev.mDataOffset, SEEK_SET) < 0
-						|| 1 != fread(data_buf.data(), rev.mDataLength * 2, 1, fi))
+					if (!fi.Seek((uint64_t)track_offset + rev.mDataOffset)
+						|| !fi.Read(data_buf.data(), rev.mDataLength * 2))
 						fatalf("Unable to read track %d from input file.", i);
 
 					raw_track.mTransitions.reserve(data_buf.size());
@@ -211,11 +210,9 @@ void scp_read(RawDisk& raw_disk, const char *path, int selected_track, int force
 			}
 		}
 	}
-
-	fclose(fi);
 };
 
-void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, int forced_tpi, int forced_side_step) {
+void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, int forced_tpi, int forced_side_step, MessageLog& log) {
 	int maxrevs = 5;
 
 	// go through all tracks we'll be writing, and find out the max number of revs we have
@@ -232,12 +229,8 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 	const int tracks_to_write = raw_disk.mTrackCount;
 	const int sides_to_write = raw_disk.mSideCount;
 
-	printf("Writing %s-sided SuperCard Pro %u-track image with %u revolutions: %s\n", sides_to_write > 1 ? "double" : "single", tracks_to_write, maxrevs, path);
+	log.Printf("Writing %s-sided SuperCard Pro %u-track image with %u revolutions: %s\n", sides_to_write > 1 ? "double" : "single", tracks_to_write, maxrevs, path);
 
-	FILE *fo = fopen(path, "wb");
-	if (!fo)
-		fatalf("Cannot open %s for write\n", path);
-	
 	const bool source_96tpi = raw_disk.mTrackStep == 1;
 	const bool source_double_sided = sides_to_write > 1;
 	const bool write_96tpi = source_96tpi || forced_tpi >= 96;
@@ -246,11 +239,15 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 	// the source is 40 track, as 40 track single sided isn't normally a thing
 	const bool image_double_sided = (!forced_side_step && !source_96tpi) || source_double_sided || forced_side_step != 1;
 
-	if (forced_tpi && forced_tpi < 96 && source_96tpi)
-		fatal("Cannot write a 96tpi disk to a 48tpi SCP image.");
+	if (forced_tpi && forced_tpi < 96 && source_96tpi) {
+		log.Fail("Cannot write a 96tpi disk to a 48tpi SCP image.\n");
+		return;
+	}
 
-	if (forced_side_step == 1 && source_double_sided)
-		fatal("Cannot write a double-sided image with single-side stepping.\n");
+	if (forced_side_step == 1 && source_double_sided) {
+		log.Fail("Cannot write a double-sided image with single-side stepping.\n");
+		return;
+	}
 
 	const int image_track_step = (write_96tpi && !source_96tpi ? 2 : 1) * (image_double_sided ? 2 : 1);
 
@@ -282,8 +279,18 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 	filehdr.mSides = 0;
 	filehdr.mChecksum = 0;
 
-	// write out initial header
-	fwrite(&filehdr, sizeof filehdr, 1, fo);
+	// write out initial header; the image is built in memory, with at most two
+	// bytes per flux transition
+	BinaryWriter writer;
+	size_t transitionTotal = 0;
+
+	for(int side=0; side<sides_to_write; ++side) {
+		for(int i=0; i<tracks_to_write; ++i)
+			transitionTotal += raw_disk.mPhysTracks[side][i * raw_disk.mTrackStep].mTransitions.size();
+	}
+
+	writer.Reserve(sizeof filehdr + transitionTotal * 2 + 65536);
+	writer.PutBytes(&filehdr, sizeof filehdr);
 
 	for(int i=0; i<tracks_to_write; ++i) {
 		if (selected_track >= 0 && selected_track != i)
@@ -302,56 +309,24 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 			// we need 25ns samples and a 360 RPM rotational speed
 			const double sample_scale = (use_360rpm ? 40000000.0 / 6.0 : 40000000.0 / 5.0) / (double)track_info.mSamplesPerRev;
 
-			std::vector<uint32_t> new_samples;
 			const auto& transitions = track_info.mTransitions;
-		
-			new_samples.reserve(transitions.size());
-			for(std::vector<uint32_t>::const_iterator it = std::lower_bound(transitions.begin(), transitions.end(), track_info.mIndexTimes.front()),
-				itEnd = std::upper_bound(it, transitions.end(), track_info.mIndexTimes[maxrevs]); it != itEnd; ++it) {
-				new_samples.push_back((uint32_t)((double)*it * sample_scale + 0.5));
-			}
+			const FluxWindow window = flux_window(transitions, track_info.mIndexTimes.front(), track_info.mIndexTimes[maxrevs]);
 
-			std::vector<uint32_t> new_index_marks;
-			for(auto it = track_info.mIndexTimes.begin(), itEnd = track_info.mIndexTimes.end(); it != itEnd; ++it) {
-				new_index_marks.push_back((uint32_t)((double)*it * sample_scale + 0.5));
-			}
-
-			// encode all samples
-			std::vector<uint8_t> bitdata;
-			std::vector<uint32_t> new_sample_offsets;
+			std::vector<uint32_t> new_samples(window.mEnd - window.mStart);
+			flux_rescale(new_samples.data(), transitions.data() + window.mStart, new_samples.size(), sample_scale);
 
-			if (new_samples.size() > 1) {
-				uint32_t error = 0;
-				uint32_t last_time = new_index_marks.front();
+			std::vector<uint32_t> new_index_marks(track_info.mIndexTimes.size());
+			flux_rescale(new_index_marks.data(), track_info.mIndexTimes.data(), new_index_marks.size(), sample_scale);
 
-				for(auto it = new_samples.begin(), itEnd = new_samples.end(); it != itEnd; ++it) {
-					uint32_t delay = *it - last_time;
-					last_time = *it;
-
-					// we can't encode a sample of 0, so we need to push such transitions
-					if (delay < error + 1) {		// delay - error < 1
-						error += 1 - delay;
-						delay = 1;
-					}
-
-					// encode
-					new_sample_offsets.push_back((uint32_t)bitdata.size());
-
-					while(delay >= 0x10000) {
-						bitdata.push_back(0);
-						bitdata.push_back(0);
-						delay -= 0x10000;
-					}
+			// encode all samples (word offsets)
+			std::vector<uint16_t> bitdata;
+			std::vector<uint32_t> new_sample_offsets;
 
-					bitdata.push_back((uint8_t)(delay >> 8));
-					bitdata.push_back((uint8_t)(delay >> 0));
-				}
-			}
+			if (new_samples.size() > 1)
+				flux_pack16(bitdata, new_samples.data(), new_samples.size(), new_index_marks.front(), true, &new_sample_offsets);
 
-			if (bitdata.size() & 2) {
+			if (bitdata.size() & 1)
 				bitdata.push_back(0);
-				bitdata.push_back(0);
-			}
 
 			new_sample_offsets.push_back((uint32_t)bitdata.size());
 
@@ -370,23 +345,23 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 				uint32_t data_start = new_sample_offsets[sample_start - new_samples.begin()];
 				uint32_t data_end = new_sample_offsets[sample_end - new_samples.begin()];
 
-				track_data[3*j + 3] = sizeof(track_data) + data_start;
+				track_data[3*j + 3] = sizeof(track_data) + data_start * 2;
 
 				// track length (in encoded values)
-				track_data[3*j + 2] = (data_end - data_start) >> 1;
+				track_data[3*j + 2] = data_end - data_start;
 			}
 
 			// update checksum
 			filehdr.mChecksum += ComputeByteSum(track_data, sizeof track_data);
-			filehdr.mChecksum += ComputeByteSum(bitdata.data(), bitdata.size());
+			filehdr.mChecksum += ComputeByteSum(bitdata.data(), bitdata.size() * 2);
 
 			// set track offset and update checksum
-			uint32_t track_offset = (uint32_t)ftell(fo);
+			uint32_t track_offset = (uint32_t)writer.GetSize();
 			filehdr.mTrackOffsets[image_track] = track_offset;
 
 			// write it out
-			fwrite(track_data, sizeof track_data, 1, fo);
-			fwrite(bitdata.data(), bitdata.size(), 1, fo);
+			writer.PutBytes(track_data, sizeof track_data);
+			writer.PutBytes(bitdata.data(), bitdata.size() * 2);
 		}
 	}
 
@@ -399,7 +374,7 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 	// data to prevent the first byte of a footer string from being misinterpreted.
 	const auto scp_timestamp = get_localtime_scp_us();
 	const size_t scp_timestamp_len = scp_timestamp.size() + 1;
-	fwrite(scp_timestamp.c_str(), scp_timestamp_len, 1, fo);
+	writer.PutBytes(scp_timestamp.c_str(), scp_timestamp_len);
 	filehdr.mChecksum += ComputeByteSum(scp_timestamp.c_str(), scp_timestamp_len);
 
 	// set up footer
@@ -410,23 +385,22 @@ void scp_write(const RawDisk& raw_disk, const char *path, int selected_track, in
 
 	// write application name
 	static const char kAppName[] = A8RC_NAME_AND_VERSION;
-	footer.mApplicationNameOffset = (uint32_t)ftell(fo);
+	footer.mApplicationNameOffset = (uint32_t)writer.GetSize();
 
 	uint16_t nameLen = sizeof(kAppName) - 1;
-	write_u16(nameLen, fo);
+	writer.PutU16(nameLen);
 	filehdr.mChecksum += ComputeByteSum(&nameLen, sizeof nameLen);
 
-	fwrite(kAppName, sizeof kAppName, 1, fo);
+	writer.PutBytes(kAppName, sizeof kAppName);
 	filehdr.mChecksum += ComputeByteSum(kAppName, sizeof kAppName);
 
 	// write footer
-	fwrite(&footer, sizeof footer, 1, fo);
+	writer.PutBytes(&footer, sizeof footer);
 	filehdr.mChecksum += ComputeByteSum(&footer, sizeof footer);
 
 	// rewrite file header
 	filehdr.mChecksum += ComputeByteSum(filehdr.mTrackOffsets, sizeof filehdr.mTrackOffsets);
 
-	fseek(fo, 0, SEEK_SET);
-	fwrite(&filehdr, sizeof filehdr, 1, fo);
-	fclose(fo);
+	writer.PatchBytes(0, &filehdr, sizeof filehdr);
+	writer.WriteFile(path, log);
 }
@@ -210,8 +210,7 @@ erase_track:
 			//splice_end -= (splice_end - splice_start) / 50;
 
 			// extract transitions between splice points
-			auto it1 = std::lower_bound(raw_track.mTransitions.begin(), raw_track.mTransitions.end(), splice_start);
-			auto it2 = std::upper_bound(it1, raw_track.mTransitions.end(), splice_end);
+			const FluxWindow window = flux_window(raw_track.mTransitions, splice_start, splice_end);
 
 			// Encode leader time -- we need to delay from the index mark to the splice
 			// start. This needs to be at least a few dozen bits (~5K ticks) as the initially
@@ -236,38 +235,19 @@ erase_track:
 				transitions.push_back(swizzle_u16_to_be(1));
 
 			// Rescale transitions from splice start to splice stop.
-			if (it1 == it2) {
+			if (window.mStart == window.mEnd) {
 				// Uh oh... we don't have any transitions. Well, just erase the track.
 				goto erase_track;
 			}
 		
 			double tick_scale = (double)g_scpDirRotTicks / raw_track.mSamplesPerRev;
-			uint32_t last_time = splice_start;
-			for(auto it = it1; it != it2; ++it) {
-				uint32_t cur_time = (uint32_t)(0.5 + (*it) * tick_scale);
-				uint32_t delay = cur_time >= last_time ? cur_time - last_time : 0;
-				last_time = cur_time;
-
-				if (!delay) {
-					delay = 1;
-					++last_time;
-				}
+			std::vector<uint32_t> tick_times(window.mEnd - window.mStart);
+			flux_rescale(tick_times.data(), raw_track.mTransitions.data() + window.mStart, tick_times.size(), tick_scale);
 
-				while(delay >= 0x10000) {
-					delay -= 0x10000;
-					transitions.push_back(0);
-				}
+			// the deltas are in ticks, so the splice start needs to be too
+			const uint32_t tick_splice_start = (uint32_t)(0.5 + splice_start * tick_scale);
 
-				if (delay)
-					transitions.push_back(swizzle_u16_to_be(delay));
-				else {
-					// Uh oh... we can't actually write this transition time exactly because
-					// it's a multiple of 64K. Write one tick more and adjust the time base
-					// for the next transition.
-					transitions.push_back(swizzle_u16_to_be(1));
-					++last_time;
-				}
-			}
+			flux_pack16(transitions, tick_times.data(), tick_times.size(), tick_splice_start, true);
 
 			if (transitions.size() > 262144)
 				fatalf("Cannot write track: exceeds 512K memory limit.\n", i);
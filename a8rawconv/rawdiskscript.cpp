@@ -1,10 +1,166 @@
 #include "stdafx.h"
 
-class ScriptEngine {
+// Script bytecode. Each op is followed by its operands in the code stream.
+enum ScriptOp : uint32_t {
+	kScriptOp_End,			// end of program
+	kScriptOp_Geometry,		// tracks, sides
+	kScriptOp_Track,		// track, side, length of the track body including the end op
+	kScriptOp_EndTrack,
+	kScriptOp_Bytes,		// offset into byte data, length
+	kScriptOp_ByteRun,		// special, value, count
+	kScriptOp_PadBits,		// count, value
+	kScriptOp_CRCBegin,
+	kScriptOp_CRCEnd,
+	kScriptOp_Flux,			// delay in 1/256ths of a tick
+	kScriptOp_NoFlux,		// delay in 1/256ths of a tick
+	kScriptOp_Repeat,		// count (at least 2)
+	kScriptOp_Loop			// distance from this operand back to the start of the loop body
+};
+
+// A compiled disk script. Expressions are folded at compile time, so the
+// code only contains the final values.
+struct ScriptProgram {
+	std::vector<uint32_t> mCode;
+	std::vector<uint8_t> mData;
+};
+
+// Flux transition offsets within an FM byte, for normal ($FF clock) and
+// special ($C7 clock) bytes.
+struct ScriptFMByteCells {
+	uint8_t mCount;
+	uint16_t mOffsets[16];
+};
+
+class ScriptFMByteTable {
 public:
-	ScriptEngine(RawDisk& raw_disk);
+	ScriptFMByteTable() {
+		for(int special=0; special<2; ++special) {
+			for(int v=0; v<256; ++v) {
+				ScriptFMByteCells& entry = mEntries[special][v];
+
+				// clock and data cells alternate, clock first; 4us = 160 ticks at 25ns,
+				// with the transition in the middle of the cell
+				const uint16_t cells = merge_cells16(special ? 0xC7 : 0xFF, (uint8_t)v);
+
+				entry.mCount = 0;
+
+				for(int i=0; i<16; ++i) {
+					if (cells & (0x8000 >> i))
+						entry.mOffsets[entry.mCount++] = (uint16_t)(i * 160 + 80);
+				}
+			}
+		}
+	}
+
+	ScriptFMByteCells mEntries[2][256];
+};
+
+static const ScriptFMByteTable kScriptFMByteTable;
+
+// Script state that carries over from one track to the next in script order:
+// the running CRC and the fraction of a tick left over from flux delays. A
+// track's entry state is worked out by skipping over the tracks before it,
+// which is cheap next to generating their flux.
+struct ScriptCarryState {
+	uint16_t mCRC = 0;
+	int32_t mCellFracAccum = 128;
+
+	// Take the whole ticks of a delay, keeping the fraction for the next one.
+	int32_t TakeDelay(uint32_t count256, int32_t min_delay) {
+		mCellFracAccum += count256;
+
+		int32_t delay = mCellFracAccum >> 8;
+
+		if (delay < min_delay)
+			delay = min_delay;
+
+		mCellFracAccum -= delay << 8;
+		return delay;
+	}
+
+	// Update the state for a track body starting at pc, without generating it.
+	void SkipTrack(const ScriptProgram& program, const uint32_t *pc);
+};
+
+void ScriptCarryState::SkipTrack(const ScriptProgram& program, const uint32_t *pc) {
+	std::vector<uint32_t> loopCounts;
+
+	for(;;) {
+		switch(*pc++) {
+			case kScriptOp_EndTrack:
+				return;
+
+			case kScriptOp_Bytes:
+				for(uint32_t i=0; i<pc[1]; ++i)
+					mCRC = UpdateCRC(mCRC, program.mData[pc[0] + i]);
+
+				pc += 2;
+				break;
+
+			case kScriptOp_ByteRun:
+				for(uint32_t i=0; i<pc[2]; ++i)
+					mCRC = UpdateCRC(mCRC, (uint8_t)pc[1]);
+
+				pc += 3;
+				break;
+
+			case kScriptOp_PadBits:
+				pc += 2;
+				break;
+
+			case kScriptOp_CRCBegin:
+				mCRC = 0xFFFF;
+				break;
+
+			case kScriptOp_CRCEnd: {
+				const uint16_t crc = mCRC;
+
+				mCRC = UpdateCRC(mCRC, (uint8_t)(crc >> 8));
+				mCRC = UpdateCRC(mCRC, (uint8_t)crc);
+				break;
+			}
+
+			case kScriptOp_Flux:
+				TakeDelay(*pc++, 1);
+				break;
+
+			case kScriptOp_NoFlux:
+				TakeDelay(*pc++, 0);
+				break;
+
+			case kScriptOp_Repeat:
+				loopCounts.push_back(*pc++);
+				break;
+
+			case kScriptOp_Loop:
+				if (--loopCounts.back())
+					pc -= *pc;
+				else {
+					loopCounts.pop_back();
+					++pc;
+				}
+				break;
+
+			default:
+				A8RC_RT_ASSERT(false);
+				return;
+		}
+	}
+}
+
+// Executes the body of a track statement. Apart from the carried state that
+// it starts with, a track is independent of the others, so tracks can be
+// generated in parallel.
+class ScriptTrackEngine {
+public:
+	ScriptTrackEngine(RawTrack& track, int logicalTrack, std::string& log, const ScriptCarryState& state);
+
+	// Run the track body starting at pc, through the end of the track.
+	void Execute(const ScriptProgram& program, const uint32_t *pc);
 
 	void EmitByte(bool special, uint8_t c);
+	void EmitByteRun(bool special, uint8_t c, uint32_t count);
+	void EmitBytes(const uint8_t *data, size_t len);
 	void EmitPadBits(uint32_t count, bool set);
 	void EmitCellDelay(uint32_t count256);
 	void EmitCellDelayNoFlux(uint32_t count256);
@@ -12,138 +168,181 @@ public:
 	void BeginCRC();
 	void EndCRC();
 
-	void BeginTrack(int track, int side);
+private:
+	void BeginTrack();
 	void EndTrack();
 
-	void SetGeometry(int tracks, int sides);
-
-private:
-	RawDisk& mRawDisk;
-	RawTrack *mpCurrentTrack = nullptr;
-	int mCurrentLogicalTrackNum = 0;
+	RawTrack& mTrack;
+	const int mLogicalTrackNum;
+	std::string& mLog;
 	uint32_t mTrackPos = 0;
-	uint16_t mCRC = 0;
-	int32_t mCellFracAccum = 128;
+	ScriptCarryState mState;
 };
 
-ScriptEngine::ScriptEngine(RawDisk& raw_disk)
-	: mRawDisk(raw_disk)
+ScriptTrackEngine::ScriptTrackEngine(RawTrack& track, int logicalTrack, std::string& log, const ScriptCarryState& state)
+	: mTrack(track)
+	, mLogicalTrackNum(logicalTrack)
+	, mLog(log)
+	, mState(state)
 {
-	// Initialize the raw disk.
-	for(auto& side : mRawDisk.mPhysTracks) {
-		for(auto& track : side) {
-			// Currently we use 25ns (SCP).
-			track.mSamplesPerRev = 8333333;
-
-			track.mSpliceStart = -1;
-			track.mSpliceEnd = -1;
-		}
-	}
 }
 
-void ScriptEngine::EmitByte(bool special, uint8_t c) {
-	if (!mpCurrentTrack)
-		fatalf("Cannot emit data byte outside of a track.\n");
+void ScriptTrackEngine::Execute(const ScriptProgram& program, const uint32_t *pc) {
+	std::vector<uint32_t> loopCounts;
 
-	mCRC = ComputeCRC(&c, 1, mCRC);
+	BeginTrack();
 
-	// 4us = 160 ticks at 25ns
-	uint8_t clockBits = special ? 0xC7 : 0xFF;
-	uint8_t dataBits = c;
+	for(;;) {
+		switch(*pc++) {
+			case kScriptOp_EndTrack:
+				EndTrack();
+				return;
+
+			case kScriptOp_Bytes:
+				EmitBytes(program.mData.data() + pc[0], pc[1]);
+				pc += 2;
+				break;
 
-	for(int bit = 0; bit < 8; ++bit) {
-		// clock bit
-		if (clockBits & 0x80)
-			mpCurrentTrack->mTransitions.push_back(mTrackPos + 80);
+			case kScriptOp_ByteRun:
+				EmitByteRun(pc[0] != 0, (uint8_t)pc[1], pc[2]);
+				pc += 3;
+				break;
 
-		clockBits += clockBits;
+			case kScriptOp_PadBits:
+				EmitPadBits(pc[0], pc[1] != 0);
+				pc += 2;
+				break;
 
-		mTrackPos += 160;
+			case kScriptOp_CRCBegin:
+				BeginCRC();
+				break;
 
-		// data bit
-		if (dataBits & 0x80)
-			mpCurrentTrack->mTransitions.push_back(mTrackPos + 80);
+			case kScriptOp_CRCEnd:
+				EndCRC();
+				break;
 
-		dataBits += dataBits;
+			case kScriptOp_Flux:
+				EmitCellDelay(*pc++);
+				break;
 
-		mTrackPos += 160;
+			case kScriptOp_NoFlux:
+				EmitCellDelayNoFlux(*pc++);
+				break;
+
+			case kScriptOp_Repeat:
+				loopCounts.push_back(*pc++);
+				break;
+
+			case kScriptOp_Loop:
+				if (--loopCounts.back())
+					pc -= *pc;
+				else {
+					loopCounts.pop_back();
+					++pc;
+				}
+				break;
+
+			default:
+				// the compiler doesn't allow any other ops in a track
+				A8RC_RT_ASSERT(false);
+				return;
+		}
 	}
 }
 
-void ScriptEngine::EmitPadBits(uint32_t count, bool set) {
-	while(count-- > 0) {
-		mpCurrentTrack->mTransitions.push_back(mTrackPos + 80);
+void ScriptTrackEngine::EmitByte(bool special, uint8_t c) {
+	EmitByteRun(special, c, 1);
+}
 
-		mTrackPos += 160;
+void ScriptTrackEngine::EmitByteRun(bool special, uint8_t c, uint32_t count) {
+	auto& transitions = mTrack.mTransitions;
+	const ScriptFMByteCells& cells = kScriptFMByteTable.mEntries[special][c];
 
-		if (set)
-			mpCurrentTrack->mTransitions.push_back(mTrackPos + 80);
+	const size_t offset = transitions.size();
+	transitions.resize(offset + (size_t)cells.mCount * count);
 
-		mTrackPos += 160;
+	uint32_t *dst = transitions.data() + offset;
+
+	for(uint32_t i=0; i<count; ++i) {
+		mState.mCRC = UpdateCRC(mState.mCRC, c);
+
+		for(int j=0; j<cells.mCount; ++j)
+			*dst++ = mTrackPos + cells.mOffsets[j];
+
+		mTrackPos += 160 * 16;
 	}
 }
 
-void ScriptEngine::EmitCellDelay(uint32_t count256) {
-	mCellFracAccum += count256;
+void ScriptTrackEngine::EmitBytes(const uint8_t *data, size_t len) {
+	auto& transitions = mTrack.mTransitions;
 
-	int32_t delay = mCellFracAccum >> 8;
+	for(size_t i=0; i<len; ++i) {
+		const uint8_t c = data[i];
+		const ScriptFMByteCells& cells = kScriptFMByteTable.mEntries[0][c];
 
-	if (delay < 1)
-		delay = 1;
+		mState.mCRC = UpdateCRC(mState.mCRC, c);
 
-	mCellFracAccum -= delay << 8;
+		for(int j=0; j<cells.mCount; ++j)
+			transitions.push_back(mTrackPos + cells.mOffsets[j]);
 
-	mTrackPos += delay;
-	mpCurrentTrack->mTransitions.push_back(mTrackPos);
+		mTrackPos += 160 * 16;
+	}
 }
 
-void ScriptEngine::EmitCellDelayNoFlux(uint32_t count256) {
-	mCellFracAccum += count256;
+void ScriptTrackEngine::EmitPadBits(uint32_t count, bool set) {
+	auto& transitions = mTrack.mTransitions;
+
+	while(count-- > 0) {
+		transitions.push_back(mTrackPos + 80);
+
+		mTrackPos += 160;
 
-	int32_t delay = mCellFracAccum >> 8;
+		if (set)
+			transitions.push_back(mTrackPos + 80);
 
-	mCellFracAccum -= delay << 8;
+		mTrackPos += 160;
+	}
+}
 
-	mTrackPos += delay;
+void ScriptTrackEngine::EmitCellDelay(uint32_t count256) {
+	mTrackPos += mState.TakeDelay(count256, 1);
+	mTrack.mTransitions.push_back(mTrackPos);
 }
 
-void ScriptEngine::BeginCRC() {
-	mCRC = 0xFFFF;
+void ScriptTrackEngine::EmitCellDelayNoFlux(uint32_t count256) {
+	mTrackPos += mState.TakeDelay(count256, 0);
 }
 
-void ScriptEngine::EndCRC() {
+void ScriptTrackEngine::BeginCRC() {
+	mState.mCRC = 0xFFFF;
+}
+
+void ScriptTrackEngine::EndCRC() {
 	// EmitByte() itself changes the CRC, so we need to cache it!
-	uint16_t crc = mCRC;
+	uint16_t crc = mState.mCRC;
 
 	EmitByte(false, (uint8_t)(crc >> 8));
 	EmitByte(false, (uint8_t)crc);
 }
 
-void ScriptEngine::BeginTrack(int track, int side) {
-	if (track < 0 || track > 84 / mRawDisk.mTrackStep)
-		fatalf("Invalid track number: %d\n", track);
-
-	if (side < 0 || side >= mRawDisk.mSideCount)
-		fatalf("Invalid side number: %d\n", side);
-
-	mpCurrentTrack = &mRawDisk.mPhysTracks[0][track * mRawDisk.mTrackStep];
-	mCurrentLogicalTrackNum = track;
-
-	mpCurrentTrack->mIndexTimes.assign( { 0, 8333333, 1666666 } );
+void ScriptTrackEngine::BeginTrack() {
+	mTrack.mIndexTimes.assign( { 0, 8333333, 1666666 } );
 
 	mTrackPos = 0;
 }
 
-void ScriptEngine::EndTrack() {
+void ScriptTrackEngine::EndTrack() {
 	// Fill out the remaining time until the end of the track with $FF data
 	// bytes.
-	auto& transitions = mpCurrentTrack->mTransitions;
-	const uint32_t endPos = mpCurrentTrack->mIndexTimes[1];
+	auto& transitions = mTrack.mTransitions;
+	const uint32_t endPos = mTrack.mIndexTimes[1];
 
 	if (mTrackPos > endPos) {
 		const float kTicksToBits = 1.0f / 160.0f;
 
-		printf("Warning: Overrun on track %d (%.1f bit cells > %.1f bit cells). Track will be truncated.\n", mCurrentLogicalTrackNum, (float)mTrackPos * kTicksToBits, (float)endPos * kTicksToBits);
+		char buf[256];
+		snprintf(buf, sizeof buf, "Warning: Overrun on track %d (%.1f bit cells > %.1f bit cells). Track will be truncated.\n", mLogicalTrackNum, (float)mTrackPos * kTicksToBits, (float)endPos * kTicksToBits);
+		mLog += buf;
 
 		auto it = std::lower_bound(transitions.begin(), transitions.end(), endPos);
 
@@ -152,8 +351,8 @@ void ScriptEngine::EndTrack() {
 		mTrackPos = endPos;
 	}
 
-	mpCurrentTrack->mSpliceStart = mTrackPos;
-	mpCurrentTrack->mSpliceEnd = endPos;
+	mTrack.mSpliceStart = mTrackPos;
+	mTrack.mSpliceEnd = endPos;
 
 	while(mTrackPos + 160 < endPos) {
 		transitions.push_back(mTrackPos + 80);
@@ -165,235 +364,167 @@ void ScriptEngine::EndTrack() {
 
 	transitions.resize(len * 2);
 	std::transform(transitions.begin(), transitions.begin() + len, transitions.begin() + len, [endPos](uint32_t t) { return t + endPos; });
-
-	mpCurrentTrack = nullptr;
 }
 
-void ScriptEngine::SetGeometry(int tracks, int sides) {
-	if (tracks < 1 || tracks > 84)
-		fatalf("Invalid track count: %u.\n", tracks);
-
-	if (sides < 1 || sides > 2)
-		fatalf("Invalid side count: %u.\n", sides);
-
-	mRawDisk.mTrackCount = tracks;
-	mRawDisk.mTrackStep = tracks < 42 ? 2 : 1;
-	mRawDisk.mSideCount = sides;
-}
-
-///////////////////////////////////////////////////////////////////////////
-
-class ScriptExpr {
-public:
-	virtual int32_t Evaluate(ScriptEngine& eng) = 0;
-};
-
-class ScriptExprValue final : public ScriptExpr {
-public:
-	ScriptExprValue(int32_t val) : mValue(val) {}
-
-	int32_t Evaluate(ScriptEngine& eng) override { return mValue; }
-
-private:
-	const int32_t mValue;
-};
-
-class ScriptStatement {
+// Runs the statements outside of tracks, in order, and then generates the
+// tracks on the worker threads.
+class ScriptEngine {
 public:
-	virtual void Execute(ScriptEngine& eng) = 0;
-};
+	ScriptEngine(RawDisk& raw_disk);
 
-class ScriptStatementBlock final : public ScriptStatement {
-public:
-	ScriptStatementBlock(ScriptStatement *const *list, size_t n)
-		: mpStatements(list)
-		, mCount(n)
-	{
-	}
+	void Execute(const ScriptProgram& program);
 
-	void Execute(ScriptEngine& eng) {
-		for(size_t i=0; i<mCount; ++i)
-			mpStatements[i]->Execute(eng);
-	}
+	void SetGeometry(int tracks, int sides);
 
 private:
-	ScriptStatement *const *const mpStatements;
-	const size_t mCount;
-};
-
-class ScriptStatementTrack final : public ScriptStatement {
-public:
-	ScriptStatementTrack(ScriptExpr *trackExpr, ScriptExpr *sideExpr, ScriptStatement *child)
-		: mpTrackExpr(trackExpr)
-		, mpSideExpr(sideExpr)
-		, mpChildStatement(child)
-	{
-	}
-
-	void Execute(ScriptEngine& eng) override {
-		int32_t track = mpTrackExpr->Evaluate(eng);
-		int32_t side = mpSideExpr ? mpSideExpr->Evaluate(eng) : 0;
-
-		eng.BeginTrack(track, side);
+	struct TrackJob {
+		RawTrack *mpTrack;
+		int mLogicalTrackNum;
+		const uint32_t *mpBody;
+		ScriptCarryState mEntryState;
+		std::string mLog;
+	};
 
-		mpChildStatement->Execute(eng);
+	void AddTrack(int track, int side, const uint32_t *body, const ScriptCarryState& state);
 
-		eng.EndTrack();
-	}
-
-private:
-	ScriptExpr *mpTrackExpr;
-	ScriptExpr *mpSideExpr;
-	ScriptStatement *mpChildStatement;
+	RawDisk& mRawDisk;
+	std::vector<TrackJob> mTrackJobs;
 };
 
-class ScriptStatementRepeat final : public ScriptStatement {
-public:
-	ScriptStatementRepeat(ScriptExpr *countExpr, ScriptStatement *child)
-		: mpCountExpr(countExpr)
-		, mpChildStatement(child)
-	{
-	}
-
-	void Execute(ScriptEngine& eng) override {
-		int32_t count = mpCountExpr->Evaluate(eng);
+ScriptEngine::ScriptEngine(RawDisk& raw_disk)
+	: mRawDisk(raw_disk)
+{
+	// Initialize the raw disk.
+	for(auto& side : mRawDisk.mPhysTracks) {
+		for(auto& track : side) {
+			// Currently we use 25ns (SCP).
+			track.mSamplesPerRev = 8333333;
 
-		while(count-- > 0)
-			mpChildStatement->Execute(eng);
+			track.mSpliceStart = -1;
+			track.mSpliceEnd = -1;
+		}
 	}
+}
 
-private:
-	ScriptExpr *mpCountExpr;
-	ScriptStatement *mpChildStatement;
-};
-
-class ScriptStatementByte final : public ScriptStatement {
-public:
-	ScriptStatementByte(bool special, ScriptExpr *e) : mbSpecial(special), mpValueExpr(e) {}
-
-	void Execute(ScriptEngine& eng) override {
-		int32_t v = mpValueExpr->Evaluate(eng);
-		if (v < 0 || v > 255)
-			fatalf("Invalid data byte: %d\n", (int)v);
+void ScriptEngine::Execute(const ScriptProgram& program) {
+	const uint32_t *pc = program.mCode.data();
+	std::vector<uint32_t> loopCounts;
+	ScriptCarryState state;
+	bool done = false;
 
-		eng.EmitByte(mbSpecial, (uint8_t)v);
-	};
+	while(!done) {
+		switch(*pc++) {
+			case kScriptOp_End:
+				done = true;
+				break;
 
-private:
-	const bool mbSpecial;
-	ScriptExpr *const mpValueExpr;
-};
+			case kScriptOp_Geometry:
+				SetGeometry((int)pc[0], (int)pc[1]);
+				pc += 2;
+				break;
 
-class ScriptStatementBytes final : public ScriptStatement {
-public:
-	ScriptStatementBytes(const uint8_t *data, size_t len) : mpData(data), mLen(len) {}
+			case kScriptOp_Track:
+				AddTrack((int)pc[0], (int)pc[1], pc + 3, state);
+				state.SkipTrack(program, pc + 3);
+				pc += 3 + pc[2];
+				break;
 
-	void Execute(ScriptEngine& eng) override {
-		for(size_t i=0; i<mLen; ++i)
-			eng.EmitByte(false, mpData[i]);
-	};
+			case kScriptOp_Bytes:
+			case kScriptOp_ByteRun:
+			case kScriptOp_CRCEnd:
+				fatalf("Cannot emit data byte outside of a track.\n");
+				break;
 
-private:
-	const uint8_t *const mpData;
-	const size_t mLen;
-};
+			case kScriptOp_PadBits:
+				fatalf("Cannot emit pad bits outside of a track.\n");
+				break;
 
-class ScriptStatementPadBits final : public ScriptStatement {
-public:
-	ScriptStatementPadBits(ScriptExpr *e, ScriptExpr *e2) : mpCountExpr(e), mpValueExpr(e2) {}
+			case kScriptOp_Flux:
+				fatalf("Cannot emit flux transition outside of a track.\n");
+				break;
 
-	void Execute(ScriptEngine& eng) override {
-		int32_t count = mpCountExpr->Evaluate(eng);
-		if (count < 0 || count > 1000000)
-			fatalf("Invalid pad bit count: %d\n", (int)count);
+			case kScriptOp_CRCBegin:
+				state.mCRC = 0xFFFF;
+				break;
 
-		int32_t v = mpValueExpr->Evaluate(eng);
-		if (v < 0 || v > 1)
-			fatalf("Invalid pad bit value: %d\n", (int)v);
+			case kScriptOp_NoFlux:
+				state.TakeDelay(*pc++, 0);
+				break;
 
-		eng.EmitPadBits(count, v != 0);
-	};
+			case kScriptOp_Repeat:
+				loopCounts.push_back(*pc++);
+				break;
 
-private:
-	ScriptExpr *const mpCountExpr;
-	ScriptExpr *const mpValueExpr;
-};
+			case kScriptOp_Loop:
+				if (--loopCounts.back())
+					pc -= *pc;
+				else {
+					loopCounts.pop_back();
+					++pc;
+				}
+				break;
 
-class ScriptStatementCRCBegin final : public ScriptStatement {
-public:
-	void Execute(ScriptEngine& eng) override {
-		eng.BeginCRC();
+			default:
+				A8RC_RT_ASSERT(false);
+				return;
+		}
 	}
-};
 
-class ScriptStatementCRCEnd final : public ScriptStatement {
-public:
-	void Execute(ScriptEngine& eng) override {
-		eng.EndCRC();
-	}
-};
+	// A track written more than once is added to, so group the statements for
+	// each track and run each group in script order.
+	std::vector<std::vector<TrackJob *>> groups;
+	std::unordered_map<RawTrack *, size_t> groupLookup;
 
-class ScriptStatementFlux final : public ScriptStatement {
-public:
-	ScriptStatementFlux(ScriptExpr *e) : mpCountExpr(e) {}
+	for(TrackJob& job : mTrackJobs) {
+		auto r = groupLookup.emplace(job.mpTrack, groups.size());
 
-	void Execute(ScriptEngine& eng) override {
-		int32_t count = mpCountExpr->Evaluate(eng);
-		if (count < 1 || count > 1000000)
-			fatalf("Invalid cell delay: %d\n", (int)count);
+		if (r.second)
+			groups.emplace_back();
 
-		eng.EmitCellDelay((count * 160 * 256 + 50) / 100);
-	};
-
-private:
-	ScriptExpr *const mpCountExpr;
-};
-
-class ScriptStatementNoFlux final : public ScriptStatement {
-public:
-	ScriptStatementNoFlux(ScriptExpr *e) : mpCountExpr(e) {}
+		groups[r.first->second].push_back(&job);
+	}
 
-	void Execute(ScriptEngine& eng) override {
-		int32_t count = mpCountExpr->Evaluate(eng);
-		if (count < 1 || count > 1000000)
-			fatalf("Invalid cell delay: %d\n", (int)count);
+	parallel_for(groups.size(), [&](size_t i) {
+		for(TrackJob *job : groups[i]) {
+			ScriptTrackEngine eng(*job->mpTrack, job->mLogicalTrackNum, job->mLog, job->mEntryState);
 
-		eng.EmitCellDelayNoFlux((count * 160 * 256 + 50) / 100);
-	};
+			eng.Execute(program, job->mpBody);
+		}
+	});
 
-private:
-	ScriptExpr *const mpCountExpr;
-};
+	for(const TrackJob& job : mTrackJobs)
+		fputs(job.mLog.c_str(), stdout);
+}
 
-class ScriptStatementGeometry final : public ScriptStatement {
-public:
-	ScriptStatementGeometry(ScriptExpr *e, ScriptExpr *e2) : mpTracksExpr(e), mpSidesExpr(e) {}
+void ScriptEngine::AddTrack(int track, int side, const uint32_t *body, const ScriptCarryState& state) {
+	if (track < 0 || track > 84 / mRawDisk.mTrackStep)
+		fatalf("Invalid track number: %d\n", track);
 
-	void Execute(ScriptEngine& eng) override {
-		int32_t tracks = mpTracksExpr->Evaluate(eng);
-		int32_t sides = mpSidesExpr->Evaluate(eng);
+	if (side < 0 || side >= mRawDisk.mSideCount)
+		fatalf("Invalid side number: %d\n", side);
 
-		if (tracks < 1 || tracks > 84)
-			fatalf("Invalid track count: %d\n", (int)tracks);
+	mTrackJobs.push_back(TrackJob { &mRawDisk.mPhysTracks[side][track * mRawDisk.mTrackStep], track, body, state, {} });
+}
 
-		if (sides < 1 || sides > 2)
-			fatalf("Invalid side count: %d\n", (int)sides);
+void ScriptEngine::SetGeometry(int tracks, int sides) {
+	if (tracks < 1 || tracks > 84)
+		fatalf("Invalid track count: %u.\n", tracks);
 
-		eng.SetGeometry(tracks, sides);
-	};
+	if (sides < 1 || sides > 2)
+		fatalf("Invalid side count: %u.\n", sides);
 
-private:
-	ScriptExpr *const mpTracksExpr;
-	ScriptExpr *const mpSidesExpr;
-};
+	mRawDisk.mTrackCount = tracks;
+	mRawDisk.mTrackStep = tracks < 42 ? 2 : 1;
+	mRawDisk.mSideCount = sides;
+}
 
+///////////////////////////////////////////////////////////////////////////
 class ScriptCompiler {
 	ScriptCompiler(const ScriptCompiler&) = delete;
 	ScriptCompiler& operator=(const ScriptCompiler&) = delete;
 
 public:
 	ScriptCompiler() = default;
-	~ScriptCompiler();
 
 	void Run(const char *fn, const void *text, size_t len, RawDisk& rawDisk);
 
@@ -416,35 +547,22 @@ private:
 		kTokGeometry
 	};
 
-	ScriptStatement *ParseStatement();
-	ScriptStatement *ParseChildStatement();
-	ScriptExpr *ParseExpression();
+	bool ParseStatement();
+	bool ParseChildStatement();
+	bool ParseExpression(int32_t& value);
+	bool ParseRepeat();
+
+	void EmitOp(ScriptOp op);
+	void EmitOp(ScriptOp op, uint32_t arg);
+	void EmitOp(ScriptOp op, uint32_t arg1, uint32_t arg2);
+	void EmitByteRun(bool special, uint8_t c, uint32_t count);
+	bool EmitCellDelay(ScriptOp op, int32_t count);
 
 	void Push(int tok);
 	int Token();
 	bool Error(const char *str);
 	bool ErrorF(const char *format, ...);
 
-	template<class T, typename... Args>
-	T *Alloc(Args&&... args) {
-		void *mem = AllocRaw(sizeof(T));
-
-		return new(mem) T(std::forward<Args>(args)...);
-	}
-
-	void *AllocRaw(size_t n) {
-		mAllocs.push_back(nullptr);
-
-		void *p = malloc(n);
-		if (!p) {
-			mAllocs.pop_back();
-			throw std::bad_alloc();
-		}
-
-		mAllocs.back() = p;
-		return p;
-	}
-
 	int mPushedToken = -1;
 	const char *mpSrc = nullptr;
 	const char *mpSrcEnd = nullptr;
@@ -454,15 +572,14 @@ private:
 	int mLineNo = 1;
 	int32_t mIntVal = 0;
 
-	std::vector<void *> mAllocs;
-};
+	ScriptProgram mProgram;
 
-ScriptCompiler::~ScriptCompiler() {
-	while(!mAllocs.empty()) {
-		free(mAllocs.back());
-		mAllocs.pop_back();
-	}
-}
+	// Offset of the last op in the code, if it can be merged with the next
+	// one; ~0 after a jump target.
+	size_t mLastOp = ~(size_t)0;
+
+	bool mbInTrack = false;
+};
 
 void ScriptCompiler::Run(const char *fn, const void *text, size_t len, RawDisk& rawDisk) {
 	mpSrc = (const char *)text;
@@ -470,8 +587,6 @@ void ScriptCompiler::Run(const char *fn, const void *text, size_t len, RawDisk&
 	mpFileName = fn;
 	mpLineStart = mpSrc;
 
-	std::vector<ScriptStatement *> children;
-
 	for(;;) {
 		int tok = Token();
 
@@ -480,180 +595,230 @@ void ScriptCompiler::Run(const char *fn, const void *text, size_t len, RawDisk&
 
 		Push(tok);
 
-		ScriptStatement *c = ParseStatement();
-		if (!c)
+		if (!ParseStatement())
 			break;
-
-		children.push_back(c);
 	}
 
 	if (mPushedToken == kTokError)
 		fatalf("Script compilation failed.\n");
 
+	EmitOp(kScriptOp_End);
+
+	if (g_verbosity >= 2)
+		printf("Compiled disk script to %u code words and %u data bytes\n", (unsigned)mProgram.mCode.size(), (unsigned)mProgram.mData.size());
+
 	ScriptEngine eng(rawDisk);
-	for(auto *s : children)
-		s->Execute(eng);
+	eng.Execute(mProgram);
 }
 
-ScriptStatement *ScriptCompiler::ParseStatement() {
+bool ScriptCompiler::ParseStatement() {
 	int tok = Token();
 
 	if (tok == kTokError)
-		return nullptr;
-
-	ScriptStatement *s = nullptr;
+		return false;
 
 	if (tok == kTokTrack) {
-		ScriptExpr *e = ParseExpression();
-		if (!e)
-			return nullptr;
+		int32_t track;
+		if (!ParseExpression(track))
+			return false;
 
-		ScriptExpr *e2 = nullptr;
+		int32_t side = 0;
 		tok = Token();
 		if (tok == ',') {
-			e2 = ParseExpression();
-			if (!e2)
-				return nullptr;
+			if (!ParseExpression(side))
+				return false;
 		} else
 			Push(tok);
 
-		ScriptStatement *c = ParseChildStatement();
-		if (!c)
-			return nullptr;
+		if (mbInTrack)
+			return Error("Track statements cannot be nested");
 
-		return Alloc<ScriptStatementTrack>(e, e2, c);
-	} else if (tok == kTokRepeat) {
-		ScriptExpr *e = ParseExpression();
-		if (!e)
-			return nullptr;
+		auto& code = mProgram.mCode;
 
-		ScriptStatement *c = ParseChildStatement();
-		if (!c)
-			return nullptr;
+		EmitOp(kScriptOp_Track, (uint32_t)track, (uint32_t)side);
+		code.push_back(0);
 
-		return Alloc<ScriptStatementRepeat>(e, c);
-	} else if (tok == kTokByte) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
+		const size_t bodyStart = code.size();
 
-		s = Alloc<ScriptStatementByte>(false, e);
-	} else if (tok == kTokBytes) {	
-		std::vector<uint8_t> data;
+		mbInTrack = true;
+
+		if (!ParseChildStatement())
+			return false;
 
+		mbInTrack = false;
+
+		EmitOp(kScriptOp_EndTrack);
+
+		code[bodyStart - 1] = (uint32_t)(code.size() - bodyStart);
+		return true;
+	} else if (tok == kTokRepeat) {
+		return ParseRepeat();
+	} else if (tok == kTokByte || tok == kTokSpecialByte) {
+		int32_t v;
+		if (!ParseExpression(v))
+			return false;
+
+		if (v < 0 || v > 255)
+			return ErrorF("Invalid data byte: %d", (int)v);
+
+		EmitByteRun(tok == kTokSpecialByte, (uint8_t)v, 1);
+	} else if (tok == kTokBytes) {	
 		for(;;) {
 			tok = Token();
 			if (tok == kTokError)
-				return nullptr;
+				return false;
 
-			if (tok != kTokInt) {
-				Error("Expected integral constant");
-				return nullptr;
-			}
+			if (tok != kTokInt)
+				return Error("Expected integral constant");
 
-			if (mIntVal < 0 || mIntVal > 255) {
-				Error("Value out of range (must be 0-255)");
-				return nullptr;
-			}
+			if (mIntVal < 0 || mIntVal > 255)
+				return Error("Value out of range (must be 0-255)");
 
-			data.push_back((uint8_t)mIntVal);
+			EmitByteRun(false, (uint8_t)mIntVal, 1);
 
 			tok = Token();
 
 			if (tok == ';')
 				break;
 
-			if (tok != ',') {
-				Error("Expected ',' or end of statement");
-				return nullptr;
-			}
+			if (tok != ',')
+				return Error("Expected ',' or end of statement");
 		}
 
-		size_t n = data.size();
-		uint8_t *buf = (uint8_t *)AllocRaw(n);
-
-		memcpy(buf, data.data(), n);
-
-		return Alloc<ScriptStatementBytes>(buf, n);
-	} else if (tok == kTokSpecialByte) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
-
-		s = Alloc<ScriptStatementByte>(true, e);
+		return true;
 	} else if (tok == kTokPadBits) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
+		int32_t count;
+		if (!ParseExpression(count))
+			return false;
 
 		tok = Token();
 		if (tok != ',') {
 			if (tok != kTokError)
 				Error("Expected ','");
-			return nullptr;
+			return false;
 		}
 
-		auto *e2 = ParseExpression();
-		if (!e2)
-			return nullptr;
+		int32_t v;
+		if (!ParseExpression(v))
+			return false;
+
+		if (count < 0 || count > 1000000)
+			return ErrorF("Invalid pad bit count: %d", (int)count);
+
+		if (v < 0 || v > 1)
+			return ErrorF("Invalid pad bit value: %d", (int)v);
 
-		s = Alloc<ScriptStatementPadBits>(e, e2);
+		EmitOp(kScriptOp_PadBits, (uint32_t)count, (uint32_t)v);
 	} else if (tok == kTokCRCBegin) {
-		s = Alloc<ScriptStatementCRCBegin>();
+		EmitOp(kScriptOp_CRCBegin);
 	} else if (tok == kTokCRCEnd) {
-		s = Alloc<ScriptStatementCRCEnd>();
-	} else if (tok == kTokFlux) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
-
-		s = Alloc<ScriptStatementFlux>(e);
-	} else if (tok == kTokNoFlux) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
-
-		s = Alloc<ScriptStatementNoFlux>(e);
+		EmitOp(kScriptOp_CRCEnd);
+	} else if (tok == kTokFlux || tok == kTokNoFlux) {
+		int32_t count;
+		if (!ParseExpression(count))
+			return false;
+
+		if (!EmitCellDelay(tok == kTokFlux ? kScriptOp_Flux : kScriptOp_NoFlux, count))
+			return false;
 	} else if (tok == kTokGeometry) {
-		auto *e = ParseExpression();
-		if (!e)
-			return nullptr;
+		if (mbInTrack)
+			return Error("Geometry cannot be changed within a track");
+
+		int32_t tracks;
+		if (!ParseExpression(tracks))
+			return false;
 
 		tok = Token();
-		if (tok != ',') {
-			Error("Expected side count after track count");
-			return nullptr;
-		}
-		auto *e2 = ParseExpression();
-		if (!e2)
-			return nullptr;
+		if (tok != ',')
+			return Error("Expected side count after track count");
+
+		int32_t sides;
+		if (!ParseExpression(sides))
+			return false;
+
+		if (tracks < 1 || tracks > 84)
+			return ErrorF("Invalid track count: %d", (int)tracks);
+
+		if (sides < 1 || sides > 2)
+			return ErrorF("Invalid side count: %d", (int)sides);
 
-		s = Alloc<ScriptStatementGeometry>(e, e2);
+		EmitOp(kScriptOp_Geometry, (uint32_t)tracks, (uint32_t)sides);
 	} else {
-		Error("Expected statement");
-		return nullptr;
+		return Error("Expected statement");
 	}
 
 	tok = Token();
 	if (tok == kTokError)
-		return nullptr;
+		return false;
+
+	if (tok != ';')
+		return Error("Expected ';' at end of statement");
+
+	return true;
+}
+
+bool ScriptCompiler::ParseRepeat() {
+	int32_t count;
+	if (!ParseExpression(count))
+		return false;
+
+	auto& code = mProgram.mCode;
+
+	// Compile the body behind a repeat op, then see if the loop can be
+	// simplified now that we know what is in it.
+	const size_t repeatStart = code.size();
+	EmitOp(kScriptOp_Repeat, count > 0 ? (uint32_t)count : 0);
+
+	const size_t bodyStart = code.size();
+	mLastOp = ~(size_t)0;
+
+	if (!ParseChildStatement())
+		return false;
 
-	if (tok != ';') {
-		Error("Expected ';' at end of statement");
-		return nullptr;
+	if (count <= 0 || bodyStart == code.size()) {
+		// no iterations or empty body -- drop the loop entirely
+		code.resize(repeatStart);
+		mLastOp = ~(size_t)0;
+		return true;
 	}
 
-	return s;
+	if (count == 1 || (mLastOp == bodyStart && (code[bodyStart] == kScriptOp_ByteRun || code[bodyStart] == kScriptOp_PadBits))) {
+		// Either the body runs once, or it is a single run that can be
+		// lengthened instead of looped. Remove the repeat op in favor of
+		// the body.
+		code.erase(code.begin() + repeatStart, code.begin() + bodyStart);
+
+		if (count == 1) {
+			if (mLastOp != ~(size_t)0)
+				mLastOp -= bodyStart - repeatStart;
+
+			return true;
+		}
+
+		mLastOp = repeatStart;
+
+		uint32_t& runCount = code[repeatStart + (code[repeatStart] == kScriptOp_ByteRun ? 3 : 1)];
+		const uint64_t newCount = (uint64_t)runCount * (uint32_t)count;
+
+		if (newCount > UINT32_MAX)
+			return Error("Repeat count too large");
+
+		runCount = (uint32_t)newCount;
+		return true;
+	}
+
+	code.push_back(kScriptOp_Loop);
+	code.push_back((uint32_t)(code.size() - bodyStart));
+	mLastOp = ~(size_t)0;
+	return true;
 }
 
-ScriptStatement *ScriptCompiler::ParseChildStatement() {
+bool ScriptCompiler::ParseChildStatement() {
 	int tok = Token();
 
 	if (tok == ':')
 		return ParseStatement();
 	else if (tok == '{') {
-		std::vector<ScriptStatement *> children;
-
 		for(;;) {
 			int tok = Token();
 
@@ -662,42 +827,94 @@ ScriptStatement *ScriptCompiler::ParseChildStatement() {
 
 			Push(tok);
 
-			ScriptStatement *c = ParseStatement();
-			if (!c)
-				return nullptr;
-
-			children.push_back(c);
+			if (!ParseStatement())
+				return false;
 		}
 
-		if (children.size() == 0)
-			return Alloc<ScriptStatementBlock>(nullptr, 0);
-		else if (children.size() == 1)
-			return children.front();
-		else {
-			auto list = (ScriptStatement **)AllocRaw(sizeof(ScriptStatement *) * children.size());
-
-			std::copy(children.begin(), children.end(), list);
-
-			return Alloc<ScriptStatementBlock>(list, children.size());
-		}
+		return true;
 	}
 	
 	if (tok != kTokError)
 		Error("Expected child statement");
 
-	return nullptr;
+	return false;
 }
 
-ScriptExpr *ScriptCompiler::ParseExpression() {
+bool ScriptCompiler::ParseExpression(int32_t& value) {
 	int tok = Token();
 
-	if (tok == kTokInt)
-		return Alloc<ScriptExprValue>(mIntVal);
+	if (tok == kTokInt) {
+		value = mIntVal;
+		return true;
+	}
 
 	if (tok != kTokError)
 		Error("Expected value");
 
-	return nullptr;
+	return false;
+}
+
+void ScriptCompiler::EmitOp(ScriptOp op) {
+	mLastOp = mProgram.mCode.size();
+	mProgram.mCode.push_back(op);
+}
+
+void ScriptCompiler::EmitOp(ScriptOp op, uint32_t arg) {
+	EmitOp(op);
+	mProgram.mCode.push_back(arg);
+}
+
+void ScriptCompiler::EmitOp(ScriptOp op, uint32_t arg1, uint32_t arg2) {
+	EmitOp(op);
+	mProgram.mCode.push_back(arg1);
+	mProgram.mCode.push_back(arg2);
+}
+
+void ScriptCompiler::EmitByteRun(bool special, uint8_t c, uint32_t count) {
+	auto& code = mProgram.mCode;
+	auto& data = mProgram.mData;
+
+	if (mLastOp != ~(size_t)0) {
+		uint32_t *last = &code[mLastOp];
+
+		// extend a run of the same byte
+		if (last[0] == kScriptOp_ByteRun && last[1] == (uint32_t)special && last[2] == c && (uint64_t)last[3] + count <= UINT32_MAX) {
+			last[3] += count;
+			return;
+		}
+
+		if (!special && count == 1) {
+			// append to a byte string at the end of the data
+			if (last[0] == kScriptOp_Bytes && last[1] + last[2] == data.size()) {
+				data.push_back(c);
+				++last[2];
+				return;
+			}
+
+			// turn a single byte and this one into a byte string
+			if (last[0] == kScriptOp_ByteRun && !last[1] && last[3] == 1) {
+				const uint8_t prev = (uint8_t)last[2];
+
+				code.resize(mLastOp);
+				EmitOp(kScriptOp_Bytes, (uint32_t)data.size(), 2);
+				data.push_back(prev);
+				data.push_back(c);
+				return;
+			}
+		}
+	}
+
+	EmitOp(kScriptOp_ByteRun, special ? 1 : 0, c);
+	code.push_back(count);
+}
+
+bool ScriptCompiler::EmitCellDelay(ScriptOp op, int32_t count) {
+	if (count < 1 || count > 1000000)
+		return ErrorF("Invalid cell delay: %d", (int)count);
+
+	// delay is in hundredths of a 4us cell (160 ticks)
+	EmitOp(op, (uint32_t)(((uint64_t)count * 160 * 256 + 50) / 100));
+	return true;
 }
 
 void ScriptCompiler::Push(int tok) {
@@ -919,29 +1136,18 @@ bool ScriptCompiler::ErrorF(const char *format, ...) {
 }
 
 void script_read(RawDisk& raw_disk, const char *path, int selected_track) {
-	FILE *f = fopen(path, "rb");
-
-	if (!f)
-		fatalf("Unable to open disk script: %s\n", path);
-
-	if (fseek(f, 0, SEEK_END))
-		fatalf("Unable to read disk script: %s\n", strerror(ferror(f)));
-
-	auto len = ftell(f);
-	if (len < 0)
-		fatalf("Unable to read disk script: %s\n", strerror(ferror(f)));
-
-	if (fseek(f, 0, SEEK_SET))
-		fatalf("Unable to read disk script: %s\n", strerror(ferror(f)));
+	InputFile f;
+	f.Open(path);
 
-	if (len > 0x1000000 || len != (size_t)len)
+	const uint64_t len = f.GetSize();
+	if (len > 0x1000000)
 		fatalf("Disk script is too big: %lld\n", (long long)len);
 
 	void *buf = malloc((size_t)len);
-	if (1 != fread(buf, (size_t)len, 1, f))
-		fatalf("Unable to read disk script: %s\n", strerror(ferror(f)));
+	if (!f.Read(buf, (size_t)len))
+		fatalf("Unable to read disk script: %s\n", path);
 	
-	fclose(f);
+	f.Close();
 
 	ScriptCompiler eng;
 	eng.Run(path, buf, (size_t)len, raw_disk);
@@ -1,14 +1,17 @@
 #include "stdafx.h"
 
 void fatal(const char *msg) {
-	puts(msg);
+	// errors still go out in quiet mode, on stderr
+	FILE *f = g_quiet ? stderr : stdout;
+	fputs(msg, f);
+	fputc('\n', f);
 	exit(10);
 }
 
 void fatalf(const char *msg, ...) {
 	va_list val;
 	va_start(val, msg);
-	vprintf(msg, val);
+	vfprintf(g_quiet ? stderr : stdout, msg, val);
 	va_end(val);
 	exit(10);
 }
@@ -16,3 +19,170 @@ void fatalf(const char *msg, ...) {
 void fatal_read() {
 	fatalf("Unable to read from input file: %s.\n", g_inputPath.c_str());
 }
+
+namespace {
+	void append_vformat(std::string& dst, const char *format, va_list args) {
+		va_list args2;
+		va_copy(args2, args);
+		const int len = vsnprintf(nullptr, 0, format, args2);
+		va_end(args2);
+
+		if (len > 0) {
+			const size_t offset = dst.size();
+			dst.resize(offset + len + 1);
+			vsnprintf(&dst[offset], len + 1, format, args);
+			dst.resize(offset + len);
+		}
+	}
+}
+
+void MessageLog::Printf(const char *format, ...) {
+	va_list val;
+	va_start(val, format);
+	append_vformat(mText, format, val);
+	va_end(val);
+}
+
+void MessageLog::Fail(const char *format, ...) {
+	if (!mError.empty())
+		return;
+
+	va_list val;
+	va_start(val, format);
+	append_vformat(mError, format, val);
+	va_end(val);
+}
+
+void MessageLog::Flush() {
+	fputs(mText.c_str(), stdout);
+	mText.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+	thread_local DecodeLog *g_pCurrentDecodeLog;
+}
+
+void DecodeLog::Printf(int level, const char *format, va_list args) {
+	// check the repeat limit first so that suppressed messages aren't formatted
+	const bool limited = level == 0 && g_verbosity < 2;
+
+	if (limited && !CheckRepeat(format))
+		return;
+
+	va_list args2;
+	va_copy(args2, args);
+	const int len = vsnprintf(nullptr, 0, format, args2);
+	va_end(args2);
+
+	if (len <= 0)
+		return;
+
+	const size_t offset = mText.size();
+	mText.resize(offset + len + 1);
+	vsnprintf(&mText[offset], len + 1, format, args);
+	mText.resize(offset + len);
+
+	if (limited)
+		NoteFirstMessage(format);
+
+	mMessages.push_back(Message { format, (uint32_t)offset, (uint32_t)mText.size(), limited });
+}
+
+void DecodeLog::Append(const DecodeLog& src) {
+	for(const Message& msg : src.mMessages) {
+		if (msg.mbLimited && !CheckRepeat(msg.mpFormat))
+			continue;
+
+		const size_t offset = mText.size();
+		mText.append(src.mText, msg.mStart, msg.mEnd - msg.mStart);
+
+		if (msg.mbLimited)
+			NoteFirstMessage(msg.mpFormat);
+
+		mMessages.push_back(Message { msg.mpFormat, (uint32_t)offset, (uint32_t)mText.size(), msg.mbLimited });
+	}
+
+	for(const char *format : src.mSuppressedFormats)
+		AddSuppressed(format, src.mRepeats.find(format)->second.mSuppressed);
+}
+
+void DecodeLog::Flush() {
+	fputs(mText.c_str(), stdout);
+
+	for(const char *format : mSuppressedFormats) {
+		const RepeatInfo& info = mRepeats[format];
+		if (info.mFirstMessage >= mMessages.size())
+			continue;
+
+		const Message& first = mMessages[info.mFirstMessage];
+
+		// quote the first message of the kind, minus its line break
+		uint32_t end = first.mEnd;
+		while(end > first.mStart && mText[end - 1] == '\n')
+			--end;
+
+		printf("(%u more message%s like \"%.*s\" suppressed)\n"
+			, info.mSuppressed
+			, info.mSuppressed == 1 ? "" : "s"
+			, (int)(end - first.mStart)
+			, mText.data() + first.mStart);
+	}
+
+	mText.clear();
+	mMessages.clear();
+	mRepeats.clear();
+	mSuppressedFormats.clear();
+}
+
+bool DecodeLog::CheckRepeat(const char *format) {
+	auto r = mRepeats.insert({ format, RepeatInfo { UINT32_MAX, 0, 0 } });
+	RepeatInfo& info = r.first->second;
+
+	if (info.mKept < kMaxRepeats) {
+		++info.mKept;
+		return true;
+	}
+
+	AddSuppressed(format, 1);
+	return false;
+}
+
+void DecodeLog::NoteFirstMessage(const char *format) {
+	RepeatInfo& info = mRepeats[format];
+
+	if (info.mFirstMessage == UINT32_MAX)
+		info.mFirstMessage = (uint32_t)mMessages.size();
+}
+
+void DecodeLog::AddSuppressed(const char *format, uint32_t count) {
+	RepeatInfo& info = mRepeats.insert({ format, RepeatInfo { UINT32_MAX, 0, 0 } }).first->second;
+
+	if (!info.mSuppressed)
+		mSuppressedFormats.push_back(format);
+
+	info.mSuppressed += count;
+}
+
+DecodeLogScope::DecodeLogScope(DecodeLog& log)
+	: mpPrevLog(g_pCurrentDecodeLog)
+{
+	g_pCurrentDecodeLog = &log;
+}
+
+DecodeLogScope::~DecodeLogScope() {
+	g_pCurrentDecodeLog = mpPrevLog;
+}
+
+void log_printf(int level, const char *format, ...) {
+	va_list val;
+	va_start(val, format);
+
+	if (g_pCurrentDecodeLog)
+		g_pCurrentDecodeLog->Printf(level, format, val);
+	else
+		vprintf(format, val);
+
+	va_end(val);
+}
@@ -11,4 +11,91 @@
 [[noreturn]] void fatalf(const char *msg, ...);
 [[noreturn]] void fatal_read();
 
+// Messages held back and printed later in one go, so that work done in
+// parallel still reports in order.
+//
+// Work running on a worker thread can't stop the program with fatal(), so
+// it records the error in its log with Fail() and returns instead; the owner
+// of the log reports it once the work has been joined.
+class MessageLog {
+public:
+	void Printf(const char *format, ...);
+
+	// Record an error. Only the first error is kept.
+	void Fail(const char *format, ...);
+
+	bool HasFailed() const { return !mError.empty(); }
+	const char *GetError() const { return mError.c_str(); }
+
+	void Flush();
+
+private:
+	std::string mText;
+	std::string mError;
+};
+
+// Diagnostics from decoding a track. A log is installed on a thread with
+// DecodeLogScope; messages logged on that thread are then held in it and
+// printed when it is flushed, so that tracks split across threads still
+// report in stream order.
+//
+// Level 0 messages are printed at any verbosity, usually for noise in the
+// flux, and only the first few of each kind are kept per log unless
+// sector-level debugging (-vv) is on. Messages at higher levels have been
+// asked for with -v and are always kept.
+class DecodeLog {
+public:
+	void Printf(int level, const char *format, va_list args);
+
+	// Append the messages from another log, as if they had been logged here.
+	void Append(const DecodeLog& src);
+
+	void Flush();
+
+private:
+	enum : uint32_t { kMaxRepeats = 8 };
+
+	struct Message {
+		const char *mpFormat;
+		uint32_t mStart;
+		uint32_t mEnd;
+		bool mbLimited;
+	};
+
+	struct RepeatInfo {
+		uint32_t mFirstMessage;
+		uint32_t mKept;
+		uint32_t mSuppressed;
+	};
+
+	bool CheckRepeat(const char *format);
+	void NoteFirstMessage(const char *format);
+	void AddSuppressed(const char *format, uint32_t count);
+
+	std::string mText;
+	std::vector<Message> mMessages;
+	std::unordered_map<const char *, RepeatInfo> mRepeats;
+	std::vector<const char *> mSuppressedFormats;
+};
+
+class DecodeLogScope {
+public:
+	explicit DecodeLogScope(DecodeLog& log);
+	~DecodeLogScope();
+
+	DecodeLogScope(const DecodeLogScope&) = delete;
+	DecodeLogScope& operator=(const DecodeLogScope&) = delete;
+
+private:
+	DecodeLog *mpPrevLog;
+};
+
+// Log a decoder message, to the thread's DecodeLog if one is installed and
+// directly to the console otherwise.
+void log_printf(int level, const char *format, ...);
+
+// Log a message only if the verbosity is at least the given level, without
+// evaluating the arguments otherwise.
+#define A8RC_LOG(level, ...) ((g_verbosity >= (level)) ? log_printf((level), __VA_ARGS__) : (void)0)
+
 #endif
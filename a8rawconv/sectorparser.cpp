@@ -1,7 +1,9 @@
 #include "stdafx.h"
+#include "stats.h"
 
-SectorParser::SectorParser()
-	: mReadPhase(0)
+SectorParser::SectorParser(DecoderCounters *counters)
+	: mpCounters(counters)
+	, mReadPhase(0)
 	, mBitPhase(0)
 {
 }
@@ -14,11 +16,16 @@ void SectorParser::Init(int track, const std::vector<uint32_t> *indexTimes, floa
 	mRawStart = streamTime;
 }
 
-bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits) {
+bool SectorParser::Parse(uint32_t stream_time, uint16_t cells) {
+	uint8_t clock_bits;
+	uint8_t data_bits;
+
 	if (mReadPhase < 6) {
 		if (++mBitPhase == 16) {
 			mBitPhase = 0;
 
+			split_cells16(cells, clock_bits, data_bits);
+
 			if (clock_bits != 0xFF)
 				return false;
 
@@ -41,7 +48,7 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 #endif
 
 				if (mBuf[3] < 1 || mBuf[3] > 18) {
-					printf("Invalid sector number\n");
+					A8RC_LOG(0, "Invalid sector number\n");
 					return false;
 				}
 
@@ -60,14 +67,12 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 				auto it_index = std::upper_bound(mpIndexTimes->begin(), mpIndexTimes->end(), (uint32_t)vsn_time + 1);
 
 				if (it_index == mpIndexTimes->begin()) {
-					if (g_verbosity >= 2)
-						printf("Skipping track %d, sector %d before first index mark\n", mTrack, mSector);
+					A8RC_LOG(2, "Skipping track %d, sector %d before first index mark\n", mTrack, mSector);
 					return false;
 				}
 
 				if (it_index == mpIndexTimes->end()) {
-					if (g_verbosity >= 2)
-						printf("Skipping track %d, sector %d after last index mark\n", mTrack, mSector);
+					A8RC_LOG(2, "Skipping track %d, sector %d after last index mark\n", mTrack, mSector);
 					return false;
 				}
 
@@ -79,14 +84,14 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 				mRotPos = (float)vsn_offset / (float)(it_index[1] - it_index[0]);
 				mRotPos -= floorf(mRotPos);
 
-				if (g_verbosity >= 2)
-					printf("Found track %d, sector %d at position %4.2f\n", mTrack, mSector, mRotPos);
+				A8RC_LOG(2, "Found track %d, sector %d at position %4.2f\n", mTrack, mSector, mRotPos);
 
 				mRecordedAddressCRC = recordedCRC;
 				mComputedAddressCRC = computedCRC;
 
 				if (computedCRC != recordedCRC) {
-					printf("Found track %d, sector %d with bad address CRC: %04X != %04X\n", mTrack, mSector, computedCRC, recordedCRC);
+					A8RC_LOG(0, "Found track %d, sector %d with bad address CRC: %04X != %04X\n", mTrack, mSector, computedCRC, recordedCRC);
+					++mpCounters->mAddressCRCErrors;
 
 					auto& tracksecs = mpDstTrack->mSectors;
 					tracksecs.emplace_back();
@@ -121,8 +126,8 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 		}
 	} else if (mReadPhase == 6) {
 		if (!--mDAMBitCounter || stream_time - mDAMTimeoutTime < 0x80000000U) {
-			if (g_verbosity >= 2)
-				printf("FM track %d, sector %d: timeout while searching for DAM\n", mTrack, mSector);
+			A8RC_LOG(2, "FM track %d, sector %d: timeout while searching for DAM\n", mTrack, mSector);
+			++mpCounters->mDAMTimeouts;
 			return false;
 		}
 
@@ -130,6 +135,8 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 
 		if (stream_time - mDAMMinTime >= 0x8000000U)
 			return true;
+
+		split_cells16(cells, clock_bits, data_bits);
 			
 		if (clock_bits == 0xC7) {
 			// another IDAM detected before DAM -- terminate
@@ -141,8 +148,7 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 			//	return false;
 
 			if (data_bits == 0xF8 || data_bits == 0xF9 || data_bits == 0xFA || data_bits == 0xFB) {
-				if (g_verbosity >= 2)
-					printf("DAM detected (%02X)\n", data_bits);
+				A8RC_LOG(2, "DAM detected (%02X)\n", data_bits);
 
 				mReadPhase = 7;
 				mBitPhase = 0;
@@ -153,9 +159,10 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 		}
 	} else {
 		if (++mBitPhase == 16) {
+			split_cells16(cells, clock_bits, data_bits);
+
 			if (clock_bits != 0xFF) {
-				if (g_verbosity > 1)
-					printf("Bad data clock: %02X\n", clock_bits);
+				A8RC_LOG(2, "Bad data clock: %02X\n", clock_bits);
 			}
 
 //			printf("Data; %02X\n", ~data_bits);
@@ -173,6 +180,10 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 
 				//printf("Read sector %d: CRCs %04X, %04X\n", mSector, crc, recordedCRC);
 
+				++mpCounters->mParsersCompleted;
+				if (crc != recordedCRC)
+					++mpCounters->mDataCRCErrors;
+
 				// add new sector entry
 				auto& tracksecs = mpDstTrack->mSectors;
 				tracksecs.emplace_back();
@@ -210,7 +221,7 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 					endPos -= floorf(endPos);
 
 					if (recordedCRC == crc) {
-						printf("Decoded FM track %d, sector %2d: %u bytes, pos %5.3f-%5.3f, DAM %02X, CRC %04X (OK)\n",
+						log_printf(1, "Decoded FM track %d, sector %2d: %u bytes, pos %5.3f-%5.3f, DAM %02X, CRC %04X (OK)\n",
 							mTrack,
 							mSector,
 							mSectorSize,
@@ -219,7 +230,7 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 							mBuf[0],
 							recordedCRC);
 					} else {
-						printf("Decoded FM track %d, sector %2d: %u bytes, pos %5.3f-%5.3f, DAM %02X, CRC %04X (bad -- computed %04X)\n",
+						log_printf(1, "Decoded FM track %d, sector %2d: %u bytes, pos %5.3f-%5.3f, DAM %02X, CRC %04X (bad -- computed %04X)\n",
 							mTrack,
 							mSector,
 							mSectorSize,
@@ -232,9 +243,9 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 				}
 			
 				if (g_dumpBadSectors && crc != recordedCRC) {
-					printf("  Index Clk Data Cells\n");
+					log_printf(1, "  Index Clk Data Cells\n");
 					for(int i=0; i<mSectorSize + 1; ++i) {
-						printf("  %4d  %02X | %02X (%02X,%02X %02X %02X %02X %02X %02X %02X) | %+6.1f%s\n"
+						log_printf(1, "  %4d  %02X | %02X (%02X,%02X %02X %02X %02X %02X %02X %02X) | %+6.1f%s\n"
 							, i - 1
 							, mClockBuf[i]
 							, mBuf[i]
@@ -262,8 +273,9 @@ bool SectorParser::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_
 
 ///////////////////////////////////////////////////////////////////////////
 
-SectorParserMFM::SectorParserMFM()
-	: mReadPhase(0)
+SectorParserMFM::SectorParserMFM(DecoderCounters *counters)
+	: mpCounters(counters)
+	, mReadPhase(0)
 	, mBitPhase(0)
 {
 }
@@ -277,11 +289,16 @@ void SectorParserMFM::Init(int track, int side, const std::vector<uint32_t> *ind
 	mRawStart = streamTime;
 }
 
-bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits) {
+bool SectorParserMFM::Parse(uint32_t stream_time, uint16_t cells) {
+	uint8_t clock_bits;
+	uint8_t data_bits;
+
 	if (mReadPhase < 7) {
 		if (++mBitPhase == 16) {
 			mBitPhase = 0;
 
+			split_cells16(cells, clock_bits, data_bits);
+
 			mBuf[mReadPhase+3] = data_bits;
 			++mReadPhase;
 
@@ -290,7 +307,7 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 					return false;
 
 				if (mBuf[4] != mTrack) {
-					printf("Track number mismatch on track %d.%d: %02X != %02X\n", mTrack, mSide, mBuf[4], mTrack);
+					A8RC_LOG(0, "Track number mismatch on track %d.%d: %02X != %02X\n", mTrack, mSide, mBuf[4], mTrack);
 					return false;
 				}
 
@@ -306,7 +323,8 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 				mComputedAddressCRC = computedCRC;
 
 				if (computedCRC != recordedCRC) {
-					printf("CRC failure on sector header: %04X != %04X\n", computedCRC, recordedCRC);
+					A8RC_LOG(0, "CRC failure on sector header: %04X != %04X\n", computedCRC, recordedCRC);
+					++mpCounters->mAddressCRCErrors;
 					return false;
 				}
 
@@ -318,14 +336,12 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 				auto it_index = std::upper_bound(mpIndexTimes->begin(), mpIndexTimes->end(), (uint32_t)vsn_time + 1);
 
 				if (it_index == mpIndexTimes->begin()) {
-					if (g_verbosity >= 2)
-						printf("Skipping track %d, sector %d before first index mark\n", mTrack, mSector);
+					A8RC_LOG(2, "Skipping track %d, sector %d before first index mark\n", mTrack, mSector);
 					return false;
 				}
 
 				if (it_index == mpIndexTimes->end()) {
-					if (g_verbosity >= 2)
-						printf("Skipping track %d, sector %d after last index mark\n", mTrack, mSector);
+					A8RC_LOG(2, "Skipping track %d, sector %d after last index mark\n", mTrack, mSector);
 					return false;
 				}
 
@@ -339,16 +355,17 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 				if (mRotPos >= 1.0f)
 					mRotPos -= 1.0f;
 
-				if (g_verbosity >= 2)
-					printf("Found track %d, sector %d at position %4.2f\n", mTrack, mSector, mRotPos);
+				A8RC_LOG(2, "Found track %d, sector %d at position %4.2f\n", mTrack, mSector, mRotPos);
 			}
 		}
 	} else if (mReadPhase == 7) {
-//		if (clock_bits == 0x0A && data_bits != 0xA1)
-		if ((clock_bits & 0x7F) == 0x0A && data_bits == 0xA1) {
+		// A1 with missing clock, ignoring the clock cell ahead of it
+		if ((cells & 0x7FFF) == kMFMSyncCells) {
 			++mReadPhase;
 		}
 	} else if (mReadPhase == 8 || mReadPhase == 9) {
+		split_cells16(cells, clock_bits, data_bits);
+
 		if ((clock_bits & 0x7F) == 0x0A) {
 			if (data_bits != 0xA1) {
 				mReadPhase = 7;
@@ -363,6 +380,8 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 		}
 	} else if (mReadPhase == 10) {
 		if (++mBitPhase == 16) {
+			split_cells16(cells, clock_bits, data_bits);
+
 			if (clock_bits == 0x0A && data_bits == 0xA1) {
 				mBitPhase = 0;
 			} else {
@@ -377,6 +396,8 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 		}
 	} else {
 		if (++mBitPhase == 16) {
+			split_cells16(cells, clock_bits, data_bits);
+
 //			printf("Data; %02X\n", ~data_bits);
 			mBuf[mReadPhase - 7] = data_bits;
 
@@ -390,6 +411,10 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 
 				//printf("Read sector %d: CRCs %04X, %04X\n", mSector, crc, recordedCRC);
 
+				++mpCounters->mParsersCompleted;
+				if (crc != recordedCRC)
+					++mpCounters->mDataCRCErrors;
+
 				// add new sector entry
 				auto& tracksecs = mpDstTrack->mSectors;
 				tracksecs.push_back(SectorInfo());
@@ -413,16 +438,15 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 				newsec.mbMFM = true;
 				newsec.mWeakOffset = -1;
 
-				if (g_verbosity >= 1)
-					printf("Decoded MFM track %2d, sector %2d with %u bytes, DAM %02X, recorded CRC %04X (computed %04X) [pos %.3f-%.3f]\n",
-						mTrack,
-						mSector,
-						mSectorSize,
-						mBuf[3],
-						recordedCRC,
-						crc,
-						newsec.mPosition,
-						newsec.mEndingPosition);
+				A8RC_LOG(1, "Decoded MFM track %2d, sector %2d with %u bytes, DAM %02X, recorded CRC %04X (computed %04X) [pos %.3f-%.3f]\n",
+					mTrack,
+					mSector,
+					mSectorSize,
+					mBuf[3],
+					recordedCRC,
+					crc,
+					newsec.mPosition,
+					newsec.mEndingPosition);
 
 				return false;
 			}
@@ -435,26 +459,77 @@ bool SectorParserMFM::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t da
 
 ///////////////////////////////////////////////////////////////////////////
 
-const uint8_t SectorParserMFMAmiga::kSpaceTable[16]={
-	0x00, 0x01, 0x04, 0x05,
-	0x10, 0x11, 0x14, 0x15,
-	0x40, 0x41, 0x44, 0x45,
-	0x50, 0x51, 0x54, 0x55,
-};
-
-void SectorParserMFMAmiga::Init(int cylinder, int head, const std::vector<uint32_t> *indexTimes, float samplesPerCell, TrackInfo *dstTrack, uint32_t streamTime) {
+void TrackDecoderMFMAmiga::Init(int cylinder, int head, const std::vector<uint32_t> *indexTimes, TrackInfo *dstTrack, size_t expectedCells) {
 	mCylinder = cylinder;
 	mHead = head;
 	mpIndexTimes = indexTimes;
-	mSamplesPerCell = samplesPerCell;
 	mpDstTrack = dstTrack;
-	mRawStart = streamTime;
+
+	mCells.reserve(expectedCells / 64 + 1);
+	mCellTimes.reserve(expectedCells);
 }
 
-bool SectorParserMFMAmiga::Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits) {
+void TrackDecoderMFMAmiga::FindSyncMarks(std::vector<uint32_t>& syncCells) {
+	Flush();
+
+	// Find every cell that ends a $4489 word, 64 cells at a time. For each
+	// cell of the sync word, shift the stream by that cell's distance from
+	// the end and check that it has the right value across the board.
+	std::vector<uint32_t> hits;
+	uint64_t prev = 0;
+
+	for(size_t w = 0; w < mCells.size(); ++w) {
+		const uint64_t cur = mCells[w];
+		uint64_t match = ~(uint64_t)0;
+
+		for(int k = 0; k < 16; ++k) {
+			const uint64_t shifted = k ? (cur >> k) + (prev << (64 - k)) : cur;
+
+			match &= (kMFMSyncCells >> k) & 1 ? shifted : ~shifted;
+		}
+
+		for(int i = 0; match; ++i, match += match) {
+			if (match & ((uint64_t)1 << 63)) {
+				const uint32_t cell = (uint32_t)(w * 64 + i);
+
+				if (cell < mCellCount)
+					hits.push_back(cell);
+			}
+		}
+
+		prev = cur;
+	}
+
+	// A sector starts after two sync words in a row. Same as the sync
+	// detector in the decoders, a sync word is not looked for while waiting
+	// for the second one, and the second one doesn't start a new pair.
+	bool pending = false;
+	uint32_t pendingCell = 0;
+
+	for(uint32_t cell : hits) {
+		if (pending) {
+			const uint32_t dist = cell - pendingCell;
+
+			if (dist < 16)
+				continue;
+
+			pending = false;
+
+			if (dist == 16) {
+				syncCells.push_back(cell);
+				continue;
+			}
+		}
+
+		pending = true;
+		pendingCell = cell;
+	}
+}
+
+void TrackDecoderMFMAmiga::DecodeSector(uint32_t syncCell, DecoderCounters& counters) {
 	// What we are looking for:
-	//	sync A1 ($4489) (already parsed for us)
-	//	sync A1 ($4489) (already parsed for us)
+	//	sync A1 ($4489) (already found for us)
+	//	sync A1 ($4489) (already found for us)
 	//	format byte $FF
 	//	track number (0-159)
 	//	sector number (0-10)
@@ -464,152 +539,189 @@ bool SectorParserMFMAmiga::Parse(uint32_t stream_time, uint8_t clock_bits, uint8
 	//	longword - data checksum
 	//	512 bytes of sector data
 	//
-	// There aren't separate address/data frames, so we simply stream in 540 bytes and periodically
-	// peek at it for validity once in a while.
+	// Each field is split into odd bits followed by even bits, which we pull
+	// out of the cell stream a longword at a time.
 
-	if (++mBitPhase < 16)
-		return true;
+	uint32_t longs[135];
+	uint32_t endCell;
 
-	mBitPhase = 0;
-
-	mBuf[mReadPhase] = data_bits;
-	++mReadPhase;
-
-	switch(mReadPhase) {
-		case 4:
-		{
-			const uint32_t addressInfo
-				= kSpaceTable[mBuf[3] & 15]
-				+ (kSpaceTable[mBuf[3] >> 4] << 8)
-				+ (kSpaceTable[mBuf[1] & 15] << 1)
-				+ (kSpaceTable[mBuf[1] >> 4] << 9)
-				+ (kSpaceTable[mBuf[2] & 15] << 16)
-				+ (kSpaceTable[mBuf[2] >> 4] << 24)
-				+ (kSpaceTable[mBuf[0] & 15] << 17)
-				+ (kSpaceTable[mBuf[0] >> 4] << 25);
-
-			uint8_t format = (uint8_t)(addressInfo >> 24);
-			uint8_t track = (uint8_t)(addressInfo >> 16);
-			uint8_t sector = (uint8_t)(addressInfo >> 8);
-
-			if (format != 0xFF || track != mCylinder * 2 + mHead || sector >= 11)
-				return false;
+	if (!GetDataLongs(syncCell, 0, 1, longs, endCell))
+		return;
 
-			mSector = sector;
-			break;
-		}
+	const uint32_t addressInfo = merge_cells32((uint16_t)(longs[0] >> 16), (uint16_t)longs[0]);
 
-		case 24: {
-			// The Amiga checksum is a longword XOR sum on MFM longwords of the data, which
-			// is then encoded into MFM. This is a really odd way to do it because it means
-			// that only even bits are ever set in the checksum, which is then split into
-			// odd/even pairs for MFM encoding... which means that the odd word is always
-			// $0000. Oh well.
-			uint8_t chk0 = 0;
-			uint8_t chk1 = 0;
-
-			for(int i=0; i<22; i += 2) {
-				chk0 ^= mBuf[i];
-				chk1 ^= mBuf[i+1];
-			}
+	uint8_t format = (uint8_t)(addressInfo >> 24);
+	uint8_t track = (uint8_t)(addressInfo >> 16);
+	uint8_t sector = (uint8_t)(addressInfo >> 8);
 
-			uint32_t computedSum = ((uint32_t)chk0 << 8) + ((uint32_t)chk1 << 0);
-			uint32_t receivedSum = ((uint32_t)mBuf[20] << 24) + ((uint32_t)mBuf[21] << 16) + ((uint32_t)mBuf[22] << 8) + mBuf[23];
-			
-			if (computedSum != receivedSum) {
-				printf("Checksum failure on sector header: %08X != %08X\n", computedSum, receivedSum);
-				return false;
-			}
+	if (format != 0xFF || track != mCylinder * 2 + mHead || sector >= 11)
+		return;
 
-			int vsn_time = stream_time;
+	if (!GetDataLongs(syncCell, 1, 5, longs + 1, endCell))
+		return;
 
-			// find the nearest index mark
-			auto it_index = std::upper_bound(mpIndexTimes->begin(), mpIndexTimes->end(), (uint32_t)vsn_time + 1);
+	// The Amiga checksum is a longword XOR sum on MFM longwords of the data, which
+	// is then encoded into MFM. This is a really odd way to do it because it means
+	// that only even bits are ever set in the checksum, which is then split into
+	// odd/even pairs for MFM encoding... which means that the odd word is always
+	// $0000. Oh well.
+	uint32_t headerSum = longs[0] ^ longs[1] ^ longs[2] ^ longs[3] ^ longs[4] ^ (longs[5] & 0xFFFF0000);
 
-			if (it_index == mpIndexTimes->begin()) {
-				if (g_verbosity >= 2)
-					printf("Skipping track %d.%d, sector %d before first index mark\n", mCylinder, mHead, mSector);
-				return false;
-			}
+	uint32_t computedSum = (headerSum ^ (headerSum >> 16)) & 0xFFFF;
+	uint32_t receivedSum = longs[5];
 
-			if (it_index == mpIndexTimes->end()) {
-				if (g_verbosity >= 2)
-					printf("Skipping track %d.%d, sector %d after last index mark\n", mCylinder, mHead, mSector);
-				return false;
-			}
+	if (computedSum != receivedSum) {
+		A8RC_LOG(0, "Checksum failure on sector header: %08X != %08X\n", computedSum, receivedSum);
+		++counters.mAddressCRCErrors;
+		return;
+	}
 
-			int vsn_offset = vsn_time - *--it_index;
+	int vsn_time = mCellTimes[endCell];
 
-			mRotStart = it_index[0];
-			mRotEnd = it_index[1];
+	// find the nearest index mark
+	auto it_index = std::upper_bound(mpIndexTimes->begin(), mpIndexTimes->end(), (uint32_t)vsn_time + 1);
 
-			mRotPos = (float)vsn_offset / (float)(it_index[1] - it_index[0]);
+	if (it_index == mpIndexTimes->begin()) {
+		A8RC_LOG(2, "Skipping track %d.%d, sector %d before first index mark\n", mCylinder, mHead, sector);
+		return;
+	}
 
-			if (mRotPos >= 1.0f)
-				mRotPos -= 1.0f;
+	if (it_index == mpIndexTimes->end()) {
+		A8RC_LOG(2, "Skipping track %d.%d, sector %d after last index mark\n", mCylinder, mHead, sector);
+		return;
+	}
 
-			if (g_verbosity >= 2)
-				printf("Found track %d.%d, sector %d at position %4.2f\n", mCylinder, mHead, mSector, mRotPos);
+	int vsn_offset = vsn_time - *--it_index;
+
+	const uint32_t rotStart = it_index[0];
+	const uint32_t rotEnd = it_index[1];
+
+	float rotPos = (float)vsn_offset / (float)(it_index[1] - it_index[0]);
+
+	if (rotPos >= 1.0f)
+		rotPos -= 1.0f;
+
+	A8RC_LOG(2, "Found track %d.%d, sector %d at position %4.2f\n", mCylinder, mHead, sector, rotPos);
+
+	if (!GetDataLongs(syncCell, 6, 129, longs + 6, endCell))
+		return;
+
+	// recompute data checksum
+	uint32_t dataSum = 0;
+
+	for(int i=7; i<135; ++i)
+		dataSum ^= longs[i];
+
+	computedSum = (dataSum ^ (dataSum >> 16)) & 0xFFFF;
+	uint32_t recordedSum = longs[6];
+
+	++counters.mParsersCompleted;
+	if (computedSum != recordedSum)
+		++counters.mDataCRCErrors;
+
+	// add new sector entry
+	const uint32_t stream_time = mCellTimes[endCell];
+	auto& tracksecs = mpDstTrack->mSectors;
+	tracksecs.emplace_back();
+	SectorInfo& newsec = tracksecs.back();
+
+	for(int i=0; i<64; ++i)
+		write_u64_be(&newsec.mData[i*8], merge_cells64(longs[i + 7], longs[i + 71]));
+
+	newsec.mIndex = sector;
+	newsec.mRawStart = mCellTimes[syncCell];
+	newsec.mRawEnd = stream_time;
+	newsec.mPosition = rotPos;
+	newsec.mEndingPosition = (float)(stream_time - rotStart) / (float)(rotEnd - rotStart);
+	newsec.mEndingPosition -= floorf(newsec.mEndingPosition);
+	newsec.mAddressMark = (uint8_t)longs[0];
+	newsec.mRecordedAddressCRC = 0;
+	newsec.mComputedAddressCRC = 0;
+	newsec.mRecordedCRC = recordedSum;
+	newsec.mComputedCRC = computedSum;
+	newsec.mSectorSize = 512;
+	newsec.mbMFM = true;
+	newsec.mWeakOffset = -1;
+
+	A8RC_LOG(1, "Decoded Amiga track %2d.%d, sector %2d with recorded checksum %08X (computed %08X) [pos %.3f-%.3f]\n",
+		mCylinder,
+		mHead,
+		sector,
+		recordedSum,
+		computedSum,
+		newsec.mPosition,
+		newsec.mEndingPosition);
+}
 
-			break;
-		}
+void TrackDecoderMFMAmiga::Flush() {
+	// pad out the last partial word of cells
+	if (mCells.size() * 64 < mCellCount)
+		mCells.push_back(mCurrentCells << (64 - (mCellCount & 63)));
+}
 
-		case 540: {
-			// recompute data checksum
-			uint8_t chk0 = 0;
-			uint8_t chk1 = 0;
+uint64_t TrackDecoderMFMAmiga::GetCells64(uint32_t endCell) const {
+	const uint32_t w = endCell >> 6;
+	const uint32_t offset = endCell & 63;
+	uint64_t cells = mCells[w] >> (63 - offset);
 
-			for(int i=0; i<512; i += 2) {
-				chk0 ^= mBuf[i+28];
-				chk1 ^= mBuf[i+29];
-			}
+	if (offset < 63 && w > 0)
+		cells += mCells[w - 1] << (offset + 1);
 
-			uint32_t computedSum = ((uint32_t)chk0 << 8) + (uint32_t)chk1;
-			uint32_t recordedSum = ((uint32_t)mBuf[24] << 24) + ((uint32_t)mBuf[25] << 16) + ((uint32_t)mBuf[26] << 8) + mBuf[27];
+	return cells;
+}
+
+bool TrackDecoderMFMAmiga::GetDataLongs(uint32_t syncCell, uint32_t first, uint32_t count, uint32_t *dst, uint32_t& endCell) const {
+	auto itRestart = std::upper_bound(mRestartCells.begin(), mRestartCells.end(), syncCell);
+	const auto itRestartEnd = mRestartCells.end();
+
+	endCell = syncCell + (first + count) * 64;
+
+	if (itRestart == itRestartEnd || *itRestart > endCell) {
+		if (endCell >= mCellCount)
+			return false;
 
-			// add new sector entry
-			auto& tracksecs = mpDstTrack->mSectors;
-			tracksecs.emplace_back();
-			SectorInfo& newsec = tracksecs.back();
+		for(uint32_t i = 0; i < count; ++i)
+			dst[i] = (uint32_t)split_cells64(GetCells64(syncCell + (first + i + 1) * 64));
 
-			for(int i=0; i<256; ++i) {
-				newsec.mData[i*2]
-					=  kSpaceTable[mBuf[i + 284] >> 4]
-					+ (kSpaceTable[mBuf[i +  28] >> 4] << 1);
+		return true;
+	}
+
+	// The PLL restarted somewhere in here, and the restart cell doesn't count
+	// towards the bit phase. Step through the cells one at a time instead.
+	uint32_t cell = syncCell;
+	const auto advance = [&](uint32_t n) {
+		while(n--) {
+			++cell;
 
-				newsec.mData[i*2+1]
-					=  kSpaceTable[mBuf[i + 284] & 15]
-					+ (kSpaceTable[mBuf[i +  28] & 15] << 1);
+			while(itRestart != itRestartEnd && *itRestart == cell) {
+				++cell;
+				++itRestart;
 			}
+		}
 
-			newsec.mIndex = mSector;
-			newsec.mRawStart = mRawStart;
-			newsec.mRawEnd = stream_time;
-			newsec.mPosition = mRotPos;
-			newsec.mEndingPosition = (float)(stream_time - mRotStart) / (float)(mRotEnd - mRotStart);
-			newsec.mEndingPosition -= floorf(newsec.mEndingPosition);
-			newsec.mAddressMark = mBuf[3];
-			newsec.mRecordedAddressCRC = 0;
-			newsec.mComputedAddressCRC = 0;
-			newsec.mRecordedCRC = recordedSum;
-			newsec.mComputedCRC = computedSum;
-			newsec.mSectorSize = 512;
-			newsec.mbMFM = true;
-			newsec.mWeakOffset = -1;
-
-			if (g_verbosity >= 1)
-				printf("Decoded Amiga track %2d.%d, sector %2d with recorded checksum %08X (computed %08X) [pos %.3f-%.3f]\n",
-					mCylinder,
-					mHead,
-					mSector,
-					recordedSum,
-					computedSum,
-					newsec.mPosition,
-					newsec.mEndingPosition);
+		return cell < mCellCount;
+	};
 
-			return false;
+	if (!advance(first * 64))
+		return false;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		uint32_t v = 0;
+
+		for(int j = 0; j < 4; ++j) {
+			if (!advance(16))
+				return false;
+
+			uint8_t clock_bits;
+			uint8_t data_bits;
+			split_cells16((uint16_t)GetCells64(cell), clock_bits, data_bits);
+
+			v = (v << 8) + data_bits;
 		}
+
+		dst[i] = v;
 	}
 
+	endCell = cell;
 	return true;
 }
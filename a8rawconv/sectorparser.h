@@ -1,15 +1,25 @@
 #ifndef f_SECTORPARSER_H
 #define f_SECTORPARSER_H
 
+struct DecoderCounters;
+
 class SectorParser {
 public:
-	SectorParser();
+	explicit SectorParser(DecoderCounters *counters);
 
 	void Init(int track, const std::vector<uint32_t> *indexTimes, float samplesPerCell, TrackInfo *dstTrack, uint32_t streamTime);
 
-	bool Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits);
+	bool Parse(uint32_t stream_time, uint16_t cells);
+
+	// Number of cells up to and including the next one that Parse() needs to
+	// see. While reading whole bytes, the cells before the last one of a byte
+	// only count towards the byte and can be passed over with SkipCells()
+	// instead; while searching for the data mark, every cell is needed.
+	int GetCellsToNextByte() const { return mReadPhase == 6 ? 1 : 16 - mBitPhase; }
+	void SkipCells(int cells) { mBitPhase += cells; }
 
 protected:
+	DecoderCounters *mpCounters;
 	TrackInfo *mpDstTrack;
 	int mTrack;
 	int mSector;
@@ -37,13 +47,19 @@ protected:
 
 class SectorParserMFM {
 public:
-	SectorParserMFM();
+	explicit SectorParserMFM(DecoderCounters *counters);
 
 	void Init(int track, int side, const std::vector<uint32_t> *indexTimes, float samplesPerCell, TrackInfo *dstTrack, uint32_t streamTime);
 
-	bool Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits);
+	bool Parse(uint32_t stream_time, uint16_t cells);
+
+	// See SectorParser. Every cell is needed while looking for the $A1 sync
+	// marks ahead of the data mark.
+	int GetCellsToNextByte() const { return mReadPhase >= 7 && mReadPhase <= 9 ? 1 : 16 - mBitPhase; }
+	void SkipCells(int cells) { mBitPhase += cells; }
 
 protected:
+	DecoderCounters *mpCounters;
 	TrackInfo *mpDstTrack;
 	int mTrack;
 	int mSide;
@@ -64,30 +80,65 @@ protected:
 	const std::vector<uint32_t> *mpIndexTimes;
 };
 
-class SectorParserMFMAmiga {
+// Whole-track decoder for Amiga MFM. Amiga tracks are written in one go with
+// all 11 sectors back to back, so rather than starting a parser at each sync
+// mark and feeding it a cell at a time, the cells for the whole track are
+// collected from the PLL first. The sync marks are then located with a bulk
+// scan and each sector is decoded 64 cells at a time.
+class TrackDecoderMFMAmiga {
 public:
-	void Init(int track, int side, const std::vector<uint32_t> *indexTimes, float samplesPerCell, TrackInfo *dstTrack, uint32_t streamTime);
+	void Init(int cylinder, int head, const std::vector<uint32_t> *indexTimes, TrackInfo *dstTrack, size_t expectedCells);
 
-	bool Parse(uint32_t stream_time, uint8_t clock_bits, uint8_t data_bits);
+	// Add a cell from the PLL, with the raw cell register after it was shifted in.
+	void AddCell(uint32_t stream_time, uint16_t shifter) {
+		// The PLL restarts the register with a 1 cell that isn't passed on
+		// when it runs dry. Put it back so that windows of the cell stream
+		// match the register.
+		if ((uint16_t)((mLastShifter << 1) + (shifter & 1)) != shifter)
+			PushCell(stream_time, 1, true);
+
+		PushCell(stream_time, shifter & 1, false);
+		mLastShifter = shifter;
+	}
+
+	// Find the cells ending each $4489 $4489 sync, using the same rules as
+	// the per-cell sync detection in the FM/MFM decoders.
+	void FindSyncMarks(std::vector<uint32_t>& syncCells);
+
+	// Decode the sector following the sync mark ending at the given cell.
+	void DecodeSector(uint32_t syncCell, DecoderCounters& counters);
+
+private:
+	void PushCell(uint32_t stream_time, uint32_t bit, bool restart) {
+		if (restart)
+			mRestartCells.push_back(mCellCount);
+
+		mCellTimes.push_back(stream_time);
+		mCurrentCells = (mCurrentCells << 1) + bit;
+
+		if (!(++mCellCount & 63)) {
+			mCells.push_back(mCurrentCells);
+			mCurrentCells = 0;
+		}
+	}
+
+	void Flush();
+	uint64_t GetCells64(uint32_t endCell) const;
+	bool GetDataLongs(uint32_t syncCell, uint32_t first, uint32_t count, uint32_t *dst, uint32_t& endCell) const;
 
-protected:
 	TrackInfo *mpDstTrack = nullptr;
 	int mCylinder = 0;
 	int mHead = 0;
-	int mSector = 0;
-	int mReadPhase = 0;
-	int mBitPhase = 0;
-	uint32_t mRawStart = 0;
-	float mRotPos = 0;
-	uint32_t mRotStart = 0;
-	uint32_t mRotEnd = 0;
-	float mSamplesPerCell = 0;
 
-	uint8_t mBuf[540] = {};
+	// Cells are packed oldest first from the MSB of each word.
+	std::vector<uint64_t> mCells;
+	std::vector<uint32_t> mCellTimes;
+	std::vector<uint32_t> mRestartCells;
+	uint64_t mCurrentCells = 0;
+	uint32_t mCellCount = 0;
+	uint16_t mLastShifter = 0;
 
 	const std::vector<uint32_t> *mpIndexTimes = nullptr;
-
-	static const uint8_t kSpaceTable[];
 };
 
 #endif
@@ -0,0 +1,597 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include <new>
+#include "jsonreport.h"
+#include "os.h"
+#include "stats.h"
+
+ConversionStats g_stats;
+
+namespace {
+	// These are plain globals rather than members of g_stats, since operator
+	// new can be called before g_stats is constructed.
+	bool g_countAllocations;
+	std::atomic<uint64_t> g_allocationCount { 0 };
+	std::atomic<uint64_t> g_allocatedBytes { 0 };
+
+	const char *const kStatsStageNames[kStatsStageCount] = {
+		"read",
+		"postcomp",
+		"decode",
+		"splice",
+		"sift",
+		"encode",
+		"write",
+	};
+
+	const char *const kStatsMemoryNames[kStatsMemoryCount] = {
+		"raw_flux",
+		"sectors",
+		"kryoflux_stream",
+		"encoder_streams",
+		"encoder_field_cache",
+	};
+
+	const char *const kStatsMemoryDescriptions[kStatsMemoryCount] = {
+		"raw flux",
+		"decoded sectors",
+		"KryoFlux track stream",
+		"encoder sector streams",
+		"encoder data field cache",
+	};
+
+	// named after the -d modes
+	const char *const kStatsDecoderNames[kStatsDecoderCount] = {
+		"fm",
+		"mfm",
+		"pcmfm",
+		"amiga",
+		"macgcr",
+		"a2gcr",
+	};
+
+	const char *const kStatsPassNames[kStatsPassCount] = {
+		"fm",
+		"mfm",
+		"pcmfm",
+		"amiga",
+		"macgcr",
+		"a2gcr",
+		"fm_pll",
+		"mfm_pll",
+	};
+
+	double get_rate_per_sec(uint64_t count, uint64_t us) {
+		return us ? (double)count * 1000000.0 / (double)us : 0.0;
+	}
+
+	double get_mb(uint64_t bytes) {
+		return (double)bytes / 1048576.0;
+	}
+
+	void WriteCountersJson(JsonWriter& json, const char *name, const DecoderCounters& counters) {
+		json.BeginObject(name, true);
+		json.WriteInt("bits_clocked", counters.mBitsClocked);
+		json.WriteInt("transitions_ignored", counters.mTransitionsIgnored);
+		json.WriteInt("parsers_spawned", counters.mParsersSpawned);
+		json.WriteInt("parsers_completed", counters.mParsersCompleted);
+		json.WriteInt("dam_timeouts", counters.mDAMTimeouts);
+		json.WriteInt("address_crc_errors", counters.mAddressCRCErrors);
+		json.WriteInt("data_crc_errors", counters.mDataCRCErrors);
+
+		json.BeginArray("phase_errors", true);
+		for(uint32_t count : counters.mPhaseErrors)
+			json.WriteInt(nullptr, count);
+		json.EndArray();
+
+		json.EndObject();
+	}
+
+	// Only the passes that ran are written.
+	void WritePassCountersJson(JsonWriter& json, const char *name, const DecoderPassCounters& counters) {
+		json.BeginObject(name);
+
+		for(int i=0; i<kStatsPassCount; ++i) {
+			if (!counters.mPasses[i].IsEmpty())
+				WriteCountersJson(json, kStatsPassNames[i], counters.mPasses[i]);
+		}
+
+		json.EndObject();
+	}
+}
+
+// GCC doesn't know that the replacement operator new below comes from
+// malloc(), and warns about the matching free() calls once they're inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+	if (g_countAllocations) {
+		g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+		g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	for(;;) {
+		if (void *p = malloc(size ? size : 1))
+			return p;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+
+		handler();
+	}
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic pop
+#endif
+
+StatsTimer::StatsTimer() {
+	if (g_stats.IsEnabled()) {
+		mWallStart = get_monotonic_time_us();
+		mCpuStart = get_process_cpu_time_us();
+		mAllocationsStart = g_allocationCount.load(std::memory_order_relaxed);
+		mAllocatedBytesStart = g_allocatedBytes.load(std::memory_order_relaxed);
+	}
+}
+
+StatsTimes StatsTimer::Lap() {
+	StatsTimes times;
+
+	if (g_stats.IsEnabled()) {
+		const uint64_t wall = get_monotonic_time_us();
+		const uint64_t cpu = get_process_cpu_time_us();
+		const uint64_t allocations = g_allocationCount.load(std::memory_order_relaxed);
+		const uint64_t allocatedBytes = g_allocatedBytes.load(std::memory_order_relaxed);
+
+		times.mWallUs = wall - mWallStart;
+		times.mCpuUs = cpu - mCpuStart;
+		times.mAllocations = allocations - mAllocationsStart;
+		times.mAllocatedBytes = allocatedBytes - mAllocatedBytesStart;
+
+		mWallStart = wall;
+		mCpuStart = cpu;
+		mAllocationsStart = allocations;
+		mAllocatedBytesStart = allocatedBytes;
+	}
+
+	return times;
+}
+
+DecoderCounters& DecoderCounters::operator+=(const DecoderCounters& other) {
+	mBitsClocked += other.mBitsClocked;
+	mTransitionsIgnored += other.mTransitionsIgnored;
+
+	for(int i=0; i<kPhaseErrorBins; ++i)
+		mPhaseErrors[i] += other.mPhaseErrors[i];
+
+	mParsersSpawned += other.mParsersSpawned;
+	mParsersCompleted += other.mParsersCompleted;
+	mDAMTimeouts += other.mDAMTimeouts;
+	mAddressCRCErrors += other.mAddressCRCErrors;
+	mDataCRCErrors += other.mDataCRCErrors;
+	return *this;
+}
+
+DecoderPassCounters& DecoderPassCounters::operator+=(const DecoderPassCounters& other) {
+	for(int i=0; i<kStatsPassCount; ++i)
+		mPasses[i] += other.mPasses[i];
+
+	return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void ConversionStats::Enable() {
+	mbEnabled = true;
+	g_countAllocations = true;
+	mTotalTimer = StatsTimer();
+}
+
+void ConversionStats::AddStageTime(StatsStage stage, const StatsTimes& times) {
+	if (!mbEnabled)
+		return;
+
+	StageInfo& info = mStages[stage];
+	info.mTimes += times;
+	info.mPeakRSS = std::max<uint64_t>(info.mPeakRSS, get_peak_rss_bytes());
+	++info.mCount;
+}
+
+void ConversionStats::AddDecoderTime(StatsDecoder decoder, const StatsTimes& times, uint32_t transitions) {
+	if (!mbEnabled)
+		return;
+
+	mDecoders[decoder].mTimes += times;
+	++mDecoders[decoder].mCount;
+	mDecoderTransitions[decoder] += transitions;
+}
+
+void ConversionStats::AddTrack(const TrackStats& trackStats) {
+	if (!mbEnabled)
+		return;
+
+	mTracks.push_back(trackStats);
+	mCounters += trackStats.mCounters;
+}
+
+void ConversionStats::CountSectors(const DiskInfo& disk, int selected_track) {
+	if (!mbEnabled)
+		return;
+
+	mSectors = 0;
+	mGoodSectors = 0;
+
+	for(int i=0; i<disk.mTrackCount; ++i) {
+		if (selected_track >= 0 && selected_track != i)
+			continue;
+
+		for(int side=0; side<disk.mSideCount; ++side) {
+			const TrackInfo& track_info = disk.mPhysTracks[side][i * disk.mTrackStep];
+
+			for(uint32_t idx : track_info.mSiftedSectors) {
+				const SectorInfo& sec = track_info.mSectors[idx];
+
+				++mSectors;
+
+				if (sec.mRecordedCRC == sec.mComputedCRC && sec.mRecordedAddressCRC == sec.mComputedAddressCRC)
+					++mGoodSectors;
+			}
+		}
+	}
+
+	for(TrackStats& trackStats : mTracks) {
+		const TrackInfo& track_info = disk.mPhysTracks[trackStats.mSide][trackStats.mPhysTrack];
+
+		trackStats.mSiftedSectors = 0;
+		trackStats.mGoodSectors = 0;
+
+		for(uint32_t idx : track_info.mSiftedSectors) {
+			const SectorInfo& sec = track_info.mSectors[idx];
+
+			++trackStats.mSiftedSectors;
+
+			if (sec.mRecordedCRC == sec.mComputedCRC && sec.mRecordedAddressCRC == sec.mComputedAddressCRC)
+				++trackStats.mGoodSectors;
+		}
+	}
+}
+
+void ConversionStats::NoteMemory(StatsMemory type, uint64_t bytes) {
+	if (!mbEnabled)
+		return;
+
+	std::atomic<uint64_t>& peak = mMemory[type];
+	uint64_t prev = peak.load(std::memory_order_relaxed);
+
+	while(prev < bytes && !peak.compare_exchange_weak(prev, bytes, std::memory_order_relaxed))
+		;
+}
+
+void ConversionStats::MeasureRawDisk(const RawDisk& disk) {
+	if (!mbEnabled)
+		return;
+
+	uint64_t bytes = 0;
+
+	for(const auto& side : disk.mPhysTracks) {
+		for(const RawTrack& track : side)
+			bytes += (track.mTransitions.capacity() + track.mIndexTimes.capacity()) * sizeof(uint32_t);
+	}
+
+	NoteMemory(kStatsMemory_RawFlux, bytes);
+}
+
+void ConversionStats::MeasureDisk(const DiskInfo& disk) {
+	if (!mbEnabled)
+		return;
+
+	uint64_t bytes = 0;
+
+	for(const auto& side : disk.mPhysTracks) {
+		for(const TrackInfo& track : side) {
+			bytes += track.mSectors.capacity() * sizeof(SectorInfo);
+			bytes += track.mSiftedSectors.capacity() * sizeof(uint32_t);
+			bytes += track.mGCRData.capacity();
+		}
+	}
+
+	NoteMemory(kStatsMemory_Sectors, bytes);
+}
+
+void ConversionStats::Print() const {
+	if (!mbEnabled)
+		return;
+
+	StatsTimer totalTimer = mTotalTimer;
+	const StatsTimes total = totalTimer.Lap();
+
+	// each decoder makes its own pass over the track, so the decode rate is
+	// for tracks rather than decoder passes
+	uint64_t totalTransitions = 0;
+	for(const TrackStats& trackStats : mTracks)
+		totalTransitions += trackStats.mTransitions;
+
+	printf("\n");
+	printf("Stage        Wall (ms)   CPU (ms)   Allocs  Alloc (MB)  Peak RSS (MB)  Throughput\n");
+	printf("--------------------------------------------------------------------------------------------\n");
+
+	const auto printTimes = [](int indent, const char *name, const StatsTimes& times) {
+		printf("%*s%-*s %10.1f %10.1f %8llu %11.2f"
+			, indent, ""
+			, 11 - indent, name
+			, (double)times.mWallUs / 1000.0
+			, (double)times.mCpuUs / 1000.0
+			, (unsigned long long)times.mAllocations
+			, get_mb(times.mAllocatedBytes));
+	};
+
+	for(int i=0; i<kStatsStageCount; ++i) {
+		const StageInfo& stage = mStages[i];
+		if (!stage.mCount)
+			continue;
+
+		printTimes(0, kStatsStageNames[i], stage.mTimes);
+		printf(" %14.2f", get_mb(stage.mPeakRSS));
+
+		switch(i) {
+			case kStatsStage_Read:
+				printf("  %.2f MB/s (%llu bytes)", get_rate_per_sec(mBytesRead, stage.mTimes.mWallUs) / 1000000.0, (unsigned long long)mBytesRead);
+				break;
+
+			case kStatsStage_Decode:
+				printf("  %.2fM transitions/s (%llu transitions)", get_rate_per_sec(totalTransitions, stage.mTimes.mWallUs) / 1000000.0, (unsigned long long)totalTransitions);
+				break;
+
+			case kStatsStage_Sift:
+				printf("  %u sectors, %u good", mSectors, mGoodSectors);
+				break;
+
+			case kStatsStage_Write:
+				printf("  %.2f MB/s (%llu bytes)", get_rate_per_sec(mBytesWritten, stage.mTimes.mWallUs) / 1000000.0, (unsigned long long)mBytesWritten);
+				break;
+		}
+
+		printf("\n");
+
+		if (i == kStatsStage_Decode) {
+			for(int j=0; j<kStatsDecoderCount; ++j) {
+				const StageInfo& decoder = mDecoders[j];
+				if (!decoder.mCount)
+					continue;
+
+				printTimes(2, kStatsDecoderNames[j], decoder.mTimes);
+				printf(" %14s  %.2fM transitions/s\n", "", get_rate_per_sec(mDecoderTransitions[j], decoder.mTimes.mWallUs) / 1000000.0);
+			}
+		}
+	}
+
+	printTimes(0, "total", total);
+	printf(" %14.2f\n", get_mb(get_peak_rss_bytes()));
+
+	bool memoryHeaderPrinted = false;
+
+	for(int i=0; i<kStatsMemoryCount; ++i) {
+		const uint64_t bytes = mMemory[i].load();
+		if (!bytes)
+			continue;
+
+		if (!memoryHeaderPrinted) {
+			memoryHeaderPrinted = true;
+
+			printf("\n");
+			printf("Memory held                Peak (MB)\n");
+			printf("------------------------------------\n");
+		}
+
+		printf("%-26s %9.2f\n", kStatsMemoryDescriptions[i], get_mb(bytes));
+	}
+
+	if (mTracks.empty())
+		return;
+
+	printf("\n");
+	printf("Track Side  Wall (ms)   CPU (ms)   Allocs  Transitions  MTrans/s  Decoded  Sifted  Good\n");
+	printf("----------------------------------------------------------------------------------------\n");
+
+	for(const TrackStats& trackStats : mTracks) {
+		printf("%5d %4d %10.1f %10.1f %8llu %12u %9.2f %8u %7u %5u%s\n"
+			, trackStats.mTrack
+			, trackStats.mSide
+			, (double)trackStats.mTimes.mWallUs / 1000.0
+			, (double)trackStats.mTimes.mCpuUs / 1000.0
+			, (unsigned long long)trackStats.mTimes.mAllocations
+			, trackStats.mTransitions
+			, get_rate_per_sec(trackStats.mTransitions, trackStats.mTimes.mWallUs) / 1000000.0
+			, trackStats.mDecodedSectors
+			, trackStats.mSiftedSectors
+			, trackStats.mGoodSectors
+			, trackStats.mbCached ? "  (cached)" : ""
+		);
+	}
+
+	printf("\n");
+	printf("Track Side  Pass      Bits clocked  Ignored  Spawned  Completed  DAM t/o  Addr CRC  Data CRC\n");
+	printf("--------------------------------------------------------------------------------------------\n");
+
+	// one row for each decoder pass that ran
+	const auto printCounters = [](const char *label, const DecoderPassCounters& passCounters) {
+		for(int i=0; i<kStatsPassCount; ++i) {
+			const DecoderCounters& counters = passCounters.mPasses[i];
+			if (counters.IsEmpty())
+				continue;
+
+			printf("%-10s  %-8s %13llu %8u %8u %10u %8u %9u %9u\n"
+				, label
+				, kStatsPassNames[i]
+				, (unsigned long long)counters.mBitsClocked
+				, counters.mTransitionsIgnored
+				, counters.mParsersSpawned
+				, counters.mParsersCompleted
+				, counters.mDAMTimeouts
+				, counters.mAddressCRCErrors
+				, counters.mDataCRCErrors
+			);
+		}
+	};
+
+	char trackLabel[16];
+
+	for(const TrackStats& trackStats : mTracks) {
+		snprintf(trackLabel, sizeof trackLabel, "%5d %4d", trackStats.mTrack, trackStats.mSide);
+		printCounters(trackLabel, trackStats.mCounters);
+	}
+
+	printCounters("total", mCounters);
+
+	// phase error distribution of each pass, as a percentage of its transitions
+	bool phaseHeaderPrinted = false;
+
+	for(int pass=0; pass<kStatsPassCount; ++pass) {
+		const DecoderCounters& counters = mCounters.mPasses[pass];
+
+		uint64_t phaseErrorTotal = 0;
+		for(uint32_t count : counters.mPhaseErrors)
+			phaseErrorTotal += count;
+
+		if (!phaseErrorTotal)
+			continue;
+
+		if (!phaseHeaderPrinted) {
+			phaseHeaderPrinted = true;
+
+			printf("\n");
+			printf("Phase error (cells)");
+
+			for(int i=0; i<DecoderCounters::kPhaseErrorBins; ++i)
+				printf(" %+3d/12", i - DecoderCounters::kPhaseErrorBins / 2);
+
+			printf("\n");
+		}
+
+		printf("%-8s (%%)       ", kStatsPassNames[pass]);
+
+		for(uint32_t count : counters.mPhaseErrors)
+			printf(" %6.2f", (double)count * 100.0 / (double)phaseErrorTotal);
+
+		printf("\n");
+	}
+}
+
+void ConversionStats::WriteJson(JsonWriter& json) const {
+	if (!mbEnabled)
+		return;
+
+	StatsTimer totalTimer = mTotalTimer;
+	const StatsTimes total = totalTimer.Lap();
+
+	json.BeginObject("stats");
+	json.WriteFloat("wall_ms", (double)total.mWallUs / 1000.0, 3);
+	json.WriteFloat("cpu_ms", (double)total.mCpuUs / 1000.0, 3);
+	json.WriteInt("bytes_read", mBytesRead);
+	json.WriteInt("bytes_written", mBytesWritten);
+	json.WriteInt("sectors", mSectors);
+	json.WriteInt("good_sectors", mGoodSectors);
+	json.WriteInt("allocations", total.mAllocations);
+	json.WriteInt("allocated_bytes", total.mAllocatedBytes);
+	json.WriteInt("peak_rss_bytes", get_peak_rss_bytes());
+
+	json.BeginObject("memory", true);
+	for(int i=0; i<kStatsMemoryCount; ++i)
+		json.WriteInt(kStatsMemoryNames[i], mMemory[i].load());
+	json.EndObject();
+
+	json.BeginArray("stages");
+	for(int i=0; i<kStatsStageCount; ++i) {
+		const StageInfo& stage = mStages[i];
+		if (!stage.mCount)
+			continue;
+
+		json.BeginObject(nullptr, true);
+		json.WriteString("stage", kStatsStageNames[i]);
+		json.WriteFloat("wall_ms", (double)stage.mTimes.mWallUs / 1000.0, 3);
+		json.WriteFloat("cpu_ms", (double)stage.mTimes.mCpuUs / 1000.0, 3);
+		json.WriteInt("allocations", stage.mTimes.mAllocations);
+		json.WriteInt("allocated_bytes", stage.mTimes.mAllocatedBytes);
+		json.WriteInt("peak_rss_bytes", stage.mPeakRSS);
+		json.EndObject();
+	}
+	json.EndArray();
+
+	json.BeginArray("decoders");
+	for(int i=0; i<kStatsDecoderCount; ++i) {
+		const StageInfo& decoder = mDecoders[i];
+		if (!decoder.mCount)
+			continue;
+
+		json.BeginObject(nullptr, true);
+		json.WriteString("decoder", kStatsDecoderNames[i]);
+		json.WriteFloat("wall_ms", (double)decoder.mTimes.mWallUs / 1000.0, 3);
+		json.WriteFloat("cpu_ms", (double)decoder.mTimes.mCpuUs / 1000.0, 3);
+		json.WriteInt("transitions", mDecoderTransitions[i]);
+		json.WriteFloat("transitions_per_sec", get_rate_per_sec(mDecoderTransitions[i], decoder.mTimes.mWallUs), 0);
+		json.EndObject();
+	}
+	json.EndArray();
+
+	WritePassCountersJson(json, "decoder_counters", mCounters);
+
+	json.BeginArray("tracks");
+	for(const TrackStats& trackStats : mTracks) {
+		json.BeginObject(nullptr, true);
+		json.WriteInt("track", trackStats.mTrack);
+		json.WriteInt("side", trackStats.mSide);
+		json.WriteFloat("wall_ms", (double)trackStats.mTimes.mWallUs / 1000.0, 3);
+		json.WriteFloat("cpu_ms", (double)trackStats.mTimes.mCpuUs / 1000.0, 3);
+		json.WriteInt("allocations", trackStats.mTimes.mAllocations);
+		json.WriteInt("transitions", trackStats.mTransitions);
+		json.WriteInt("decoded_sectors", trackStats.mDecodedSectors);
+		json.WriteInt("sifted_sectors", trackStats.mSiftedSectors);
+		json.WriteInt("good_sectors", trackStats.mGoodSectors);
+		json.WriteBool("cached", trackStats.mbCached);
+		WritePassCountersJson(json, "decoder_counters", trackStats.mCounters);
+		json.EndObject();
+	}
+	json.EndArray();
+
+	json.EndObject();
+}
@@ -0,0 +1,194 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_STATS_H
+#define f_STATS_H
+
+#include <atomic>
+
+class JsonWriter;
+
+// Conversion timing, throughput and memory statistics (-stats). Wall time
+// comes from the monotonic clock and CPU time is for the whole process, so it
+// includes any worker threads used by the stage. Allocations are counted by
+// the global operator new while statistics are enabled.
+enum StatsStage : uint8_t {
+	kStatsStage_Read,
+	kStatsStage_PostComp,
+	kStatsStage_Decode,
+	kStatsStage_SpliceFind,
+	kStatsStage_Sift,
+	kStatsStage_Encode,
+	kStatsStage_Write,
+	kStatsStageCount
+};
+
+enum StatsDecoder : uint8_t {
+	kStatsDecoder_FM,
+	kStatsDecoder_AtariMFM,
+	kStatsDecoder_PCMFM,
+	kStatsDecoder_AmigaMFM,
+	kStatsDecoder_MacGCR,
+	kStatsDecoder_A2GCR,
+	kStatsDecoderCount
+};
+
+// Decoder passes over a track that the decoder counters are kept separately
+// for: one for each decoder, plus the alternate PLLs (-pll) that the FM and
+// MFM decoders run over the same flux again.
+enum StatsPass : uint8_t {
+	kStatsPass_FM			= kStatsDecoder_FM,
+	kStatsPass_AtariMFM		= kStatsDecoder_AtariMFM,
+	kStatsPass_PCMFM		= kStatsDecoder_PCMFM,
+	kStatsPass_AmigaMFM		= kStatsDecoder_AmigaMFM,
+	kStatsPass_MacGCR		= kStatsDecoder_MacGCR,
+	kStatsPass_A2GCR		= kStatsDecoder_A2GCR,
+	kStatsPass_FMAltPLLs,
+	kStatsPass_MFMAltPLLs,
+	kStatsPassCount
+};
+
+// Largest amount of memory held by each of the major data structures.
+enum StatsMemory : uint8_t {
+	kStatsMemory_RawFlux,				// RawTrack transitions and index marks
+	kStatsMemory_Sectors,				// TrackInfo sectors and nibble data
+	kStatsMemory_KryoFluxStream,		// KryoFlux stream file for one track
+	kStatsMemory_EncoderStreams,		// encoded sector streams for one track
+	kStatsMemory_EncoderFieldCache,		// data fields shared by the encoder
+	kStatsMemoryCount
+};
+
+struct StatsTimes {
+	uint64_t mWallUs = 0;
+	uint64_t mCpuUs = 0;
+	uint64_t mAllocations = 0;
+	uint64_t mAllocatedBytes = 0;
+
+	StatsTimes& operator+=(const StatsTimes& other) {
+		mWallUs += other.mWallUs;
+		mCpuUs += other.mCpuUs;
+		mAllocations += other.mAllocations;
+		mAllocatedBytes += other.mAllocatedBytes;
+		return *this;
+	}
+};
+
+// Measures the time and allocations since it was started or last lapped. It
+// does nothing if statistics are off.
+class StatsTimer {
+public:
+	StatsTimer();
+
+	StatsTimes Lap();
+
+private:
+	uint64_t mWallStart = 0;
+	uint64_t mCpuStart = 0;
+	uint64_t mAllocationsStart = 0;
+	uint64_t mAllocatedBytesStart = 0;
+};
+
+// Counters kept by the decoders as they run. They are plain counts that are
+// bumped in the PLL and parser loops and only read once the track is done.
+// Phase errors are the offsets of the transitions the PLL clocked in as 1
+// bits, binned in twelfths of a bit cell from -6/12 to +6/12.
+struct DecoderCounters {
+	enum : int { kPhaseErrorBins = 12 };
+
+	uint64_t mBitsClocked = 0;
+	uint32_t mTransitionsIgnored = 0;
+	uint32_t mPhaseErrors[kPhaseErrorBins] {};
+	uint32_t mParsersSpawned = 0;
+	uint32_t mParsersCompleted = 0;
+	uint32_t mDAMTimeouts = 0;
+	uint32_t mAddressCRCErrors = 0;
+	uint32_t mDataCRCErrors = 0;
+
+	DecoderCounters& operator+=(const DecoderCounters& other);
+
+	bool IsEmpty() const { return !mBitsClocked && !mParsersSpawned; }
+};
+
+struct DecoderPassCounters {
+	DecoderCounters mPasses[kStatsPassCount];
+
+	DecoderPassCounters& operator+=(const DecoderPassCounters& other);
+};
+
+struct TrackStats {
+	int mTrack = 0;
+	int mPhysTrack = 0;
+	int mSide = 0;
+	StatsTimes mTimes;
+	uint32_t mTransitions = 0;
+	uint32_t mDecodedSectors = 0;
+	uint32_t mSiftedSectors = 0;
+	uint32_t mGoodSectors = 0;
+	DecoderPassCounters mCounters;
+	bool mbCached = false;
+};
+
+class ConversionStats {
+public:
+	bool IsEnabled() const { return mbEnabled; }
+	void Enable();
+
+	void AddStageTime(StatsStage stage, const StatsTimes& times);
+	void AddDecoderTime(StatsDecoder decoder, const StatsTimes& times, uint32_t transitions);
+	void AddTrack(const TrackStats& trackStats);
+
+	// These may be called from any thread.
+	void AddBytesRead(uint64_t bytes) { mBytesRead += bytes; }
+	void AddBytesWritten(uint64_t bytes) { mBytesWritten += bytes; }
+
+	// Count the sifted sectors on the disk, overall and for each decoded track.
+	void CountSectors(const DiskInfo& disk, int selected_track);
+
+	// Record the memory held by a structure, keeping the largest amount seen.
+	// This may be called from any thread.
+	void NoteMemory(StatsMemory type, uint64_t bytes);
+
+	void MeasureRawDisk(const RawDisk& disk);
+	void MeasureDisk(const DiskInfo& disk);
+
+	void Print() const;
+	void WriteJson(JsonWriter& json) const;
+
+private:
+	struct StageInfo {
+		StatsTimes mTimes;
+		uint64_t mPeakRSS = 0;
+		uint32_t mCount = 0;
+	};
+
+	bool mbEnabled = false;
+	StatsTimer mTotalTimer;
+	StageInfo mStages[kStatsStageCount];
+	StageInfo mDecoders[kStatsDecoderCount];
+	uint64_t mDecoderTransitions[kStatsDecoderCount] {};
+	std::vector<TrackStats> mTracks;
+	DecoderPassCounters mCounters;
+	std::atomic<uint64_t> mBytesRead { 0 };
+	std::atomic<uint64_t> mBytesWritten { 0 };
+	std::atomic<uint64_t> mMemory[kStatsMemoryCount] {};
+	uint32_t mSectors = 0;
+	uint32_t mGoodSectors = 0;
+};
+
+extern ConversionStats g_stats;
+
+#endif
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <set>
 #include <string>
@@ -42,8 +43,11 @@
 #include <algorithm>
 
 #include "binary.h"
+#include "cellsplit.h"
 #include "checksum.h"
 #include "disk.h"
+#include "fluxtransform.h"
+#include "gcr.h"
 #include "diskio.h"
 #include "globals.h"
 #include "reporting.h"
@@ -0,0 +1,207 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include "os.h"
+#include "trackcache.h"
+
+// Bump this whenever the file layout changes or a decoder change would give
+// different results for the same flux and settings.
+static const uint32_t kTrackCacheVersion = 1;
+
+static const char kTrackCacheSignature[4] = { 'A', '8', 'T', 'C' };
+
+namespace {
+	void put_u64(BinaryWriter& writer, uint64_t v) {
+		writer.PutU32((uint32_t)v);
+		writer.PutU32((uint32_t)(v >> 32));
+	}
+
+	void put_float(BinaryWriter& writer, float v) {
+		uint32_t bits;
+		memcpy(&bits, &v, 4);
+		writer.PutU32(bits);
+	}
+
+	uint64_t get_u64(BinaryReader& reader) {
+		const uint32_t lo = reader.GetU32();
+		return lo + ((uint64_t)reader.GetU32() << 32);
+	}
+
+	float get_float(BinaryReader& reader) {
+		const uint32_t bits = reader.GetU32();
+		float v;
+		memcpy(&v, &bits, 4);
+		return v;
+	}
+}
+
+void TrackCache::Init(const char *dir, uint64_t settingsHash) {
+	mDir = dir;
+	mSettingsHash = ComputeHash64(&kTrackCacheVersion, sizeof kTrackCacheVersion, settingsHash);
+	mbStoreFailed = false;
+
+	while(mDir.size() > 1 && (mDir.back() == '/' || mDir.back() == '\\'))
+		mDir.pop_back();
+
+	if (!create_directory(mDir.c_str()))
+		fatalf("Unable to create track cache directory: %s.\n", dir);
+}
+
+uint64_t TrackCache::ComputeKey(const RawTrack& rawTrack) const {
+	const int32_t geometry[2] = { rawTrack.mPhysTrack, rawTrack.mSide };
+
+	uint64_t hash = mSettingsHash;
+	hash = ComputeHash64(geometry, sizeof geometry, hash);
+	hash = ComputeHash64(&rawTrack.mSamplesPerRev, sizeof rawTrack.mSamplesPerRev, hash);
+	hash = ComputeHash64(rawTrack.mIndexTimes.data(), rawTrack.mIndexTimes.size() * sizeof(uint32_t), hash);
+	hash = ComputeHash64(rawTrack.mTransitions.data(), rawTrack.mTransitions.size() * sizeof(uint32_t), hash);
+
+	return hash;
+}
+
+bool TrackCache::Load(uint64_t key, TrackInfo& dstTrack) const {
+	const std::string path = GetPath(key);
+
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	std::vector<uint8_t> buf;
+	bool readOK = !fseek(f, 0, SEEK_END);
+	const long len = readOK ? ftell(f) : -1;
+
+	if (len > 0 && !fseek(f, 0, SEEK_SET)) {
+		buf.resize((size_t)len);
+		readOK = 1 == fread(buf.data(), buf.size(), 1, f);
+	} else
+		readOK = false;
+
+	fclose(f);
+
+	if (!readOK)
+		return false;
+
+	BinaryReader reader(buf.data(), buf.size());
+
+	char signature[4];
+	reader.GetBytes(signature, 4);
+	if (memcmp(signature, kTrackCacheSignature, 4) || reader.GetU32() != kTrackCacheVersion || get_u64(reader) != key)
+		return false;
+
+	TrackInfo track;
+	track.mDecodeLimitsHit = reader.GetU8();
+
+	const uint32_t sectorCount = reader.GetU32();
+	if (!reader.IsValid() || sectorCount > buf.size() / sizeof(SectorInfo::mData))
+		return false;
+
+	track.mSectors.resize(sectorCount);
+
+	for(SectorInfo& sec : track.mSectors) {
+		sec.mRawStart = reader.GetU32();
+		sec.mRawEnd = reader.GetU32();
+		sec.mPosition = get_float(reader);
+		sec.mEndingPosition = get_float(reader);
+		sec.mIndex = (int32_t)reader.GetU32();
+		sec.mWeakOffset = (int32_t)reader.GetU32();
+		sec.mSectorSize = reader.GetU32();
+		sec.mbMFM = reader.GetU8() != 0;
+		sec.mAddressMark = reader.GetU8();
+		sec.mRecordedAddressCRC = reader.GetU16();
+		sec.mComputedAddressCRC = reader.GetU16();
+		sec.mRecordedCRC = reader.GetU32();
+		sec.mComputedCRC = reader.GetU32();
+		reader.GetBytes(sec.mData, sizeof sec.mData);
+	}
+
+	const uint32_t gcrLen = reader.GetU32();
+	if (!reader.IsValid() || gcrLen > buf.size())
+		return false;
+
+	track.mGCRData.resize(gcrLen);
+	reader.GetBytes(track.mGCRData.data(), gcrLen);
+
+	if (!reader.IsValid() || !reader.IsAtEnd())
+		return false;
+
+	dstTrack = std::move(track);
+	return true;
+}
+
+void TrackCache::Store(uint64_t key, const TrackInfo& track) {
+	BinaryWriter writer;
+	writer.Reserve(64 + track.mSectors.size() * (sizeof(SectorInfo) + 16) + track.mGCRData.size());
+
+	writer.PutBytes(kTrackCacheSignature, 4);
+	writer.PutU32(kTrackCacheVersion);
+	put_u64(writer, key);
+	writer.PutU8(track.mDecodeLimitsHit);
+	writer.PutU32((uint32_t)track.mSectors.size());
+
+	for(const SectorInfo& sec : track.mSectors) {
+		writer.PutU32(sec.mRawStart);
+		writer.PutU32(sec.mRawEnd);
+		put_float(writer, sec.mPosition);
+		put_float(writer, sec.mEndingPosition);
+		writer.PutU32((uint32_t)sec.mIndex);
+		writer.PutU32((uint32_t)sec.mWeakOffset);
+		writer.PutU32(sec.mSectorSize);
+		writer.PutU8(sec.mbMFM ? 1 : 0);
+		writer.PutU8(sec.mAddressMark);
+		writer.PutU16(sec.mRecordedAddressCRC);
+		writer.PutU16(sec.mComputedAddressCRC);
+		writer.PutU32(sec.mRecordedCRC);
+		writer.PutU32(sec.mComputedCRC);
+		writer.PutBytes(sec.mData, sizeof sec.mData);
+	}
+
+	writer.PutU32((uint32_t)track.mGCRData.size());
+	writer.PutBytes(track.mGCRData.data(), track.mGCRData.size());
+
+	// Write to a temporary file and rename it into place, so that an
+	// interrupted run never leaves a truncated entry behind.
+	const std::string path = GetPath(key);
+	const std::string tempPath = get_temp_path(path.c_str());
+
+	bool success = false;
+	FILE *f = fopen(tempPath.c_str(), "wb");
+	if (f) {
+		success = 1 == fwrite(writer.GetData(), writer.GetSize(), 1, f);
+
+		if (fclose(f))
+			success = false;
+
+		if (success)
+			success = rename_file_replace(tempPath.c_str(), path.c_str());
+
+		if (!success)
+			remove(tempPath.c_str());
+	}
+
+	if (!success && !mbStoreFailed) {
+		mbStoreFailed = true;
+		printf("WARNING: Unable to write to track cache: %s\n", path.c_str());
+	}
+}
+
+std::string TrackCache::GetPath(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof name, "/%08X%08X.a8tc", (unsigned)(key >> 32), (unsigned)key);
+
+	return mDir + name;
+}
@@ -0,0 +1,51 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_TRACKCACHE_H
+#define f_TRACKCACHE_H
+
+// On-disk cache of decoded tracks (-cache). Each track is stored in its own
+// file, named by a hash of the track's flux and of the decoder settings that
+// produced the sectors, so that re-running a conversion on the same capture
+// can skip decoding tracks that haven't changed.
+class TrackCache {
+public:
+	// Enable the cache, creating the directory if needed. The settings hash
+	// must cover every option that affects the decoded result.
+	void Init(const char *dir, uint64_t settingsHash);
+
+	bool IsEnabled() const { return !mDir.empty(); }
+
+	uint64_t ComputeKey(const RawTrack& rawTrack) const;
+
+	// Load a cached track into dstTrack. Returns false if there is no entry
+	// or it can't be used, in which case dstTrack is left untouched.
+	bool Load(uint64_t key, TrackInfo& dstTrack) const;
+
+	// Store a decoded track. Failures only produce a warning, since the cache
+	// is not needed to complete the conversion.
+	void Store(uint64_t key, const TrackInfo& track);
+
+private:
+	std::string GetPath(uint64_t key) const;
+
+	std::string mDir;
+	uint64_t mSettingsHash = 0;
+	bool mbStoreFailed = false;
+};
+
+#endif
@@ -0,0 +1,550 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "stdafx.h"
+#include "stats.h"
+#include "zip.h"
+
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+	// Deflate base values and extra bit counts for length codes 257-285 and
+	// distance codes 0-29.
+	const uint16_t kInflateLengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+
+	const uint8_t kInflateLengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+
+	const uint16_t kInflateDistBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
+
+	const uint8_t kInflateDistExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+	};
+
+	// Order in which the code length code lengths are stored.
+	const uint8_t kInflateCodeLengthOrder[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+	};
+
+	// Canonical Huffman decoder. Codes of up to kFastBits bits are decoded
+	// with a single table lookup; longer ones are decoded a bit at a time
+	// from the code counts.
+	class InflateHuffman {
+	public:
+		enum : uint32_t { kFastBits = 10, kMaxBits = 15 };
+
+		bool Build(const uint8_t *lengths, uint32_t n);
+
+		// Returns the symbol and its code length, or -1 for an unused code.
+		int Decode(uint32_t bits, uint32_t& len) const {
+			const uint16_t fast = mFast[bits & ((1 << kFastBits) - 1)];
+
+			if (fast) {
+				len = fast & 15;
+				return fast >> 4;
+			}
+
+			return DecodeSlow(bits, len);
+		}
+
+	private:
+		int DecodeSlow(uint32_t bits, uint32_t& len) const;
+
+		uint16_t mFast[1 << kFastBits];
+		uint16_t mCount[kMaxBits + 1];
+		uint16_t mSymbols[288];
+	};
+
+	bool InflateHuffman::Build(const uint8_t *lengths, uint32_t n) {
+		memset(mCount, 0, sizeof mCount);
+		memset(mFast, 0, sizeof mFast);
+
+		for(uint32_t i = 0; i < n; ++i)
+			++mCount[lengths[i]];
+
+		mCount[0] = 0;
+
+		// reject over-subscribed codes; incomplete codes are allowed, as a
+		// single distance code is legal
+		int left = 1;
+		for(uint32_t len = 1; len <= kMaxBits; ++len) {
+			left = (left << 1) - mCount[len];
+			if (left < 0)
+				return false;
+		}
+
+		uint16_t offsets[kMaxBits + 2];
+		offsets[1] = 0;
+		for(uint32_t len = 1; len <= kMaxBits; ++len)
+			offsets[len + 1] = offsets[len] + mCount[len];
+
+		for(uint32_t i = 0; i < n; ++i) {
+			if (lengths[i])
+				mSymbols[offsets[lengths[i]]++] = (uint16_t)i;
+		}
+
+		// fill the fast table; deflate codes are stored starting from the
+		// most significant bit, so the table index is the bit-reversed code
+		uint32_t code = 0;
+		uint32_t index = 0;
+
+		for(uint32_t len = 1; len <= kFastBits; ++len) {
+			for(uint32_t i = 0; i < mCount[len]; ++i) {
+				uint32_t rev = 0;
+				for(uint32_t bit = 0; bit < len; ++bit)
+					rev |= ((code >> bit) & 1) << (len - 1 - bit);
+
+				const uint16_t entry = (uint16_t)((mSymbols[index++] << 4) + len);
+				for(uint32_t j = rev; j < (1U << kFastBits); j += 1U << len)
+					mFast[j] = entry;
+
+				++code;
+			}
+
+			code <<= 1;
+		}
+
+		return true;
+	}
+
+	int InflateHuffman::DecodeSlow(uint32_t bits, uint32_t& len) const {
+		int code = 0;
+		int first = 0;
+		int index = 0;
+
+		for(uint32_t i = 1; i <= kMaxBits; ++i) {
+			code |= bits & 1;
+			bits >>= 1;
+
+			const int count = mCount[i];
+			if (code - count < first) {
+				len = i;
+				return mSymbols[index + (code - first)];
+			}
+
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+
+		return -1;
+	}
+
+	class InflateBitReader {
+	public:
+		InflateBitReader(const uint8_t *src, size_t len) : mpSrc(src), mpSrcEnd(src + len) {
+			Refill();
+		}
+
+		// At least 56 bits are always available after a refill. Reads past
+		// the end of the stream return zero bits and are caught by IsValid().
+		void Refill() {
+			while(mBitCount <= 56) {
+				uint64_t c = 0;
+
+				if (mpSrc != mpSrcEnd)
+					c = *mpSrc++;
+				else
+					++mPadBytes;
+
+				mBits += c << mBitCount;
+				mBitCount += 8;
+			}
+		}
+
+		uint32_t Peek() const { return (uint32_t)mBits; }
+
+		void Consume(uint32_t n) {
+			mBits >>= n;
+			mBitCount -= n;
+		}
+
+		uint32_t Get(uint32_t n) {
+			const uint32_t v = (uint32_t)mBits & ((1U << n) - 1);
+			Consume(n);
+			return v;
+		}
+
+		void AlignToByte() {
+			Consume(mBitCount & 7);
+		}
+
+		bool IsValid() const {
+			return (size_t)mBitCount >= mPadBytes * 8;
+		}
+
+	private:
+		uint64_t mBits = 0;
+		uint32_t mBitCount = 0;
+		size_t mPadBytes = 0;
+		const uint8_t *mpSrc;
+		const uint8_t *const mpSrcEnd;
+	};
+
+	bool inflate_read_dynamic_codes(InflateBitReader& reader, InflateHuffman& litLenCode, InflateHuffman& distCode) {
+		const uint32_t litLenCount = reader.Get(5) + 257;
+		const uint32_t distCount = reader.Get(5) + 1;
+		const uint32_t codeLenCount = reader.Get(4) + 4;
+
+		if (litLenCount > 286 || distCount > 30)
+			return false;
+
+		uint8_t lengths[286 + 30] = {};
+
+		reader.Refill();
+
+		for(uint32_t i = 0; i < codeLenCount; ++i)
+			lengths[kInflateCodeLengthOrder[i]] = (uint8_t)reader.Get(3);
+
+		reader.Refill();
+
+		InflateHuffman codeLenCode;
+		if (!codeLenCode.Build(lengths, 19))
+			return false;
+
+		memset(lengths, 0, 19);
+
+		uint32_t pos = 0;
+		while(pos < litLenCount + distCount) {
+			uint32_t len;
+			const int sym = codeLenCode.Decode(reader.Peek(), len);
+			if (sym < 0)
+				return false;
+
+			reader.Consume(len);
+
+			if (sym < 16)
+				lengths[pos++] = (uint8_t)sym;
+			else {
+				uint8_t value = 0;
+				uint32_t repeat;
+
+				if (sym == 16) {
+					if (!pos)
+						return false;
+
+					value = lengths[pos - 1];
+					repeat = 3 + reader.Get(2);
+				} else if (sym == 17)
+					repeat = 3 + reader.Get(3);
+				else
+					repeat = 11 + reader.Get(7);
+
+				if (pos + repeat > litLenCount + distCount)
+					return false;
+
+				while(repeat--)
+					lengths[pos++] = value;
+			}
+
+			reader.Refill();
+		}
+
+		// the end of block code must be present
+		if (!lengths[256])
+			return false;
+
+		return litLenCode.Build(lengths, litLenCount) && distCode.Build(lengths + litLenCount, distCount);
+	}
+}
+
+bool inflate_data(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen) {
+	InflateBitReader reader(src, srcLen);
+	std::unique_ptr<InflateHuffman> litLenCode(new InflateHuffman);
+	std::unique_ptr<InflateHuffman> distCode(new InflateHuffman);
+	size_t pos = 0;
+
+	for(;;) {
+		if (!reader.IsValid())
+			return false;
+
+		const bool finalBlock = reader.Get(1) != 0;
+		const uint32_t blockType = reader.Get(2);
+
+		if (blockType == 0) {
+			// stored block
+			reader.AlignToByte();
+
+			const uint32_t len = reader.Get(16);
+			const uint32_t invLen = reader.Get(16);
+			if ((len ^ invLen) != 0xFFFF || len > dstLen - pos)
+				return false;
+
+			for(uint32_t i = 0; i < len; ++i) {
+				reader.Refill();
+				dst[pos++] = (uint8_t)reader.Get(8);
+			}
+
+			reader.Refill();
+		} else if (blockType == 3) {
+			return false;
+		} else {
+			if (blockType == 1) {
+				uint8_t lengths[288 + 30];
+
+				memset(lengths, 8, 144);
+				memset(lengths + 144, 9, 112);
+				memset(lengths + 256, 7, 24);
+				memset(lengths + 280, 8, 8);
+				memset(lengths + 288, 5, 30);
+
+				litLenCode->Build(lengths, 288);
+				distCode->Build(lengths + 288, 30);
+			} else {
+				reader.Refill();
+
+				if (!inflate_read_dynamic_codes(reader, *litLenCode, *distCode))
+					return false;
+			}
+
+			for(;;) {
+				reader.Refill();
+
+				uint32_t len;
+				const int sym = litLenCode->Decode(reader.Peek(), len);
+				if (sym < 0)
+					return false;
+
+				reader.Consume(len);
+
+				if (sym < 256) {
+					if (pos >= dstLen)
+						return false;
+
+					dst[pos++] = (uint8_t)sym;
+				} else if (sym == 256) {
+					break;
+				} else {
+					const uint32_t lengthCode = sym - 257;
+					if (lengthCode >= 29)
+						return false;
+
+					const uint32_t matchLen = kInflateLengthBase[lengthCode] + reader.Get(kInflateLengthExtra[lengthCode]);
+
+					const int distSym = distCode->Decode(reader.Peek(), len);
+					if (distSym < 0 || distSym >= 30)
+						return false;
+
+					reader.Consume(len);
+					reader.Refill();
+
+					const uint32_t dist = kInflateDistBase[distSym] + reader.Get(kInflateDistExtra[distSym]);
+
+					if (dist > pos || matchLen > dstLen - pos)
+						return false;
+
+					const uint8_t *matchSrc = dst + pos - dist;
+					uint8_t *matchDst = dst + pos;
+					for(uint32_t i = 0; i < matchLen; ++i)
+						matchDst[i] = matchSrc[i];
+
+					pos += matchLen;
+				}
+			}
+		}
+
+		if (finalBlock)
+			break;
+	}
+
+	return reader.IsValid() && pos == dstLen;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+	const uint32_t kZipLocalHeaderSig = 0x04034b50;
+	const uint32_t kZipCentralDirSig = 0x02014b50;
+	const uint32_t kZipEndOfCentralDirSig = 0x06054b50;
+
+	const uint32_t kZipLocalHeaderSize = 30;
+	const uint32_t kZipCentralDirEntrySize = 46;
+	const uint32_t kZipEndOfCentralDirSize = 22;
+
+	const uint16_t kZipMethod_Stored = 0;
+	const uint16_t kZipMethod_Deflated = 8;
+
+	const uint16_t kZipFlag_Encrypted = 0x0001;
+
+	// Deflate can't expand more than 258 bytes from a 2 bit code, which
+	// bounds the size that a valid entry can decompress to.
+	const uint64_t kZipMaxDeflateRatio = 1032;
+}
+
+ZipArchive::~ZipArchive() {
+	if (mpFile)
+		fclose(mpFile);
+}
+
+void ZipArchive::Open(const char *path) {
+	mPath = path;
+	mpFile = fopen(path, "rb");
+	if (!mpFile)
+		fatalf("Unable to open input archive: %s.\n", path);
+
+	// The end of central directory record is at the end of the file,
+	// followed by a comment of up to 64K.
+	if (fseek(mpFile, 0, SEEK_END))
+		fatalf("Unable to read archive: %s.\n", path);
+
+	const long fileLen = ftell(mpFile);
+	if (fileLen < (long)kZipEndOfCentralDirSize)
+		fatalf("Not a zip archive: %s.\n", path);
+
+	mFileSize = (uint64_t)fileLen;
+
+	const uint32_t tailLen = (uint32_t)std::min<long>(fileLen, kZipEndOfCentralDirSize + 0xFFFF);
+	std::vector<uint8_t> tail(tailLen);
+
+	if (fseek(mpFile, fileLen - (long)tailLen, SEEK_SET) || 1 != fread(tail.data(), tailLen, 1, mpFile))
+		fatalf("Unable to read archive: %s.\n", path);
+
+	const uint8_t *eocd = nullptr;
+	for(uint32_t offset = tailLen - kZipEndOfCentralDirSize + 1; offset; --offset) {
+		if (read_u32(&tail[offset - 1]) == kZipEndOfCentralDirSig) {
+			eocd = &tail[offset - 1];
+			break;
+		}
+	}
+
+	if (!eocd)
+		fatalf("Not a zip archive: %s.\n", path);
+
+	BinaryReader eocdReader(eocd + 4, kZipEndOfCentralDirSize - 4);
+	const uint16_t diskNumber = eocdReader.GetU16();
+	const uint16_t dirDiskNumber = eocdReader.GetU16();
+	const uint16_t diskEntryCount = eocdReader.GetU16();
+	const uint16_t entryCount = eocdReader.GetU16();
+	const uint32_t dirSize = eocdReader.GetU32();
+	const uint32_t dirOffset = eocdReader.GetU32();
+
+	if (diskNumber || dirDiskNumber || diskEntryCount != entryCount)
+		fatalf("Multi-part zip archives are not supported: %s.\n", path);
+
+	if (entryCount == 0xFFFF || dirSize == 0xFFFFFFFF || dirOffset == 0xFFFFFFFF)
+		fatalf("Zip64 archives are not supported: %s.\n", path);
+
+	if ((uint64_t)dirOffset + dirSize > (uint64_t)fileLen)
+		fatalf("Zip archive has an invalid central directory: %s.\n", path);
+
+	std::vector<uint8_t> dir(dirSize);
+	if (fseek(mpFile, dirOffset, SEEK_SET) || (dirSize && 1 != fread(dir.data(), dirSize, 1, mpFile)))
+		fatalf("Unable to read archive: %s.\n", path);
+
+	BinaryReader dirReader(dir.data(), dir.size());
+	mEntries.resize(entryCount);
+
+	for(Entry& entry : mEntries) {
+		const uint32_t sig = dirReader.GetU32();
+		dirReader.GetSpan(4);		// version made by, version needed
+		entry.mFlags = dirReader.GetU16();
+		entry.mMethod = dirReader.GetU16();
+		dirReader.GetSpan(4);		// modification time and date
+		entry.mCRC32 = dirReader.GetU32();
+		entry.mCompressedSize = dirReader.GetU32();
+		entry.mUncompressedSize = dirReader.GetU32();
+		const uint16_t nameLen = dirReader.GetU16();
+		const uint16_t extraLen = dirReader.GetU16();
+		const uint16_t commentLen = dirReader.GetU16();
+		dirReader.GetSpan(8);		// disk number, attributes
+		entry.mLocalHeaderOffset = dirReader.GetU32();
+
+		const uint8_t *name = dirReader.GetSpan(nameLen);
+		dirReader.GetSpan(extraLen + commentLen);
+
+		if (!dirReader.IsValid() || sig != kZipCentralDirSig)
+			fatalf("Zip archive has an invalid central directory: %s.\n", path);
+
+		entry.mName.assign((const char *)name, nameLen);
+
+		// check the sizes against the archive now, so that nothing is
+		// allocated for them from a corrupted directory
+		if ((uint64_t)entry.mLocalHeaderOffset + kZipLocalHeaderSize + entry.mCompressedSize > mFileSize
+			|| entry.mUncompressedSize > (uint64_t)entry.mCompressedSize * kZipMaxDeflateRatio)
+			fatalf("Zip entry has invalid size: %s.\n", entry.mName.c_str());
+	}
+}
+
+int ZipArchive::FindEntry(const char *name) const {
+	for(size_t i = 0; i < mEntries.size(); ++i) {
+		if (mEntries[i].mName == name)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+void ZipArchive::ReadEntry(size_t index, std::vector<uint8_t>& dst) {
+	const Entry& entry = mEntries[index];
+	const char *name = entry.mName.c_str();
+
+	if (entry.mFlags & kZipFlag_Encrypted)
+		fatalf("Encrypted zip entries are not supported: %s.\n", name);
+
+	if (entry.mMethod != kZipMethod_Stored && entry.mMethod != kZipMethod_Deflated)
+		fatalf("Zip entry uses unsupported compression method %u: %s.\n", entry.mMethod, name);
+
+	if (entry.mMethod == kZipMethod_Stored && entry.mCompressedSize != entry.mUncompressedSize)
+		fatalf("Zip entry has invalid size: %s.\n", name);
+
+	// The local header has its own copy of the name and extra field, which
+	// can differ in length from the central directory.
+	uint8_t localHeader[kZipLocalHeaderSize];
+	if (fseek(mpFile, entry.mLocalHeaderOffset, SEEK_SET) || 1 != fread(localHeader, sizeof localHeader, 1, mpFile))
+		fatalf("Unable to read zip entry: %s.\n", name);
+
+	if (read_u32(localHeader) != kZipLocalHeaderSig)
+		fatalf("Zip entry has an invalid local header: %s.\n", name);
+
+	const uint32_t skipLen = (uint32_t)localHeader[26] + ((uint32_t)localHeader[27] << 8)
+		+ (uint32_t)localHeader[28] + ((uint32_t)localHeader[29] << 8);
+
+	if ((uint64_t)entry.mLocalHeaderOffset + kZipLocalHeaderSize + skipLen + entry.mCompressedSize > mFileSize)
+		fatalf("Zip entry has invalid size: %s.\n", name);
+
+	if (fseek(mpFile, skipLen, SEEK_CUR))
+		fatalf("Unable to read zip entry: %s.\n", name);
+
+	dst.resize(entry.mUncompressedSize);
+
+	if (entry.mMethod == kZipMethod_Stored) {
+		if (entry.mUncompressedSize && 1 != fread(dst.data(), entry.mUncompressedSize, 1, mpFile))
+			fatalf("Unable to read zip entry: %s.\n", name);
+	} else {
+		std::vector<uint8_t> src(entry.mCompressedSize);
+
+		if (entry.mCompressedSize && 1 != fread(src.data(), entry.mCompressedSize, 1, mpFile))
+			fatalf("Unable to read zip entry: %s.\n", name);
+
+		if (!inflate_data(src.data(), src.size(), dst.data(), dst.size()))
+			fatalf("Zip entry has corrupted compressed data: %s.\n", name);
+	}
+
+	g_stats.AddBytesRead(entry.mCompressedSize);
+
+	if (ComputeCRC32(dst.data(), dst.size()) != entry.mCRC32)
+		fatalf("Zip entry failed CRC check: %s.\n", name);
+}
@@ -0,0 +1,70 @@
+// a8rawconv - A8 raw disk conversion utility
+// Copyright (C) 2014-2020 Avery Lee
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef f_ZIP_H
+#define f_ZIP_H
+
+// Read-only access to .zip archives, for reading image sets directly from
+// an archive. Only stored and deflated entries are supported, and Zip64
+// and encrypted archives are rejected.
+class ZipArchive {
+public:
+	ZipArchive() = default;
+	~ZipArchive();
+
+	ZipArchive(const ZipArchive&) = delete;
+	ZipArchive& operator=(const ZipArchive&) = delete;
+
+	// Open an archive and read its central directory. Failures are fatal.
+	void Open(const char *path);
+
+	const char *GetPath() const { return mPath.c_str(); }
+
+	size_t GetEntryCount() const { return mEntries.size(); }
+	const std::string& GetEntryName(size_t index) const { return mEntries[index].mName; }
+	uint32_t GetEntrySize(size_t index) const { return mEntries[index].mUncompressedSize; }
+
+	// Returns the index of the entry with the given name, or -1 if there is none.
+	int FindEntry(const char *name) const;
+
+	// Extract an entry into dst, which is resized to fit. The entry is
+	// decompressed directly into dst and its CRC checked. Failures are fatal.
+	void ReadEntry(size_t index, std::vector<uint8_t>& dst);
+
+private:
+	struct Entry {
+		std::string mName;
+		uint32_t mCRC32;
+		uint32_t mCompressedSize;
+		uint32_t mUncompressedSize;
+		uint32_t mLocalHeaderOffset;
+		uint16_t mMethod;
+		uint16_t mFlags;
+	};
+
+	FILE *mpFile = nullptr;
+	std::string mPath;
+	uint64_t mFileSize = 0;
+	std::vector<Entry> mEntries;
+};
+
+// Decompress a raw deflate stream (RFC 1951) into a buffer of known size.
+// Returns false if the stream is invalid or does not decompress to exactly
+// dstLen bytes.
+bool inflate_data(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen);
+
+#endif